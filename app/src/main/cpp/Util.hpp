@@ -1,61 +1,13 @@
 #pragma once
 
-#include <android/log.h>
 #include <camera/NdkCameraError.h>
 #include <camera/NdkCameraManager.h>
 
 #include <source_location>
-#include <string_view>
 
-namespace camera::util {
-
-constexpr auto TAG = "VkWatCam";
-
-inline void logI(const char* text) {
-    __android_log_write(ANDROID_LOG_INFO, TAG, text);
-}
-
-template <typename... Args>
-inline void logI(Args&&... args) {
-    __android_log_print(ANDROID_LOG_INFO, TAG, args...);
-}
-
-inline void logW(const char* text) {
-    __android_log_write(ANDROID_LOG_WARN, TAG, text);
-}
+#include "logger.hpp"
 
-template <typename... Args>
-inline void logW(Args&&... args) {
-    __android_log_print(ANDROID_LOG_WARN, TAG, args...);
-}
-
-inline void logE(const char* text) {
-    __android_log_write(ANDROID_LOG_ERROR, TAG, text);
-}
-
-template <typename... Args>
-inline void logE(Args&&... args) {
-    __android_log_print(ANDROID_LOG_ERROR, TAG, args...);
-}
-
-template <typename T>
-inline void logAssert(
-    T&& assertion,
-    const std::string_view msg = {},
-    std::source_location location = std::source_location::current()
-) {
-    if (!assertion) {
-        __android_log_assert(
-            nullptr,
-            camera::util::TAG,
-            "%s::%s(%i): *** assertion failed: %s",
-            location.file_name(),
-            location.function_name(),
-            location.line(),
-            msg.data()
-        );
-    }
-}
+namespace camera::util {
 
 void callCamera(
     camera_status_t status,
@@ -0,0 +1,310 @@
+#include "audio_encoder.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+
+#include "util.hpp"
+
+using namespace camera::util;
+
+namespace camera {
+
+namespace {
+
+// MediaCodecInfo.CodecProfileLevel.AACObjectLC
+constexpr int32_t AAC_PROFILE_LC = 2;
+
+int64_t monotonicNowUs() {
+    return std::chrono::steady_clock::now().time_since_epoch() /
+           std::chrono::microseconds(1);
+}
+
+}  // namespace
+
+AudioEncoder::~AudioEncoder() { stop(); }
+
+bool AudioEncoder::open(
+    const AudioEncoderConfig& config,
+    PacketCallback onPacket,
+    FormatCallback onFormat
+) {
+    if (codec_) return false;
+    config_ = config;
+    onPacket_ = std::move(onPacket);
+    onFormat_ = std::move(onFormat);
+
+    AAudioStreamBuilder* builder;
+    aaudio_result_t result = AAudio_createStreamBuilder(&builder);
+    if (result != AAUDIO_OK) {
+        logE("Can't create the stream builder: %d", result);
+        return false;
+    }
+    AAudioStreamBuilder_setDirection(builder, AAUDIO_DIRECTION_INPUT);
+    AAudioStreamBuilder_setSampleRate(builder, config.sampleRate);
+    AAudioStreamBuilder_setChannelCount(builder, config.channelCount);
+    AAudioStreamBuilder_setFormat(builder, AAUDIO_FORMAT_PCM_I16);
+    AAudioStreamBuilder_setDataCallback(builder, onAudio, this);
+    result = AAudioStreamBuilder_openStream(builder, &stream_);
+    AAudioStreamBuilder_delete(builder);
+    if (result != AAUDIO_OK) {
+        logW(
+            "Can't open the microphone: %s",
+            AAudio_convertResultToText(result)
+        );
+        stream_ = nullptr;
+        return false;
+    }
+    // The device may not honour the requested format
+    config_.sampleRate = AAudioStream_getSampleRate(stream_);
+    config_.channelCount = AAudioStream_getChannelCount(stream_);
+
+    // A second of audio covers any stall of the encoder thread
+    ringFrames_ = std::bit_ceil(static_cast<uint32_t>(config_.sampleRate));
+    ring_ = std::make_unique<int16_t[]>(ringFrames_ * config_.channelCount);
+    writeFrame_ = 0;
+    readFrame_ = 0;
+    droppedFrames_ = 0;
+    firstFrameTimeUs_ = 0;
+    stopDeadlineUs_ = 0;
+
+    codec_ = AMediaCodec_createEncoderByType(config.mime);
+    if (!codec_) {
+        logE("No encoder for %s", config.mime);
+        release();
+        return false;
+    }
+    AMediaFormat* format = AMediaFormat_new();
+    AMediaFormat_setString(format, AMEDIAFORMAT_KEY_MIME, config.mime);
+    AMediaFormat_setInt32(
+        format, AMEDIAFORMAT_KEY_SAMPLE_RATE, config_.sampleRate
+    );
+    AMediaFormat_setInt32(
+        format, AMEDIAFORMAT_KEY_CHANNEL_COUNT, config_.channelCount
+    );
+    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_BIT_RATE, config.bitrate);
+    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_AAC_PROFILE, AAC_PROFILE_LC);
+    AMediaFormat_setInt32(
+        format,
+        AMEDIAFORMAT_KEY_MAX_INPUT_SIZE,
+        FRAMES_PER_BUFFER * config_.channelCount * sizeof(int16_t)
+    );
+    media_status_t status = AMediaCodec_configure(
+        codec_, format, nullptr, nullptr, AMEDIACODEC_CONFIGURE_FLAG_ENCODE
+    );
+    AMediaFormat_delete(format);
+    if (status != AMEDIA_OK) {
+        logE("Failed to configure the audio encoder: %d", status);
+        release();
+        return false;
+    }
+    status = AMediaCodec_start(codec_);
+    if (status != AMEDIA_OK) {
+        logE("Failed to start the audio encoder: %d", status);
+        release();
+        return false;
+    }
+
+    // Waits for samples until the capture starts
+    encodeThread_ = std::thread(&AudioEncoder::encode, this);
+    logI(
+        "Audio encoder opened %d Hz, %d ch, %d bps",
+        config_.sampleRate,
+        config_.channelCount,
+        config.bitrate
+    );
+    return true;
+}
+
+bool AudioEncoder::startCapture() {
+    if (!stream_) return false;
+    aaudio_result_t result = AAudioStream_requestStart(stream_);
+    if (result != AAUDIO_OK) {
+        logE(
+            "Can't start the microphone: %s",
+            AAudio_convertResultToText(result)
+        );
+        stop();
+        return false;
+    }
+    return true;
+}
+
+void AudioEncoder::stop() {
+    if (!codec_) return;
+    if (stream_) AAudioStream_requestStop(stream_);
+    // The encode thread queues what is left with the end of stream flag
+    stopDeadlineUs_ = monotonicNowUs() + STOP_TIMEOUT_US;
+    if (encodeThread_.joinable()) encodeThread_.join();
+    AMediaCodec_stop(codec_);
+    release();
+    logI("Audio encoder stopped");
+}
+
+void AudioEncoder::release() {
+    if (stream_) {
+        AAudioStream_close(stream_);
+        stream_ = nullptr;
+    }
+    if (codec_) {
+        AMediaCodec_delete(codec_);
+        codec_ = nullptr;
+    }
+    ring_.reset();
+}
+
+aaudio_data_callback_result_t AudioEncoder::onAudio(
+    AAudioStream*,
+    void* userData,
+    void* audioData,
+    int32_t numFrames
+) {
+    // Realtime thread: no locks, no allocations, no logging
+    auto* self = static_cast<AudioEncoder*>(userData);
+    uint32_t channels = self->config_.channelCount;
+    uint64_t write = self->writeFrame_.load(std::memory_order_relaxed);
+    uint64_t read = self->readFrame_.load(std::memory_order_acquire);
+    if (write == 0 && self->firstFrameTimeUs_.load() == 0) {
+        int64_t durationUs =
+            int64_t(numFrames) * 1'000'000 / self->config_.sampleRate;
+        self->firstFrameTimeUs_ = monotonicNowUs() - durationUs;
+    }
+
+    uint32_t frames = std::min<uint64_t>(
+        numFrames,
+        self->ringFrames_ - (write - read)
+    );
+    auto* samples = static_cast<const int16_t*>(audioData);
+    uint32_t start = write & (self->ringFrames_ - 1);
+    uint32_t first = std::min(frames, self->ringFrames_ - start);
+    memcpy(
+        self->ring_.get() + start * channels,
+        samples,
+        first * channels * sizeof(int16_t)
+    );
+    memcpy(
+        self->ring_.get(),
+        samples + first * channels,
+        (frames - first) * channels * sizeof(int16_t)
+    );
+    if (frames < static_cast<uint32_t>(numFrames)) {
+        self->droppedFrames_.fetch_add(numFrames - frames);
+    }
+    self->writeFrame_.store(write + frames, std::memory_order_release);
+    return AAUDIO_CALLBACK_RESULT_CONTINUE;
+}
+
+int64_t AudioEncoder::getBaseTimeUs() {
+    // Capture time of frame 0, the stream timestamp is the most accurate
+    int64_t framePosition;
+    int64_t timeNs;
+    aaudio_result_t result = AAudioStream_getTimestamp(
+        stream_, CLOCK_MONOTONIC, &framePosition, &timeNs
+    );
+    if (result == AAUDIO_OK) {
+        return timeNs / 1000 - framePosition * 1'000'000 / config_.sampleRate;
+    }
+    return firstFrameTimeUs_;
+}
+
+bool AudioEncoder::feed(
+    int64_t baseTimeUs,
+    uint64_t& framesQueued,
+    bool endOfStream
+) {
+    ssize_t index = AMediaCodec_dequeueInputBuffer(codec_, 0);
+    if (index < 0) return false;
+
+    size_t capacity;
+    uint8_t* buffer = AMediaCodec_getInputBuffer(codec_, index, &capacity);
+    uint32_t channels = config_.channelCount;
+    uint32_t frameBytes = channels * sizeof(int16_t);
+    uint64_t read = readFrame_.load(std::memory_order_relaxed);
+    uint64_t available = writeFrame_.load(std::memory_order_acquire) - read;
+    uint32_t frames = std::min<uint64_t>(
+        {available, FRAMES_PER_BUFFER, capacity / frameBytes}
+    );
+
+    uint32_t start = read & (ringFrames_ - 1);
+    uint32_t first = std::min(frames, ringFrames_ - start);
+    memcpy(buffer, ring_.get() + start * channels, first * frameBytes);
+    memcpy(
+        buffer + first * frameBytes,
+        ring_.get(),
+        (frames - first) * frameBytes
+    );
+    readFrame_.store(read + frames, std::memory_order_release);
+
+    uint64_t position = framesQueued + droppedFrames_.load();
+    int64_t timeUs = baseTimeUs + position * 1'000'000 / config_.sampleRate;
+    framesQueued += frames;
+    bool last = endOfStream && frames == available;
+    AMediaCodec_queueInputBuffer(
+        codec_,
+        index,
+        0,
+        frames * frameBytes,
+        timeUs,
+        last ? AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM : 0
+    );
+    return last;
+}
+
+void AudioEncoder::encode() {
+    int64_t baseTimeUs = INT64_MIN;
+    uint64_t framesQueued = 0;
+    bool endQueued = false;
+    for (;;) {
+        bool stopping = stopDeadlineUs_.load() != 0;
+        uint64_t available = writeFrame_.load(std::memory_order_acquire) -
+                             readFrame_.load(std::memory_order_relaxed);
+        if (!endQueued && (available >= FRAMES_PER_BUFFER || stopping)) {
+            // Stopped before capturing anything only the end of stream
+            // is queued
+            if (baseTimeUs == INT64_MIN) {
+                baseTimeUs = available > 0 ? getBaseTimeUs() : monotonicNowUs();
+            }
+            endQueued = feed(baseTimeUs, framesQueued, stopping);
+        }
+
+        // Only wait for output when there is no input to catch up on
+        int64_t timeoutUs =
+            available >= 2 * FRAMES_PER_BUFFER ? 0 : DEQUEUE_TIMEOUT_US;
+        AMediaCodecBufferInfo info;
+        ssize_t index =
+            AMediaCodec_dequeueOutputBuffer(codec_, &info, timeoutUs);
+        if (index == AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED) {
+            AMediaFormat* format = AMediaCodec_getOutputFormat(codec_);
+            logI("Audio output format %s", AMediaFormat_toString(format));
+            if (onFormat_) onFormat_(format);
+            AMediaFormat_delete(format);
+            continue;
+        }
+        if (index < 0) {
+            int64_t deadline = stopDeadlineUs_.load();
+            if (deadline && monotonicNowUs() > deadline) {
+                logW("Audio encoder didn't reach the end of stream in time");
+                return;
+            }
+            continue;
+        }
+
+        size_t capacity;
+        uint8_t* data = AMediaCodec_getOutputBuffer(codec_, index, &capacity);
+        bool endOfStream = info.flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM;
+        if (data && info.size > 0 && onPacket_) {
+            onPacket_({
+                .data = data + info.offset,
+                .size = static_cast<size_t>(info.size),
+                .presentationTimeUs = info.presentationTimeUs,
+                .flags = info.flags
+            });
+        }
+        AMediaCodec_releaseOutputBuffer(codec_, index, false);
+        if (endOfStream) return;
+    }
+}
+
+}  // namespace camera
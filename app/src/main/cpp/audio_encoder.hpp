@@ -0,0 +1,98 @@
+#pragma once
+
+#include <aaudio/AAudio.h>
+#include <media/NdkMediaCodec.h>
+#include <media/NdkMediaFormat.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+
+#include "video_encoder.hpp"
+
+namespace camera {
+
+struct AudioEncoderConfig {
+    const char* mime = "audio/mp4a-latm";
+    int32_t sampleRate = 48000;
+    int32_t channelCount = 1;
+    int32_t bitrate = 128'000;
+};
+
+/**
+ * Microphone to AAC. AAudio delivers PCM on its realtime callback, which
+ * only copies it into a lock-free ring; a separate thread feeds the ring to
+ * the codec and delivers the encoded packets. Timestamps are on
+ * CLOCK_MONOTONIC like the video frames.
+ */
+class AudioEncoder {
+  public:
+    // Packet data is only valid during the call
+    using PacketCallback = std::function<void(const EncodedPacket&)>;
+    // Called once with the output format, before the first packet
+    using FormatCallback = std::function<void(AMediaFormat*)>;
+
+    AudioEncoder() = default;
+    ~AudioEncoder();
+
+    AudioEncoder(const AudioEncoder&) = delete;
+    AudioEncoder& operator=(const AudioEncoder&) = delete;
+
+    /**
+     * Open the microphone stream and the codec without capturing yet. False
+     * if either can't be opened.
+     */
+    bool open(
+        const AudioEncoderConfig& config,
+        PacketCallback onPacket,
+        FormatCallback onFormat = {}
+    );
+    /** Start capturing, the microphone is in use from here on. */
+    bool startCapture();
+    /** Stop capturing and wait until the captured audio is encoded. */
+    void stop();
+
+    [[nodiscard]] bool isRunning() const { return codec_ != nullptr; }
+
+  private:
+    // An AAC frame
+    static constexpr int32_t FRAMES_PER_BUFFER = 1024;
+    static constexpr int64_t DEQUEUE_TIMEOUT_US = 10'000;
+    static constexpr int64_t STOP_TIMEOUT_US = 1'000'000;
+
+    AudioEncoderConfig config_;
+    AAudioStream* stream_ = nullptr;
+    AMediaCodec* codec_ = nullptr;
+    PacketCallback onPacket_;
+    FormatCallback onFormat_;
+    std::thread encodeThread_;
+
+    // Single producer single consumer ring of interleaved samples, indices
+    // count frames and only grow
+    std::unique_ptr<int16_t[]> ring_;
+    uint32_t ringFrames_ = 0;
+    std::atomic<uint64_t> writeFrame_ = 0;
+    std::atomic<uint64_t> readFrame_ = 0;
+    // Frames lost to a full ring, they still advance the timestamps
+    std::atomic<uint64_t> droppedFrames_ = 0;
+    // Estimated capture time of the first frame, from the first callback
+    std::atomic<int64_t> firstFrameTimeUs_ = 0;
+    // Set by stop(), 0 while running
+    std::atomic<int64_t> stopDeadlineUs_ = 0;
+
+    static aaudio_data_callback_result_t onAudio(
+        AAudioStream* stream,
+        void* userData,
+        void* audioData,
+        int32_t numFrames
+    );
+
+    void encode();
+    bool feed(int64_t baseTimeUs, uint64_t& framesQueued, bool endOfStream);
+    int64_t getBaseTimeUs();
+    void release();
+};
+
+}  // namespace camera
@@ -4,6 +4,8 @@
 #include <camera/NdkCameraManager.h>
 #include <unistd.h>
 
+#include <ctime>
+
 #include "util.hpp"
 
 using namespace camera::util;
@@ -62,21 +64,21 @@ void CameraManager::onCameraStatusChanged(const char* id, bool available) {
 }
 
 void onSessionClosed(void* ctx, ACameraCaptureSession* ses) {
-    logW("session %p closed", ses);
+    logAsyncI("session %p closed", ses);
     reinterpret_cast<CameraManager*>(ctx)->onSessionState(
         ses, CaptureSessionState::CLOSED
     );
 }
 
 void onSessionReady(void* ctx, ACameraCaptureSession* ses) {
-    logW("session %p ready", ses);
+    logAsyncI("session %p ready", ses);
     reinterpret_cast<CameraManager*>(ctx)->onSessionState(
         ses, CaptureSessionState::READY
     );
 }
 
 void onSessionActive(void* ctx, ACameraCaptureSession* ses) {
-    logW("session %p active", ses);
+    logAsyncI("session %p active", ses);
     reinterpret_cast<CameraManager*>(ctx)->onSessionState(
         ses, CaptureSessionState::ACTIVE
     );
@@ -86,7 +88,7 @@ void CameraManager::onSessionState(
     ACameraCaptureSession* ses, CaptureSessionState state
 ) {
     if (!ses || ses != captureSession_) {
-        logW("CaptureSession is %s", (ses ? "NOT our session" : "NULL"));
+        logAsyncW("CaptureSession is %s", ses ? "NOT our session" : "NULL");
         return;
     }
 
@@ -95,7 +97,70 @@ void CameraManager::onSessionState(
     captureSessionState_ = state;
 }
 
-CameraManager::CameraManager(ANativeWindow* previewWindow)
+void onCaptureCompleted(
+    void* ctx,
+    ACameraCaptureSession*,
+    ACaptureRequest*,
+    const ACameraMetadata* result
+) {
+    reinterpret_cast<CameraManager*>(ctx)->onCaptureCompleted(result);
+}
+
+void onStillCaptureCompleted(
+    void* ctx,
+    ACameraCaptureSession*,
+    ACaptureRequest*,
+    const ACameraMetadata* result
+) {
+    reinterpret_cast<CameraManager*>(ctx)->onStillCaptureCompleted(result);
+}
+
+namespace {
+
+bool readFrameMetadata(const ACameraMetadata* result, FrameMetadata& metadata) {
+    ACameraMetadata_const_entry entry = {};
+    if (ACameraMetadata_getConstEntry(
+            result, ACAMERA_SENSOR_TIMESTAMP, &entry
+        ) != ACAMERA_OK) {
+        return false;
+    }
+    metadata.timestampNs = entry.data.i64[0];
+    if (ACameraMetadata_getConstEntry(
+            result, ACAMERA_SENSOR_EXPOSURE_TIME, &entry
+        ) == ACAMERA_OK) {
+        metadata.exposureNs = entry.data.i64[0];
+    }
+    if (ACameraMetadata_getConstEntry(
+            result, ACAMERA_SENSOR_SENSITIVITY, &entry
+        ) == ACAMERA_OK) {
+        metadata.iso = entry.data.i32[0];
+    }
+    return true;
+}
+
+}  // namespace
+
+void CameraManager::onCaptureCompleted(const ACameraMetadata* result) {
+    FrameMetadata metadata;
+    if (!readFrameMetadata(result, metadata)) return;
+
+    std::lock_guard lock(captureResultsMutex_);
+    metadata.frameNumber = ++captureCount_;
+    captureResults_[captureCount_ % CAPTURE_RESULT_HISTORY] = metadata;
+}
+
+void CameraManager::onStillCaptureCompleted(const ACameraMetadata* result) {
+    FrameMetadata metadata;
+    if (!readFrameMetadata(result, metadata)) return;
+
+    // Numbered like the preview frame before it, the preview numbers
+    // stay consecutive
+    std::lock_guard lock(captureResultsMutex_);
+    metadata.frameNumber = captureCount_;
+    stillResult_ = metadata;
+}
+
+CameraManager::CameraManager()
     : cameraMgr_(nullptr),
       activeCameraId_(""),
       cameraFacing_(ACAMERA_LENS_FACING_BACK),
@@ -103,7 +168,7 @@ CameraManager::CameraManager(ANativeWindow* previewWindow)
       outputContainer_(nullptr),
       captureSessionState_(CaptureSessionState::MAX_STATE) {
     valid_ = false;
-    requests_.resize(/*CAPTURE_REQUEST_COUNT*/ 1);
+    requests_.resize(CAPTURE_REQUEST_COUNT);
     memset(requests_.data(), 0, requests_.size() * sizeof(requests_[0]));
     cameras_.clear();
     cameraMgr_ = ACameraManager_create();
@@ -113,6 +178,19 @@ CameraManager::CameraManager(ANativeWindow* previewWindow)
     enumerateCameras();
     logAssert(activeCameraId_.size(), "unknown ActiveCameraIdx");
 
+    ACameraMetadata* metadataObj;
+    callCamera(ACameraManager_getCameraCharacteristics(
+        cameraMgr_, activeCameraId_.c_str(), &metadataObj
+    ));
+    ACameraMetadata_const_entry timestampSource = {};
+    if (ACameraMetadata_getConstEntry(
+            metadataObj, ACAMERA_SENSOR_INFO_TIMESTAMP_SOURCE, &timestampSource
+        ) == ACAMERA_OK) {
+        realtimeTimestamps_ = timestampSource.data.u8[0] ==
+                              ACAMERA_SENSOR_INFO_TIMESTAMP_SOURCE_REALTIME;
+    }
+    ACameraMetadata_free(metadataObj);
+
     // Create back facing camera device
     static ACameraDevice_StateCallbacks cameraDeviceListener = {
         .context = this,
@@ -136,9 +214,19 @@ CameraManager::CameraManager(ANativeWindow* previewWindow)
         cameraMgr_, cameraMgrListener
     ));
 
-    valid_ = true;
+    // Exposure of every capture for the frame overlay
+    static ACameraCaptureSession_captureCallbacks captureCallbacks{
+        .context = this,
+        .onCaptureCompleted = ::camera::onCaptureCompleted,
+    };
+    captureListener_ = &captureCallbacks;
+    static ACameraCaptureSession_captureCallbacks stillCaptureCallbacks{
+        .context = this,
+        .onCaptureCompleted = ::camera::onStillCaptureCompleted,
+    };
+    stillCaptureListener_ = &stillCaptureCallbacks;
 
-    createSession(previewWindow);
+    valid_ = true;
 }
 
 CameraManager::~CameraManager() {
@@ -150,6 +238,7 @@ CameraManager::~CameraManager() {
     ACameraCaptureSession_close(captureSession_);
 
     for (auto& req : requests_) {
+        if (!req.outputNativeWindow_) continue;
         callCamera(ACaptureRequest_removeTarget(req.request_, req.target_));
         ACaptureRequest_free(req.request_);
         ACameraOutputTarget_free(req.target_);
@@ -226,14 +315,19 @@ void CameraManager::enumerateCameras() {
     ACameraManager_deleteCameraIdList(cameraIds);
 }
 
-void CameraManager::createSession(ANativeWindow* previewWindow) {
+void CameraManager::createSession(
+    ANativeWindow* previewWindow, ANativeWindow* stillWindow
+) {
     // Create output from this app's ANativeWindow, and add into output
     // container
     requests_[PREVIEW_REQUEST_IDX].outputNativeWindow_ = previewWindow;
     requests_[PREVIEW_REQUEST_IDX].template_ = TEMPLATE_RECORD;
+    requests_[JPG_CAPTURE_REQUEST_IDX].outputNativeWindow_ = stillWindow;
+    requests_[JPG_CAPTURE_REQUEST_IDX].template_ = TEMPLATE_STILL_CAPTURE;
 
     callCamera(ACaptureSessionOutputContainer_create(&outputContainer_));
     for (auto& req : requests_) {
+        if (!req.outputNativeWindow_) continue;
         ANativeWindow_acquire(req.outputNativeWindow_);
         callCamera(ACaptureSessionOutput_create(
             req.outputNativeWindow_, &req.sessionOutput_
@@ -274,6 +368,38 @@ void CameraManager::createSession(ANativeWindow* previewWindow) {
     ));
 }
 
+bool CameraManager::getMaxOutputSize(
+    int32_t format, int32_t* width, int32_t* height
+) {
+    ACameraMetadata* metadataObj;
+    callCamera(ACameraManager_getCameraCharacteristics(
+        cameraMgr_, activeCameraId_.c_str(), &metadataObj
+    ));
+
+    ACameraMetadata_const_entry entry = {};
+    callCamera(ACameraMetadata_getConstEntry(
+        metadataObj, ACAMERA_SCALER_AVAILABLE_STREAM_CONFIGURATIONS, &entry
+    ));
+
+    // format, width, height, input
+    int64_t maxArea = 0;
+    for (uint32_t i = 0; i + 3 < entry.count; i += 4) {
+        if (entry.data.i32[i] != format) continue;
+        if (entry.data.i32[i + 3]) continue;
+
+        int32_t w = entry.data.i32[i + 1];
+        int32_t h = entry.data.i32[i + 2];
+        if (static_cast<int64_t>(w) * h > maxArea) {
+            maxArea = static_cast<int64_t>(w) * h;
+            *width = w;
+            *height = h;
+        }
+    }
+    ACameraMetadata_free(metadataObj);
+
+    return maxArea > 0;
+}
+
 bool CameraManager::getSensorOrientation(int32_t* facing, int32_t* angle) {
     if (!cameraMgr_) {
         return false;
@@ -307,7 +433,7 @@ void CameraManager::startPreview(bool start) {
     if (start) {
         callCamera(ACameraCaptureSession_setRepeatingRequest(
             captureSession_,
-            nullptr,
+            captureListener_,
             1,
             &requests_[PREVIEW_REQUEST_IDX].request_,
             nullptr
@@ -319,4 +445,116 @@ void CameraManager::startPreview(bool start) {
     }
 }
 
+bool CameraManager::takePicture() {
+    CaptureRequestInfo& still = requests_[JPG_CAPTURE_REQUEST_IDX];
+    if (!still.request_ ||
+        captureSessionState_ != CaptureSessionState::ACTIVE) {
+        logW("Can't take a picture, capture session is not active");
+        return false;
+    }
+
+    // A single capture is queued alongside the repeating preview request,
+    // the preview keeps streaming while the still frame is produced
+    camera_status_t status = ACameraCaptureSession_capture(
+        captureSession_,
+        stillCaptureListener_,
+        1,
+        &still.request_,
+        &still.sessionSequenceId_
+    );
+    if (status != ACAMERA_OK) {
+        logE("Still capture failed: %s", getErrorStr(status));
+        return false;
+    }
+    return true;
+}
+
+int64_t CameraManager::toMonotonicNs(int64_t timestampNs) const {
+    if (!realtimeTimestamps_) return timestampNs;
+    // CLOCK_BOOTTIME runs ahead by the time spent in suspend
+    timespec boot, monotonic;
+    clock_gettime(CLOCK_BOOTTIME, &boot);
+    clock_gettime(CLOCK_MONOTONIC, &monotonic);
+    int64_t offsetNs = (boot.tv_sec - monotonic.tv_sec) * 1'000'000'000LL +
+                       (boot.tv_nsec - monotonic.tv_nsec);
+    return timestampNs - offsetNs;
+}
+
+FrameMetadata CameraManager::getFrameMetadata(int64_t timestampNs) {
+    FrameMetadata metadata{.timestampNs = toMonotonicNs(timestampNs)};
+    std::lock_guard lock(captureResultsMutex_);
+    if (stillResult_.timestampNs == timestampNs) {
+        metadata.frameNumber = stillResult_.frameNumber;
+        metadata.exposureNs = stillResult_.exposureNs;
+        metadata.iso = stillResult_.iso;
+        return metadata;
+    }
+    if (captureCount_ == 0) return metadata;
+
+    const FrameMetadata* result =
+        &captureResults_[captureCount_ % CAPTURE_RESULT_HISTORY];
+    metadata.frameNumber = result->frameNumber + 1;
+    for (const FrameMetadata& candidate : captureResults_) {
+        if (candidate.frameNumber != 0 &&
+            candidate.timestampNs == timestampNs) {
+            result = &candidate;
+            metadata.frameNumber = candidate.frameNumber;
+            break;
+        }
+    }
+    metadata.exposureNs = result->exposureNs;
+    metadata.iso = result->iso;
+    return metadata;
+}
+
+bool CameraManager::setFrameRate(int32_t maxFps) {
+    ACaptureRequest* request = requests_[PREVIEW_REQUEST_IDX].request_;
+    if (!request) return false;
+
+    ACameraMetadata* metadataObj;
+    callCamera(ACameraManager_getCameraCharacteristics(
+        cameraMgr_, activeCameraId_.c_str(), &metadataObj
+    ));
+    ACameraMetadata_const_entry entry = {};
+    camera_status_t status = ACameraMetadata_getConstEntry(
+        metadataObj, ACAMERA_CONTROL_AE_AVAILABLE_TARGET_FPS_RANGES, &entry
+    );
+
+    // Highest max, then highest min for a steadier rate
+    int32_t range[2] = {0, 0};
+    for (uint32_t i = 0; status == ACAMERA_OK && i + 1 < entry.count; i += 2) {
+        int32_t min = entry.data.i32[i];
+        int32_t max = entry.data.i32[i + 1];
+        if (max > maxFps) continue;
+        if (max > range[1] || (max == range[1] && min > range[0])) {
+            range[0] = min;
+            range[1] = max;
+        }
+    }
+    ACameraMetadata_free(metadataObj);
+
+    if (range[1] == 0) {
+        logW("No AE target fps range up to %d", maxFps);
+        return false;
+    }
+    if (range[1] == frameRate_) return true;
+
+    callCamera(ACaptureRequest_setEntry_i32(
+        request, ACAMERA_CONTROL_AE_TARGET_FPS_RANGE, 2, range
+    ));
+    frameRate_ = range[1];
+    logI("Preview fps range [%d, %d]", range[0], range[1]);
+
+    // The repeating request only picks up the change when it's set again
+    if (captureSessionState_ != CaptureSessionState::ACTIVE) return true;
+    status = ACameraCaptureSession_setRepeatingRequest(
+        captureSession_, captureListener_, 1, &request, nullptr
+    );
+    if (status != ACAMERA_OK) {
+        logE("Can't update the preview request: %s", getErrorStr(status));
+        return false;
+    }
+    return true;
+}
+
 }  // namespace camera
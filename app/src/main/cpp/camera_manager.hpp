@@ -5,10 +5,15 @@
 #include <camera/NdkCameraManager.h>
 #include <camera/NdkCameraMetadataTags.h>
 
+#include <array>
+#include <atomic>
 #include <map>
+#include <mutex>
 #include <string>
 #include <vector>
 
+#include "frame_overlay.hpp"
+
 namespace camera {
 
 enum class CaptureSessionState : int32_t {
@@ -53,14 +58,47 @@ struct CameraId {
 
 class CameraManager {
   public:
-    CameraManager(ANativeWindow* previewWindow);
+    CameraManager();
     ~CameraManager();
 
+    /**
+     * Create the capture session with a repeating preview output and an
+     * on-demand still output. The still window may be null.
+     */
+    void createSession(
+        ANativeWindow* previewWindow, ANativeWindow* stillWindow
+    );
+
+    /**
+     * Find the largest output stream size of the active camera for the given
+     * AIMAGE_FORMAT_* format.
+     */
+    bool getMaxOutputSize(int32_t format, int32_t* width, int32_t* height);
+
     void onCameraStatusChanged(const char* id, bool available);
     void onDisconnected(ACameraDevice* dev);
     void onError(ACameraDevice* dev, int err);
     void onSessionState(ACameraCaptureSession* ses, CaptureSessionState state);
+    void onCaptureCompleted(const ACameraMetadata* result);
+    void onStillCaptureCompleted(const ACameraMetadata* result);
     void startPreview(bool start);
+    bool takePicture();
+
+    /**
+     * Limit the preview frame rate to the supported AE target range with
+     * the highest frame rate up to maxFps, applied to the running preview.
+     */
+    bool setFrameRate(int32_t maxFps);
+
+    /** Convert an AImage timestamp to CLOCK_MONOTONIC, like the audio. */
+    [[nodiscard]] int64_t toMonotonicNs(int64_t timestampNs) const;
+
+    /**
+     * Metadata of the frame with the given AImage timestamp, its timestamp
+     * converted to CLOCK_MONOTONIC. The result of the frame may not have
+     * arrived yet, then it's taken to follow the latest one.
+     */
+    FrameMetadata getFrameMetadata(int64_t timestampNs);
 
   private:
     ACameraManager* cameraMgr_;
@@ -73,14 +111,30 @@ class CameraManager {
 
     ACaptureSessionOutputContainer* outputContainer_;
     ACameraCaptureSession* captureSession_;
-    CaptureSessionState captureSessionState_;
+    // Written on the camera callback thread
+    std::atomic<CaptureSessionState> captureSessionState_;
 
     ACameraManager_AvailabilityCallbacks* cameraMgrListener;
+    // Results of the repeating preview request, they number the frames
+    ACameraCaptureSession_captureCallbacks* captureListener_ = nullptr;
+    ACameraCaptureSession_captureCallbacks* stillCaptureListener_ = nullptr;
 
     volatile bool valid_;
+    // Upper bound of the AE target range, 0 until set
+    int32_t frameRate_ = 0;
+    // Sensor timestamps in CLOCK_BOOTTIME rather than CLOCK_MONOTONIC
+    bool realtimeTimestamps_ = false;
+
+    // Latest capture results with the sensor timestamps, written on the
+    // camera callback thread
+    static constexpr size_t CAPTURE_RESULT_HISTORY = 16;
+    std::mutex captureResultsMutex_;
+    std::array<FrameMetadata, CAPTURE_RESULT_HISTORY> captureResults_{};
+    uint64_t captureCount_ = 0;
+    // Result of the latest still capture, kept apart from the preview
+    FrameMetadata stillResult_{};
 
     void enumerateCameras();
-    void createSession(ANativeWindow* previewWindow);
     bool getSensorOrientation(int32_t* facing, int32_t* angle);
 };
 
@@ -0,0 +1,62 @@
+#include "content_hash.hpp"
+
+#include <array>
+#include <cstring>
+
+namespace camera {
+
+namespace {
+
+constexpr uint64_t PRIME_1 = 0x9e3779b185ebca87ull;
+constexpr uint64_t PRIME_2 = 0xc2b2ae3d27d4eb4full;
+
+uint64_t rotl(uint64_t x, int bits) {
+    return (x << bits) | (x >> (64 - bits));
+}
+
+uint64_t mix(uint64_t lane, uint64_t word) {
+    return rotl(lane + word * PRIME_2, 31) * PRIME_1;
+}
+
+uint64_t load(const uint8_t* bytes) {
+    uint64_t word;
+    memcpy(&word, bytes, sizeof(word));
+    return word;
+}
+
+}  // namespace
+
+uint64_t hashImage(
+    const uint8_t* data,
+    size_t rowBytes,
+    uint32_t height,
+    size_t rowStride
+) {
+    std::array<uint64_t, 4> lanes{PRIME_1, PRIME_2, ~PRIME_1, ~PRIME_2};
+    for (uint32_t y = 0; y < height; ++y) {
+        const uint8_t* row = data + y * rowStride;
+        size_t x = 0;
+        for (; x + 32 <= rowBytes; x += 32) {
+            for (size_t lane = 0; lane < lanes.size(); ++lane) {
+                lanes[lane] = mix(lanes[lane], load(row + x + lane * 8));
+            }
+        }
+        // The tail of the row, padded with zeros, then the row is ended so
+        // bytes moving between rows change the hash
+        std::array<uint8_t, 32> tail{};
+        memcpy(tail.data(), row + x, rowBytes - x);
+        for (size_t lane = 0; lane < lanes.size(); ++lane) {
+            lanes[lane] = mix(lanes[lane], load(tail.data() + lane * 8));
+        }
+        lanes[0] = mix(lanes[0], y);
+    }
+
+    uint64_t hash = rotl(lanes[0], 1) + rotl(lanes[1], 7) +
+                    rotl(lanes[2], 12) + rotl(lanes[3], 18);
+    hash ^= hash >> 33;
+    hash *= PRIME_2;
+    hash ^= hash >> 29;
+    return hash;
+}
+
+}  // namespace camera
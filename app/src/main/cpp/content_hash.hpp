@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace camera {
+
+/**
+ * Fast 64 bit checksum of the pixels of an image or an area of it, for
+ * telling whether it changed since the previous frame. Every byte of the
+ * visible rows is mixed in, on four independent lanes so it runs at memory
+ * bandwidth, while the padding at the end of the rows is left out. Not a
+ * cryptographic hash, only for content from a trusted producer.
+ */
+uint64_t hashImage(
+    const uint8_t* data,
+    size_t rowBytes,
+    uint32_t height,
+    size_t rowStride
+);
+
+}  // namespace camera
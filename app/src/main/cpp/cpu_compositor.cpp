@@ -0,0 +1,433 @@
+#include "cpu_compositor.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace camera {
+
+namespace {
+
+// x / 255 rounded to nearest, exact for x <= 255 * 255
+inline uint8_t div255(uint32_t x) {
+    x += 128;
+    return static_cast<uint8_t>((x + (x >> 8)) >> 8);
+}
+
+// dst = (premul + dst * invAlpha) / 255 over n contiguous samples
+void blendSpan(
+    uint8_t* dst,
+    const uint16_t* premul,
+    const uint8_t* invAlpha,
+    int32_t n
+) {
+    int32_t i = 0;
+#if defined(__ARM_NEON)
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t d = vld1q_u8(dst + i);
+        uint8x16_t ia = vld1q_u8(invAlpha + i);
+        uint16x8_t lo = vmlal_u8(
+            vld1q_u16(premul + i), vget_low_u8(d), vget_low_u8(ia)
+        );
+        uint16x8_t hi = vmlal_u8(
+            vld1q_u16(premul + i + 8), vget_high_u8(d), vget_high_u8(ia)
+        );
+        lo = vaddq_u16(lo, vdupq_n_u16(128));
+        hi = vaddq_u16(hi, vdupq_n_u16(128));
+        uint8x16_t out = vcombine_u8(
+            vshrn_n_u16(vsraq_n_u16(lo, lo, 8), 8),
+            vshrn_n_u16(vsraq_n_u16(hi, hi, 8), 8)
+        );
+        vst1q_u8(dst + i, out);
+    }
+#elif defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i half = _mm_set1_epi16(128);
+    for (; i + 16 <= n; i += 16) {
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        __m128i ia =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(invAlpha + i));
+        __m128i pLo =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(premul + i));
+        __m128i pHi =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(premul + i + 8));
+        // Products stay below 2^16, so 16 bit multiplies are enough
+        __m128i lo = _mm_add_epi16(
+            pLo,
+            _mm_mullo_epi16(
+                _mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(ia, zero)
+            )
+        );
+        __m128i hi = _mm_add_epi16(
+            pHi,
+            _mm_mullo_epi16(
+                _mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(ia, zero)
+            )
+        );
+        lo = _mm_add_epi16(lo, half);
+        hi = _mm_add_epi16(hi, half);
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+        _mm_storeu_si128(
+            reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo, hi)
+        );
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = div255(premul[i] + dst[i] * invAlpha[i]);
+    }
+}
+
+// Calls fn(begin, end) for every run of visible tiles in a row of the mask
+template <typename Fn>
+void forEachSpan(
+    const uint8_t* mask,
+    int32_t tilesX,
+    int32_t tileWidth,
+    int32_t width,
+    Fn&& fn
+) {
+    for (int32_t tx = 0; tx < tilesX;) {
+        if (!mask[tx]) {
+            ++tx;
+            continue;
+        }
+        int32_t first = tx;
+        while (tx < tilesX && mask[tx]) ++tx;
+        fn(first * tileWidth, std::min(tx * tileWidth, width));
+    }
+}
+
+struct YuvFromRgb {
+    float kr;
+    float kg;
+    float kb;
+    float yScale;
+    float yOffset;
+    float cScale;
+
+    YuvFromRgb(YuvMatrix matrix, YuvRange range) {
+        kr = matrix == YuvMatrix::BT709 ? 0.2126f : 0.299f;
+        kb = matrix == YuvMatrix::BT709 ? 0.0722f : 0.114f;
+        kg = 1.0f - kr - kb;
+        bool full = range == YuvRange::FULL;
+        yScale = full ? 1.0f : 219.0f / 255.0f;
+        yOffset = full ? 0.0f : 16.0f;
+        cScale = full ? 1.0f : 224.0f / 255.0f;
+    }
+
+    void convert(const float* rgb, float* yuv) const {
+        float luma = kr * rgb[0] + kg * rgb[1] + kb * rgb[2];
+        yuv[0] = yOffset + luma * yScale;
+        yuv[1] = 128.0f + (rgb[2] - luma) / (2.0f * (1.0f - kb)) * cScale;
+        yuv[2] = 128.0f + (rgb[0] - luma) / (2.0f * (1.0f - kr)) * cScale;
+    }
+};
+
+}  // namespace
+
+CpuCompositor::CpuCompositor(ThreadPool& pool) : pool_(pool) {}
+
+const char* CpuCompositor::getKernelName() {
+#if defined(__ARM_NEON)
+    return "neon";
+#elif defined(__SSE2__)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+void CpuCompositor::setWatermark(
+    const uint8_t* rgba,
+    int32_t width,
+    int32_t height,
+    int32_t rowStride,
+    bool premultiplied,
+    int32_t frameWidth,
+    int32_t frameHeight,
+    int32_t rotation,
+    YuvMatrix matrix,
+    YuvRange range
+) {
+    width_ = frameWidth;
+    height_ = frameHeight;
+    int32_t chromaWidth = (frameWidth + 1) / 2;
+    int32_t chromaHeight = (frameHeight + 1) / 2;
+    lumaPremul_.assign(size_t(frameWidth) * frameHeight, 0);
+    lumaInvAlpha_.assign(size_t(frameWidth) * frameHeight, 255);
+    uPremul_.assign(size_t(chromaWidth) * chromaHeight, 0);
+    vPremul_.assign(size_t(chromaWidth) * chromaHeight, 0);
+    chromaInvAlpha_.assign(size_t(chromaWidth) * chromaHeight, 255);
+    chromaLayout_ = ChromaLayout::NONE;
+    tilesX_ = (frameWidth + TILE_SIZE - 1) / TILE_SIZE;
+    int32_t tilesY = (frameHeight + TILE_SIZE - 1) / TILE_SIZE;
+    tileMask_.assign(size_t(tilesX_) * tilesY, 0);
+
+    bool swapped = rotation == 90 || rotation == 270;
+    // Size of the frame in watermark pixels before rotation
+    float scaleX = float(width) / float(swapped ? frameHeight : frameWidth);
+    float scaleY = float(height) / float(swapped ? frameWidth : frameHeight);
+    // Nearest watermark pixel for a frame pixel
+    auto sample = [&](int32_t fx, int32_t fy) {
+        int32_t sx = swapped ? fy : fx;
+        int32_t sy = swapped ? fx : fy;
+        int32_t wx = std::min(int32_t((sx + 0.5f) * scaleX), width - 1);
+        int32_t wy = std::min(int32_t((sy + 0.5f) * scaleY), height - 1);
+        if (rotation == 90) {
+            wy = height - 1 - wy;
+        } else if (rotation == 180) {
+            wx = width - 1 - wx;
+            wy = height - 1 - wy;
+        } else if (rotation == 270) {
+            wx = width - 1 - wx;
+        }
+        return rgba + size_t(wy) * rowStride + size_t(wx) * 4;
+    };
+
+    const YuvFromRgb toYuv(matrix, range);
+    pool_.parallelFor(0, chromaHeight, ROW_GRAIN, [&](int32_t b, int32_t e) {
+        for (int32_t cy = b; cy < e; ++cy) {
+            for (int32_t cx = 0; cx < chromaWidth; ++cx) {
+                float alphaSum = 0.0f;
+                float uSum = 0.0f;
+                float vSum = 0.0f;
+                for (int32_t dy = 0; dy < 2; ++dy) {
+                    int32_t fy = std::min(cy * 2 + dy, frameHeight - 1);
+                    for (int32_t dx = 0; dx < 2; ++dx) {
+                        int32_t fx = std::min(cx * 2 + dx, frameWidth - 1);
+                        const uint8_t* p = sample(fx, fy);
+                        float alpha = p[3] / 255.0f;
+                        float rgb[3] = {float(p[0]), float(p[1]), float(p[2])};
+                        if (premultiplied && alpha > 0.0f) {
+                            for (float& c : rgb) c = std::min(c / alpha, 255.f);
+                        }
+                        float yuv[3];
+                        toYuv.convert(rgb, yuv);
+                        alphaSum += alpha;
+                        uSum += yuv[1] * alpha;
+                        vSum += yuv[2] * alpha;
+
+                        // Odd sizes clamp onto the last sample, skip repeats
+                        if (fx != cx * 2 + dx || fy != cy * 2 + dy) continue;
+                        size_t i = size_t(fy) * frameWidth + fx;
+                        lumaPremul_[i] = uint16_t(std::lround(yuv[0] * p[3]));
+                        lumaInvAlpha_[i] = 255 - p[3];
+                        if (p[3] != 0) {
+                            int32_t tile = fy / TILE_SIZE * tilesX_;
+                            tileMask_[tile + fx / TILE_SIZE] = 1;
+                        }
+                    }
+                }
+                size_t i = size_t(cy) * chromaWidth + cx;
+                // Premultiplying by the averaged alpha weights each sample's
+                // chroma by its own coverage
+                uPremul_[i] = uint16_t(std::lround(uSum * 255.0f / 4.0f));
+                vPremul_[i] = uint16_t(std::lround(vSum * 255.0f / 4.0f));
+                chromaInvAlpha_[i] =
+                    uint8_t(255 - std::lround(alphaSum * 255.0f / 4.0f));
+            }
+        }
+    });
+}
+
+void CpuCompositor::clearWatermark() {
+    lumaPremul_.clear();
+    lumaInvAlpha_.clear();
+    uPremul_.clear();
+    vPremul_.clear();
+    chromaInvAlpha_.clear();
+    chromaPremul_.clear();
+    chromaLayoutInvAlpha_.clear();
+    chromaLayout_ = ChromaLayout::NONE;
+    tileMask_.clear();
+}
+
+CpuCompositor::ChromaLayout CpuCompositor::getChromaLayout(
+    const uint8_t* u,
+    const uint8_t* v,
+    int32_t pixelStride
+) {
+    if (pixelStride == 1) return ChromaLayout::PLANAR;
+    if (pixelStride == 2 && v == u + 1) return ChromaLayout::UV;
+    if (pixelStride == 2 && u == v + 1) return ChromaLayout::VU;
+    return ChromaLayout::STRIDED;
+}
+
+void CpuCompositor::prepareChroma(ChromaLayout layout) {
+    if (layout == chromaLayout_) return;
+    chromaLayout_ = layout;
+    chromaPremul_.clear();
+    chromaLayoutInvAlpha_.clear();
+    if (layout != ChromaLayout::UV && layout != ChromaLayout::VU) return;
+
+    // Interleave once so semi-planar rows blend as one contiguous span
+    const auto& first = layout == ChromaLayout::UV ? uPremul_ : vPremul_;
+    const auto& second = layout == ChromaLayout::UV ? vPremul_ : uPremul_;
+    chromaPremul_.resize(first.size() * 2);
+    chromaLayoutInvAlpha_.resize(first.size() * 2);
+    for (size_t i = 0; i < first.size(); ++i) {
+        chromaPremul_[i * 2] = first[i];
+        chromaPremul_[i * 2 + 1] = second[i];
+        chromaLayoutInvAlpha_[i * 2] = chromaInvAlpha_[i];
+        chromaLayoutInvAlpha_[i * 2 + 1] = chromaInvAlpha_[i];
+    }
+}
+
+void CpuCompositor::blendLumaRow(uint8_t* dst, int32_t y) const {
+    size_t offset = size_t(y) * width_;
+    forEachSpan(
+        &tileMask_[(y / TILE_SIZE) * tilesX_],
+        tilesX_,
+        TILE_SIZE,
+        width_,
+        [&](int32_t begin, int32_t end) {
+            blendSpan(
+                dst + begin,
+                &lumaPremul_[offset + begin],
+                &lumaInvAlpha_[offset + begin],
+                end - begin
+            );
+        }
+    );
+}
+
+void CpuCompositor::blendChromaRow(
+    uint8_t* u,
+    uint8_t* v,
+    int32_t pixelStride,
+    int32_t y
+) const {
+    int32_t chromaWidth = (width_ + 1) / 2;
+    size_t offset = size_t(y) * chromaWidth;
+    const uint8_t* mask = &tileMask_[(y * 2 / TILE_SIZE) * tilesX_];
+    constexpr int32_t CHROMA_TILE = TILE_SIZE / 2;
+
+    switch (chromaLayout_) {
+        case ChromaLayout::PLANAR:
+            forEachSpan(
+                mask,
+                tilesX_,
+                CHROMA_TILE,
+                chromaWidth,
+                [&](int32_t begin, int32_t end) {
+                    const uint8_t* ia = &chromaInvAlpha_[offset + begin];
+                    blendSpan(
+                        u + begin, &uPremul_[offset + begin], ia, end - begin
+                    );
+                    blendSpan(
+                        v + begin, &vPremul_[offset + begin], ia, end - begin
+                    );
+                }
+            );
+            break;
+        case ChromaLayout::UV:
+        case ChromaLayout::VU: {
+            uint8_t* uv = std::min(u, v);
+            forEachSpan(
+                mask,
+                tilesX_,
+                CHROMA_TILE,
+                chromaWidth,
+                [&](int32_t begin, int32_t end) {
+                    blendSpan(
+                        uv + begin * 2,
+                        &chromaPremul_[(offset + begin) * 2],
+                        &chromaLayoutInvAlpha_[(offset + begin) * 2],
+                        (end - begin) * 2
+                    );
+                }
+            );
+            break;
+        }
+        default:
+            forEachSpan(
+                mask,
+                tilesX_,
+                CHROMA_TILE,
+                chromaWidth,
+                [&](int32_t begin, int32_t end) {
+                    for (int32_t x = begin; x < end; ++x) {
+                        uint8_t ia = chromaInvAlpha_[offset + x];
+                        uint8_t* pu = u + x * pixelStride;
+                        uint8_t* pv = v + x * pixelStride;
+                        *pu = div255(uPremul_[offset + x] + *pu * ia);
+                        *pv = div255(vPremul_[offset + x] + *pv * ia);
+                    }
+                }
+            );
+            break;
+    }
+}
+
+void CpuCompositor::blend(const YuvImage& frame) {
+    if (!hasWatermark() || frame.width != width_ || frame.height != height_) {
+        return;
+    }
+    prepareChroma(getChromaLayout(frame.u, frame.v, frame.uvPixelStride));
+
+    int32_t chromaHeight = (height_ + 1) / 2;
+    pool_.parallelFor(0, chromaHeight, ROW_GRAIN, [&](int32_t b, int32_t e) {
+        for (int32_t cy = b; cy < e; ++cy) {
+            for (int32_t y = cy * 2; y < std::min(cy * 2 + 2, height_); ++y) {
+                blendLumaRow(frame.y + size_t(y) * frame.yRowStride, y);
+            }
+            size_t uvOffset = size_t(cy) * frame.uvRowStride;
+            blendChromaRow(
+                frame.u + uvOffset,
+                frame.v + uvOffset,
+                frame.uvPixelStride,
+                cy
+            );
+        }
+    });
+}
+
+void CpuCompositor::composite(const YuvPlanes& src, const YuvImage& dst) {
+    int32_t width = std::min(src.width, dst.width);
+    int32_t height = std::min(src.height, dst.height);
+    int32_t chromaWidth = (width + 1) / 2;
+    auto srcLayout = getChromaLayout(src.u, src.v, src.uvPixelStride);
+    auto dstLayout = getChromaLayout(dst.u, dst.v, dst.uvPixelStride);
+    bool blending =
+        hasWatermark() && dst.width == width_ && dst.height == height_;
+    if (blending) prepareChroma(dstLayout);
+
+    int32_t chromaHeight = (height + 1) / 2;
+    pool_.parallelFor(0, chromaHeight, ROW_GRAIN, [&](int32_t b, int32_t e) {
+        for (int32_t cy = b; cy < e; ++cy) {
+            for (int32_t y = cy * 2; y < std::min(cy * 2 + 2, height); ++y) {
+                uint8_t* row = dst.y + size_t(y) * dst.yRowStride;
+                memcpy(row, src.y + size_t(y) * src.yRowStride, width);
+                if (blending) blendLumaRow(row, y);
+            }
+
+            const uint8_t* su = src.u + size_t(cy) * src.uvRowStride;
+            const uint8_t* sv = src.v + size_t(cy) * src.uvRowStride;
+            uint8_t* du = dst.u + size_t(cy) * dst.uvRowStride;
+            uint8_t* dv = dst.v + size_t(cy) * dst.uvRowStride;
+            if (srcLayout == dstLayout && srcLayout == ChromaLayout::PLANAR) {
+                memcpy(du, su, chromaWidth);
+                memcpy(dv, sv, chromaWidth);
+            } else if (srcLayout == dstLayout &&
+                       srcLayout != ChromaLayout::STRIDED) {
+                // Same interleaving, the row is one run of 2 * chromaWidth
+                memcpy(std::min(du, dv), std::min(su, sv), chromaWidth * 2);
+            } else {
+                for (int32_t x = 0; x < chromaWidth; ++x) {
+                    du[x * dst.uvPixelStride] = su[x * src.uvPixelStride];
+                    dv[x * dst.uvPixelStride] = sv[x * src.uvPixelStride];
+                }
+            }
+            if (blending) blendChromaRow(du, dv, dst.uvPixelStride, cy);
+        }
+    });
+}
+
+}  // namespace camera
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "thread_pool.hpp"
+#include "yuv_convert.hpp"
+
+namespace camera {
+
+/**
+ * Alpha blends the watermark straight into YUV 4:2:0 frames on the CPU, for
+ * devices whose Vulkan driver can't sample camera buffers through a YCbCr
+ * conversion. The watermark is converted to YUV, scaled and rotated to the
+ * frame once in setWatermark(), so per frame only an integer
+ * out = (overlay * a + frame * (255 - a)) / 255 is left, run on SIMD lanes
+ * and spread over a thread pool. Tiles without any visible watermark pixel
+ * are skipped.
+ */
+class CpuCompositor {
+  public:
+    explicit CpuCompositor(ThreadPool& pool);
+
+    /**
+     * Prepare the overlay for frames of frameWidth x frameHeight. rotation is
+     * the clockwise angle (0, 90, 180 or 270) the RGBA watermark has to be
+     * turned by to line up with the frame.
+     */
+    void setWatermark(
+        const uint8_t* rgba,
+        int32_t width,
+        int32_t height,
+        int32_t rowStride,
+        bool premultiplied,
+        int32_t frameWidth,
+        int32_t frameHeight,
+        int32_t rotation,
+        YuvMatrix matrix,
+        YuvRange range
+    );
+
+    void clearWatermark();
+
+    [[nodiscard]] bool hasWatermark() const { return !lumaPremul_.empty(); }
+
+    /** Blend the watermark into frame in place. */
+    void blend(const YuvImage& frame);
+
+    /**
+     * Copy src into dst (converting between planar and semi-planar chroma if
+     * the layouts differ) and blend the watermark on the way, so every row
+     * is touched once while still in cache.
+     */
+    void composite(const YuvPlanes& src, const YuvImage& dst);
+
+    // Name of the blend kernel in use, for logs and benchmarks
+    static const char* getKernelName();
+
+  private:
+    // Layout of the chroma overlay, matches the frames it is blended into
+    enum class ChromaLayout { NONE, PLANAR, UV, VU, STRIDED };
+
+    static constexpr int32_t TILE_SIZE = 32;
+    // Rows handed to a worker at once
+    static constexpr int32_t ROW_GRAIN = 32;
+    // Chunks of chroma rows cover whole tile rows, so workers never share
+    // a tileMask_ entry in setWatermark()
+    static_assert(ROW_GRAIN * 2 % TILE_SIZE == 0);
+
+    ThreadPool& pool_;
+    int32_t width_ = 0;
+    int32_t height_ = 0;
+
+    // overlay * alpha and 255 - alpha per luma sample
+    std::vector<uint16_t> lumaPremul_;
+    std::vector<uint8_t> lumaInvAlpha_;
+    // Same for U and V at chroma resolution with 2x2 averaged alpha
+    std::vector<uint16_t> uPremul_;
+    std::vector<uint16_t> vPremul_;
+    std::vector<uint8_t> chromaInvAlpha_;
+    // uPremul_ / vPremul_ rearranged for the layout of the last frame
+    ChromaLayout chromaLayout_ = ChromaLayout::NONE;
+    std::vector<uint16_t> chromaPremul_;
+    std::vector<uint8_t> chromaLayoutInvAlpha_;
+
+    // Non zero for every TILE_SIZE square holding a visible watermark pixel
+    std::vector<uint8_t> tileMask_;
+    int32_t tilesX_ = 0;
+
+    static ChromaLayout getChromaLayout(
+        const uint8_t* u,
+        const uint8_t* v,
+        int32_t pixelStride
+    );
+    void prepareChroma(ChromaLayout layout);
+
+    void blendLumaRow(uint8_t* dst, int32_t y) const;
+    void blendChromaRow(
+        uint8_t* u,
+        uint8_t* v,
+        int32_t pixelStride,
+        int32_t y
+    ) const;
+};
+
+}  // namespace camera
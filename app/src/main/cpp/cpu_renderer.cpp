@@ -0,0 +1,217 @@
+#include "cpu_renderer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "util.hpp"
+
+using namespace camera::util;
+
+namespace camera {
+
+namespace {
+
+// Rows converted to RGBA at once, even so chroma rows aren't shared
+constexpr int32_t CONVERT_GRAIN = 64;
+// Pixels per side of the squares rotated at once, keeps both the rows
+// read and the rows written in cache
+constexpr int32_t ROTATE_BLOCK = 32;
+
+// Turns a plane of Size byte pixels clockwise into dst, dst row r is src
+// column r read bottom up. dst must not be wider than src is high or
+// higher than it is wide
+template <size_t Size>
+void rotatePlane(
+    ThreadPool& pool,
+    const uint8_t* src,
+    size_t srcRowStride,
+    int32_t srcHeight,
+    uint8_t* dst,
+    size_t dstRowStride,
+    int32_t dstWidth,
+    int32_t dstHeight
+) {
+    pool.parallelFor(0, dstHeight, ROTATE_BLOCK, [&](int32_t b, int32_t e) {
+        for (int32_t x0 = 0; x0 < dstWidth; x0 += ROTATE_BLOCK) {
+            int32_t x1 = std::min(x0 + ROTATE_BLOCK, dstWidth);
+            for (int32_t row = b; row < e; ++row) {
+                uint8_t* out = dst + size_t(row) * dstRowStride;
+                const uint8_t* in = src + size_t(row) * Size;
+                for (int32_t x = x0; x < x1; ++x) {
+                    memcpy(
+                        out + size_t(x) * Size,
+                        in + size_t(srcHeight - 1 - x) * srcRowStride,
+                        Size
+                    );
+                }
+            }
+        }
+    });
+}
+
+}  // namespace
+
+CpuRenderer::CpuRenderer() : compositor_(pool_) {
+    logI(
+        "CPU renderer, %s blend, %s conversion, %u threads",
+        CpuCompositor::getKernelName(),
+        getYuvKernelName(),
+        pool_.size() + 1
+    );
+}
+
+void CpuRenderer::setWindow(ANativeWindow* window) {
+    window_ = window;
+    windowConfigured_ = false;
+}
+
+void CpuRenderer::startRecording(VideoEncoder* encoder) {
+    mediaEncoder_ = encoder;
+}
+
+void CpuRenderer::stopRecording() { mediaEncoder_ = nullptr; }
+
+void CpuRenderer::setWatermark(AHardwareBuffer* buffer) {
+    AHardwareBuffer_Desc desc;
+    AHardwareBuffer_describe(buffer, &desc);
+    void* data = nullptr;
+    if (AHardwareBuffer_lock(
+            buffer, AHARDWAREBUFFER_USAGE_CPU_READ_OFTEN, -1, nullptr, &data
+        ) != 0) {
+        logAsyncE("Can't lock the watermark buffer");
+        return;
+    }
+
+    watermarkWidth_ = static_cast<int32_t>(desc.width);
+    watermarkHeight_ = static_cast<int32_t>(desc.height);
+    size_t rowSize = size_t{desc.width} * 4;
+    watermark_.resize(rowSize * desc.height);
+    for (uint32_t y = 0; y < desc.height; ++y) {
+        memcpy(
+            watermark_.data() + y * rowSize,
+            static_cast<const uint8_t*>(data) + size_t{y} * desc.stride * 4,
+            rowSize
+        );
+    }
+    AHardwareBuffer_unlock(buffer, nullptr);
+    applyWatermark();
+}
+
+void CpuRenderer::drawFrame(const YuvPlanes& frame) {
+    if (frame.width != width_ || frame.height != height_) {
+        resize(frame.width, frame.height);
+    }
+
+    YuvImage composited{
+        .y = frame_.data(),
+        .u = frame_.data() + size_t(width_) * height_,
+        .width = width_,
+        .height = height_,
+        .yRowStride = width_,
+        .uvRowStride = (width_ + 1) / 2 * 2,
+        .uvPixelStride = 2
+    };
+    composited.v = composited.u + 1;
+    compositor_.composite(frame, composited);
+
+    if (mediaEncoder_ && mediaEncoder_->canAcceptFrame()) encode(composited);
+    if (!window_) return;
+
+    pool_.parallelFor(0, height_, CONVERT_GRAIN, [&](int32_t b, int32_t e) {
+        YuvPlanes band{
+            .y = composited.y + size_t(b) * composited.yRowStride,
+            .u = composited.u + size_t(b / 2) * composited.uvRowStride,
+            .v = composited.v + size_t(b / 2) * composited.uvRowStride,
+            .width = width_,
+            .height = e - b,
+            .yRowStride = composited.yRowStride,
+            .uvRowStride = composited.uvRowStride,
+            .uvPixelStride = composited.uvPixelStride
+        };
+        uint8_t* out = rgba_.data() + size_t(b) * width_ * 4;
+        yuv420ToRgba(band, out, width_ * 4, MATRIX, RANGE);
+    });
+    present();
+}
+
+void CpuRenderer::resize(int32_t width, int32_t height) {
+    width_ = width;
+    height_ = height;
+    size_t chromaSize = size_t((width + 1) / 2) * ((height + 1) / 2) * 2;
+    frame_.resize(size_t(width) * height + chromaSize);
+    rgba_.resize(size_t(width) * height * 4);
+    windowConfigured_ = false;
+    applyWatermark();
+}
+
+void CpuRenderer::applyWatermark() {
+    if (watermark_.empty() || width_ == 0) return;
+    // Straight alpha, blended like the GPU path does. The watermark is
+    // portrait, turned back by the angle the frame is turned by later
+    compositor_.setWatermark(
+        watermark_.data(),
+        watermarkWidth_,
+        watermarkHeight_,
+        watermarkWidth_ * 4,
+        false,
+        width_,
+        height_,
+        360 - ROTATION,
+        MATRIX,
+        RANGE
+    );
+}
+
+void CpuRenderer::present() {
+    // Portrait, the landscape frame turned clockwise
+    if (!windowConfigured_) {
+        ANativeWindow_setBuffersGeometry(
+            window_, height_, width_, WINDOW_FORMAT_RGBA_8888
+        );
+        windowConfigured_ = true;
+    }
+    ANativeWindow_Buffer buffer;
+    if (ANativeWindow_lock(window_, &buffer, nullptr) != 0) {
+        logAsyncE("Can't lock the window");
+        return;
+    }
+    rotatePlane<4>(
+        pool_,
+        rgba_.data(),
+        size_t(width_) * 4,
+        height_,
+        static_cast<uint8_t*>(buffer.bits),
+        size_t(buffer.stride) * 4,
+        std::min(buffer.width, height_),
+        std::min(buffer.height, width_)
+    );
+    ANativeWindow_unlockAndPost(window_);
+}
+
+void CpuRenderer::encode(const YuvImage& frame) {
+    // The NV12 planes turned like the preview, the UV pairs move as one
+    mediaEncoder_->queueFrame([&](const YuvImage& out) {
+        rotatePlane<1>(
+            pool_,
+            frame.y,
+            frame.yRowStride,
+            frame.height,
+            out.y,
+            out.yRowStride,
+            std::min(out.width, frame.height),
+            std::min(out.height, frame.width)
+        );
+        rotatePlane<2>(
+            pool_,
+            frame.u,
+            frame.uvRowStride,
+            (frame.height + 1) / 2,
+            out.u,
+            out.uvRowStride,
+            std::min((out.width + 1) / 2, (frame.height + 1) / 2),
+            std::min((out.height + 1) / 2, (frame.width + 1) / 2)
+        );
+    });
+}
+
+}  // namespace camera
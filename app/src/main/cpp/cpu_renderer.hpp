@@ -0,0 +1,75 @@
+#pragma once
+
+#include <android/hardware_buffer.h>
+#include <android/native_window.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "cpu_compositor.hpp"
+#include "thread_pool.hpp"
+#include "video_encoder.hpp"
+#include "yuv_convert.hpp"
+
+namespace camera {
+
+/**
+ * Preview and recording without Vulkan, for devices whose driver can't
+ * sample camera buffers through a YCbCr conversion. Camera frames are read
+ * on the CPU and the watermark view is blended in by CpuCompositor. The
+ * NV12 result is turned to portrait straight into the input buffers of an
+ * encoder in byte buffer mode, only the display window gets it converted
+ * to RGBA. Only the watermark view is drawn, the text, overlay and layer
+ * effects of VkRenderer need the GPU.
+ */
+class CpuRenderer {
+  public:
+    CpuRenderer();
+
+    void setWindow(ANativeWindow* window);
+    /**
+     * Queue frames to the encoder too while it keeps up, it has to take
+     * byte buffer input.
+     */
+    void startRecording(VideoEncoder* encoder);
+    void stopRecording();
+
+    /** Take the watermark view from a CPU readable RGBA buffer. */
+    void setWatermark(AHardwareBuffer* buffer);
+
+    /** Composite a landscape camera frame and show it. */
+    void drawFrame(const YuvPlanes& frame);
+
+  private:
+    // Matches the YCbCr conversion of the GPU path
+    static constexpr YuvMatrix MATRIX = YuvMatrix::BT709;
+    static constexpr YuvRange RANGE = YuvRange::FULL;
+    // Clockwise angle from the camera frame to the portrait outputs
+    static constexpr int32_t ROTATION = 90;
+
+    ThreadPool pool_;
+    CpuCompositor compositor_;
+    ANativeWindow* window_ = nullptr;
+    // Whether the window buffers were given the frame's size and format
+    bool windowConfigured_ = false;
+    VideoEncoder* mediaEncoder_ = nullptr;
+
+    int32_t width_ = 0;
+    int32_t height_ = 0;
+    // Composited frame as NV12, then as landscape RGBA
+    std::vector<uint8_t> frame_;
+    std::vector<uint8_t> rgba_;
+
+    // Copy of the last watermark view, fitted again when the frame size
+    // changes
+    std::vector<uint8_t> watermark_;
+    int32_t watermarkWidth_ = 0;
+    int32_t watermarkHeight_ = 0;
+
+    void resize(int32_t width, int32_t height);
+    void applyWatermark();
+    void present();
+    void encode(const YuvImage& frame);
+};
+
+}  // namespace camera
@@ -0,0 +1,287 @@
+#include "file_writer.hpp"
+
+#include <fcntl.h>
+#include <linux/falloc.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "util.hpp"
+
+using namespace camera::util;
+
+namespace camera {
+
+FileWriter::FileWriter() {
+    pool_.resize(BUFFER_COUNT);
+    for (auto& buffer : pool_) {
+        buffer.reserve(BUFFER_SIZE);
+    }
+    thread_ = std::thread(&FileWriter::run, this);
+}
+
+FileWriter::~FileWriter() {
+    if (isOpen()) close();
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    jobReady_.notify_one();
+    thread_.join();
+}
+
+bool FileWriter::open(const std::string& path) {
+    if (isOpen()) return false;
+    // Readable too, patches of a hash chain read what they overwrite
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        logE("Can't open %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    path_ = path;
+    position_ = 0;
+    currentOffset_ = 0;
+    failed_ = false;
+    closed_ = false;
+
+    std::unique_lock lock(mutex_);
+    hashChain_.reset();
+    linkEnds_.clear();
+    jobDone_.wait(lock, [this] { return !pool_.empty(); });
+    current_ = std::move(pool_.back());
+    pool_.pop_back();
+    return true;
+}
+
+bool FileWriter::preallocate(uint64_t size) {
+    if (!isOpen()) return false;
+    {
+        std::lock_guard lock(mutex_);
+        jobs_.emplace_back().allocate = size;
+    }
+    jobReady_.notify_one();
+    return true;
+}
+
+bool FileWriter::write(const void* data, size_t size) {
+    if (!isOpen() || failed_) return false;
+    auto* bytes = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+        size_t chunk = std::min(size, BUFFER_SIZE - current_.size());
+        current_.insert(current_.end(), bytes, bytes + chunk);
+        bytes += chunk;
+        size -= chunk;
+        position_ += chunk;
+        if (current_.size() == BUFFER_SIZE) submitCurrent();
+    }
+    return true;
+}
+
+bool FileWriter::writeAt(uint64_t offset, const void* data, size_t size) {
+    if (!isOpen() || failed_ || offset + size > position_) return false;
+    auto* bytes = static_cast<const uint8_t*>(data);
+
+    // The part already handed to the I/O thread goes through a job
+    if (offset < currentOffset_) {
+        size_t queued = std::min<uint64_t>(size, currentOffset_ - offset);
+        Job job{
+            .offset = offset,
+            .data = {bytes, bytes + queued},
+            .patch = true
+        };
+        {
+            std::lock_guard lock(mutex_);
+            jobs_.push_back(std::move(job));
+        }
+        jobReady_.notify_one();
+        bytes += queued;
+        offset += queued;
+        size -= queued;
+    }
+    // The rest is still in the buffer being filled
+    if (size > 0) {
+        memcpy(current_.data() + (offset - currentOffset_), bytes, size);
+    }
+    return true;
+}
+
+bool FileWriter::enableHashChain(HashChainLink link) {
+    if (!isOpen() || position_ > 0) return false;
+    std::lock_guard lock(mutex_);
+    hashChain_ = std::make_unique<HashChain>(std::move(link));
+    return true;
+}
+
+void FileWriter::endHashLink() {
+    if (!isOpen()) return;
+    std::lock_guard lock(mutex_);
+    if (hashChain_) linkEnds_.push_back(position_);
+}
+
+bool FileWriter::close() {
+    if (!isOpen()) return false;
+    submitCurrent();
+
+    std::unique_lock lock(mutex_);
+    // The size lets the close give back the space preallocated past it
+    jobs_.push_back(Job{.offset = position_, .close = true});
+    jobReady_.notify_one();
+    jobDone_.wait(lock, [this] { return closed_; });
+    // Return the empty buffer appends were collected in
+    pool_.push_back(std::move(current_));
+    current_ = {};
+    fd_ = -1;
+    return !failed_;
+}
+
+void FileWriter::submitCurrent() {
+    if (current_.empty()) return;
+
+    std::unique_lock lock(mutex_);
+    jobs_.push_back(Job{
+        .offset = currentOffset_,
+        .data = std::move(current_),
+        .pooled = true
+    });
+    currentOffset_ = position_;
+    jobReady_.notify_one();
+    // Only blocks when the disk is BUFFER_COUNT buffers behind
+    jobDone_.wait(lock, [this] { return !pool_.empty(); });
+    current_ = std::move(pool_.back());
+    pool_.pop_back();
+}
+
+void FileWriter::run() {
+    uint64_t unsyncedBytes = 0;
+    std::unique_lock lock(mutex_);
+    for (;;) {
+        jobReady_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+        if (jobs_.empty()) return;
+        Job job = std::move(jobs_.front());
+        jobs_.pop_front();
+        lock.unlock();
+
+        if (job.close) {
+            if (hashChain_) finishHashChain();
+            if (ftruncate(fd_, static_cast<off_t>(job.offset)) != 0) {
+                logW("Can't trim the file: %s", strerror(errno));
+            }
+            if (fdatasync(fd_) != 0 || ::close(fd_) != 0) failed_ = true;
+            unsyncedBytes = 0;
+        } else if (job.allocate > 0) {
+            // Not supported by every file system, only an optimization
+            if (fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0, job.allocate) != 0) {
+                logW("Can't preallocate the file: %s", strerror(errno));
+            }
+        } else if (!failed_) {
+            // Hashed while the bytes are at hand, no second pass over them
+            if (hashChain_ && job.patch && !hashPatch(job)) {
+                logE("Can't read the bytes to patch: %s", strerror(errno));
+                failed_ = true;
+            } else if (hashChain_ && !job.patch) {
+                hashAppend(job);
+            }
+            if (!failed_ &&
+                !writeFully(job.offset, job.data.data(), job.data.size())) {
+                logE("File write failed: %s", strerror(errno));
+                failed_ = true;
+            }
+            unsyncedBytes += job.data.size();
+            // One sync per batch instead of per write keeps the disk
+            // streaming while bounding what a power loss can take
+            if (unsyncedBytes >= SYNC_BYTES) {
+                fdatasync(fd_);
+                unsyncedBytes = 0;
+            }
+        }
+
+        lock.lock();
+        if (job.pooled) {
+            job.data.clear();
+            pool_.push_back(std::move(job.data));
+        }
+        if (job.close) closed_ = true;
+        jobDone_.notify_all();
+    }
+}
+
+void FileWriter::hashAppend(const Job& job) {
+    const uint8_t* data = job.data.data();
+    uint64_t offset = job.offset;
+    uint64_t end = job.offset + job.data.size();
+    // Links end where endHashLink() was called, anywhere in the buffers
+    for (;;) {
+        uint64_t linkEnd;
+        {
+            std::lock_guard lock(mutex_);
+            if (linkEnds_.empty() || linkEnds_.front() > end) break;
+            linkEnd = linkEnds_.front();
+            linkEnds_.pop_front();
+        }
+        hashChain_->append(data, linkEnd - offset);
+        data += linkEnd - offset;
+        offset = linkEnd;
+        hashChain_->endLink();
+    }
+    hashChain_->append(data, end - offset);
+}
+
+bool FileWriter::hashPatch(const Job& job) {
+    // The bytes were hashed as they were, which the file still holds
+    std::vector<uint8_t> original(job.data.size());
+    size_t read = 0;
+    while (read < original.size()) {
+        ssize_t result = pread(
+            fd_,
+            original.data() + read,
+            original.size() - read,
+            static_cast<off_t>(job.offset + read)
+        );
+        if (result < 0 && errno == EINTR) continue;
+        if (result <= 0) return false;
+        read += result;
+    }
+    hashChain_->addPatch(
+        job.offset,
+        original.data(),
+        job.data.data(),
+        job.data.size()
+    );
+    return true;
+}
+
+void FileWriter::finishHashChain() {
+    {
+        std::lock_guard lock(mutex_);
+        linkEnds_.clear();
+    }
+    std::string chainPath = path_ + HASH_CHAIN_SUFFIX;
+    if (!hashChain_->save(chainPath)) {
+        logE("Can't write %s: %s", chainPath.c_str(), strerror(errno));
+        failed_ = true;
+        return;
+    }
+    logI(
+        "Hash chain of %s: %s",
+        path_.c_str(),
+        toHex(hashChain_->getHead()).c_str()
+    );
+}
+
+bool FileWriter::writeFully(uint64_t offset, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = pwrite(fd_, data, size, static_cast<off_t>(offset));
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        offset += written;
+        size -= written;
+    }
+    return true;
+}
+
+}  // namespace camera
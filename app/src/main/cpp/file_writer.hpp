@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "hash_chain.hpp"
+
+namespace camera {
+
+/**
+ * Sequential file output through a dedicated I/O thread. Writes are
+ * gathered into a few large buffers which the thread hands to the kernel
+ * in one go, and fsync is batched to once per SYNC_BYTES. The caller only
+ * blocks when every buffer is still waiting for the disk.
+ */
+class FileWriter {
+  public:
+    static constexpr size_t BUFFER_SIZE = 2 << 20;
+    static constexpr size_t BUFFER_COUNT = 4;
+    static constexpr uint64_t SYNC_BYTES = 32 << 20;
+
+    FileWriter();
+    ~FileWriter();
+
+    FileWriter(const FileWriter&) = delete;
+    FileWriter& operator=(const FileWriter&) = delete;
+
+    bool open(const std::string& path);
+    /**
+     * Reserve disk space on the I/O thread so later writes don't have to
+     * allocate blocks. The file size doesn't change.
+     */
+    bool preallocate(uint64_t size);
+    /** Append size bytes. */
+    bool write(const void* data, size_t size);
+    /**
+     * Overwrite bytes written before, e.g. a size field in a header. Applied
+     * in order with the appends.
+     */
+    bool writeAt(uint64_t offset, const void* data, size_t size);
+    /**
+     * Keep a HashChain over the file, hashed on the I/O thread right before
+     * the bytes go to the kernel. Call after open() and before writing.
+     * close() writes the chain next to the file.
+     */
+    bool enableHashChain(HashChainLink link);
+    /** End the current link of the chain at the current position. */
+    void endHashLink();
+    /** Write everything out, fsync and close. False if any write failed. */
+    bool close();
+
+    [[nodiscard]] bool isOpen() const { return fd_ >= 0; }
+    // Size of the file once everything queued is written
+    [[nodiscard]] uint64_t getPosition() const { return position_; }
+
+  private:
+    struct Job {
+        uint64_t offset = 0;
+        std::vector<uint8_t> data;
+        uint64_t allocate = 0;
+        // Buffer goes back to the pool once written
+        bool pooled = false;
+        // Overwrites bytes queued before, hashed as a patch
+        bool patch = false;
+        bool close = false;
+    };
+
+    int fd_ = -1;
+    std::string path_;
+    uint64_t position_ = 0;
+    // Appends collect here until it is full
+    std::vector<uint8_t> current_;
+    uint64_t currentOffset_ = 0;
+
+    std::mutex mutex_;
+    std::condition_variable jobReady_;
+    std::condition_variable jobDone_;
+    std::deque<Job> jobs_;
+    std::vector<std::vector<uint8_t>> pool_;
+    bool closed_ = false;
+    bool stop_ = false;
+    std::atomic_bool failed_ = false;
+    std::thread thread_;
+    // Only used by the I/O thread once enabled
+    std::unique_ptr<HashChain> hashChain_;
+    std::deque<uint64_t> linkEnds_;
+
+    void submitCurrent();
+    void run();
+    void hashAppend(const Job& job);
+    bool hashPatch(const Job& job);
+    void finishHashChain();
+    bool writeFully(uint64_t offset, const uint8_t* data, size_t size);
+};
+
+}  // namespace camera
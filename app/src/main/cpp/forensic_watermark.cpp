@@ -0,0 +1,387 @@
+#include "forensic_watermark.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <numbers>
+#include <vector>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FORENSIC_HAS_X86 1
+#endif
+
+namespace camera {
+
+namespace {
+
+constexpr uint32_t N = FORENSIC_BLOCK_SIZE;
+// DCT basis (u, v) carrying the bits, mid band so it survives encoding
+// without standing out like high frequency noise
+constexpr int BASIS_U = 3;
+constexpr int BASIS_V = 2;
+
+using Basis = std::array<std::array<float, N>, N>;
+
+const Basis& getBasis() {
+    static const Basis basis = [] {
+        Basis b;
+        auto pi = std::numbers::pi_v<float>;
+        for (uint32_t y = 0; y < N; ++y) {
+            for (uint32_t x = 0; x < N; ++x) {
+                b[y][x] = std::cos(pi * (x + 0.5f) * BASIS_U / N) *
+                          std::cos(pi * (y + 0.5f) * BASIS_V / N);
+            }
+        }
+        return b;
+    }();
+    return basis;
+}
+
+// The basis in Q12 for the integer projections, exact in every kernel
+using QuantizedBasis = std::array<std::array<int16_t, N>, N>;
+
+const QuantizedBasis& getQuantizedBasis() {
+    alignas(16) static const QuantizedBasis basis = [] {
+        QuantizedBasis q;
+        for (uint32_t y = 0; y < N; ++y) {
+            for (uint32_t x = 0; x < N; ++x) {
+                q[y][x] = static_cast<int16_t>(
+                    std::lround(getBasis()[y][x] * 4096.0f)
+                );
+            }
+        }
+        return q;
+    }();
+    return basis;
+}
+
+// Project a row of blocks on the basis from block first on, one
+// coefficient per block. The vectorized kernels return how many blocks
+// they did, the scalar one finishes the row
+using ProjectKernel = int32_t (*)(
+    const uint8_t* blocks,
+    int32_t rowStride,
+    int32_t count,
+    const QuantizedBasis& basis,
+    int32_t* coefficients
+);
+
+void projectBlocksScalar(
+    const uint8_t* blocks,
+    int32_t rowStride,
+    int32_t first,
+    int32_t count,
+    const QuantizedBasis& basis,
+    int32_t* coefficients
+) {
+    for (int32_t i = first; i < count; ++i) {
+        int32_t sum = 0;
+        for (uint32_t y = 0; y < N; ++y) {
+            const uint8_t* row =
+                blocks + static_cast<ptrdiff_t>(y) * rowStride + i * N;
+            for (uint32_t x = 0; x < N; ++x) {
+                sum += row[x] * basis[y][x];
+            }
+        }
+        coefficients[i] = sum;
+    }
+}
+
+#if defined(__ARM_NEON)
+
+int32_t projectBlocksNeon(
+    const uint8_t* blocks,
+    int32_t rowStride,
+    int32_t count,
+    const QuantizedBasis& basis,
+    int32_t* coefficients
+) {
+    for (int32_t i = 0; i < count; ++i) {
+        int32x4_t sum = vdupq_n_s32(0);
+        for (uint32_t y = 0; y < N; ++y) {
+            const uint8_t* row =
+                blocks + static_cast<ptrdiff_t>(y) * rowStride + i * N;
+            int16x8_t pixels = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(row)));
+            int16x8_t weights = vld1q_s16(basis[y].data());
+            sum = vmlal_s16(sum, vget_low_s16(pixels), vget_low_s16(weights));
+            sum =
+                vmlal_s16(sum, vget_high_s16(pixels), vget_high_s16(weights));
+        }
+        int32x2_t pair = vadd_s32(vget_low_s32(sum), vget_high_s32(sum));
+        coefficients[i] = vget_lane_s32(vpadd_s32(pair, pair), 0);
+    }
+    return count;
+}
+
+constexpr const char* KERNEL_NAME = "neon";
+
+ProjectKernel selectProjectKernel() { return projectBlocksNeon; }
+
+#elif defined(FORENSIC_HAS_X86)
+
+inline int32_t sumSse2(__m128i value) {
+    value = _mm_add_epi32(value, _mm_shuffle_epi32(value, 0x4e));
+    value = _mm_add_epi32(value, _mm_shuffle_epi32(value, 0xb1));
+    return _mm_cvtsi128_si32(value);
+}
+
+// Two blocks at a time, a 16 pixel load covers a row of both
+int32_t projectBlocksSse2(
+    const uint8_t* blocks,
+    int32_t rowStride,
+    int32_t count,
+    const QuantizedBasis& basis,
+    int32_t* coefficients
+) {
+    __m128i zero = _mm_setzero_si128();
+    int32_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128i first = zero;
+        __m128i second = zero;
+        for (uint32_t y = 0; y < N; ++y) {
+            const uint8_t* row =
+                blocks + static_cast<ptrdiff_t>(y) * rowStride + i * N;
+            __m128i pixels =
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(row));
+            __m128i weights =
+                _mm_load_si128(reinterpret_cast<const __m128i*>(&basis[y]));
+            first = _mm_add_epi32(
+                first, _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), weights)
+            );
+            second = _mm_add_epi32(
+                second,
+                _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), weights)
+            );
+        }
+        coefficients[i] = sumSse2(first);
+        coefficients[i + 1] = sumSse2(second);
+    }
+    return i;
+}
+
+// Four blocks at a time, each 128 bit lane holds one of them
+__attribute__((target("avx2"))) int32_t projectBlocksAvx2(
+    const uint8_t* blocks,
+    int32_t rowStride,
+    int32_t count,
+    const QuantizedBasis& basis,
+    int32_t* coefficients
+) {
+    int32_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256i low = _mm256_setzero_si256();
+        __m256i high = _mm256_setzero_si256();
+        for (uint32_t y = 0; y < N; ++y) {
+            const uint8_t* row =
+                blocks + static_cast<ptrdiff_t>(y) * rowStride + i * N;
+            __m256i pixels =
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row));
+            __m256i weights = _mm256_broadcastsi128_si256(
+                _mm_load_si128(reinterpret_cast<const __m128i*>(&basis[y]))
+            );
+            low = _mm256_add_epi32(
+                low,
+                _mm256_madd_epi16(
+                    _mm256_cvtepu8_epi16(_mm256_castsi256_si128(pixels)),
+                    weights
+                )
+            );
+            high = _mm256_add_epi32(
+                high,
+                _mm256_madd_epi16(
+                    _mm256_cvtepu8_epi16(_mm256_extracti128_si256(pixels, 1)),
+                    weights
+                )
+            );
+        }
+        // Blocks i, i + 2 in the low lane, i + 1, i + 3 in the high one
+        __m256i sums = _mm256_hadd_epi32(low, high);
+        sums = _mm256_hadd_epi32(sums, sums);
+        coefficients[i] = _mm256_extract_epi32(sums, 0);
+        coefficients[i + 1] = _mm256_extract_epi32(sums, 4);
+        coefficients[i + 2] = _mm256_extract_epi32(sums, 1);
+        coefficients[i + 3] = _mm256_extract_epi32(sums, 5);
+    }
+    return i;
+}
+
+bool hasAvx2() {
+    static const bool hasAvx2 = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+    }();
+    return hasAvx2;
+}
+
+constexpr const char* KERNEL_NAME = "sse2";
+
+ProjectKernel selectProjectKernel() {
+    return hasAvx2() ? projectBlocksAvx2 : projectBlocksSse2;
+}
+
+#else
+
+constexpr const char* KERNEL_NAME = "scalar";
+
+ProjectKernel selectProjectKernel() { return nullptr; }
+
+#endif
+
+// Payload bit of a block and its keyed sign
+struct BlockCode {
+    uint32_t bit;
+    float sign;
+};
+
+BlockCode getBlockCode(uint32_t key, uint32_t blockX, uint32_t blockY) {
+    uint32_t h = forensicHash(blockX + forensicHash(blockY));
+    h = forensicHash(key ^ h);
+    return {h % FORENSIC_PAYLOAD_BITS, (h >> 31) ? 1.0f : -1.0f};
+}
+
+bool getBit(const ForensicWords& words, uint32_t bit) {
+    return (words[bit / 32] >> (bit % 32)) & 1;
+}
+
+bool extract(
+    const uint8_t* luma,
+    int32_t width,
+    int32_t height,
+    int32_t rowStride,
+    uint32_t key,
+    ProjectKernel kernel,
+    ForensicPayload& payload,
+    float& confidence
+) {
+    const QuantizedBasis& basis = getQuantizedBasis();
+    int32_t blockCount = width / static_cast<int32_t>(N);
+    std::vector<int32_t> coefficients(blockCount);
+    std::array<int64_t, FORENSIC_PAYLOAD_BITS> correlation{};
+    std::array<double, FORENSIC_PAYLOAD_BITS> energy{};
+    for (int32_t blockY = 0; blockY < height / static_cast<int32_t>(N);
+         ++blockY) {
+        const uint8_t* blocks =
+            luma + static_cast<ptrdiff_t>(blockY) * N * rowStride;
+        int32_t done = 0;
+        if (kernel) {
+            done = kernel(
+                blocks, rowStride, blockCount, basis, coefficients.data()
+            );
+        }
+        projectBlocksScalar(
+            blocks, rowStride, done, blockCount, basis, coefficients.data()
+        );
+        for (int32_t blockX = 0; blockX < blockCount; ++blockX) {
+            int32_t coefficient = coefficients[blockX];
+            BlockCode code = getBlockCode(key, blockX, blockY);
+            correlation[code.bit] += code.sign > 0 ? coefficient : -coefficient;
+            energy[code.bit] += static_cast<double>(coefficient) * coefficient;
+        }
+    }
+
+    // Unmarked, the correlation of a bit is a sum of coefficients with
+    // random signs, its standard deviation the root of their energy
+    ForensicWords words{};
+    confidence = INFINITY;
+    for (uint32_t bit = 0; bit < FORENSIC_PAYLOAD_BITS; ++bit) {
+        if (correlation[bit] > 0) words[bit / 32] |= 1u << (bit % 32);
+        float deviation = energy[bit] > 0
+            ? static_cast<float>(
+                  std::abs(static_cast<double>(correlation[bit])) /
+                  std::sqrt(energy[bit])
+              )
+            : 0.0f;
+        confidence = std::min(confidence, deviation);
+    }
+    payload = unpackForensicPayload(words);
+    return confidence >= FORENSIC_MIN_CONFIDENCE;
+}
+
+}  // namespace
+
+ForensicWords packForensicPayload(const ForensicPayload& payload) {
+    return {payload.deviceId, payload.frameNumber, payload.timestampS, 0};
+}
+
+ForensicPayload unpackForensicPayload(const ForensicWords& words) {
+    return {
+        .deviceId = words[0], .frameNumber = words[1], .timestampS = words[2]
+    };
+}
+
+uint32_t forensicHash(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+void embedForensicWatermark(
+    uint8_t* luma,
+    int32_t width,
+    int32_t height,
+    int32_t rowStride,
+    uint32_t key,
+    const ForensicPayload& payload,
+    float strength
+) {
+    const Basis& basis = getBasis();
+    ForensicWords words = packForensicPayload(payload);
+    for (int32_t y = 0; y < height; ++y) {
+        uint8_t* row = luma + static_cast<ptrdiff_t>(y) * rowStride;
+        for (int32_t x = 0; x < width; ++x) {
+            // Partial blocks at the edges are marked too, like the shader
+            // does, extraction skips them
+            BlockCode code = getBlockCode(key, x / N, y / N);
+            float sign = getBit(words, code.bit) ? code.sign : -code.sign;
+            float value = row[x] + strength * sign * basis[y % N][x % N];
+            row[x] = static_cast<uint8_t>(
+                std::clamp(std::lround(value), 0L, 255L)
+            );
+        }
+    }
+}
+
+bool extractForensicWatermark(
+    const uint8_t* luma,
+    int32_t width,
+    int32_t height,
+    int32_t rowStride,
+    uint32_t key,
+    ForensicPayload& payload,
+    float& confidence
+) {
+    static const ProjectKernel kernel = selectProjectKernel();
+    return extract(
+        luma, width, height, rowStride, key, kernel, payload, confidence
+    );
+}
+
+bool extractForensicWatermarkReference(
+    const uint8_t* luma,
+    int32_t width,
+    int32_t height,
+    int32_t rowStride,
+    uint32_t key,
+    ForensicPayload& payload,
+    float& confidence
+) {
+    return extract(
+        luma, width, height, rowStride, key, nullptr, payload, confidence
+    );
+}
+
+const char* getForensicKernelName() {
+#if defined(FORENSIC_HAS_X86)
+    return hasAvx2() ? "avx2" : KERNEL_NAME;
+#else
+    return KERNEL_NAME;
+#endif
+}
+
+}  // namespace camera
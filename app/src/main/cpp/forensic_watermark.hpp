@@ -0,0 +1,90 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace camera {
+
+/** What the invisible watermark carries in every frame. */
+struct ForensicPayload {
+    uint32_t deviceId = 0;
+    uint32_t frameNumber = 0;
+    // Seconds since the epoch, UTC
+    uint32_t timestampS = 0;
+
+    bool operator==(const ForensicPayload&) const = default;
+};
+
+// Payload words as the shader reads them, the last one is unused
+using ForensicWords = std::array<uint32_t, 4>;
+
+/**
+ * Keyed spread spectrum watermark in the luma of a frame. Every 8x8 block
+ * carries one payload bit, chosen from the key and the block position,
+ * as a mid frequency DCT basis function with a keyed sign. Extraction
+ * projects each block on that basis and correlates with the signs, so the
+ * image content averages out over the blocks of a bit. Extraction needs
+ * the frame at the size it was marked at.
+ *
+ * The shader embeds the mark while compositing, these are the reference
+ * embedding and the extraction, matching it bit for bit in block layout
+ * and signs.
+ */
+constexpr uint32_t FORENSIC_BLOCK_SIZE = 8;
+constexpr uint32_t FORENSIC_PAYLOAD_BITS = 96;
+// Amplitude at the basis peak in 8 bit luma levels
+constexpr float FORENSIC_STRENGTH = 3.0f;
+// Correlation, in standard deviations of unmarked content, every bit
+// needs for the payload to be trusted. Unmarked, the weakest of the bits
+// is practically always well below it
+constexpr float FORENSIC_MIN_CONFIDENCE = 2.0f;
+
+ForensicWords packForensicPayload(const ForensicPayload& payload);
+ForensicPayload unpackForensicPayload(const ForensicWords& words);
+
+// Integer hash shared with the shader
+uint32_t forensicHash(uint32_t x);
+
+/** Add the mark to an 8 bit luma plane, strength in luma levels. */
+void embedForensicWatermark(
+    uint8_t* luma,
+    int32_t width,
+    int32_t height,
+    int32_t rowStride,
+    uint32_t key,
+    const ForensicPayload& payload,
+    float strength = FORENSIC_STRENGTH
+);
+
+/**
+ * Recover the payload of a marked luma plane with the fastest kernel
+ * available on the running CPU (NEON on arm, AVX2 or SSE2 on x86).
+ * confidence is the weakest bit's correlation in standard deviations,
+ * false if it is below FORENSIC_MIN_CONFIDENCE, e.g. for another key or
+ * an unmarked frame. Bit exact with extractForensicWatermarkReference().
+ */
+bool extractForensicWatermark(
+    const uint8_t* luma,
+    int32_t width,
+    int32_t height,
+    int32_t rowStride,
+    uint32_t key,
+    ForensicPayload& payload,
+    float& confidence
+);
+
+// Portable scalar implementation, the reference for the vectorized kernels
+bool extractForensicWatermarkReference(
+    const uint8_t* luma,
+    int32_t width,
+    int32_t height,
+    int32_t rowStride,
+    uint32_t key,
+    ForensicPayload& payload,
+    float& confidence
+);
+
+// Name of the kernel extractForensicWatermark() dispatches to
+const char* getForensicKernelName();
+
+}  // namespace camera
@@ -0,0 +1,83 @@
+#include "frame_overlay.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <ctime>
+
+namespace camera {
+
+namespace {
+
+constexpr int64_t NS_PER_SECOND = 1'000'000'000;
+
+int64_t toNs(const timespec& time) {
+    return time.tv_sec * NS_PER_SECOND + time.tv_nsec;
+}
+
+}  // namespace
+
+void FrameOverlay::setLocation(std::string_view text) {
+    size_t length = std::min(text.size(), LINE_LENGTH - 1);
+    std::copy_n(text.begin(), length, location_.begin());
+    location_[length] = '\0';
+}
+
+size_t FrameOverlay::format(
+    const FrameMetadata& metadata, int64_t realtimeOffsetNs, Lines& lines
+) const {
+    size_t count = 0;
+
+    int64_t realtimeNs = metadata.timestampNs + realtimeOffsetNs;
+    auto seconds = static_cast<time_t>(realtimeNs / NS_PER_SECOND);
+    auto millis = static_cast<int>(realtimeNs % NS_PER_SECOND / 1'000'000);
+    tm utc{};
+    gmtime_r(&seconds, &utc);
+    snprintf(
+        lines[count++].data(),
+        LINE_LENGTH,
+        "%04d-%02d-%02d %02d:%02d:%02d.%03dZ #%06" PRIu64,
+        utc.tm_year + 1900,
+        utc.tm_mon + 1,
+        utc.tm_mday,
+        utc.tm_hour,
+        utc.tm_min,
+        utc.tm_sec,
+        millis,
+        metadata.frameNumber
+    );
+
+    if (metadata.exposureNs > 0) {
+        // Shutter speeds are read as fractions below a second
+        char* line = lines[count++].data();
+        int length;
+        if (metadata.exposureNs < NS_PER_SECOND) {
+            length = snprintf(
+                line,
+                LINE_LENGTH,
+                "1/%" PRId64 " s",
+                (NS_PER_SECOND + metadata.exposureNs / 2) / metadata.exposureNs
+            );
+        } else {
+            length = snprintf(
+                line,
+                LINE_LENGTH,
+                "%.1f s",
+                static_cast<double>(metadata.exposureNs) / NS_PER_SECOND
+            );
+        }
+        snprintf(line + length, LINE_LENGTH - length, " ISO %d", metadata.iso);
+    }
+
+    if (location_[0] != '\0') lines[count++] = location_;
+    return count;
+}
+
+int64_t FrameOverlay::getRealtimeOffsetNs() {
+    timespec realtime, monotonic;
+    clock_gettime(CLOCK_REALTIME, &realtime);
+    clock_gettime(CLOCK_MONOTONIC, &monotonic);
+    return toNs(realtime) - toNs(monotonic);
+}
+
+}  // namespace camera
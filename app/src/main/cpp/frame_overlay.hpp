@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace camera {
+
+/** What is known about a camera frame, from the image and its result. */
+struct FrameMetadata {
+    // Sensor timestamp, in CLOCK_MONOTONIC once handed to the renderer
+    int64_t timestampNs = 0;
+    // Preview captures completed since the session started, a still has
+    // the number of the preview frame before it
+    uint64_t frameNumber = 0;
+    // 0 without a capture result
+    int64_t exposureNs = 0;
+    int32_t iso = 0;
+};
+
+/**
+ * Formats the lines burned into every frame: the UTC time of the sensor
+ * timestamp to the millisecond with the frame number, the exposure, and
+ * the location when one is set. Lines go to fixed buffers, formatting
+ * doesn't allocate.
+ */
+class FrameOverlay {
+  public:
+    static constexpr size_t MAX_LINES = 3;
+    static constexpr size_t LINE_LENGTH = 64;
+    using Line = std::array<char, LINE_LENGTH>;
+    using Lines = std::array<Line, MAX_LINES>;
+
+    /** Free text, e.g. coordinates, cut to a line. Empty hides it. */
+    void setLocation(std::string_view text);
+
+    /**
+     * Write the lines of a frame, returns how many. realtimeOffsetNs is
+     * CLOCK_REALTIME minus CLOCK_MONOTONIC.
+     */
+    size_t format(
+        const FrameMetadata& metadata, int64_t realtimeOffsetNs, Lines& lines
+    ) const;
+
+    static int64_t getRealtimeOffsetNs();
+
+  private:
+    Line location_{};
+};
+
+}  // namespace camera
@@ -0,0 +1,44 @@
+#include "frame_pacer.hpp"
+
+#include <algorithm>
+
+namespace camera {
+
+FramePacer::FramePacer(int32_t frameRate, uint32_t maxRepeats)
+    : maxRepeats_(std::max(maxRepeats, 1u)) {
+    setFrameRate(frameRate);
+}
+
+void FramePacer::setFrameRate(int32_t frameRate) {
+    frameRate_ = std::max(frameRate, 0);
+    intervalNs_ = frameRate_ > 0 ? 1'000'000'000 / frameRate_ : 0;
+}
+
+void FramePacer::reset() { nextSlotNs_ = INT64_MIN; }
+
+FramePacer::Slots FramePacer::advance(int64_t timestampNs) {
+    if (intervalNs_ == 0) {
+        return {.count = 1, .firstTimeNs = timestampNs, .intervalNs = 0};
+    }
+    if (nextSlotNs_ == INT64_MIN) nextSlotNs_ = timestampNs;
+
+    // Half an interval of slack keeps a jittery camera at the output rate
+    // from alternating between drops and repeats
+    int64_t dueNs = timestampNs + intervalNs_ / 2;
+    if (dueNs < nextSlotNs_) {
+        return {.count = 0, .firstTimeNs = 0, .intervalNs = intervalNs_};
+    }
+    auto due = static_cast<uint64_t>((dueNs - nextSlotNs_) / intervalNs_ + 1);
+    // After a stall only the latest slots are filled, the others stay a gap
+    uint64_t count = std::min<uint64_t>(due, maxRepeats_);
+    int64_t firstTimeNs =
+        nextSlotNs_ + static_cast<int64_t>(due - count) * intervalNs_;
+    nextSlotNs_ += static_cast<int64_t>(due) * intervalNs_;
+    return {
+        .count = static_cast<uint32_t>(count),
+        .firstTimeNs = firstTimeNs,
+        .intervalNs = intervalNs_
+    };
+}
+
+}  // namespace camera
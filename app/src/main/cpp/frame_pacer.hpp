@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+
+namespace camera {
+
+/**
+ * Maps camera frames onto a fixed rate output grid by their sensor
+ * timestamps. A frame fills every grid slot that falls within half an
+ * interval after it, so the output drops frames when the camera is
+ * faster and repeats them when it's slower, the same way for the same
+ * timestamps.
+ */
+class FramePacer {
+  public:
+    struct Slots {
+        // 0 drops the frame, more than 1 repeats it
+        uint32_t count;
+        int64_t firstTimeNs;
+        int64_t intervalNs;
+    };
+
+    /** 0 fps passes every frame through once. */
+    explicit FramePacer(int32_t frameRate = 0, uint32_t maxRepeats = 1);
+
+    /** Keeps the grid going from the next slot on. */
+    void setFrameRate(int32_t frameRate);
+    /** The next frame starts a new grid. */
+    void reset();
+
+    Slots advance(int64_t timestampNs);
+
+    [[nodiscard]] int32_t getFrameRate() const { return frameRate_; }
+
+  private:
+    int32_t frameRate_ = 0;
+    int64_t intervalNs_ = 0;
+    uint32_t maxRepeats_;
+    int64_t nextSlotNs_ = INT64_MIN;
+};
+
+}  // namespace camera
@@ -0,0 +1,105 @@
+#include "frame_readback.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+namespace camera {
+
+namespace {
+
+int64_t nowUs() {
+    return std::chrono::steady_clock::now().time_since_epoch() /
+           std::chrono::microseconds(1);
+}
+
+}  // namespace
+
+FrameReadback::FrameReadback() : worker_(&FrameReadback::run, this) {}
+
+FrameReadback::~FrameReadback() {
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_one();
+    worker_.join();
+}
+
+int32_t FrameReadback::acquire() {
+    std::lock_guard lock(mutex_);
+    auto slot = std::find(busy_.begin(), busy_.end(), false);
+    if (slot == busy_.end()) {
+        ++framesSkipped_;
+        return -1;
+    }
+    *slot = true;
+    return static_cast<int32_t>(slot - busy_.begin());
+}
+
+void FrameReadback::submit(
+    uint32_t slot,
+    std::function<void()> waitForPixels,
+    const ReadbackFrame& frame,
+    Callback callback
+) {
+    {
+        std::lock_guard lock(mutex_);
+        jobs_.push_back({
+            .slot = slot,
+            .waitForPixels = std::move(waitForPixels),
+            .frame = frame,
+            .callback = std::move(callback),
+            .submitTimeUs = nowUs()
+        });
+    }
+    cv_.notify_one();
+}
+
+ReadbackStats FrameReadback::getStats() {
+    std::vector<int64_t> latencies;
+    ReadbackStats stats;
+    {
+        std::lock_guard lock(mutex_);
+        stats.framesRead = framesRead_;
+        stats.framesSkipped = framesSkipped_;
+        size_t count = std::min<uint64_t>(framesRead_, LATENCY_WINDOW);
+        latencies.assign(latenciesUs_.begin(), latenciesUs_.begin() + count);
+    }
+    if (latencies.empty()) return stats;
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](size_t percent) {
+        size_t index = (latencies.size() - 1) * percent / 100;
+        return static_cast<float>(latencies[index]) / 1000.0f;
+    };
+    stats.latencyP50Ms = percentile(50);
+    stats.latencyP95Ms = percentile(95);
+    stats.latencyMaxMs = percentile(100);
+    return stats;
+}
+
+void FrameReadback::run() {
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock lock(mutex_);
+            cv_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+            // Pending slots are drained, the GPU may still be writing them
+            if (jobs_.empty()) return;
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+
+        job.waitForPixels();
+        job.frame.latencyUs = nowUs() - job.submitTimeUs;
+        if (job.callback) job.callback(job.frame);
+
+        std::lock_guard lock(mutex_);
+        latenciesUs_[framesRead_ % LATENCY_WINDOW] = job.frame.latencyUs;
+        ++framesRead_;
+        busy_[job.slot] = false;
+    }
+}
+
+}  // namespace camera
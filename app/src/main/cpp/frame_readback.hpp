@@ -0,0 +1,93 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace camera {
+
+struct ReadbackFrame {
+    // Packed rows of 4 byte pixels, valid during the callback
+    const uint8_t* pixels = nullptr;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    bool bgra = false;
+    // Sensor timestamp of the camera frame in CLOCK_MONOTONIC
+    int64_t timestampNs = 0;
+    // From the submission to the pixels being readable
+    int64_t latencyUs = 0;
+};
+
+struct ReadbackStats {
+    uint64_t framesRead = 0;
+    // Frames selected while every slot was still in use
+    uint64_t framesSkipped = 0;
+    // Over the last LATENCY_WINDOW frames read
+    float latencyP50Ms = 0.0f;
+    float latencyP95Ms = 0.0f;
+    float latencyMaxMs = 0.0f;
+};
+
+/**
+ * Ring of slots the GPU copies composited frames back into. The render
+ * thread takes a free slot, records the copy into the frame's command
+ * buffer and submits the slot with a function waiting for its fence. A
+ * worker thread waits, hands the pixels to the callback and frees the
+ * slot, so the render thread never waits for a readback. A frame finding
+ * every slot in use is skipped.
+ */
+class FrameReadback {
+  public:
+    using Callback = std::function<void(const ReadbackFrame& frame)>;
+
+    static constexpr uint32_t SLOT_COUNT = 3;
+    static constexpr size_t LATENCY_WINDOW = 128;
+
+    FrameReadback();
+    ~FrameReadback();
+
+    FrameReadback(const FrameReadback&) = delete;
+    FrameReadback& operator=(const FrameReadback&) = delete;
+
+    /** A free slot to copy into, -1 when all are in use. */
+    int32_t acquire();
+    /**
+     * Hand over a slot the copy was submitted for. waitForPixels blocks
+     * until it is done, the frame points at the slot's pixels.
+     */
+    void submit(
+        uint32_t slot,
+        std::function<void()> waitForPixels,
+        const ReadbackFrame& frame,
+        Callback callback
+    );
+    ReadbackStats getStats();
+
+  private:
+    struct Job {
+        uint32_t slot = 0;
+        std::function<void()> waitForPixels;
+        ReadbackFrame frame;
+        Callback callback;
+        int64_t submitTimeUs = 0;
+    };
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Job> jobs_;
+    std::array<bool, SLOT_COUNT> busy_{};
+    bool stop_ = false;
+    uint64_t framesRead_ = 0;
+    uint64_t framesSkipped_ = 0;
+    // Ring of the latest latencies
+    std::array<int64_t, LATENCY_WINDOW> latenciesUs_{};
+    std::thread worker_;
+
+    void run();
+};
+
+}  // namespace camera
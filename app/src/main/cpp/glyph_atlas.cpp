@@ -0,0 +1,128 @@
+#include "glyph_atlas.hpp"
+
+#include <fstream>
+#include <iterator>
+
+#include "util.hpp"
+
+#define STB_TRUETYPE_IMPLEMENTATION
+#include <stb_truetype.h>
+
+using namespace camera::util;
+
+namespace camera {
+
+std::vector<uint8_t> GlyphAtlas::readFont(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return {};
+    return {
+        std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()
+    };
+}
+
+bool GlyphAtlas::build(const std::vector<uint8_t>& font, float pixelHeight) {
+    stbtt_fontinfo info;
+    int offset = stbtt_GetFontOffsetForIndex(font.data(), 0);
+    if (offset < 0 || !stbtt_InitFont(&info, font.data(), offset)) {
+        logE("Invalid font");
+        return false;
+    }
+    int ascent, descent, lineGap;
+    stbtt_GetFontVMetrics(&info, &ascent, &descent, &lineGap);
+    float scale = stbtt_ScaleForPixelHeight(&info, pixelHeight);
+
+    // The smallest square the glyphs fit in
+    std::array<stbtt_packedchar, GLYPH_COUNT> packed{};
+    for (uint32_t size = MIN_SIZE; size <= MAX_SIZE; size *= 2) {
+        pixels_.assign(size * size, 0);
+        stbtt_pack_context context;
+        if (!stbtt_PackBegin(
+                &context, pixels_.data(), size, size, 0, 1, nullptr
+            )) {
+            break;
+        }
+        bool fits = stbtt_PackFontRange(
+            &context,
+            font.data(),
+            0,
+            pixelHeight,
+            FIRST_CHAR,
+            GLYPH_COUNT,
+            packed.data()
+        );
+        stbtt_PackEnd(&context);
+        if (!fits) continue;
+
+        width_ = size;
+        height_ = size;
+        ascent_ = static_cast<float>(ascent) * scale;
+        lineHeight_ = static_cast<float>(ascent - descent + lineGap) * scale;
+        for (size_t i = 0; i < GLYPH_COUNT; ++i) {
+            const stbtt_packedchar& c = packed[i];
+            glyphs_[i] = {
+                .x0 = c.x0,
+                .y0 = c.y0,
+                .x1 = c.x1,
+                .y1 = c.y1,
+                .xOffset = c.xoff,
+                .yOffset = c.yoff,
+                .xOffset2 = c.xoff2,
+                .yOffset2 = c.yoff2,
+                .advance = c.xadvance
+            };
+        }
+        logI("Glyph atlas %ux%u for %.0f px glyphs", size, size, pixelHeight);
+        return true;
+    }
+
+    logE("Glyphs of %.0f px don't fit a %u px atlas", pixelHeight, MAX_SIZE);
+    pixels_.clear();
+    return false;
+}
+
+float GlyphAtlas::layout(
+    std::string_view text,
+    float x,
+    float y,
+    std::vector<GlyphQuad>& quads,
+    float scale
+) const {
+    float penX = x;
+    float baseline = y + ascent_ * scale;
+    auto width = static_cast<float>(width_);
+    auto height = static_cast<float>(height_);
+    for (char c : text) {
+        const Glyph* glyph = findGlyph(c);
+        if (!glyph) continue;
+        // Blank glyphs like the space only advance
+        if (glyph->x1 > glyph->x0) {
+            quads.push_back({
+                penX + glyph->xOffset * scale,
+                baseline + glyph->yOffset * scale,
+                penX + glyph->xOffset2 * scale,
+                baseline + glyph->yOffset2 * scale,
+                glyph->x0 / width,
+                glyph->y0 / height,
+                glyph->x1 / width,
+                glyph->y1 / height
+            });
+        }
+        penX += glyph->advance * scale;
+    }
+    return penX - x;
+}
+
+float GlyphAtlas::measure(std::string_view text, float scale) const {
+    float advance = 0.0f;
+    for (char c : text) {
+        if (const Glyph* glyph = findGlyph(c)) advance += glyph->advance;
+    }
+    return advance * scale;
+}
+
+const GlyphAtlas::Glyph* GlyphAtlas::findGlyph(char c) const {
+    if (isEmpty() || c < FIRST_CHAR || c > LAST_CHAR) return nullptr;
+    return &glyphs_[c - FIRST_CHAR];
+}
+
+}  // namespace camera
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace camera {
+
+/** A glyph placed on the canvas, in pixels, y down, and its atlas area. */
+struct GlyphQuad {
+    float x0, y0, x1, y1;
+    float u0, v0, u1, v1;
+};
+
+/**
+ * The printable ASCII glyphs of a TrueType font rasterized once into a
+ * single channel coverage atlas. Text is then laid out as quads sampling
+ * it, changing the text doesn't touch the atlas.
+ */
+class GlyphAtlas {
+  public:
+    static constexpr char FIRST_CHAR = ' ';
+    static constexpr char LAST_CHAR = '~';
+
+    /** Read a font file, empty if it can't be read. */
+    static std::vector<uint8_t> readFont(const std::string& path);
+
+    /** Rasterize the glyphs at pixelHeight, false if the font is invalid. */
+    bool build(const std::vector<uint8_t>& font, float pixelHeight);
+
+    /**
+     * Append the quads of a line with its top left corner at x, y, the
+     * glyphs scaled from their rasterized size. Other than printable ASCII
+     * characters are skipped. Returns the advance.
+     */
+    float layout(
+        std::string_view text,
+        float x,
+        float y,
+        std::vector<GlyphQuad>& quads,
+        float scale = 1.0f
+    ) const;
+    /** Width of the line laid out. */
+    [[nodiscard]] float measure(
+        std::string_view text, float scale = 1.0f
+    ) const;
+
+    [[nodiscard]] bool isEmpty() const { return pixels_.empty(); }
+    [[nodiscard]] const std::vector<uint8_t>& getPixels() const {
+        return pixels_;
+    }
+    [[nodiscard]] uint32_t getWidth() const { return width_; }
+    [[nodiscard]] uint32_t getHeight() const { return height_; }
+    [[nodiscard]] float getLineHeight() const { return lineHeight_; }
+
+  private:
+    static constexpr size_t GLYPH_COUNT = LAST_CHAR - FIRST_CHAR + 1;
+    static constexpr uint32_t MIN_SIZE = 256;
+    static constexpr uint32_t MAX_SIZE = 2048;
+
+    // Atlas area in pixels, and the bitmap offsets from the pen position
+    // on the baseline
+    struct Glyph {
+        uint16_t x0, y0, x1, y1;
+        float xOffset, yOffset, xOffset2, yOffset2;
+        float advance;
+    };
+
+    std::vector<uint8_t> pixels_;
+    uint32_t width_ = 0;
+    uint32_t height_ = 0;
+    float ascent_ = 0.0f;
+    float lineHeight_ = 0.0f;
+    std::array<Glyph, GLYPH_COUNT> glyphs_{};
+
+    [[nodiscard]] const Glyph* findGlyph(char c) const;
+};
+
+}  // namespace camera
@@ -0,0 +1,467 @@
+#include "hash_chain.hpp"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+
+namespace camera {
+
+namespace {
+
+constexpr uint8_t MAGIC[4] = {'W', 'M', 'H', 'C'};
+constexpr uint8_t LINK = 1;
+constexpr uint8_t PATCH = 2;
+constexpr size_t HEADER_SIZE = 60;
+constexpr size_t READ_SIZE = 1 << 20;
+
+template <size_t N>
+void storeLe(uint8_t* out, uint64_t value) {
+    for (size_t i = 0; i < N; ++i) {
+        out[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+template <size_t N>
+uint64_t loadLe(const uint8_t* in) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < N; ++i) {
+        value |= static_cast<uint64_t>(in[i]) << (8 * i);
+    }
+    return value;
+}
+
+template <size_t N>
+void appendLe(std::vector<uint8_t>& out, uint64_t value) {
+    out.resize(out.size() + N);
+    storeLe<N>(out.data() + out.size() - N, value);
+}
+
+void appendBytes(std::vector<uint8_t>& out, const uint8_t* data, size_t size) {
+    out.insert(out.end(), data, data + size);
+}
+
+Sha256Digest hashLinkEnd(Sha256& link, uint64_t end) {
+    uint8_t bytes[8];
+    storeLe<8>(bytes, end);
+    link.update(bytes, sizeof(bytes));
+    return link.finish();
+}
+
+Sha256Digest hashPatch(
+    const Sha256Digest& previous,
+    uint64_t offset,
+    const uint8_t* original,
+    const uint8_t* replacement,
+    size_t size
+) {
+    uint8_t fields[13];
+    fields[0] = PATCH;
+    storeLe<8>(fields + 1, offset);
+    storeLe<4>(fields + 9, size);
+    Sha256 sha;
+    sha.update(previous.data(), previous.size());
+    sha.update(fields, sizeof(fields));
+    sha.update(original, size);
+    sha.update(replacement, size);
+    return sha.finish();
+}
+
+struct FileCloser {
+    void operator()(FILE* file) const { fclose(file); }
+};
+
+using File = std::unique_ptr<FILE, FileCloser>;
+
+// Reads the records of a sidecar, failing on anything past its end
+class RecordReader {
+  public:
+    explicit RecordReader(const std::vector<uint8_t>& data) : data_(data) {}
+
+    [[nodiscard]] bool atEnd() const { return position_ == data_.size(); }
+
+    const uint8_t* take(size_t size) {
+        if (size > data_.size() - position_) return nullptr;
+        const uint8_t* bytes = data_.data() + position_;
+        position_ += size;
+        return bytes;
+    }
+
+    template <size_t N>
+    bool read(uint64_t& value) {
+        const uint8_t* bytes = take(N);
+        if (bytes == nullptr) return false;
+        value = loadLe<N>(bytes);
+        return true;
+    }
+
+  private:
+    const std::vector<uint8_t>& data_;
+    size_t position_ = 0;
+};
+
+struct Record {
+    uint8_t type = 0;
+    // End of a link, start of a patch
+    uint64_t offset = 0;
+    size_t size = 0;
+    const uint8_t* original = nullptr;
+    const uint8_t* replacement = nullptr;
+    Sha256Digest digest{};
+};
+
+bool readRecords(
+    const std::vector<uint8_t>& data,
+    HashChainHeader& header,
+    std::vector<Record>& records,
+    std::string& error
+) {
+    RecordReader reader(data);
+    const uint8_t* magic = reader.take(sizeof(MAGIC));
+    uint64_t version = 0;
+    if (magic == nullptr || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        !reader.read<4>(version)) {
+        error = "not a hash chain";
+        return false;
+    }
+    if (version != HASH_CHAIN_VERSION) {
+        error = "unsupported hash chain version " + std::to_string(version);
+        return false;
+    }
+    const uint8_t* id = reader.take(header.recordingId.size());
+    uint64_t segment = 0;
+    const uint8_t* previousHead = nullptr;
+    if (id == nullptr || !reader.read<4>(segment) ||
+        (previousHead = reader.take(header.previousHead.size())) == nullptr) {
+        error = "truncated hash chain";
+        return false;
+    }
+    std::copy_n(id, header.recordingId.size(), header.recordingId.begin());
+    header.segment = static_cast<uint32_t>(segment);
+    std::copy_n(
+        previousHead,
+        header.previousHead.size(),
+        header.previousHead.begin()
+    );
+
+    while (!reader.atEnd()) {
+        Record& record = records.emplace_back();
+        uint64_t type = 0;
+        bool valid = reader.read<1>(type) && reader.read<8>(record.offset);
+        record.type = static_cast<uint8_t>(type);
+        if (valid && record.type == PATCH) {
+            uint64_t size = 0;
+            valid = reader.read<4>(size);
+            record.size = size;
+            record.original = valid ? reader.take(record.size) : nullptr;
+            record.replacement = valid ? reader.take(record.size) : nullptr;
+            valid = record.replacement != nullptr;
+        } else if (valid && record.type != LINK) {
+            error = "unknown hash chain record";
+            return false;
+        }
+        const uint8_t* digest = valid ? reader.take(record.digest.size())
+                                      : nullptr;
+        if (digest == nullptr) {
+            error = "truncated hash chain";
+            return false;
+        }
+        std::copy_n(digest, record.digest.size(), record.digest.begin());
+    }
+    return true;
+}
+
+std::string formatRange(uint64_t begin, uint64_t end) {
+    return "bytes " + std::to_string(begin) + "-" + std::to_string(end);
+}
+
+}  // namespace
+
+Sha256Digest getHashChainSeed(const RecordingId& recordingId) {
+    Sha256 sha;
+    sha.update(MAGIC, sizeof(MAGIC));
+    sha.update(recordingId.data(), recordingId.size());
+    return sha.finish();
+}
+
+HashChainLinker::HashChainLinker(const RecordingId& recordingId)
+    : recordingId_(recordingId) {
+    std::promise<Sha256Digest> seed;
+    seed.set_value(getHashChainSeed(recordingId));
+    head_ = seed.get_future().share();
+}
+
+HashChainLink HashChainLinker::next(uint32_t segment) {
+    HashChainLink link{
+        .header = {.recordingId = recordingId_, .segment = segment},
+        .previousHead = head_,
+        .head = {}
+    };
+    head_ = link.head.get_future().share();
+    return link;
+}
+
+HashChain::HashChain(HashChainLink link)
+    : header_(link.header),
+      previousHead_(std::move(link.previousHead)),
+      headPromise_(std::move(link.head)) {}
+
+void HashChain::start() {
+    if (started_) return;
+    started_ = true;
+    if (previousHead_.valid()) {
+        try {
+            header_.previousHead = previousHead_.get();
+        } catch (const std::future_error&) {
+            // The previous segment failed before it saved its chain, this
+            // one keeps its own and won't verify as the next one
+            header_.previousHead = getHashChainSeed(header_.recordingId);
+        }
+    }
+    head_ = header_.previousHead;
+    startLink();
+}
+
+void HashChain::startLink() {
+    link_.update(head_.data(), head_.size());
+    link_.update(&LINK, 1);
+    linkStart_ = position_;
+}
+
+void HashChain::append(const void* data, size_t size) {
+    start();
+    link_.update(data, size);
+    position_ += size;
+}
+
+void HashChain::endLink() {
+    start();
+    if (position_ > linkStart_) {
+        head_ = hashLinkEnd(link_, position_);
+        records_.push_back(LINK);
+        appendLe<8>(records_, position_);
+        appendBytes(records_, head_.data(), head_.size());
+    } else if (pending_.empty()) {
+        return;
+    } else {
+        link_.reset();
+    }
+
+    for (const Patch& patch : pending_) {
+        size_t size = patch.original.size();
+        head_ = hashPatch(
+            head_,
+            patch.offset,
+            patch.original.data(),
+            patch.replacement.data(),
+            size
+        );
+        records_.push_back(PATCH);
+        appendLe<8>(records_, patch.offset);
+        appendLe<4>(records_, size);
+        appendBytes(records_, patch.original.data(), size);
+        appendBytes(records_, patch.replacement.data(), size);
+        appendBytes(records_, head_.data(), head_.size());
+    }
+    pending_.clear();
+    startLink();
+}
+
+void HashChain::addPatch(
+    uint64_t offset,
+    const uint8_t* original,
+    const uint8_t* replacement,
+    size_t size
+) {
+    pending_.push_back({
+        .offset = offset,
+        .original = {original, original + size},
+        .replacement = {replacement, replacement + size}
+    });
+}
+
+bool HashChain::save(const std::string& path) {
+    endLink();
+    // The next segment only needs the head, even if this sidecar is lost
+    headPromise_.set_value(head_);
+
+    std::vector<uint8_t> header;
+    header.reserve(HEADER_SIZE);
+    appendBytes(header, MAGIC, sizeof(MAGIC));
+    appendLe<4>(header, HASH_CHAIN_VERSION);
+    appendBytes(header, header_.recordingId.data(), header_.recordingId.size());
+    appendLe<4>(header, header_.segment);
+    const Sha256Digest& previousHead = header_.previousHead;
+    appendBytes(header, previousHead.data(), previousHead.size());
+
+    File file(fopen(path.c_str(), "wbe"));
+    if (!file) return false;
+    bool written =
+        fwrite(header.data(), 1, header.size(), file.get()) == header.size() &&
+        fwrite(records_.data(), 1, records_.size(), file.get()) ==
+            records_.size() &&
+        fflush(file.get()) == 0 && fdatasync(fileno(file.get())) == 0;
+    return fclose(file.release()) == 0 && written;
+}
+
+bool verifyHashChain(
+    const std::string& path,
+    const std::string& chainPath,
+    HashChainResult& result
+) {
+    result = {};
+    std::vector<uint8_t> chain;
+    File chainFile(fopen(chainPath.c_str(), "rbe"));
+    if (chainFile) {
+        uint8_t buffer[4096];
+        size_t size;
+        while ((size = fread(buffer, 1, sizeof(buffer), chainFile.get())) > 0) {
+            chain.insert(chain.end(), buffer, buffer + size);
+        }
+    }
+    if (!chainFile || ferror(chainFile.get())) {
+        result.error = chainPath + ": " + strerror(errno);
+        return false;
+    }
+    std::vector<Record> records;
+    if (!readRecords(chain, result.header, records, result.error)) {
+        return false;
+    }
+
+    // Bytes were hashed before they were patched, so the first patch of a
+    // byte has the value that went into its link, and the file has to
+    // hold the value of the last one
+    struct Patched {
+        uint8_t hashed;
+        uint8_t current;
+    };
+    std::map<uint64_t, Patched> patched;
+    for (const Record& record : records) {
+        if (record.type != PATCH) continue;
+        for (size_t i = 0; i < record.size; ++i) {
+            auto [it, added] = patched.try_emplace(
+                record.offset + i,
+                Patched{record.original[i], record.replacement[i]}
+            );
+            if (added) continue;
+            if (it->second.current != record.original[i]) {
+                result.error = "patches of " +
+                               formatRange(record.offset, record.offset +
+                                                              record.size) +
+                               " don't follow each other";
+                return false;
+            }
+            it->second.current = record.replacement[i];
+        }
+    }
+
+    File file(fopen(path.c_str(), "rbe"));
+    if (!file) {
+        result.error = path + ": " + strerror(errno);
+        return false;
+    }
+    // Later segments continue from the one before, checked by comparing
+    // their previousHead with its head
+    if (result.header.segment == 0 &&
+        result.header.previousHead !=
+            getHashChainSeed(result.header.recordingId)) {
+        result.error = "first segment doesn't start from its recording ID";
+        return false;
+    }
+    std::vector<uint8_t> buffer(READ_SIZE);
+    result.head = result.header.previousHead;
+    uint64_t position = 0;
+    for (const Record& record : records) {
+        Sha256Digest digest;
+        if (record.type == PATCH) {
+            digest = hashPatch(
+                result.head,
+                record.offset,
+                record.original,
+                record.replacement,
+                record.size
+            );
+            if (digest != record.digest) {
+                result.error = "patch of " +
+                               formatRange(record.offset, record.offset +
+                                                              record.size) +
+                               " was changed";
+                return false;
+            }
+            ++result.patches;
+        } else {
+            uint64_t begin = position;
+            if (record.offset <= begin) {
+                result.error = "links out of order at " +
+                               std::to_string(record.offset);
+                return false;
+            }
+            Sha256 link;
+            link.update(result.head.data(), result.head.size());
+            link.update(&LINK, 1);
+            while (position < record.offset) {
+                size_t size = std::min<uint64_t>(
+                    record.offset - position,
+                    buffer.size()
+                );
+                if (fread(buffer.data(), 1, size, file.get()) != size) {
+                    result.error = "file ends inside link " +
+                                   std::to_string(result.links) + ", " +
+                                   formatRange(begin, record.offset);
+                    return false;
+                }
+                for (auto it = patched.lower_bound(position);
+                     it != patched.end() && it->first < position + size;
+                     ++it) {
+                    uint8_t& byte = buffer[it->first - position];
+                    if (byte != it->second.current) {
+                        result.error = "patched byte at " +
+                                       std::to_string(it->first) +
+                                       " was changed";
+                        return false;
+                    }
+                    byte = it->second.hashed;
+                }
+                link.update(buffer.data(), size);
+                position += size;
+            }
+            digest = hashLinkEnd(link, record.offset);
+            if (digest != record.digest) {
+                result.error = "link " + std::to_string(result.links) +
+                               ", " + formatRange(begin, record.offset) +
+                               ", was changed";
+                return false;
+            }
+            ++result.links;
+        }
+        result.head = digest;
+    }
+
+    if (fgetc(file.get()) != EOF) {
+        result.error = "file continues after the last link at " +
+                       std::to_string(position);
+        return false;
+    }
+    if (!patched.empty() && patched.rbegin()->first >= position) {
+        result.error = "patch past the end of the file";
+        return false;
+    }
+    return true;
+}
+
+std::string toHex(const Sha256Digest& digest) {
+    static constexpr char DIGITS[] = "0123456789abcdef";
+    std::string hex;
+    hex.reserve(digest.size() * 2);
+    for (uint8_t byte : digest) {
+        hex += DIGITS[byte >> 4];
+        hex += DIGITS[byte & 15];
+    }
+    return hex;
+}
+
+}  // namespace camera
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "sha256.hpp"
+
+namespace camera {
+
+// Sidecar of a recording, next to it with this appended to its name
+constexpr auto HASH_CHAIN_SUFFIX = ".sha256chain";
+constexpr uint32_t HASH_CHAIN_VERSION = 2;
+
+using RecordingId = std::array<uint8_t, 16>;
+
+struct HashChainHeader {
+    // Random per recording, shared by its segments
+    RecordingId recordingId{};
+    uint32_t segment = 0;
+    // Head the chain continues from, the last one of the previous segment,
+    // for the first segment the seed of the recording ID
+    Sha256Digest previousHead{};
+};
+
+/** Head the first segment of a recording continues from. */
+Sha256Digest getHashChainSeed(const RecordingId& recordingId);
+
+/** Where the chain of one segment continues from and hands on to. */
+struct HashChainLink {
+    HashChainHeader header;
+    // Becomes the previousHead of the header
+    std::shared_future<Sha256Digest> previousHead;
+    // Gets the last head when the chain is saved
+    std::promise<Sha256Digest> head;
+};
+
+/**
+ * Links the segments of a recording, each chain continues from the last
+ * head of the one before. A segment's file is opened while the previous
+ * one is still being finished, so its chain waits for that head only when
+ * it hashes its first bytes.
+ */
+class HashChainLinker {
+  public:
+    explicit HashChainLinker(const RecordingId& recordingId);
+
+    /** The link of the next segment, called for the segments in order. */
+    HashChainLink next(uint32_t segment);
+
+  private:
+    RecordingId recordingId_;
+    std::shared_future<Sha256Digest> head_;
+};
+
+/**
+ * Tamper-evident SHA-256 chain over a file as it is written. Each link
+ * hashes the previous link together with the bytes since it, a GOP of a
+ * recording, so changing a byte breaks its link and every later one. The
+ * first link continues from the previous segment's head, which the header
+ * keeps, so a missing or reordered segment breaks the chain too.
+ *
+ * Bytes overwritten after they were hashed, like box sizes filled in at
+ * the end, get a patch link with their old and new values, chained after
+ * the link that is open when the patch arrives.
+ *
+ * The chain only proves the file matches the sidecar. To make a later
+ * rewrite of both evident, the head has to be kept somewhere else, it is
+ * logged when a file is closed.
+ */
+class HashChain {
+  public:
+    explicit HashChain(HashChainLink link);
+
+    /** Hash the next bytes of the file. */
+    void append(const void* data, size_t size);
+    /** Close the current link, nothing happens when it is empty. */
+    void endLink();
+    void addPatch(
+        uint64_t offset,
+        const uint8_t* original,
+        const uint8_t* replacement,
+        size_t size
+    );
+    /** End the last link and write the sidecar to path. */
+    bool save(const std::string& path);
+
+    [[nodiscard]] const Sha256Digest& getHead() const { return head_; }
+
+  private:
+    struct Patch {
+        uint64_t offset = 0;
+        std::vector<uint8_t> original;
+        std::vector<uint8_t> replacement;
+    };
+
+    HashChainHeader header_;
+    std::shared_future<Sha256Digest> previousHead_;
+    std::promise<Sha256Digest> headPromise_;
+    bool started_ = false;
+    Sha256Digest head_{};
+    Sha256 link_;
+    uint64_t position_ = 0;
+    uint64_t linkStart_ = 0;
+    // Patches arriving while a link is open are chained after it
+    std::vector<Patch> pending_;
+    // Sidecar records, written out by save()
+    std::vector<uint8_t> records_;
+
+    void start();
+    void startLink();
+};
+
+struct HashChainResult {
+    HashChainHeader header;
+    Sha256Digest head{};
+    uint32_t links = 0;
+    uint32_t patches = 0;
+    // What broke the chain, empty when the file matches it
+    std::string error;
+};
+
+/**
+ * Check the file at path against the sidecar at chainPath, reading the
+ * file once. The result holds the head to compare with the one logged when
+ * the file was written, or with the previousHead of the next segment. The
+ * first segment has to continue from the seed of its recording ID.
+ */
+bool verifyHashChain(
+    const std::string& path,
+    const std::string& chainPath,
+    HashChainResult& result
+);
+
+std::string toHex(const Sha256Digest& digest);
+
+}  // namespace camera
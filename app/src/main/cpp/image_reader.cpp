@@ -6,26 +6,14 @@ using namespace camera::util;
 
 namespace camera {
 
-void onImageAvailable(void* ctx, AImageReader* reader) {
-    reinterpret_cast<ImageReader*>(ctx)->imageCallback(reader);
-}
-
-ImageReader::ImageReader(int32_t width, int32_t height, AIMAGE_FORMATS format)
+ImageReader::ImageReader(
+    int32_t width, int32_t height, AIMAGE_FORMATS format, uint64_t usage
+)
     : reader_(nullptr) {
     media_status_t status = AImageReader_newWithUsage(
-        width,
-        height,
-        format,
-        AHARDWAREBUFFER_USAGE_GPU_SAMPLED_IMAGE,
-        MAX_BUF_COUNT,
-        &reader_
+        width, height, format, usage, MAX_BUF_COUNT, &reader_
     );
     logAssert(reader_ && status == AMEDIA_OK, "failed to create ImageReader");
-
-    AImageReader_ImageListener listener{
-        .context = this, .onImageAvailable = onImageAvailable
-    };
-    AImageReader_setImageListener(reader_, &listener);
 }
 
 ImageReader::~ImageReader() {
@@ -33,19 +21,6 @@ ImageReader::~ImageReader() {
     AImageReader_delete(reader_);
 }
 
-void ImageReader::imageCallback(AImageReader* reader) {
-    int32_t format;
-    media_status_t status = AImageReader_getFormat(reader, &format);
-    logAssert(status == AMEDIA_OK, "failed to get the media format");
-    if (format == AIMAGE_FORMAT_YUV_420_888) {
-        // TODO: add logic
-        logI(
-            "ImageReader::imageCallback called for AIMAGE_FORMAT_YUV_420_888 "
-            "format"
-        );
-    }
-}
-
 ANativeWindow* ImageReader::getNativeWindow() {
     logAssert(reader_, "reader_ is null");
     ANativeWindow* nativeWindow;
@@ -72,4 +47,33 @@ void ImageReader::deleteImage(AImage* image) {
     if (image) AImage_delete(image);
 }
 
+bool ImageReader::getYuvPlanes(AImage* image, YuvPlanes& planes) {
+    int32_t format;
+    if (AImage_getFormat(image, &format) != AMEDIA_OK ||
+        format != AIMAGE_FORMAT_YUV_420_888) {
+        return false;
+    }
+
+    uint8_t* data[3];
+    int32_t length;
+    for (int32_t plane = 0; plane < 3; ++plane) {
+        if (AImage_getPlaneData(image, plane, &data[plane], &length) !=
+            AMEDIA_OK) {
+            logE("Can't get data of plane %d, is CPU read usage set?", plane);
+            return false;
+        }
+    }
+
+    planes.y = data[0];
+    planes.u = data[1];
+    planes.v = data[2];
+    AImage_getWidth(image, &planes.width);
+    AImage_getHeight(image, &planes.height);
+    AImage_getPlaneRowStride(image, 0, &planes.yRowStride);
+    // U and V planes share the row and pixel strides
+    AImage_getPlaneRowStride(image, 1, &planes.uvRowStride);
+    AImage_getPlanePixelStride(image, 1, &planes.uvPixelStride);
+    return true;
+}
+
 }  // namespace camera
@@ -4,14 +4,26 @@
 
 #include <cstdint>
 
+#include "yuv_convert.hpp"
+
 namespace camera {
 
+/**
+ * Queue of images a producer such as the camera streams into. There is no
+ * image listener, the render loop polls for images, so frames are handled
+ * and released on the thread that draws them. YUV frames are converted
+ * there too, on the GPU by the YCbCr sampler or by CpuRenderer.
+ */
 class ImageReader {
   public:
-    ImageReader(int32_t width, int32_t height, AIMAGE_FORMATS format);
+    ImageReader(
+        int32_t width,
+        int32_t height,
+        AIMAGE_FORMATS format,
+        uint64_t usage = AHARDWAREBUFFER_USAGE_GPU_SAMPLED_IMAGE
+    );
     ~ImageReader();
 
-    friend void onImageAvailable(void* ctx, AImageReader* reader);
     ANativeWindow* getNativeWindow();
 
     /**
@@ -27,14 +39,19 @@ class ImageReader {
 
     void deleteImage(AImage* image);
 
+    /**
+     * Fill the plane view of an AIMAGE_FORMAT_YUV_420_888 image, the reader
+     * has to be created with one of the AHARDWAREBUFFER_USAGE_CPU_READ_*
+     * usages. The view is valid until the image is deleted.
+     */
+    static bool getYuvPlanes(AImage* image, YuvPlanes& planes);
+
   private:
     static constexpr const char* DIR_NAME = "/sdcard/DCIM/Camera/";
     static constexpr const char* FILE_NAME = "capture";
     static constexpr int32_t MAX_BUF_COUNT = 2;
 
     AImageReader* reader_;
-
-    void imageCallback(AImageReader* reader);
 };
 
 }  // namespace camera
@@ -0,0 +1,86 @@
+#include "jpeg_writer.hpp"
+
+#include <utility>
+
+#include "util.hpp"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+using namespace camera::util;
+
+namespace camera {
+
+JpegWriter::JpegWriter() : worker_(&JpegWriter::run, this) {}
+
+JpegWriter::~JpegWriter() {
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_one();
+    worker_.join();
+}
+
+void JpegWriter::submit(Job job) {
+    {
+        std::lock_guard lock(mutex_);
+        jobs_.push_back(std::move(job));
+    }
+    cv_.notify_one();
+}
+
+void JpegWriter::run() {
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock lock(mutex_);
+            cv_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+            // Drain pending jobs before stopping, the pixels they reference
+            // are owned by the submitter until onDone is called
+            if (jobs_.empty()) return;
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+
+        if (job.waitForPixels) job.waitForPixels();
+        bool success = encode(job);
+        if (job.onDone) job.onDone(success);
+    }
+}
+
+bool JpegWriter::encode(Job& job) {
+    if (!job.pixels || job.width == 0 || job.height == 0) return false;
+
+    if (job.bgra) {
+        size_t pixelCount = static_cast<size_t>(job.width) * job.height;
+        uint8_t* p = job.pixels;
+        for (size_t i = 0; i < pixelCount; ++i, p += 4) {
+            std::swap(p[0], p[2]);
+        }
+    }
+
+    // stb ignores the alpha channel when writing 4 component images
+    int result = stbi_write_jpg(
+        job.path.c_str(),
+        static_cast<int>(job.width),
+        static_cast<int>(job.height),
+        4,
+        job.pixels,
+        job.quality
+    );
+    if (!result) {
+        logE("Failed to write jpeg to %s", job.path.c_str());
+        return false;
+    }
+
+    logI(
+        "Still image %ux%u saved to %s",
+        job.width,
+        job.height,
+        job.path.c_str()
+    );
+    return true;
+}
+
+}  // namespace camera
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace camera {
+
+/**
+ * Encodes RGBA/BGRA pixel buffers to JPEG files on a dedicated worker thread
+ * so the render thread never waits for the encoder or the file system.
+ */
+class JpegWriter {
+  public:
+    struct Job {
+        // Blocks until the pixels are ready to be read, e.g. waits a fence.
+        std::function<void()> waitForPixels;
+        uint8_t* pixels = nullptr;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        // Pixels are swizzled to RGBA in place when the source is BGRA.
+        bool bgra = false;
+        int quality = 95;
+        std::string path;
+        // Called on the worker thread once the pixels are no longer used.
+        std::function<void(bool success)> onDone;
+    };
+
+    JpegWriter();
+    ~JpegWriter();
+
+    JpegWriter(const JpegWriter&) = delete;
+    JpegWriter& operator=(const JpegWriter&) = delete;
+
+    void submit(Job job);
+
+  private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Job> jobs_;
+    bool stop_ = false;
+    std::thread worker_;
+
+    void run();
+    static bool encode(Job& job);
+};
+
+}  // namespace camera
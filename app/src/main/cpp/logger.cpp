@@ -0,0 +1,109 @@
+#include "logger.hpp"
+
+#include <chrono>
+
+namespace camera::util {
+
+AsyncLogger& AsyncLogger::get() {
+    // Started on first use, so the library has no global constructor
+    static AsyncLogger logger;
+    return logger;
+}
+
+AsyncLogger::AsyncLogger() {
+    for (size_t i = 0; i < CAPACITY; ++i) {
+        ring_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    flusher_ = std::thread(&AsyncLogger::flush, this);
+}
+
+AsyncLogger::~AsyncLogger() {
+    stop_ = true;
+    published_.fetch_add(1, std::memory_order_release);
+    published_.notify_one();
+    flusher_.join();
+}
+
+bool AsyncLogger::allow(const char* format, uint32_t& suppressed) {
+    size_t hash = reinterpret_cast<uintptr_t>(format) >> 3;
+    CallSite* site = nullptr;
+    for (size_t i = 0; i < callSites_.size(); ++i) {
+        CallSite& candidate = callSites_[(hash + i) % callSites_.size()];
+        const char* owner = candidate.format.load(std::memory_order_acquire);
+        if (owner == nullptr) {
+            // Leaves owner null if the slot was taken by this call
+            candidate.format.compare_exchange_strong(owner, format);
+        }
+        if (owner == nullptr || owner == format) {
+            site = &candidate;
+            break;
+        }
+    }
+    // Out of call site slots, don't limit rather than lose messages
+    if (!site) return true;
+
+    int64_t now = std::chrono::steady_clock::now().time_since_epoch() /
+                  std::chrono::nanoseconds(1);
+    int64_t next = site->nextNs.load(std::memory_order_relaxed);
+    if (now < next ||
+        !site->nextNs.compare_exchange_strong(next, now + RATE_LIMIT_NS)) {
+        site->suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    suppressed = site->suppressed.exchange(0, std::memory_order_relaxed);
+    return true;
+}
+
+AsyncLogger::Slot* AsyncLogger::claim() {
+    // Bounded MPMC queue by D. Vyukov, reduced to a single consumer
+    size_t pos = head_.load(std::memory_order_relaxed);
+    for (;;) {
+        Slot& slot = ring_[pos % CAPACITY];
+        size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<intptr_t>(sequence - pos);
+        if (diff == 0) {
+            if (head_.compare_exchange_weak(
+                    pos, pos + 1, std::memory_order_relaxed
+                )) {
+                return &slot;
+            }
+        } else if (diff < 0) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        } else {
+            pos = head_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void AsyncLogger::publish(Slot* slot) {
+    size_t pos = slot->sequence.load(std::memory_order_relaxed);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    published_.fetch_add(1, std::memory_order_release);
+    published_.notify_one();
+}
+
+void AsyncLogger::flush() {
+    for (;;) {
+        uint32_t published = published_.load(std::memory_order_acquire);
+
+        Slot& slot = ring_[tail_ % CAPACITY];
+        if (slot.sequence.load(std::memory_order_acquire) == tail_ + 1) {
+            __android_log_write(slot.priority, TAG, slot.text);
+            slot.sequence.store(tail_ + CAPACITY, std::memory_order_release);
+            ++tail_;
+            continue;
+        }
+
+        if (uint32_t dropped = dropped_.exchange(0)) {
+            __android_log_print(
+                ANDROID_LOG_WARN, TAG, "%u log messages dropped", dropped
+            );
+        }
+        // Drained, or the next slot is claimed but not yet written
+        if (stop_ && head_.load() == tail_) return;
+        published_.wait(published, std::memory_order_acquire);
+    }
+}
+
+}  // namespace camera::util
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <android/log.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <source_location>
+#include <string_view>
+#include <thread>
+
+// Lowest android_LogPriority compiled in, everything below costs nothing
+#ifndef CAMERA_LOG_LEVEL
+#ifdef NDEBUG
+#define CAMERA_LOG_LEVEL ANDROID_LOG_WARN
+#else
+#define CAMERA_LOG_LEVEL ANDROID_LOG_INFO
+#endif
+#endif
+
+namespace camera::util {
+
+constexpr auto TAG = "VkWatCam";
+
+constexpr int LOG_LEVEL = CAMERA_LOG_LEVEL;
+
+/**
+ * Hands log messages to logd from a background thread. Producers format
+ * into a bounded lock-free ring and never wait, a full ring drops the
+ * message and counts it. Every call site (keyed by its format string) is
+ * limited to one message per RATE_LIMIT_NS, the suppressed ones are
+ * counted and reported with the next message that gets through.
+ */
+class AsyncLogger {
+  public:
+    static constexpr size_t CAPACITY = 128;
+    static constexpr size_t MAX_MESSAGE = 240;
+    static constexpr int64_t RATE_LIMIT_NS = 1'000'000'000;
+
+    static AsyncLogger& get();
+
+    ~AsyncLogger();
+
+    template <typename... Args>
+    void log(int priority, const char* format, Args... args) {
+        uint32_t suppressed = 0;
+        if (!allow(format, suppressed)) return;
+
+        Slot* slot = claim();
+        if (!slot) return;
+        int length;
+        if constexpr (sizeof...(Args) == 0) {
+            length = snprintf(slot->text, MAX_MESSAGE, "%s", format);
+        } else {
+            length = snprintf(slot->text, MAX_MESSAGE, format, args...);
+        }
+        if (suppressed && length >= 0 && size_t(length) < MAX_MESSAGE) {
+            snprintf(
+                slot->text + length,
+                MAX_MESSAGE - length,
+                " (%u suppressed)",
+                suppressed
+            );
+        }
+        slot->priority = priority;
+        publish(slot);
+    }
+
+  private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        int priority;
+        char text[MAX_MESSAGE];
+    };
+
+    struct CallSite {
+        std::atomic<const char*> format = nullptr;
+        std::atomic<int64_t> nextNs = 0;
+        std::atomic<uint32_t> suppressed = 0;
+    };
+
+    std::array<Slot, CAPACITY> ring_;
+    alignas(64) std::atomic<size_t> head_ = 0;
+    alignas(64) size_t tail_ = 0;
+    // Bumped on every publish, the flusher thread waits on it
+    std::atomic<uint32_t> published_ = 0;
+    std::atomic<uint32_t> dropped_ = 0;
+    std::atomic_bool stop_ = false;
+    std::array<CallSite, 64> callSites_;
+    std::thread flusher_;
+
+    AsyncLogger();
+
+    bool allow(const char* format, uint32_t& suppressed);
+    Slot* claim();
+    void publish(Slot* slot);
+    void flush();
+};
+
+inline void logI(const char* text) {
+    if constexpr (ANDROID_LOG_INFO >= LOG_LEVEL) {
+        __android_log_write(ANDROID_LOG_INFO, TAG, text);
+    }
+}
+
+template <typename... Args>
+inline void logI(Args&&... args) {
+    if constexpr (ANDROID_LOG_INFO >= LOG_LEVEL) {
+        __android_log_print(ANDROID_LOG_INFO, TAG, args...);
+    }
+}
+
+inline void logW(const char* text) {
+    if constexpr (ANDROID_LOG_WARN >= LOG_LEVEL) {
+        __android_log_write(ANDROID_LOG_WARN, TAG, text);
+    }
+}
+
+template <typename... Args>
+inline void logW(Args&&... args) {
+    if constexpr (ANDROID_LOG_WARN >= LOG_LEVEL) {
+        __android_log_print(ANDROID_LOG_WARN, TAG, args...);
+    }
+}
+
+inline void logE(const char* text) {
+    if constexpr (ANDROID_LOG_ERROR >= LOG_LEVEL) {
+        __android_log_write(ANDROID_LOG_ERROR, TAG, text);
+    }
+}
+
+template <typename... Args>
+inline void logE(Args&&... args) {
+    if constexpr (ANDROID_LOG_ERROR >= LOG_LEVEL) {
+        __android_log_print(ANDROID_LOG_ERROR, TAG, args...);
+    }
+}
+
+// Rate limited variants for hot paths and callbacks, never block on logd
+template <typename... Args>
+inline void logAsyncI(const char* format, Args... args) {
+    if constexpr (ANDROID_LOG_INFO >= LOG_LEVEL) {
+        AsyncLogger::get().log(ANDROID_LOG_INFO, format, args...);
+    }
+}
+
+template <typename... Args>
+inline void logAsyncW(const char* format, Args... args) {
+    if constexpr (ANDROID_LOG_WARN >= LOG_LEVEL) {
+        AsyncLogger::get().log(ANDROID_LOG_WARN, format, args...);
+    }
+}
+
+template <typename... Args>
+inline void logAsyncE(const char* format, Args... args) {
+    if constexpr (ANDROID_LOG_ERROR >= LOG_LEVEL) {
+        AsyncLogger::get().log(ANDROID_LOG_ERROR, format, args...);
+    }
+}
+
+template <typename T>
+inline void logAssert(
+    T&& assertion,
+    const std::string_view msg = {},
+    std::source_location location = std::source_location::current()
+) {
+    if (!assertion) {
+        __android_log_assert(
+            nullptr,
+            camera::util::TAG,
+            "%s::%s(%i): *** assertion failed: %s",
+            location.file_name(),
+            location.function_name(),
+            location.line(),
+            msg.data()
+        );
+    }
+}
+
+}  // namespace camera::util
@@ -4,8 +4,21 @@
 #include <game-activity/native_app_glue/android_native_app_glue.h>
 #include <jni.h>
 
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include "camera_manager.hpp"
+#include "cpu_renderer.hpp"
 #include "image_reader.hpp"
+#include "recorder.hpp"
+#include "recording_thumbnail.hpp"
+#include "thermal_governor.hpp"
 #include "util.hpp"
 #include "vulkan_renderer.hpp"
 
@@ -15,12 +28,48 @@ using namespace camera::util;
 struct AppState {
     android_app* androidApp = nullptr;
     VkRenderer* vkRenderer = nullptr;
+    // Set instead of an initialized vkRenderer when Vulkan can't be used
+    CpuRenderer* cpuRenderer = nullptr;
     CameraManager* camMgr = nullptr;
     bool canRender = false;
 };
 
 VkRenderer* vkApp;
+CpuRenderer* cpuApp = nullptr;
 ImageReader* watReader;
+CameraManager* camMgr;
+Recorder* recorder;
+RecordingThumbnail* thumbnail;
+// Next to the recording, saved when it stops
+std::string thumbnailPath;
+
+// Set from the UI thread, handled on the render thread
+std::atomic_bool recordingToggleRequested = false;
+// When the toggle was pressed, in CLOCK_MONOTONIC
+std::atomic<int64_t> recordingToggleTimeUs = 0;
+std::atomic_bool takePictureRequested = false;
+std::mutex pendingMutex;
+std::optional<std::string> pendingWatermarkText;
+std::optional<std::string> pendingLocationText;
+std::optional<std::vector<WatermarkLayer>> pendingWatermarkLayers;
+struct ForensicSettings {
+    bool enabled;
+    uint32_t key;
+    uint32_t deviceId;
+};
+std::optional<ForensicSettings> pendingForensicSettings;
+
+constexpr auto MEDIA_DIR = "/sdcard/DCIM/Camera/";
+// Drawn over the top right corner of the watermark when the asset exists
+constexpr auto WATERMARK_ANIMATION = "textures/watermark_animation.gif";
+constexpr LayerRect WATERMARK_ANIMATION_RECT{0.75f, 0.02f, 0.98f, 0.15f};
+constexpr auto STATS_INTERVAL = std::chrono::seconds(1);
+// Preview frames read back for the recording thumbnail, at a quarter of
+// the size twice a second
+constexpr uint32_t THUMBNAIL_INTERVAL = 15;
+constexpr float THUMBNAIL_SCALE = 0.25f;
+// Down to a few pixels across, the luma meter reads the smallest level
+constexpr uint32_t PYRAMID_LEVELS = 8;
 
 /**
  * Called by the Android runtime whenever events happen so the
@@ -41,12 +90,20 @@ static void handleAppCommand(android_app* app, int32_t cmd) {
                 appState->camMgr->startPreview(true);
 
                 logI("Setting a new surface");
-                appState->vkRenderer->reset(
-                    app->window, app->activity->assetManager
-                );
-                if (!appState->vkRenderer->initialized) {
+                if (appState->cpuRenderer) {
+                    appState->cpuRenderer->setWindow(app->window);
+                } else {
+                    appState->vkRenderer->reset(
+                        app->window, app->activity->assetManager
+                    );
+                }
+                if (!appState->cpuRenderer &&
+                    !appState->vkRenderer->initialized) {
                     logI("Starting application");
                     appState->vkRenderer->init();
+                    appState->vkRenderer->loadWatermarkAnimation(
+                        WATERMARK_ANIMATION, WATERMARK_ANIMATION_RECT
+                    );
                 }
                 appState->canRender = true;
             }
@@ -56,6 +113,9 @@ static void handleAppCommand(android_app* app, int32_t cmd) {
             logI("Called - APP_CMD_TERM_WINDOW");
             // todo: terminate camera, this call probably do this termination
             appState->camMgr->startPreview(false);
+            if (appState->cpuRenderer) {
+                appState->cpuRenderer->setWindow(nullptr);
+            }
             appState->canRender = false;
             break;
         case APP_CMD_DESTROY:
@@ -67,8 +127,26 @@ static void handleAppCommand(android_app* app, int32_t cmd) {
     }
 }
 
+// Fallback path, the camera frames are read on the CPU
+void drawCpuFrame(AImage* image, bool isCam) {
+    if (isCam) {
+        YuvPlanes planes;
+        if (ImageReader::getYuvPlanes(image, planes)) cpuApp->drawFrame(planes);
+    } else {
+        AHardwareBuffer* hwBuffer;
+        if (AImage_getHardwareBuffer(image, &hwBuffer) == AMEDIA_OK) {
+            cpuApp->setWatermark(hwBuffer);
+        }
+    }
+    AImage_delete(image);
+}
+
 void drawFrame(AImage* image, bool isCam) {
     if (!image) return;
+    if (cpuApp) {
+        drawCpuFrame(image, isCam);
+        return;
+    }
 
     // logI("Next image acquired");
 
@@ -76,7 +154,7 @@ void drawFrame(AImage* image, bool isCam) {
     media_status_t status = AImage_getHardwareBuffer(image, &hwBuffer);
 
     if (status != AMEDIA_OK) {
-        logE("Can't acquire hw buffer");
+        logAsyncE("Can't acquire hw buffer");
         AImage_delete(image);
         return;
     }
@@ -85,7 +163,11 @@ void drawFrame(AImage* image, bool isCam) {
     // logI("Buffer %p acquired by vk renderer", hwBuffer);
 
     if (isCam) {
-        vkApp->camHwBufferToTexture(hwBuffer);
+        int64_t timestampNs = 0;
+        AImage_getTimestamp(image, &timestampNs);
+        vkApp->camHwBufferToTexture(
+            hwBuffer, camMgr->getFrameMetadata(timestampNs)
+        );
     } else {
         vkApp->watHwBufferToTexture(hwBuffer);
     }
@@ -94,22 +176,266 @@ void drawFrame(AImage* image, bool isCam) {
     AImage_delete(image);
 }
 
+std::string makeMediaPath(const char* prefix, const char* extension) {
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now);
+    return std::string(MEDIA_DIR) + prefix + std::to_string(ms.count()) +
+           extension;
+}
+
+void captureStill(AImage* image) {
+    if (!image) return;
+
+    AHardwareBuffer* hwBuffer;
+    media_status_t status = AImage_getHardwareBuffer(image, &hwBuffer);
+
+    if (status != AMEDIA_OK) {
+        logE("Can't acquire still hw buffer");
+        AImage_delete(image);
+        return;
+    }
+
+    AHardwareBuffer_acquire(hwBuffer);
+    int64_t timestampNs = 0;
+    AImage_getTimestamp(image, &timestampNs);
+    // Held until the GPU is done sampling it, the reader would hand the
+    // buffer back to the camera otherwise
+    vkApp->stillHwBufferToJpeg(
+        hwBuffer,
+        camMgr->getFrameMetadata(timestampNs),
+        makeMediaPath("IMG_", ".jpg"),
+        [image, hwBuffer]() {
+            AHardwareBuffer_release(hwBuffer);
+            AImage_delete(image);
+        }
+    );
+}
+
+void startRendererRecording() {
+    if (cpuApp) {
+        cpuApp->startRecording(&recorder->getVideoEncoder());
+    } else {
+        vkApp->startRecording(&recorder->getVideoEncoder());
+    }
+}
+
+void stopRendererRecording() {
+    if (cpuApp) {
+        cpuApp->stopRecording();
+    } else {
+        vkApp->stopRecording();
+    }
+}
+
+// The next recording is prepared as soon as the renderer can feed the
+// encoder, so starting it takes no setup
+void prepareRecording() {
+    if (!cpuApp && !vkApp->initialized) return;
+    if (recorder->getState() != RecorderState::IDLE) return;
+    bool encoding = recorder->isEncoding();
+    if (!recorder->prepareRecording()) return;
+    if (!encoding) startRendererRecording();
+}
+
+void startRecording() {
+    // Named after the start, the file is created then too
+    std::string name = makeMediaPath("VID_", "");
+    if (!recorder->startRecording(recordingToggleTimeUs, name + ".mp4")) {
+        logW("Recording is not prepared");
+        return;
+    }
+    thumbnailPath = name + ".jpg";
+    thumbnail->start();
+}
+
+void stopRecording() {
+    // Without pre-roll the encoding stops too, the renderer lets go of the
+    // input surface before the end of stream
+    if (!recorder->hasPreroll()) stopRendererRecording();
+    recorder->stopRecording();
+    // None in the CPU fallback, nothing is read back there
+    thumbnail->save(thumbnailPath);
+}
+
+template <typename T>
+std::optional<T> takePending(std::optional<T>& pending) {
+    std::lock_guard lock(pendingMutex);
+    return std::exchange(pending, std::nullopt);
+}
+
+void logEncoderStats() {
+    static auto lastLog = std::chrono::steady_clock::now();
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastLog < STATS_INTERVAL) return;
+    lastLog = now;
+
+    EncoderStats stats = recorder->getVideoEncoder().getStats();
+    logI(
+        "Encoder queue %u, latency avg %.1f ms, max %.1f ms, %llu frames",
+        stats.queueDepth,
+        stats.averageLatencyMs,
+        stats.maxLatencyMs,
+        (unsigned long long)stats.framesEncoded
+    );
+}
+
+void logReadbackStats() {
+    static auto lastLog = std::chrono::steady_clock::now();
+    static uint64_t lastFramesRead = 0;
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastLog < STATS_INTERVAL) return;
+    lastLog = now;
+
+    ReadbackStats stats = vkApp->getReadbackStats();
+    if (stats.framesRead == lastFramesRead) return;
+    lastFramesRead = stats.framesRead;
+    logI(
+        "Readback latency p50 %.1f ms, p95 %.1f ms, max %.1f ms, "
+        "%llu frames, %llu skipped",
+        stats.latencyP50Ms,
+        stats.latencyP95Ms,
+        stats.latencyMaxMs,
+        (unsigned long long)stats.framesRead,
+        (unsigned long long)stats.framesSkipped
+    );
+}
+
+void logWatermarkStats() {
+    static auto lastLog = std::chrono::steady_clock::now();
+    static WatermarkStats lastStats;
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastLog < STATS_INTERVAL) return;
+    lastLog = now;
+
+    WatermarkStats stats = vkApp->getWatermarkStats();
+    auto countFrames = [](const WatermarkStats& s) {
+        return s.framesImported + s.framesUpdated + s.framesSkipped;
+    };
+    uint64_t frames = countFrames(stats);
+    if (frames == countFrames(lastStats)) return;
+    lastStats = stats;
+    logI(
+        "Watermark %llu frames imported, %llu updated, %llu repeats "
+        "skipped, %llu KiB uploaded, hash avg %.2f ms, %u/%u tiles "
+        "covered, %llu layer fragments",
+        (unsigned long long)stats.framesImported,
+        (unsigned long long)stats.framesUpdated,
+        (unsigned long long)stats.framesSkipped,
+        (unsigned long long)(stats.bytesUploaded / 1024),
+        static_cast<float>(stats.hashTimeUs) / 1000.0f /
+            static_cast<float>(frames),
+        stats.tilesCovered,
+        stats.tileCount,
+        (unsigned long long)stats.layerFragments
+    );
+}
+
+// From the full quality down, the cheapest steps first and the capture
+// frame rate last
+std::vector<QualityLevel> makeQualityLadder(const VideoEncoderConfig& video) {
+    int32_t bitrate = video.bitrate;
+    int32_t fps = video.frameRate;
+    return {
+        {2, 1.0f, bitrate, fps, 0},
+        {1, 1.0f, bitrate, fps, 0},
+        {1, 0.75f, bitrate, fps, 0},
+        {1, 0.75f, bitrate * 3 / 5, fps, fps * 4 / 5},
+        {1, 0.5f, bitrate * 2 / 5, fps * 4 / 5, fps * 2 / 3},
+        {1, 0.5f, bitrate * 2 / 5, fps / 2, fps / 3}
+    };
+}
+
+void applyQualityLevel(const QualityLevel& level) {
+    vkApp->setFramesInFlight(level.framesInFlight);
+    vkApp->setPreviewScale(level.previewScale);
+    recorder->setVideoBitrate(level.bitrate);
+    camMgr->setFrameRate(level.frameRate);
+    vkApp->setMediaFrameRate(level.frameRate);
+    vkApp->setPreviewFrameRate(level.previewFrameRate);
+}
+
 // Android main entry point required by the Android Glue library
 [[maybe_unused]] void android_main(struct android_app* app) {
     logI("Called android_main");
 
     AppState appState;
 
+    // Outlives the renderer, whose readback worker feeds it
+    RecordingThumbnail recordingThumbnail;
+    thumbnail = &recordingThumbnail;
     VkRenderer vulkanApplication;
     vkApp = &vulkanApplication;
+    // Without the YCbCr conversion the GPU can't sample the camera frames,
+    // they are composited on the CPU then
+    std::optional<CpuRenderer> cpuRenderer;
+    uint64_t cameraUsage = AHARDWAREBUFFER_USAGE_GPU_SAMPLED_IMAGE;
+    if (!VkRenderer::supportsYcbcrConversion()) {
+        logW("No YCbCr conversion, falling back to the CPU renderer");
+        cpuRenderer.emplace();
+        cpuApp = &*cpuRenderer;
+        cameraUsage |= AHARDWAREBUFFER_USAGE_CPU_READ_OFTEN;
+    } else {
+        // The luma meter keeps dark frames from becoming the thumbnail
+        vulkanApplication.setPyramidLevels(PYRAMID_LEVELS);
+        vulkanApplication.setLumaMeter(true);
+        vulkanApplication.setFrameReadback(
+            [](const ReadbackFrame& frame) {
+                thumbnail->onFrame(frame, vkApp->getSceneLuma());
+            },
+            THUMBNAIL_INTERVAL,
+            THUMBNAIL_SCALE
+        );
+    }
 
-    ImageReader cameraReader(1920, 1080, AIMAGE_FORMAT_YUV_420_888);
-    ImageReader watermarkReader(1080, 1920, AIMAGE_FORMAT_RGBA_8888);
+    ImageReader cameraReader(
+        1920, 1080, AIMAGE_FORMAT_YUV_420_888, cameraUsage
+    );
+    // CPU readable too, so only what changed is copied to the GPU
+    ImageReader watermarkReader(
+        1080,
+        1920,
+        AIMAGE_FORMAT_RGBA_8888,
+        AHARDWAREBUFFER_USAGE_GPU_SAMPLED_IMAGE |
+            AHARDWAREBUFFER_USAGE_CPU_READ_OFTEN
+    );
     watReader = &watermarkReader;
-    CameraManager cameraManager(cameraReader.getNativeWindow());
+    // Must outlive the camera session which streams into it
+    std::optional<ImageReader> stillReader;
+    CameraManager cameraManager;
+    camMgr = &cameraManager;
+    // Portrait, like the composited preview. The CPU renderer writes its
+    // NV12 frames into the encoder's input buffers
+    Recorder mediaRecorder(
+        {.video = {
+             .width = 1080,
+             .height = 1920,
+             .byteBufferInput = cpuApp != nullptr
+         }}
+    );
+    recorder = &mediaRecorder;
+
+    int32_t stillWidth = 1920;
+    int32_t stillHeight = 1080;
+    if (!cameraManager.getMaxOutputSize(
+            AIMAGE_FORMAT_YUV_420_888, &stillWidth, &stillHeight
+        )) {
+        logW("Can't find max still size, fallback to the preview size");
+    }
+    logI("Still capture size %dx%d", stillWidth, stillHeight);
+    stillReader.emplace(stillWidth, stillHeight, AIMAGE_FORMAT_YUV_420_888);
+    cameraManager.createSession(
+        cameraReader.getNativeWindow(), stillReader->getNativeWindow()
+    );
+
+    ThermalGovernor governor(
+        std::make_unique<AThermalSource>(),
+        makeQualityLadder(mediaRecorder.getConfig().video)
+    );
+    applyQualityLevel(governor.getLevel());
 
     appState.androidApp = app;
     appState.vkRenderer = vkApp;
+    appState.cpuRenderer = cpuApp;
     appState.camMgr = &cameraManager;
     app->userData = &appState;
     app->onAppCmd = handleAppCommand;
@@ -127,8 +453,65 @@ void drawFrame(AImage* image, bool isCam) {
             }
         }
 
-        drawFrame(cameraReader.getNextImage(), true);
+        if (recordingToggleRequested.exchange(false)) {
+            if (mediaRecorder.isRecording()) {
+                stopRecording();
+            } else {
+                startRecording();
+            }
+        }
+        prepareRecording();
+        if (takePictureRequested.exchange(false)) {
+            // Stills are encoded from the GPU composite
+            if (cpuApp) {
+                logW("Stills need the Vulkan renderer");
+            } else if (!cameraManager.takePicture()) {
+                logW("Can't take a picture");
+            }
+        }
+        if (auto text = takePending(pendingWatermarkText)) {
+            vkApp->setWatermarkText(std::move(*text));
+        }
+        if (auto text = takePending(pendingLocationText)) {
+            vkApp->setOverlayLocation(*text);
+        }
+        if (auto layers = takePending(pendingWatermarkLayers)) {
+            vkApp->setWatermarkLayers(std::move(*layers));
+        }
+        if (auto settings = takePending(pendingForensicSettings)) {
+            vkApp->setForensicWatermark(
+                settings->enabled, settings->key, settings->deviceId
+            );
+        }
+
+        if (AImage* image = cameraReader.getNextImage()) {
+            // Waits on the GPU and the display aren't CPU work, a frame
+            // paced by them would look fully loaded. Waits from between
+            // the frames, like a resize, are dropped first
+            vkApp->takeGpuWaitTime();
+            auto renderStart = std::chrono::steady_clock::now();
+            drawFrame(image, true);
+            governor.onFrame(
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - renderStart
+                ) -
+                vkApp->takeGpuWaitTime()
+            );
+        }
         drawFrame(watermarkReader.getNextImage(), false);
+        captureStill(stillReader->getNextImage());
+        if (mediaRecorder.isEncoding()) logEncoderStats();
+        logReadbackStats();
+        logWatermarkStats();
+        // The window may be gone, the preview scale needs it
+        if (appState.canRender && governor.update()) {
+            applyQualityLevel(governor.getLevel());
+        }
+    }
+
+    if (mediaRecorder.isEncoding()) {
+        stopRendererRecording();
+        mediaRecorder.stopEncoding();
     }
 }
 
@@ -139,14 +522,66 @@ jobject getWatermarkSurface(JNIEnv* env, jobject) {
     return surface;
 }
 
-void setMediaSurface(JNIEnv* env, jobject, jobject surface) {
-    logI("setMediaSurface called");
-    ANativeWindow* mediaWindow = ANativeWindow_fromSurface(env, surface);
-    vkApp->setMediaWindow(mediaWindow);
+void setPendingText(
+    JNIEnv* env, jstring text, std::optional<std::string>& pending
+) {
+    const char* chars = env->GetStringUTFChars(text, nullptr);
+    if (!chars) return;
+    {
+        std::lock_guard lock(pendingMutex);
+        pending = chars;
+    }
+    env->ReleaseStringUTFChars(text, chars);
+}
+
+void nativeSetWatermarkText(JNIEnv* env, jobject, jstring text) {
+    setPendingText(env, text, pendingWatermarkText);
+}
+
+void nativeSetLocationText(JNIEnv* env, jobject, jstring text) {
+    setPendingText(env, text, pendingLocationText);
+}
+
+// Each layer's normalized bounds on the watermark view as left, top, right,
+// bottom, it shows the same area of the rendered view
+void nativeSetWatermarkLayers(JNIEnv* env, jobject, jfloatArray bounds) {
+    jsize length = env->GetArrayLength(bounds);
+    std::vector<float> values(length);
+    env->GetFloatArrayRegion(bounds, 0, length, values.data());
+
+    std::vector<WatermarkLayer> layers;
+    for (jsize i = 0; i + 4 <= length; i += 4) {
+        LayerRect rect{values[i], values[i + 1], values[i + 2], values[i + 3]};
+        layers.push_back({.texRect = rect, .rect = rect});
+    }
+    std::lock_guard lock(pendingMutex);
+    pendingWatermarkLayers = std::move(layers);
+}
+
+void nativeSetForensicWatermark(
+    JNIEnv*, jobject, jboolean enabled, jint key, jint deviceId
+) {
+    std::lock_guard lock(pendingMutex);
+    pendingForensicSettings = {
+        enabled == JNI_TRUE,
+        static_cast<uint32_t>(key),
+        static_cast<uint32_t>(deviceId)
+    };
 }
 
 void nativeStartStopRecording(JNIEnv*, jobject) {
-    // vkApp->startStopRecording();
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    recordingToggleTimeUs = now / std::chrono::microseconds(1);
+    recordingToggleRequested = true;
+}
+
+void nativeTakePicture(JNIEnv*, jobject) {
+    takePictureRequested = true;
+}
+
+// Of the last recording, -1 before its first frame is encoded
+jlong nativeGetStartLatencyUs(JNIEnv*, jobject) {
+    return recorder ? recorder->getStartLatencyUs() : -1;
 }
 
 extern "C" JNIEXPORT jint JNI_OnLoad(JavaVM* _Nonnull vm, void* _Nullable) {
@@ -164,14 +599,29 @@ extern "C" JNIEXPORT jint JNI_OnLoad(JavaVM* _Nonnull vm, void* _Nullable) {
         {"getWatermarkSurface",
          "()Landroid/view/Surface;",
          reinterpret_cast<jobject*>(getWatermarkSurface)},
-        {"setMediaSurface",
-         "(Landroid/view/Surface;)V",
-         reinterpret_cast<void*>(setMediaSurface)},
+        {"nativeSetWatermarkText",
+         "(Ljava/lang/String;)V",
+         reinterpret_cast<void*>(nativeSetWatermarkText)},
+        {"nativeSetLocationText",
+         "(Ljava/lang/String;)V",
+         reinterpret_cast<void*>(nativeSetLocationText)},
+        {"nativeSetWatermarkLayers",
+         "([F)V",
+         reinterpret_cast<void*>(nativeSetWatermarkLayers)},
+        {"nativeSetForensicWatermark",
+         "(ZII)V",
+         reinterpret_cast<void*>(nativeSetForensicWatermark)},
         {"nativeStartStopRecording",
          "()V",
-         reinterpret_cast<void*>(nativeStartStopRecording)}
+         reinterpret_cast<void*>(nativeStartStopRecording)},
+        {"nativeTakePicture",
+         "()V",
+         reinterpret_cast<void*>(nativeTakePicture)},
+        {"nativeGetStartLatencyUs",
+         "()J",
+         reinterpret_cast<void*>(nativeGetStartLatencyUs)}
     };
-    int rc = env->RegisterNatives(c, methods, 3);
+    int rc = env->RegisterNatives(c, methods, std::size(methods));
     if (rc != JNI_OK) return rc;
 
     return JNI_VERSION_1_6;
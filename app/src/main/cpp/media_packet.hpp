@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace camera {
+
+enum class TrackType { VIDEO, AUDIO };
+
+/**
+ * What a muxer needs to know about an elementary stream, independent of
+ * AMediaFormat so it can be used off device too.
+ */
+struct TrackFormat {
+    TrackType type = TrackType::VIDEO;
+    std::string mime;
+    int32_t width = 0;
+    int32_t height = 0;
+    int32_t sampleRate = 0;
+    int32_t channelCount = 0;
+    int32_t bitrate = 0;
+    // Codec specific data: SPS and PPS with start codes for AVC, the
+    // AudioSpecificConfig for AAC
+    std::vector<uint8_t> csd0;
+    std::vector<uint8_t> csd1;
+};
+
+struct MediaPacket {
+    // MediaCodec buffer flag values
+    static constexpr uint32_t FLAG_KEY_FRAME = 1;
+    static constexpr uint32_t FLAG_CODEC_CONFIG = 2;
+
+    uint32_t track = 0;
+    int64_t presentationTimeUs = 0;
+    uint32_t flags = 0;
+    std::vector<uint8_t> data;
+
+    [[nodiscard]] bool isKeyFrame() const { return flags & FLAG_KEY_FRAME; }
+    [[nodiscard]] bool isCodecConfig() const {
+        return flags & FLAG_CODEC_CONFIG;
+    }
+};
+
+}  // namespace camera
@@ -0,0 +1,559 @@
+#include "mp4_writer.hpp"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "util.hpp"
+
+using namespace camera::util;
+
+namespace camera {
+
+namespace {
+
+constexpr uint8_t NAL_TYPE_SPS = 7;
+constexpr uint8_t NAL_TYPE_PPS = 8;
+constexpr uint32_t AAC_OBJECT_LC = 2;
+// 'und' packed as ISO-639-2/T
+constexpr uint16_t LANGUAGE_UNDEFINED = 0x55C4;
+constexpr uint32_t UNITY_MATRIX[] = {
+    0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000
+};
+
+/** Big endian serializer with nested boxes. */
+class BoxWriter {
+  public:
+    void u8(uint8_t value) { data_.push_back(value); }
+    void u16(uint16_t value) {
+        u8(value >> 8);
+        u8(value);
+    }
+    void u24(uint32_t value) {
+        u8(value >> 16);
+        u16(value);
+    }
+    void u32(uint32_t value) {
+        u16(value >> 16);
+        u16(value);
+    }
+    void u64(uint64_t value) {
+        u32(value >> 32);
+        u32(value);
+    }
+    void bytes(const void* data, size_t size) {
+        auto* begin = static_cast<const uint8_t*>(data);
+        data_.insert(data_.end(), begin, begin + size);
+    }
+    void fourcc(const char* type) { bytes(type, 4); }
+    void zeros(size_t count) { data_.resize(data_.size() + count); }
+
+    // Every begin is closed by an end(), which fills in the box size
+    void begin(const char* type) {
+        starts_.push_back(data_.size());
+        u32(0);
+        fourcc(type);
+    }
+    void beginFull(const char* type, uint8_t version, uint32_t flags = 0) {
+        begin(type);
+        u32(version << 24 | flags);
+    }
+    void end() {
+        size_t start = starts_.back();
+        starts_.pop_back();
+        uint32_t size = data_.size() - start;
+        for (int i = 0; i < 4; ++i) {
+            data_[start + i] = size >> (24 - 8 * i);
+        }
+    }
+
+    [[nodiscard]] size_t size() const { return data_.size(); }
+    std::vector<uint8_t>& data() { return data_; }
+
+  private:
+    std::vector<uint8_t> data_;
+    std::vector<size_t> starts_;
+};
+
+size_t findStartCode(const uint8_t* data, size_t size, size_t from) {
+    while (from + 3 <= size) {
+        auto* one = static_cast<const uint8_t*>(
+            memchr(data + from + 2, 1, size - from - 2)
+        );
+        if (one == nullptr) break;
+        size_t pos = one - data;
+        if (data[pos - 1] == 0 && data[pos - 2] == 0) return pos - 2;
+        from = pos - 1;
+    }
+    return size;
+}
+
+/** Call fn(nal, size) for every NAL unit of an Annex-B stream. */
+template <typename F>
+void forEachNal(const uint8_t* data, size_t size, F&& fn) {
+    size_t start = findStartCode(data, size, 0);
+    if (start == size) {
+        // No start codes, a single unit
+        if (size > 0) fn(data, size);
+        return;
+    }
+    while (start < size) {
+        size_t begin = start + 3;
+        size_t next = findStartCode(data, size, begin);
+        // Zeros before the next start code belong to it
+        size_t end = next;
+        while (end > begin && data[end - 1] == 0) --end;
+        if (end > begin) fn(data + begin, end - begin);
+        start = next;
+    }
+}
+
+std::vector<uint8_t> makeAudioSpecificConfig(
+    int32_t sampleRate,
+    int32_t channelCount
+) {
+    static constexpr int32_t RATES[] = {
+        96000, 88200, 64000, 48000, 44100, 32000, 24000,
+        22050, 16000, 12000, 11025, 8000,  7350
+    };
+    auto rate = std::find(std::begin(RATES), std::end(RATES), sampleRate);
+    uint32_t rateIndex = rate != std::end(RATES) ? rate - std::begin(RATES)
+                                                 : 3;
+    uint32_t config = AAC_OBJECT_LC << 11 | rateIndex << 7 | channelCount << 3;
+    return {static_cast<uint8_t>(config >> 8), static_cast<uint8_t>(config)};
+}
+
+}  // namespace
+
+Mp4Writer::Mp4Writer(
+    std::string path,
+    uint64_t preallocateBytes,
+    std::optional<HashChainLink> hashChain
+)
+    : path_(std::move(path)) {
+    if (!file_.open(path_)) return;
+    if (preallocateBytes > 0) file_.preallocate(preallocateBytes);
+    if (hashChain) file_.enableHashChain(std::move(*hashChain));
+}
+
+Mp4Writer::~Mp4Writer() {
+    if (started_) {
+        stop();
+    } else if (file_.isOpen()) {
+        file_.close();
+        unlink(path_.c_str());
+        unlink((path_ + HASH_CHAIN_SUFFIX).c_str());
+    }
+}
+
+int32_t Mp4Writer::addTrack(const TrackFormat& format) {
+    if (started_) return -1;
+
+    Track track;
+    track.format = format;
+    if (format.type == TrackType::VIDEO) {
+        if (format.mime != "video/avc") {
+            logE("Mp4Writer doesn't support %s", format.mime.c_str());
+            return -1;
+        }
+        auto addParameterSet = [&track](const uint8_t* nal, size_t size) {
+            uint8_t type = nal[0] & 0x1F;
+            if (type == NAL_TYPE_SPS && size >= 4) {
+                track.sps.emplace_back(nal, nal + size);
+            } else if (type == NAL_TYPE_PPS) {
+                track.pps.emplace_back(nal, nal + size);
+            }
+        };
+        forEachNal(format.csd0.data(), format.csd0.size(), addParameterSet);
+        forEachNal(format.csd1.data(), format.csd1.size(), addParameterSet);
+        if (track.sps.empty() || track.pps.empty()) {
+            logE("Mp4Writer: video format without SPS/PPS");
+            return -1;
+        }
+        track.timescale = VIDEO_TIMESCALE;
+    } else {
+        if (format.mime != "audio/mp4a-latm" || format.sampleRate <= 0) {
+            logE("Mp4Writer doesn't support %s", format.mime.c_str());
+            return -1;
+        }
+        if (track.format.csd0.empty()) {
+            track.format.csd0 = makeAudioSpecificConfig(
+                format.sampleRate,
+                format.channelCount
+            );
+        }
+        track.timescale = format.sampleRate;
+    }
+    tracks_.push_back(std::move(track));
+    return static_cast<int32_t>(tracks_.size() - 1);
+}
+
+bool Mp4Writer::start() {
+    if (started_ || tracks_.empty() || !file_.isOpen()) return false;
+
+    BoxWriter box;
+    box.begin("ftyp");
+    box.fourcc("isom");
+    box.u32(0x200);
+    box.fourcc("isom");
+    box.fourcc("iso2");
+    box.fourcc("avc1");
+    box.fourcc("mp41");
+    box.end();
+    // 64-bit mdat, its size is filled in by stop()
+    mdatOffset_ = box.size();
+    box.u32(1);
+    box.fourcc("mdat");
+    box.u64(0);
+
+    started_ = file_.write(box.data().data(), box.size());
+    lastTrack_ = -1;
+    return started_;
+}
+
+bool Mp4Writer::writeSample(
+    int32_t trackIndex,
+    const uint8_t* data,
+    size_t size,
+    int64_t presentationTimeUs,
+    uint32_t flags
+) {
+    if (!started_ || trackIndex < 0 ||
+        static_cast<size_t>(trackIndex) >= tracks_.size()) {
+        return false;
+    }
+    Track& track = tracks_[trackIndex];
+    bool keyFrame = flags & MediaPacket::FLAG_KEY_FRAME;
+    if (keyFrame && track.format.type == TrackType::VIDEO) {
+        file_.endHashLink();
+    }
+    uint64_t offset = file_.getPosition();
+
+    bool written = true;
+    uint32_t sampleSize = 0;
+    if (track.format.type == TrackType::VIDEO) {
+        // Annex-B start codes become 4-byte lengths
+        forEachNal(data, size, [&](const uint8_t* nal, size_t nalSize) {
+            uint8_t length[4] = {
+                static_cast<uint8_t>(nalSize >> 24),
+                static_cast<uint8_t>(nalSize >> 16),
+                static_cast<uint8_t>(nalSize >> 8),
+                static_cast<uint8_t>(nalSize)
+            };
+            written &= file_.write(length, sizeof(length));
+            written &= file_.write(nal, nalSize);
+            sampleSize += sizeof(length) + nalSize;
+        });
+    } else {
+        written = file_.write(data, size);
+        sampleSize = size;
+    }
+    if (!written) return false;
+
+    if (trackIndex != lastTrack_) {
+        track.chunkOffsets.push_back(offset);
+        track.chunkSamples.push_back(0);
+        lastTrack_ = trackIndex;
+    }
+    track.chunkSamples.back()++;
+
+    int64_t time = presentationTimeUs * track.timescale / 1'000'000;
+    if (!track.times.empty() && time <= track.times.back()) {
+        time = track.times.back() + 1;
+    }
+    track.times.push_back(time);
+    track.sizes.push_back(sampleSize);
+    if (keyFrame) {
+        track.syncSamples.push_back(track.sizes.size());
+    }
+    return true;
+}
+
+bool Mp4Writer::stop() {
+    if (!started_) return false;
+    started_ = false;
+
+    uint64_t mdatSize = file_.getPosition() - mdatOffset_;
+    uint8_t size[8];
+    for (int i = 0; i < 8; ++i) {
+        size[i] = mdatSize >> (56 - 8 * i);
+    }
+    std::vector<uint8_t> moov = makeMoov();
+    bool written = file_.writeAt(mdatOffset_ + 8, size, sizeof(size)) &&
+                   file_.write(moov.data(), moov.size());
+    return file_.close() && written;
+}
+
+std::vector<uint8_t> Mp4Writer::makeMoov() const {
+    // Durations in the track timescale, the last sample lasts as long as
+    // the one before it
+    auto getDuration = [](const Track& track) -> int64_t {
+        size_t count = track.times.size();
+        int64_t last = count > 1 ? track.times[count - 1] -
+                                       track.times[count - 2]
+                                 : track.timescale / 30;
+        return track.times.back() - track.times.front() + last;
+    };
+    auto toMovieTime = [](int64_t time, uint32_t timescale) -> uint64_t {
+        return time * MOVIE_TIMESCALE / timescale;
+    };
+
+    uint64_t movieDuration = 0;
+    for (const Track& track : tracks_) {
+        if (track.times.empty()) continue;
+        movieDuration = std::max(
+            movieDuration,
+            toMovieTime(track.times.front(), track.timescale) +
+                toMovieTime(getDuration(track), track.timescale)
+        );
+    }
+
+    BoxWriter box;
+    box.begin("moov");
+
+    box.beginFull("mvhd", 1);
+    box.u64(0);
+    box.u64(0);
+    box.u32(MOVIE_TIMESCALE);
+    box.u64(movieDuration);
+    box.u32(0x00010000);
+    box.u16(0x0100);
+    box.zeros(10);
+    for (uint32_t value : UNITY_MATRIX) box.u32(value);
+    box.zeros(24);
+    box.u32(tracks_.size() + 1);
+    box.end();
+
+    auto writeSampleEntry = [&box](const Track& track) {
+        const TrackFormat& format = track.format;
+        if (format.type == TrackType::VIDEO) {
+            box.begin("avc1");
+            box.zeros(6);
+            box.u16(1);
+            box.zeros(16);
+            box.u16(format.width);
+            box.u16(format.height);
+            box.u32(0x00480000);
+            box.u32(0x00480000);
+            box.u32(0);
+            box.u16(1);
+            box.zeros(32);
+            box.u16(0x0018);
+            box.u16(0xFFFF);
+
+            const std::vector<uint8_t>& sps = track.sps.front();
+            box.begin("avcC");
+            box.u8(1);
+            box.u8(sps[1]);
+            box.u8(sps[2]);
+            box.u8(sps[3]);
+            // 4-byte NAL lengths
+            box.u8(0xFF);
+            box.u8(0xE0 | track.sps.size());
+            for (const auto& nal : track.sps) {
+                box.u16(nal.size());
+                box.bytes(nal.data(), nal.size());
+            }
+            box.u8(track.pps.size());
+            for (const auto& nal : track.pps) {
+                box.u16(nal.size());
+                box.bytes(nal.data(), nal.size());
+            }
+            box.end();
+            box.end();
+            return;
+        }
+
+        box.begin("mp4a");
+        box.zeros(6);
+        box.u16(1);
+        box.zeros(8);
+        box.u16(format.channelCount);
+        box.u16(16);
+        box.zeros(4);
+        box.u32(format.sampleRate << 16);
+
+        const std::vector<uint8_t>& config = format.csd0;
+        box.beginFull("esds", 0);
+        // ES_Descriptor
+        box.u8(0x03);
+        box.u8(23 + config.size());
+        box.u16(1);
+        box.u8(0);
+        // DecoderConfigDescriptor, MPEG-4 audio stream
+        box.u8(0x04);
+        box.u8(15 + config.size());
+        box.u8(0x40);
+        box.u8(0x15);
+        box.u24(0);
+        box.u32(format.bitrate);
+        box.u32(format.bitrate);
+        // DecoderSpecificInfo
+        box.u8(0x05);
+        box.u8(config.size());
+        box.bytes(config.data(), config.size());
+        // SLConfigDescriptor
+        box.u8(0x06);
+        box.u8(1);
+        box.u8(0x02);
+        box.end();
+        box.end();
+    };
+
+    auto writeSampleTable = [&box, &writeSampleEntry](const Track& track) {
+        box.begin("stbl");
+
+        box.beginFull("stsd", 0);
+        box.u32(1);
+        writeSampleEntry(track);
+        box.end();
+
+        // Runs of equal sample durations
+        std::vector<std::pair<uint32_t, uint32_t>> deltas;
+        for (size_t i = 1; i <= track.times.size(); ++i) {
+            uint32_t delta = i < track.times.size()
+                                 ? track.times[i] - track.times[i - 1]
+                                 : deltas.empty() ? track.timescale / 30
+                                                  : deltas.back().second;
+            if (!deltas.empty() && deltas.back().second == delta) {
+                deltas.back().first++;
+            } else {
+                deltas.emplace_back(1, delta);
+            }
+        }
+        box.beginFull("stts", 0);
+        box.u32(deltas.size());
+        for (auto [count, delta] : deltas) {
+            box.u32(count);
+            box.u32(delta);
+        }
+        box.end();
+
+        if (track.format.type == TrackType::VIDEO) {
+            box.beginFull("stss", 0);
+            box.u32(track.syncSamples.size());
+            for (uint32_t sample : track.syncSamples) box.u32(sample);
+            box.end();
+        }
+
+        // Only chunks whose sample count differs from the previous one
+        std::vector<std::pair<uint32_t, uint32_t>> chunkRuns;
+        for (size_t i = 0; i < track.chunkSamples.size(); ++i) {
+            if (chunkRuns.empty() ||
+                chunkRuns.back().second != track.chunkSamples[i]) {
+                chunkRuns.emplace_back(i + 1, track.chunkSamples[i]);
+            }
+        }
+        box.beginFull("stsc", 0);
+        box.u32(chunkRuns.size());
+        for (auto [firstChunk, samples] : chunkRuns) {
+            box.u32(firstChunk);
+            box.u32(samples);
+            box.u32(1);
+        }
+        box.end();
+
+        box.beginFull("stsz", 0);
+        box.u32(0);
+        box.u32(track.sizes.size());
+        for (uint32_t size : track.sizes) box.u32(size);
+        box.end();
+
+        box.beginFull("co64", 0);
+        box.u32(track.chunkOffsets.size());
+        for (uint64_t offset : track.chunkOffsets) box.u64(offset);
+        box.end();
+
+        box.end();
+    };
+
+    for (size_t i = 0; i < tracks_.size(); ++i) {
+        const Track& track = tracks_[i];
+        if (track.times.empty()) continue;
+        bool isVideo = track.format.type == TrackType::VIDEO;
+        int64_t duration = getDuration(track);
+        uint64_t trackDuration = toMovieTime(duration, track.timescale);
+        uint64_t startTime = toMovieTime(track.times.front(), track.timescale);
+
+        box.begin("trak");
+
+        box.beginFull("tkhd", 1, 0x3);
+        box.u64(0);
+        box.u64(0);
+        box.u32(i + 1);
+        box.u32(0);
+        box.u64(startTime + trackDuration);
+        box.zeros(8);
+        box.u16(0);
+        box.u16(0);
+        box.u16(isVideo ? 0 : 0x0100);
+        box.u16(0);
+        for (uint32_t value : UNITY_MATRIX) box.u32(value);
+        box.u32(isVideo ? track.format.width << 16 : 0);
+        box.u32(isVideo ? track.format.height << 16 : 0);
+        box.end();
+
+        // A track starting after the movie begins gets an empty edit first
+        if (startTime > 0) {
+            box.begin("edts");
+            box.beginFull("elst", 1);
+            box.u32(2);
+            box.u64(startTime);
+            box.u64(UINT64_MAX);
+            box.u32(0x00010000);
+            box.u64(trackDuration);
+            // Sample times in stts always start at 0
+            box.u64(0);
+            box.u32(0x00010000);
+            box.end();
+            box.end();
+        }
+
+        box.begin("mdia");
+
+        box.beginFull("mdhd", 1);
+        box.u64(0);
+        box.u64(0);
+        box.u32(track.timescale);
+        box.u64(duration);
+        box.u16(LANGUAGE_UNDEFINED);
+        box.u16(0);
+        box.end();
+
+        box.beginFull("hdlr", 0);
+        box.u32(0);
+        box.fourcc(isVideo ? "vide" : "soun");
+        box.zeros(12);
+        const char* name = isVideo ? "VideoHandler" : "SoundHandler";
+        box.bytes(name, strlen(name) + 1);
+        box.end();
+
+        box.begin("minf");
+        if (isVideo) {
+            box.beginFull("vmhd", 0, 0x1);
+            box.zeros(8);
+        } else {
+            box.beginFull("smhd", 0);
+            box.zeros(4);
+        }
+        box.end();
+        box.begin("dinf");
+        box.beginFull("dref", 0);
+        box.u32(1);
+        box.beginFull("url ", 0, 0x1);
+        box.end();
+        box.end();
+        box.end();
+        writeSampleTable(track);
+        box.end();
+
+        box.end();
+        box.end();
+    }
+
+    box.end();
+    return std::move(box.data());
+}
+
+}  // namespace camera
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "file_writer.hpp"
+#include "muxer.hpp"
+
+namespace camera {
+
+/**
+ * Minimal MP4 writer for AVC video and AAC audio, a MuxerBackend which
+ * does not need the NDK so recordings can be produced and checked on the
+ * host. Samples are appended to a single mdat through a FileWriter and the
+ * moov box is written at the end.
+ */
+class Mp4Writer : public MuxerBackend {
+  public:
+    // The file is opened right away, with space for preallocateBytes. With
+    // a hash chain link each GOP becomes a link of the chain
+    explicit Mp4Writer(
+        std::string path,
+        uint64_t preallocateBytes = 0,
+        std::optional<HashChainLink> hashChain = std::nullopt
+    );
+    ~Mp4Writer() override;
+
+    int32_t addTrack(const TrackFormat& format) override;
+    bool start() override;
+    bool writeSample(
+        int32_t track,
+        const uint8_t* data,
+        size_t size,
+        int64_t presentationTimeUs,
+        uint32_t flags
+    ) override;
+    bool stop() override;
+
+  private:
+    static constexpr uint32_t MOVIE_TIMESCALE = 1000;
+    static constexpr uint32_t VIDEO_TIMESCALE = 90000;
+
+    struct Track {
+        TrackFormat format;
+        uint32_t timescale = 0;
+        // Video parameter sets without start codes
+        std::vector<std::vector<uint8_t>> sps;
+        std::vector<std::vector<uint8_t>> pps;
+        // Decode times in timescale units, B-frames are not used
+        std::vector<int64_t> times;
+        std::vector<uint32_t> sizes;
+        // 1-based, as stored in stss
+        std::vector<uint32_t> syncSamples;
+        std::vector<uint64_t> chunkOffsets;
+        std::vector<uint32_t> chunkSamples;
+    };
+
+    std::string path_;
+    FileWriter file_;
+    std::vector<Track> tracks_;
+    uint64_t mdatOffset_ = 0;
+    // Consecutive samples of one track are grouped into a chunk
+    int32_t lastTrack_ = -1;
+    bool started_ = false;
+
+    std::vector<uint8_t> makeMoov() const;
+};
+
+}  // namespace camera
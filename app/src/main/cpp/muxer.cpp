@@ -0,0 +1,350 @@
+#include "muxer.hpp"
+
+#include "util.hpp"
+
+using namespace camera::util;
+
+namespace camera {
+
+Muxer::Muxer(
+    BackendFactory createBackend,
+    std::vector<TrackType> tracks,
+    SegmentConfig segments
+)
+    : createBackend_(std::move(createBackend)), segments_(segments) {
+    for (TrackType type : tracks) {
+        TrackQueue& queue = tracks_.emplace_back();
+        queue.type = type;
+        queue.waitKeyFrame = type == TrackType::VIDEO;
+    }
+    thread_ = std::thread(&Muxer::run, this);
+}
+
+Muxer::~Muxer() { finish(); }
+
+void Muxer::setTrackFormat(uint32_t track, TrackFormat format) {
+    {
+        std::lock_guard lock(mutex_);
+        if (started_ || track >= tracks_.size()) return;
+        tracks_[track].format = std::move(format);
+    }
+    changed_.notify_one();
+}
+
+bool Muxer::push(
+    uint32_t track,
+    const uint8_t* data,
+    size_t size,
+    int64_t presentationTimeUs,
+    uint32_t flags
+) {
+    // The track formats carry the codec config
+    if (flags & MediaPacket::FLAG_CODEC_CONFIG) return true;
+
+    // Copied before taking the lock, the writer thread holds it briefly
+    MediaPacket packet{
+        .track = track,
+        .presentationTimeUs = presentationTimeUs,
+        .flags = flags,
+        .data = {data, data + size}
+    };
+
+    {
+        std::lock_guard lock(mutex_);
+        if (finishing_ || track >= tracks_.size()) return false;
+        TrackQueue& queue = tracks_[track];
+        if (started_ && queue.backendTrack < 0) return false;
+
+        if (queue.waitKeyFrame && !packet.isKeyFrame()) {
+            stats_.packetsDropped++;
+            return false;
+        }
+        size_t limit = queue.type == TrackType::VIDEO ? VIDEO_QUEUE_BYTES
+                                                      : AUDIO_QUEUE_BYTES;
+        if (queue.bytes + size > limit) {
+            stats_.packetsDropped++;
+            // Later frames reference the dropped one, resume at a key frame
+            queue.waitKeyFrame = queue.type == TrackType::VIDEO;
+            logAsyncW("Muxer queue %u is full, packet dropped", track);
+            return false;
+        }
+        queue.waitKeyFrame = false;
+        queue.lastTimeUs = presentationTimeUs;
+        queue.bytes += size;
+        queue.packets.push_back(std::move(packet));
+    }
+    changed_.notify_one();
+    return true;
+}
+
+bool Muxer::finish() {
+    {
+        std::lock_guard lock(mutex_);
+        if (finishing_) return !failed_;
+        finishing_ = true;
+    }
+    changed_.notify_one();
+    thread_.join();
+    return !failed_;
+}
+
+Muxer::Stats Muxer::getStats() const {
+    std::lock_guard lock(mutex_);
+    return stats_;
+}
+
+std::unique_ptr<MuxerBackend> Muxer::openSegment(
+    const std::vector<std::optional<TrackFormat>>& formats,
+    std::vector<int32_t>& backendTracks
+) {
+    std::unique_ptr<MuxerBackend> backend =
+        nextBackend_ ? std::move(nextBackend_) : createBackend_(segmentIndex_);
+    backendTracks.clear();
+    bool added = false;
+    for (const auto& format : formats) {
+        int32_t track = backend && format ? backend->addTrack(*format) : -1;
+        backendTracks.push_back(track);
+        added |= track >= 0;
+    }
+    if (!added || !backend->start()) return nullptr;
+
+    // Opening and allocating the next file now keeps it off the switch
+    if (segments_.isEnabled()) {
+        nextBackend_ = createBackend_(segmentIndex_ + 1);
+    }
+    return backend;
+}
+
+bool Muxer::switchSegment(std::unique_lock<std::mutex>& lock) {
+    std::vector<std::optional<TrackFormat>> formats;
+    for (const TrackQueue& queue : tracks_) {
+        formats.push_back(
+            queue.backendTrack >= 0 ? queue.format : std::nullopt
+        );
+    }
+
+    lock.unlock();
+    finishSegment(std::move(backend_));
+    segmentIndex_++;
+    std::vector<int32_t> backendTracks;
+    backend_ = openSegment(formats, backendTracks);
+    lock.lock();
+
+    if (!backend_) {
+        logE("Muxer failed to start segment %u", segmentIndex_);
+        failed_ = true;
+        return false;
+    }
+    for (size_t i = 0; i < tracks_.size(); ++i) {
+        tracks_[i].backendTrack = backendTracks[i];
+    }
+    segmentBytes_ = 0;
+    baseTimeUs_ = INT64_MIN;
+    stats_.segments++;
+    return true;
+}
+
+void Muxer::finishSegment(std::unique_ptr<MuxerBackend> backend) {
+    if (finisher_.joinable()) finisher_.join();
+    if (!backend) return;
+    finisher_ = std::thread([this, finished = std::move(backend)] {
+        if (!finished->stop()) {
+            std::lock_guard lock(mutex_);
+            failed_ = true;
+        }
+    });
+}
+
+bool Muxer::isReady() const {
+    for (const TrackQueue& queue : tracks_) {
+        if (!queue.format) return false;
+    }
+    return true;
+}
+
+bool Muxer::hasPackets() const {
+    for (const TrackQueue& queue : tracks_) {
+        if (!queue.packets.empty()) return true;
+    }
+    return false;
+}
+
+bool Muxer::isSegmentFull(int64_t timeUs) const {
+    if (baseTimeUs_ == INT64_MIN) return false;
+    if (segments_.maxDurationUs > 0 &&
+        timeUs - baseTimeUs_ >= segments_.maxDurationUs) {
+        return true;
+    }
+    return segments_.maxBytes > 0 && segmentBytes_ >= segments_.maxBytes;
+}
+
+bool Muxer::isCaughtUp(int64_t timeUs) const {
+    for (const TrackQueue& queue : tracks_) {
+        if (queue.backendTrack >= 0 && queue.lastTimeUs < timeUs) return false;
+    }
+    return true;
+}
+
+std::optional<size_t> Muxer::nextTrack() const {
+    std::optional<size_t> next;
+    for (size_t i = 0; i < tracks_.size(); ++i) {
+        const TrackQueue& queue = tracks_[i];
+        if (queue.packets.empty()) continue;
+        if (!next || queue.packets.front().presentationTimeUs <
+                         tracks_[*next].packets.front().presentationTimeUs) {
+            next = i;
+        }
+    }
+    if (!next || finishing_) return next;
+
+    // Hold the packet back while a track without queued packets may still
+    // produce an earlier one, unless that track lags too far behind
+    const TrackQueue& candidate = tracks_[*next];
+    int64_t time = candidate.packets.front().presentationTimeUs;
+    int64_t span = candidate.packets.back().presentationTimeUs - time;
+    int64_t maxWaitUs = std::chrono::microseconds(INTERLEAVE_WAIT).count();
+    for (const TrackQueue& queue : tracks_) {
+        if (queue.backendTrack < 0 || !queue.packets.empty()) continue;
+        if (queue.lastTimeUs < time && span < maxWaitUs) return std::nullopt;
+    }
+    return next;
+}
+
+void Muxer::run() {
+    // Created ahead so the file is open before the first packet arrives
+    nextBackend_ = createBackend_(0);
+
+    std::unique_lock lock(mutex_);
+    changed_.wait(lock, [this] { return finishing_ || hasPackets(); });
+    // Finished before anything was recorded, the unstarted backend leaves
+    // no file behind
+    if (!hasPackets()) {
+        lock.unlock();
+        nextBackend_.reset();
+        return;
+    }
+    changed_.wait_for(lock, FORMAT_TIMEOUT, [this] {
+        return finishing_ || isReady();
+    });
+    // A missing track only delays the start, at least one format is needed
+    auto hasFormat = [this] {
+        for (const TrackQueue& queue : tracks_) {
+            if (queue.format) return true;
+        }
+        return false;
+    };
+    changed_.wait(lock, [&] { return finishing_ || hasFormat(); });
+    // Finished before any encoder produced output
+    if (!hasFormat()) return;
+
+    // The file is opened without the lock, a format set meanwhile comes
+    // too late and its track is left out
+    std::vector<std::optional<TrackFormat>> formats;
+    for (const TrackQueue& queue : tracks_) {
+        formats.push_back(queue.format);
+    }
+    lock.unlock();
+    std::vector<int32_t> backendTracks;
+    backend_ = openSegment(formats, backendTracks);
+    lock.lock();
+
+    started_ = backend_ != nullptr;
+    if (!started_) {
+        logE("Muxer failed to start");
+        failed_ = true;
+        for (TrackQueue& queue : tracks_) {
+            queue.packets.clear();
+            queue.bytes = 0;
+        }
+        lock.unlock();
+        nextBackend_.reset();
+        return;
+    }
+    stats_.segments = 1;
+    bool hasVideo = false;
+    for (size_t i = 0; i < tracks_.size(); ++i) {
+        TrackQueue& queue = tracks_[i];
+        queue.backendTrack = backendTracks[i];
+        if (queue.backendTrack < 0) {
+            queue.packets.clear();
+            queue.bytes = 0;
+        }
+        hasVideo |= queue.backendTrack >= 0 && queue.type == TrackType::VIDEO;
+    }
+
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point splitDeadline = Clock::time_point::max();
+    for (;;) {
+        std::optional<size_t> next = nextTrack();
+        if (!next) {
+            if (finishing_) break;
+            changed_.wait_for(lock, INTERLEAVE_WAIT);
+            continue;
+        }
+
+        TrackQueue& queue = tracks_[*next];
+        const MediaPacket& head = queue.packets.front();
+        // Segments start with a video key frame, or anywhere without video
+        bool isSplit =
+            (!hasVideo ||
+             (queue.type == TrackType::VIDEO && head.isKeyFrame())) &&
+            isSegmentFull(head.presentationTimeUs);
+        // Earlier packets of the other tracks still belong to this segment
+        if (isSplit && !finishing_ && !isCaughtUp(head.presentationTimeUs)) {
+            Clock::time_point now = Clock::now();
+            if (splitDeadline == Clock::time_point::max()) {
+                splitDeadline = now + SPLIT_WAIT;
+            }
+            if (now < splitDeadline) {
+                changed_.wait_for(lock, INTERLEAVE_WAIT);
+                continue;
+            }
+        }
+        splitDeadline = Clock::time_point::max();
+
+        MediaPacket packet = std::move(queue.packets.front());
+        queue.packets.pop_front();
+        queue.bytes -= packet.data.size();
+        if (isSplit && !switchSegment(lock)) break;
+        int32_t backendTrack = queue.backendTrack;
+
+        // A file starts with a video key frame, earlier audio is dropped,
+        // as is audio still arriving for a segment after SPLIT_WAIT
+        if (baseTimeUs_ == INT64_MIN &&
+            (!hasVideo || queue.type == TrackType::VIDEO)) {
+            baseTimeUs_ = packet.presentationTimeUs;
+        }
+        if (baseTimeUs_ == INT64_MIN ||
+            packet.presentationTimeUs < baseTimeUs_) {
+            stats_.packetsDropped++;
+            continue;
+        }
+
+        lock.unlock();
+        bool written = backend_->writeSample(
+            backendTrack,
+            packet.data.data(),
+            packet.data.size(),
+            packet.presentationTimeUs - baseTimeUs_,
+            packet.flags
+        );
+        lock.lock();
+
+        if (written) {
+            stats_.packetsWritten++;
+            stats_.bytesWritten += packet.data.size();
+            segmentBytes_ += packet.data.size();
+        } else {
+            stats_.packetsDropped++;
+            failed_ = true;
+        }
+    }
+
+    lock.unlock();
+    finishSegment(std::move(backend_));
+    if (finisher_.joinable()) finisher_.join();
+    // The spare segment was never started and removes its file
+    nextBackend_.reset();
+}
+
+}  // namespace camera
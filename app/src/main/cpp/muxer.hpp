@@ -0,0 +1,163 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "media_packet.hpp"
+
+namespace camera {
+
+/** Container writer behind the Muxer, AMediaMuxer on device. */
+class MuxerBackend {
+  public:
+    // A backend destroyed before it was started leaves no file behind
+    virtual ~MuxerBackend() = default;
+
+    // Returns the backend track index, or -1 if the format is unsupported
+    virtual int32_t addTrack(const TrackFormat& format) = 0;
+    virtual bool start() = 0;
+    // Timestamps start at 0 with the first video key frame
+    virtual bool writeSample(
+        int32_t track,
+        const uint8_t* data,
+        size_t size,
+        int64_t presentationTimeUs,
+        uint32_t flags
+    ) = 0;
+    virtual bool stop() = 0;
+};
+
+struct SegmentConfig {
+    // A new file starts at the first key frame past either limit, 0 means
+    // no limit
+    int64_t maxDurationUs = 0;
+    uint64_t maxBytes = 0;
+
+    [[nodiscard]] bool isEnabled() const {
+        return maxDurationUs > 0 || maxBytes > 0;
+    }
+};
+
+/**
+ * Interleaves the packets of several encoders by timestamp and writes them
+ * to a MuxerBackend on its own thread. Encoders push into bounded per
+ * track queues and never wait: when a queue is full the packet is dropped,
+ * and for video every following packet up to the next key frame as well,
+ * so a slow disk costs frames but never stalls the encoders. The output
+ * can be split into segments at video key frames, every packet ends up in
+ * exactly one of them.
+ */
+class Muxer {
+  public:
+    struct Stats {
+        uint64_t packetsWritten;
+        uint64_t packetsDropped;
+        uint64_t bytesWritten;
+        uint32_t segments;
+    };
+
+    // Creates the backend of a segment, called on the writer thread
+    using BackendFactory =
+        std::function<std::unique_ptr<MuxerBackend>(uint32_t segment)>;
+
+    // Queued bytes per track before packets are dropped
+    static constexpr size_t VIDEO_QUEUE_BYTES = 16 << 20;
+    static constexpr size_t AUDIO_QUEUE_BYTES = 512 << 10;
+
+    /**
+     * With segments enabled the next backend is created while the current
+     * one is written, so the switch doesn't wait for the file to open.
+     */
+    Muxer(
+        BackendFactory createBackend,
+        std::vector<TrackType> tracks,
+        SegmentConfig segments = {}
+    );
+    ~Muxer();
+
+    Muxer(const Muxer&) = delete;
+    Muxer& operator=(const Muxer&) = delete;
+
+    /**
+     * Writing starts with the first packet once every track has its
+     * format, or after FORMAT_TIMEOUT with the tracks known by then. A
+     * muxer finished before any packet writes no file.
+     */
+    void setTrackFormat(uint32_t track, TrackFormat format);
+
+    /** Copy a packet into the track queue, false if it was dropped. */
+    bool push(
+        uint32_t track,
+        const uint8_t* data,
+        size_t size,
+        int64_t presentationTimeUs,
+        uint32_t flags
+    );
+
+    /** Write out everything queued and finalize the file. */
+    bool finish();
+
+    [[nodiscard]] Stats getStats() const;
+
+  private:
+    static constexpr auto FORMAT_TIMEOUT = std::chrono::seconds(2);
+    // How long to hold back a packet while another track has none queued
+    static constexpr auto INTERLEAVE_WAIT = std::chrono::milliseconds(100);
+    // How long a segment switch waits for the other tracks to catch up
+    static constexpr auto SPLIT_WAIT = std::chrono::seconds(1);
+
+    struct TrackQueue {
+        TrackType type;
+        std::optional<TrackFormat> format;
+        int32_t backendTrack = -1;
+        std::deque<MediaPacket> packets;
+        size_t bytes = 0;
+        // Video waits for a key frame after start and after every drop
+        bool waitKeyFrame = true;
+        int64_t lastTimeUs = INT64_MIN;
+    };
+
+    BackendFactory createBackend_;
+    SegmentConfig segments_;
+    // Only used by the writer thread
+    std::unique_ptr<MuxerBackend> backend_;
+    std::unique_ptr<MuxerBackend> nextBackend_;
+    // Finalizes the previous segment while the next one is written
+    std::thread finisher_;
+    uint32_t segmentIndex_ = 0;
+    uint64_t segmentBytes_ = 0;
+
+    mutable std::mutex mutex_;
+    std::condition_variable changed_;
+    std::vector<TrackQueue> tracks_;
+    bool finishing_ = false;
+    bool started_ = false;
+    bool failed_ = false;
+    // Timestamp of the first key frame, the start of the segment
+    int64_t baseTimeUs_ = INT64_MIN;
+    Stats stats_{};
+    std::thread thread_;
+
+    void run();
+    std::unique_ptr<MuxerBackend> openSegment(
+        const std::vector<std::optional<TrackFormat>>& formats,
+        std::vector<int32_t>& backendTracks
+    );
+    bool switchSegment(std::unique_lock<std::mutex>& lock);
+    void finishSegment(std::unique_ptr<MuxerBackend> backend);
+    bool isReady() const;
+    bool hasPackets() const;
+    bool isSegmentFull(int64_t timeUs) const;
+    bool isCaughtUp(int64_t timeUs) const;
+    std::optional<size_t> nextTrack() const;
+};
+
+}  // namespace camera
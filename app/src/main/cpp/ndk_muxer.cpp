@@ -0,0 +1,186 @@
+#include "ndk_muxer.hpp"
+
+#include <fcntl.h>
+#include <linux/falloc.h>
+#include <media/NdkMediaCodec.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "util.hpp"
+
+using namespace camera::util;
+
+namespace camera {
+
+namespace {
+
+std::vector<uint8_t> getBuffer(AMediaFormat* format, const char* name) {
+    void* data = nullptr;
+    size_t size = 0;
+    if (!AMediaFormat_getBuffer(format, name, &data, &size)) return {};
+    auto* bytes = static_cast<const uint8_t*>(data);
+    return {bytes, bytes + size};
+}
+
+}  // namespace
+
+TrackFormat toTrackFormat(AMediaFormat* format, TrackType type) {
+    TrackFormat track;
+    track.type = type;
+    const char* mime = nullptr;
+    if (AMediaFormat_getString(format, AMEDIAFORMAT_KEY_MIME, &mime)) {
+        track.mime = mime;
+    }
+    AMediaFormat_getInt32(format, AMEDIAFORMAT_KEY_WIDTH, &track.width);
+    AMediaFormat_getInt32(format, AMEDIAFORMAT_KEY_HEIGHT, &track.height);
+    AMediaFormat_getInt32(
+        format, AMEDIAFORMAT_KEY_SAMPLE_RATE, &track.sampleRate
+    );
+    AMediaFormat_getInt32(
+        format, AMEDIAFORMAT_KEY_CHANNEL_COUNT, &track.channelCount
+    );
+    AMediaFormat_getInt32(format, AMEDIAFORMAT_KEY_BIT_RATE, &track.bitrate);
+    track.csd0 = getBuffer(format, "csd-0");
+    track.csd1 = getBuffer(format, "csd-1");
+    return track;
+}
+
+NdkMuxer::NdkMuxer(std::string path, uint64_t preallocateBytes)
+    : path_(std::move(path)) {
+    // The MP4 writer seeks back to patch sizes, so the fd must be readable
+    fd_ = open(path_.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        logE("Can't open %s: %s", path_.c_str(), strerror(errno));
+        return;
+    }
+    if (preallocateBytes > 0 &&
+        fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0, preallocateBytes) != 0) {
+        logW("Can't preallocate %s: %s", path_.c_str(), strerror(errno));
+    }
+    muxer_ = AMediaMuxer_new(fd_, AMEDIAMUXER_OUTPUT_FORMAT_MPEG_4);
+    if (!muxer_) logE("Failed to create the muxer");
+}
+
+NdkMuxer::~NdkMuxer() {
+    if (started_) {
+        stop();
+    } else if (fd_ >= 0) {
+        release();
+        unlink(path_.c_str());
+    }
+}
+
+void NdkMuxer::release() {
+    if (muxer_) {
+        AMediaMuxer_delete(muxer_);
+        muxer_ = nullptr;
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+int32_t NdkMuxer::addTrack(const TrackFormat& format) {
+    if (!muxer_ || started_) return -1;
+
+    AMediaFormat* mediaFormat = AMediaFormat_new();
+    AMediaFormat_setString(
+        mediaFormat, AMEDIAFORMAT_KEY_MIME, format.mime.c_str()
+    );
+    if (format.type == TrackType::VIDEO) {
+        AMediaFormat_setInt32(
+            mediaFormat, AMEDIAFORMAT_KEY_WIDTH, format.width
+        );
+        AMediaFormat_setInt32(
+            mediaFormat, AMEDIAFORMAT_KEY_HEIGHT, format.height
+        );
+    } else {
+        AMediaFormat_setInt32(
+            mediaFormat, AMEDIAFORMAT_KEY_SAMPLE_RATE, format.sampleRate
+        );
+        AMediaFormat_setInt32(
+            mediaFormat, AMEDIAFORMAT_KEY_CHANNEL_COUNT, format.channelCount
+        );
+    }
+    if (format.bitrate > 0) {
+        AMediaFormat_setInt32(
+            mediaFormat, AMEDIAFORMAT_KEY_BIT_RATE, format.bitrate
+        );
+    }
+    if (!format.csd0.empty()) {
+        AMediaFormat_setBuffer(
+            mediaFormat, "csd-0", format.csd0.data(), format.csd0.size()
+        );
+    }
+    if (!format.csd1.empty()) {
+        AMediaFormat_setBuffer(
+            mediaFormat, "csd-1", format.csd1.data(), format.csd1.size()
+        );
+    }
+
+    ssize_t track = AMediaMuxer_addTrack(muxer_, mediaFormat);
+    AMediaFormat_delete(mediaFormat);
+    if (track < 0) {
+        logE("Muxer rejected the %s track: %zd", format.mime.c_str(), track);
+        return -1;
+    }
+    return static_cast<int32_t>(track);
+}
+
+bool NdkMuxer::start() {
+    if (!muxer_ || started_) return false;
+    media_status_t status = AMediaMuxer_start(muxer_);
+    if (status != AMEDIA_OK) {
+        logE("Failed to start the muxer: %d", status);
+        return false;
+    }
+    started_ = true;
+    return true;
+}
+
+bool NdkMuxer::writeSample(
+    int32_t track,
+    const uint8_t* data,
+    size_t size,
+    int64_t presentationTimeUs,
+    uint32_t flags
+) {
+    if (!started_) return false;
+    AMediaCodecBufferInfo info{
+        .offset = 0,
+        .size = static_cast<int32_t>(size),
+        .presentationTimeUs = presentationTimeUs,
+        .flags = flags
+    };
+    media_status_t status =
+        AMediaMuxer_writeSampleData(muxer_, track, data, &info);
+    if (status != AMEDIA_OK) {
+        logAsyncE("Failed to write a sample: %d", status);
+        return false;
+    }
+    return true;
+}
+
+bool NdkMuxer::stop() {
+    if (!started_) return false;
+    started_ = false;
+    media_status_t status = AMediaMuxer_stop(muxer_);
+    if (status != AMEDIA_OK) logE("Failed to stop the muxer: %d", status);
+    // Deleting the muxer finalizes the file, only then the fd is closed
+    AMediaMuxer_delete(muxer_);
+    muxer_ = nullptr;
+    // Truncating to the size it has gives back the space preallocated
+    // past the end
+    struct stat st {};
+    if (fstat(fd_, &st) != 0 || ftruncate(fd_, st.st_size) != 0) {
+        logW("Can't trim %s: %s", path_.c_str(), strerror(errno));
+    }
+    release();
+    return status == AMEDIA_OK;
+}
+
+}  // namespace camera
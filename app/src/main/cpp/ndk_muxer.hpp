@@ -0,0 +1,43 @@
+#pragma once
+
+#include <media/NdkMediaFormat.h>
+#include <media/NdkMediaMuxer.h>
+
+#include <string>
+
+#include "media_packet.hpp"
+#include "muxer.hpp"
+
+namespace camera {
+
+/** Copy what the muxer needs out of an encoder output format. */
+TrackFormat toTrackFormat(AMediaFormat* format, TrackType type);
+
+/** MuxerBackend writing MP4 through AMediaMuxer. */
+class NdkMuxer : public MuxerBackend {
+  public:
+    // The file is opened right away, with space for preallocateBytes
+    explicit NdkMuxer(std::string path, uint64_t preallocateBytes = 0);
+    ~NdkMuxer() override;
+
+    int32_t addTrack(const TrackFormat& format) override;
+    bool start() override;
+    bool writeSample(
+        int32_t track,
+        const uint8_t* data,
+        size_t size,
+        int64_t presentationTimeUs,
+        uint32_t flags
+    ) override;
+    bool stop() override;
+
+  private:
+    std::string path_;
+    int fd_ = -1;
+    AMediaMuxer* muxer_ = nullptr;
+    bool started_ = false;
+
+    void release();
+};
+
+}  // namespace camera
@@ -0,0 +1,115 @@
+#include "preroll_buffer.hpp"
+
+#include <cstring>
+
+namespace camera {
+
+PrerollBuffer::PrerollBuffer(size_t capacityBytes, int64_t maxDurationUs)
+    : arena_(std::make_unique<uint8_t[]>(capacityBytes)),
+      capacity_(capacityBytes),
+      maxDurationUs_(maxDurationUs),
+      entries_(MAX_PACKETS) {}
+
+bool PrerollBuffer::push(const EncodedPacket& packet) {
+    // The codec config is part of the track format
+    if (packet.isCodecConfig() || packet.size == 0) return true;
+    bool isKeyFrame = packet.isKeyFrame();
+    if (waitKeyFrame_ && !isKeyFrame) return false;
+    if (packet.size > capacity_) {
+        clear();
+        return false;
+    }
+
+    size_t offset;
+    while (count_ == MAX_PACKETS || !allocate(packet.size, offset)) {
+        evictGop();
+        // The GOP this packet belongs to is gone
+        if (count_ == 0 && !isKeyFrame) {
+            waitKeyFrame_ = true;
+            return false;
+        }
+    }
+    memcpy(arena_.get() + offset, packet.data, packet.size);
+    entries_[(head_ + count_) % MAX_PACKETS] = {
+        .offset = offset,
+        .size = packet.size,
+        .presentationTimeUs = packet.presentationTimeUs,
+        .flags = packet.flags
+    };
+    count_++;
+    bytes_ += packet.size;
+    waitKeyFrame_ = false;
+
+    // Drop the oldest GOP while the rest still covers the duration
+    int64_t startUs = packet.presentationTimeUs - maxDurationUs_;
+    for (;;) {
+        size_t next = 1;
+        while (next < count_ && !at(next).isKeyFrame()) next++;
+        if (next == count_ || at(next).presentationTimeUs > startUs) break;
+        evictGop();
+    }
+    return true;
+}
+
+void PrerollBuffer::flush(const VideoEncoder::PacketCallback& fn) {
+    for (size_t i = 0; i < count_; ++i) {
+        const Entry& entry = at(i);
+        fn({
+            .data = arena_.get() + entry.offset,
+            .size = entry.size,
+            .presentationTimeUs = entry.presentationTimeUs,
+            .flags = entry.flags
+        });
+    }
+    clear();
+}
+
+void PrerollBuffer::clear() {
+    head_ = 0;
+    count_ = 0;
+    bytes_ = 0;
+    waitKeyFrame_ = true;
+}
+
+int64_t PrerollBuffer::getDurationUs() const {
+    if (count_ == 0) return 0;
+    return at(count_ - 1).presentationTimeUs - at(0).presentationTimeUs;
+}
+
+bool PrerollBuffer::allocate(size_t size, size_t& offset) const {
+    if (count_ == 0) {
+        offset = 0;
+        return size <= capacity_;
+    }
+    const Entry& oldest = at(0);
+    const Entry& newest = at(count_ - 1);
+    size_t end = newest.offset + newest.size;
+    if (newest.offset >= oldest.offset) {
+        // Not wrapped, free space after the newest and before the oldest
+        if (end + size <= capacity_) {
+            offset = end;
+            return true;
+        }
+        if (size <= oldest.offset) {
+            offset = 0;
+            return true;
+        }
+        return false;
+    }
+    // Wrapped, free space between the newest and the oldest
+    if (end + size <= oldest.offset) {
+        offset = end;
+        return true;
+    }
+    return false;
+}
+
+void PrerollBuffer::evictGop() {
+    do {
+        bytes_ -= at(0).size;
+        head_ = (head_ + 1) % MAX_PACKETS;
+        count_--;
+    } while (count_ > 0 && !at(0).isKeyFrame());
+}
+
+}  // namespace camera
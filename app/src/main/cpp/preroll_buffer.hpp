@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "video_encoder.hpp"
+
+namespace camera {
+
+/**
+ * The last few seconds of encoded video, kept while not recording so a
+ * recording can start with what happened before it was requested.
+ *
+ * Packet data lives in one arena allocated up front and used as a ring,
+ * the metadata in a fixed ring as well, so buffering does no heap
+ * allocation per packet. The oldest GOP is evicted as a whole to stay
+ * within the byte budget and the duration, so the buffer always starts
+ * with a key frame.
+ */
+class PrerollBuffer {
+  public:
+    PrerollBuffer(size_t capacityBytes, int64_t maxDurationUs);
+
+    PrerollBuffer(const PrerollBuffer&) = delete;
+    PrerollBuffer& operator=(const PrerollBuffer&) = delete;
+
+    /** Copy a packet in, false if it was dropped. */
+    bool push(const EncodedPacket& packet);
+
+    /** Hand out the buffered packets oldest first and clear the buffer. */
+    void flush(const VideoEncoder::PacketCallback& fn);
+    void clear();
+
+    [[nodiscard]] bool isEmpty() const { return count_ == 0; }
+    [[nodiscard]] size_t getPacketCount() const { return count_; }
+    [[nodiscard]] size_t getBytes() const { return bytes_; }
+    [[nodiscard]] int64_t getDurationUs() const;
+
+  private:
+    // 10 s at 60 fps
+    static constexpr size_t MAX_PACKETS = 600;
+
+    struct Entry {
+        size_t offset;
+        size_t size;
+        int64_t presentationTimeUs;
+        uint32_t flags;
+
+        [[nodiscard]] bool isKeyFrame() const {
+            return flags & EncodedPacket::FLAG_KEY_FRAME;
+        }
+    };
+
+    std::unique_ptr<uint8_t[]> arena_;
+    size_t capacity_;
+    int64_t maxDurationUs_;
+    std::vector<Entry> entries_;
+    // Ring of count_ entries from head_
+    size_t head_ = 0;
+    size_t count_ = 0;
+    size_t bytes_ = 0;
+    // After a GOP was cut short nothing is stored up to the next key frame
+    bool waitKeyFrame_ = true;
+
+    [[nodiscard]] const Entry& at(size_t index) const {
+        return entries_[(head_ + index) % MAX_PACKETS];
+    }
+    bool allocate(size_t size, size_t& offset) const;
+    void evictGop();
+};
+
+}  // namespace camera
@@ -0,0 +1,291 @@
+#include "recorder.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "mp4_writer.hpp"
+#include "ndk_muxer.hpp"
+#include "util.hpp"
+
+using namespace camera::util;
+
+namespace camera {
+
+namespace {
+
+std::string getSegmentPath(const std::string& path, uint32_t segment) {
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), "_%03u", segment);
+    size_t extension = path.rfind('.');
+    if (extension == std::string::npos) return path + suffix;
+    return path.substr(0, extension) + suffix + path.substr(extension);
+}
+
+int64_t monotonicNowUs() {
+    return std::chrono::steady_clock::now().time_since_epoch() /
+           std::chrono::microseconds(1);
+}
+
+}  // namespace
+
+Recorder::Recorder(const RecorderConfig& config) : config_(config) {
+    if (config.prerollBytes > 0) {
+        // Allocated once, buffering doesn't allocate afterwards
+        preroll_.emplace(
+            std::min(config.prerollBytes, Muxer::VIDEO_QUEUE_BYTES / 2),
+            config.prerollDurationUs
+        );
+    }
+}
+
+Recorder::~Recorder() {
+    stopEncoding();
+    if (finisher_.joinable()) finisher_.join();
+}
+
+bool Recorder::startEncoding() {
+    if (video_.isRunning()) return false;
+    {
+        // A new stream, possibly with other parameter sets
+        std::lock_guard lock(sinkMutex_);
+        if (preroll_) preroll_->clear();
+        videoFormat_.reset();
+    }
+    return video_.start(
+        config_.video,
+        [this](const EncodedPacket& packet) { onVideoPacket(packet); },
+        [this](AMediaFormat* format) { onVideoFormat(format); }
+    );
+}
+
+void Recorder::stopEncoding() {
+    if (state_ != RecorderState::IDLE) stopRecording();
+    video_.stop();
+}
+
+bool Recorder::prepareRecording() {
+    if (state_ != RecorderState::IDLE) return false;
+    // Started here, the caller hands its input window to the renderer
+    if (!video_.isRunning() && !startEncoding()) return false;
+    state_ = RecorderState::PREPARING;
+    prepareThread_ = std::thread([this] { prepare(); });
+    return true;
+}
+
+void Recorder::prepare() {
+    if (config_.recordAudio) {
+        {
+            std::lock_guard lock(sinkMutex_);
+            audioFormat_.reset();
+        }
+        bool opened = audio_.open(
+            config_.audio,
+            [this](const EncodedPacket& packet) { onAudioPacket(packet); },
+            [this](AMediaFormat* format) { onAudioFormat(format); }
+        );
+        if (!opened) logW("Recording without audio");
+    }
+
+    // The muxer thread and the recording ID are set up here, off the start
+    path_ = {};
+    std::unique_ptr<Muxer> muxer = createMuxer(path_.get_future().share());
+    {
+        std::lock_guard lock(sinkMutex_);
+        if (videoFormat_) muxer->setTrackFormat(VIDEO_TRACK, *videoFormat_);
+        if (audioFormat_) muxer->setTrackFormat(AUDIO_TRACK, *audioFormat_);
+        muxer_ = std::move(muxer);
+    }
+
+    state_ = RecorderState::READY;
+    logI("Ready to record");
+}
+
+std::unique_ptr<Muxer> Recorder::createMuxer(
+    std::shared_future<std::string> path
+) const {
+    std::vector<TrackType> tracks{TrackType::VIDEO};
+    if (audio_.isRunning()) tracks.push_back(TrackType::AUDIO);
+    // Segments get their expected size reserved up front
+    const SegmentConfig& segments = config_.segments;
+    uint64_t preallocateBytes = segments.maxBytes;
+    if (preallocateBytes == 0 && segments.maxDurationUs > 0) {
+        int64_t bitrate = config_.video.bitrate + config_.audio.bitrate;
+        preallocateBytes = bitrate / 8 * segments.maxDurationUs / 1'000'000;
+    }
+    // Segments are created in order on the muxer thread, each one's chain
+    // continues from the last head of the one before
+    std::shared_ptr<HashChainLinker> hashChain;
+    if (config_.hashChain) {
+        RecordingId recordingId;
+        std::random_device random;
+        for (uint8_t& byte : recordingId) byte = random();
+        hashChain = std::make_shared<HashChainLinker>(recordingId);
+    }
+    auto createBackend = [path, segments, preallocateBytes, hashChain](
+                             uint32_t segment
+                         ) -> std::unique_ptr<MuxerBackend> {
+        // The muxer thread waits here for the start to name the file
+        const std::string& recordingPath = path.get();
+        if (recordingPath.empty()) return nullptr;
+        std::string segmentPath = segments.isEnabled()
+                                      ? getSegmentPath(recordingPath, segment)
+                                      : recordingPath;
+        logI("Recording to %s", segmentPath.c_str());
+        if (!hashChain) {
+            return std::make_unique<NdkMuxer>(segmentPath, preallocateBytes);
+        }
+        return std::make_unique<Mp4Writer>(
+            segmentPath,
+            preallocateBytes,
+            hashChain->next(segment)
+        );
+    };
+    // The file is named and opened on the muxer thread
+    return std::make_unique<Muxer>(createBackend, tracks, segments);
+}
+
+bool Recorder::startRecording(
+    int64_t requestTimeUs,
+    const std::string& path
+) {
+    RecorderState state = state_;
+    if (state != RecorderState::PREPARING && state != RecorderState::READY) {
+        return false;
+    }
+    // Done long before unless the start follows right after a stop
+    if (prepareThread_.joinable()) prepareThread_.join();
+
+    {
+        std::lock_guard lock(sinkMutex_);
+        requestTimeUs_ = requestTimeUs;
+    }
+    path_.set_value(path);
+    startLatencyUs_ = -1;
+    started_.store(true, std::memory_order_release);
+    // The muxer starts with the video track alone after a timeout
+    if (audio_.isRunning() && !audio_.startCapture()) {
+        logW("Recording without audio");
+    }
+    state_ = RecorderState::RECORDING;
+    // Nothing buffered, don't wait for the next GOP
+    if (!preroll_) video_.requestKeyFrame();
+    return true;
+}
+
+bool Recorder::stopRecording() {
+    if (state_ == RecorderState::IDLE) return false;
+    if (prepareThread_.joinable()) prepareThread_.join();
+
+    audio_.stop();
+    // Without pre-roll the last frames are drained into this recording
+    if (!preroll_) video_.stop();
+
+    std::unique_ptr<Muxer> muxer;
+    bool started;
+    {
+        std::lock_guard lock(sinkMutex_);
+        muxer = std::move(muxer_);
+        started = started_;
+        started_ = false;
+        hasFirstFrame_ = false;
+    }
+    state_ = RecorderState::IDLE;
+    if (!muxer) return true;
+    // Stopped before it started, the muxer opens no file
+    if (!started) path_.set_value({});
+
+    if (finisher_.joinable()) finisher_.join();
+    finisher_ = std::thread([muxer = std::move(muxer), started] {
+        // Without any packet the muxer leaves no file
+        bool finished = muxer->finish();
+        if (!started) return;
+        Muxer::Stats stats = muxer->getStats();
+        logI(
+            "Recording %s, %u files, %llu packets, %llu dropped, %llu bytes",
+            finished ? "finished" : "failed",
+            stats.segments,
+            (unsigned long long)stats.packetsWritten,
+            (unsigned long long)stats.packetsDropped,
+            (unsigned long long)stats.bytesWritten
+        );
+    });
+    return true;
+}
+
+void Recorder::setVideoBitrate(int32_t bitrate) {
+    if (config_.video.bitrate == bitrate) return;
+    config_.video.bitrate = bitrate;
+    video_.setBitrate(bitrate);
+}
+
+void Recorder::flushPreroll() {
+    int64_t prerollUs = preroll_->getDurationUs();
+    preroll_->flush([this](const EncodedPacket& packet) {
+        muxer_->push(
+            VIDEO_TRACK,
+            packet.data,
+            packet.size,
+            packet.presentationTimeUs,
+            packet.flags
+        );
+    });
+    logAsyncI("Recording with %.1f s pre-roll", prerollUs / 1e6);
+}
+
+void Recorder::onVideoPacket(const EncodedPacket& packet) {
+    std::lock_guard lock(sinkMutex_);
+    if (!muxer_ || !started_.load(std::memory_order_acquire)) {
+        if (preroll_) preroll_->push(packet);
+        return;
+    }
+
+    // The first packet after the start brings the buffered ones along
+    if (preroll_ && !preroll_->isEmpty()) flushPreroll();
+    if (!hasFirstFrame_ && !packet.isCodecConfig() &&
+        packet.presentationTimeUs >= requestTimeUs_) {
+        hasFirstFrame_ = true;
+        startLatencyUs_ = monotonicNowUs() - requestTimeUs_;
+        logAsyncI(
+            "First frame encoded %.1f ms after the start",
+            startLatencyUs_ / 1e3
+        );
+    }
+    muxer_->push(
+        VIDEO_TRACK,
+        packet.data,
+        packet.size,
+        packet.presentationTimeUs,
+        packet.flags
+    );
+}
+
+void Recorder::onVideoFormat(AMediaFormat* format) {
+    TrackFormat trackFormat = toTrackFormat(format, TrackType::VIDEO);
+    std::lock_guard lock(sinkMutex_);
+    if (muxer_) muxer_->setTrackFormat(VIDEO_TRACK, trackFormat);
+    videoFormat_ = std::move(trackFormat);
+}
+
+void Recorder::onAudioPacket(const EncodedPacket& packet) {
+    std::lock_guard lock(sinkMutex_);
+    if (!muxer_ || !started_.load(std::memory_order_acquire)) return;
+    muxer_->push(
+        AUDIO_TRACK,
+        packet.data,
+        packet.size,
+        packet.presentationTimeUs,
+        packet.flags
+    );
+}
+
+void Recorder::onAudioFormat(AMediaFormat* format) {
+    TrackFormat trackFormat = toTrackFormat(format, TrackType::AUDIO);
+    std::lock_guard lock(sinkMutex_);
+    if (muxer_) muxer_->setTrackFormat(AUDIO_TRACK, trackFormat);
+    audioFormat_ = std::move(trackFormat);
+}
+
+}  // namespace camera
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+#include "audio_encoder.hpp"
+#include "media_packet.hpp"
+#include "muxer.hpp"
+#include "preroll_buffer.hpp"
+#include "video_encoder.hpp"
+
+namespace camera {
+
+struct RecorderConfig {
+    VideoEncoderConfig video;
+    AudioEncoderConfig audio;
+    bool recordAudio = true;
+    // Video kept from before a recording starts, 0 bytes disables it.
+    // Limited to half the muxer video queue which has to take it at once
+    size_t prerollBytes = 6 << 20;
+    int64_t prerollDurationUs = 5'000'000;
+    // Split long recordings into files named VID_<time>_<n>.mp4
+    SegmentConfig segments;
+    // Write a tamper-evident hash chain of each file next to it. The files
+    // are then written by Mp4Writer, the NDK muxer's output can't be seen
+    bool hashChain = false;
+};
+
+enum class RecorderState { IDLE, PREPARING, READY, RECORDING };
+
+/**
+ * Owns the encoders and the muxer of the recordings. With pre-roll the
+ * video encoder keeps running between recordings and its packets go to a
+ * PrerollBuffer, which is flushed into the muxer ahead of the live packets
+ * when a recording starts.
+ *
+ * A recording is prepared ahead: the video encoder runs, and the audio
+ * encoder and the muxer are created in the background, the audio packets
+ * discarded. The muxer thread waits for the path, named after the start,
+ * and opens the file while the first packets queue. Starting only lets the
+ * packets through and has the microphone capture.
+ */
+class Recorder {
+  public:
+    explicit Recorder(const RecorderConfig& config = {});
+    ~Recorder();
+
+    Recorder(const Recorder&) = delete;
+    Recorder& operator=(const Recorder&) = delete;
+
+    /** Start the video encoder, the renderer presents to its window. */
+    bool startEncoding();
+    /** The renderer must have stopped presenting to the encoder. */
+    void stopEncoding();
+
+    /**
+     * Get the next recording ready. Starts encoding when it's not running
+     * yet, the renderer has to present to the encoder from then on.
+     */
+    bool prepareRecording();
+    /**
+     * Start a prepared recording to path, waiting for the preparation if
+     * it's not done yet. requestTimeUs is when it was asked for, in
+     * CLOCK_MONOTONIC, the start latency is measured from there.
+     */
+    bool startRecording(int64_t requestTimeUs, const std::string& path);
+    /**
+     * Finalize the file in the background, or drop the prepared one.
+     * Without pre-roll the encoding stops as well, so the renderer must
+     * stop presenting to the encoder first.
+     */
+    bool stopRecording();
+
+    /** Applied to the running encoder and to the next encoding. */
+    void setVideoBitrate(int32_t bitrate);
+
+    [[nodiscard]] const RecorderConfig& getConfig() const { return config_; }
+    [[nodiscard]] bool isEncoding() const { return video_.isRunning(); }
+    [[nodiscard]] RecorderState getState() const { return state_; }
+    [[nodiscard]] bool isRecording() const {
+        return state_ == RecorderState::RECORDING;
+    }
+    /** Start request to the first frame encoded after it, -1 if none. */
+    [[nodiscard]] int64_t getStartLatencyUs() const {
+        return startLatencyUs_;
+    }
+    [[nodiscard]] bool hasPreroll() const { return preroll_.has_value(); }
+    [[nodiscard]] VideoEncoder& getVideoEncoder() { return video_; }
+
+  private:
+    static constexpr uint32_t VIDEO_TRACK = 0;
+    static constexpr uint32_t AUDIO_TRACK = 1;
+
+    RecorderConfig config_;
+    VideoEncoder video_;
+    AudioEncoder audio_;
+    // Where the video packets go, switched while the encoder runs
+    std::mutex sinkMutex_;
+    std::unique_ptr<Muxer> muxer_;
+    // The prepared muxer's path, set on start or left empty to drop it
+    std::promise<std::string> path_;
+    std::optional<PrerollBuffer> preroll_;
+    std::optional<TrackFormat> videoFormat_;
+    std::optional<TrackFormat> audioFormat_;
+    bool hasFirstFrame_ = false;
+
+    std::atomic<RecorderState> state_ = RecorderState::IDLE;
+    // Lets the packets into the muxer, what starting a recording amounts to
+    std::atomic_bool started_ = false;
+    // Written before started_ is set
+    int64_t requestTimeUs_ = 0;
+    std::atomic<int64_t> startLatencyUs_ = -1;
+    std::thread prepareThread_;
+    // Finalizes the stopped recording, writing out what the muxer still
+    // has queued can take a while
+    std::thread finisher_;
+
+    void prepare();
+    std::unique_ptr<Muxer> createMuxer(
+        std::shared_future<std::string> path
+    ) const;
+    void flushPreroll();
+    void onVideoPacket(const EncodedPacket& packet);
+    void onVideoFormat(AMediaFormat* format);
+    void onAudioPacket(const EncodedPacket& packet);
+    void onAudioFormat(AMediaFormat* format);
+};
+
+}  // namespace camera
@@ -0,0 +1,55 @@
+#include "recording_thumbnail.hpp"
+
+#include <memory>
+#include <utility>
+
+#include "util.hpp"
+
+using namespace camera::util;
+
+namespace camera {
+
+void RecordingThumbnail::start() {
+    std::lock_guard lock(mutex_);
+    active_ = true;
+    pixels_.clear();
+    bright_ = false;
+}
+
+void RecordingThumbnail::onFrame(const ReadbackFrame& frame, float sceneLuma) {
+    bool bright = sceneLuma < 0.0f || sceneLuma >= MIN_LUMA;
+    std::lock_guard lock(mutex_);
+    if (!active_ || (bright_ && !bright)) return;
+    size_t size = static_cast<size_t>(frame.width) * frame.height * 4;
+    pixels_.assign(frame.pixels, frame.pixels + size);
+    width_ = frame.width;
+    height_ = frame.height;
+    bgra_ = frame.bgra;
+    bright_ = bright;
+}
+
+bool RecordingThumbnail::save(std::string path) {
+    std::lock_guard lock(mutex_);
+    active_ = false;
+    if (pixels_.empty()) return false;
+
+    // Owned by the job, the next recording may start before it's encoded
+    auto pixels = std::make_shared<std::vector<uint8_t>>(std::move(pixels_));
+    pixels_.clear();
+    writer_.submit({
+        .waitForPixels = {},
+        .pixels = pixels->data(),
+        .width = width_,
+        .height = height_,
+        .bgra = bgra_,
+        .quality = JPEG_QUALITY,
+        .path = path,
+        .onDone =
+            [pixels, path](bool success) {
+                if (!success) logW("Can't save thumbnail %s", path.c_str());
+            }
+    });
+    return true;
+}
+
+}  // namespace camera
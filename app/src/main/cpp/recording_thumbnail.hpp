@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "frame_readback.hpp"
+#include "jpeg_writer.hpp"
+
+namespace camera {
+
+/**
+ * Poster frame of a recording, the latest of the preview frames read back
+ * while it runs, saved as jpeg when it stops. A frame of a dark scene only
+ * stands in until a brighter one comes, the first frames often are while
+ * the exposure settles or the lens is covered.
+ */
+class RecordingThumbnail {
+  public:
+    // Average scene luma, 0 to 1, a frame needs to replace a brighter one
+    static constexpr float MIN_LUMA = 0.1f;
+    static constexpr int JPEG_QUALITY = 85;
+
+    /** Start keeping frames, the last recording's one is dropped. */
+    void start();
+    /**
+     * Called with the read back frames, on the readback worker. A negative
+     * sceneLuma isn't known and counts as bright.
+     */
+    void onFrame(const ReadbackFrame& frame, float sceneLuma);
+    /**
+     * Stop keeping frames and encode the one kept to path on a worker
+     * thread, false if there is none.
+     */
+    bool save(std::string path);
+
+  private:
+    std::mutex mutex_;
+    bool active_ = false;
+    std::vector<uint8_t> pixels_;
+    uint32_t width_ = 0;
+    uint32_t height_ = 0;
+    bool bgra_ = false;
+    bool bright_ = false;
+    // Drains its jobs when destroyed, they own the pixels they encode
+    JpegWriter writer_;
+};
+
+}  // namespace camera
@@ -0,0 +1,316 @@
+#include "sha256.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define SHA256_HAS_X86 1
+#endif
+
+namespace camera {
+
+namespace {
+
+constexpr size_t BLOCK_SIZE = 64;
+
+constexpr std::array<uint32_t, 8> INITIAL_STATE{
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+alignas(16) constexpr uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+// Compress count consecutive blocks into state
+using BlockKernel =
+    void (*)(uint32_t* state, const uint8_t* data, size_t count);
+
+inline uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+void compressScalar(uint32_t* state, const uint8_t* data, size_t count) {
+    for (; count > 0; --count, data += BLOCK_SIZE) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i) {
+            const uint8_t* p = data + i * 4;
+            w[i] = static_cast<uint32_t>(p[0]) << 24 | p[1] << 16 |
+                   p[2] << 8 | p[3];
+        }
+        for (int i = 16; i < 64; ++i) {
+            uint32_t s0 =
+                rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 =
+                rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; ++i) {
+            uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+            uint32_t t1 = h + s1 + ((e & f) ^ (~e & g)) + K[i] + w[i];
+            uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+            uint32_t t2 = s0 + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#if defined(__aarch64__)
+
+// Message words in groups of four, group k from the four before it
+__attribute__((target("sha2"))) void compressArm(
+    uint32_t* state, const uint8_t* data, size_t count
+) {
+    uint32x4_t abcd = vld1q_u32(state);
+    uint32x4_t efgh = vld1q_u32(state + 4);
+    for (; count > 0; --count, data += BLOCK_SIZE) {
+        uint32x4_t savedAbcd = abcd;
+        uint32x4_t savedEfgh = efgh;
+        uint32x4_t msg[4];
+        for (int k = 0; k < 16; ++k) {
+            uint32x4_t& group = msg[k % 4];
+            if (k < 4) {
+                uint8x16_t bytes = vld1q_u8(data + k * 16);
+                group = vreinterpretq_u32_u8(vrev32q_u8(bytes));
+            } else {
+                group = vsha256su1q_u32(
+                    vsha256su0q_u32(group, msg[(k + 1) % 4]),
+                    msg[(k + 2) % 4],
+                    msg[(k + 3) % 4]
+                );
+            }
+            uint32x4_t words = vaddq_u32(group, vld1q_u32(K + k * 4));
+            uint32x4_t previous = abcd;
+            abcd = vsha256hq_u32(abcd, efgh, words);
+            efgh = vsha256h2q_u32(efgh, previous, words);
+        }
+        abcd = vaddq_u32(abcd, savedAbcd);
+        efgh = vaddq_u32(efgh, savedEfgh);
+    }
+    vst1q_u32(state, abcd);
+    vst1q_u32(state + 4, efgh);
+}
+
+bool hasShaInstructions() {
+    static const bool hasSha = (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+    return hasSha;
+}
+
+constexpr const char* KERNEL_NAME = "armv8";
+
+BlockKernel selectKernel() {
+    return hasShaInstructions() ? compressArm : compressScalar;
+}
+
+#elif defined(SHA256_HAS_X86)
+
+// SHA-NI keeps the state as ABEF and CDGH, message words in groups of four
+__attribute__((target("sha,ssse3,sse4.1"))) void compressX86(
+    uint32_t* state, const uint8_t* data, size_t count
+) {
+    const __m128i byteSwap =
+        _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i dcba = _mm_loadu_si128(reinterpret_cast<const __m128i*>(state));
+    __m128i hgfe =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 4));
+    __m128i cdab = _mm_shuffle_epi32(dcba, 0xb1);
+    __m128i efgh = _mm_shuffle_epi32(hgfe, 0x1b);
+    __m128i abef = _mm_alignr_epi8(cdab, efgh, 8);
+    __m128i cdgh = _mm_blend_epi16(efgh, cdab, 0xf0);
+
+    for (; count > 0; --count, data += BLOCK_SIZE) {
+        __m128i savedAbef = abef;
+        __m128i savedCdgh = cdgh;
+        __m128i msg[4];
+        for (int k = 0; k < 16; ++k) {
+            __m128i& group = msg[k % 4];
+            if (k < 4) {
+                group = _mm_shuffle_epi8(
+                    _mm_loadu_si128(
+                        reinterpret_cast<const __m128i*>(data + k * 16)
+                    ),
+                    byteSwap
+                );
+            } else {
+                __m128i previous = msg[(k + 3) % 4];
+                group = _mm_sha256msg1_epu32(group, msg[(k + 1) % 4]);
+                group = _mm_add_epi32(
+                    group, _mm_alignr_epi8(previous, msg[(k + 2) % 4], 4)
+                );
+                group = _mm_sha256msg2_epu32(group, previous);
+            }
+            __m128i constants =
+                _mm_load_si128(reinterpret_cast<const __m128i*>(K + k * 4));
+            __m128i words = _mm_add_epi32(group, constants);
+            cdgh = _mm_sha256rnds2_epu32(cdgh, abef, words);
+            abef = _mm_sha256rnds2_epu32(
+                abef, cdgh, _mm_shuffle_epi32(words, 0x0e)
+            );
+        }
+        abef = _mm_add_epi32(abef, savedAbef);
+        cdgh = _mm_add_epi32(cdgh, savedCdgh);
+    }
+
+    __m128i feba = _mm_shuffle_epi32(abef, 0x1b);
+    __m128i dchg = _mm_shuffle_epi32(cdgh, 0xb1);
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(state), _mm_blend_epi16(feba, dchg, 0xf0)
+    );
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(state + 4), _mm_alignr_epi8(dchg, feba, 8)
+    );
+}
+
+bool hasShaInstructions() {
+    static const bool hasSha = [] {
+        unsigned eax, ebx, ecx, edx;
+        if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return false;
+        return (ebx & bit_SHA) != 0;
+    }();
+    return hasSha;
+}
+
+constexpr const char* KERNEL_NAME = "sha-ni";
+
+BlockKernel selectKernel() {
+    return hasShaInstructions() ? compressX86 : compressScalar;
+}
+
+#else
+
+constexpr const char* KERNEL_NAME = "scalar";
+
+BlockKernel selectKernel() { return compressScalar; }
+
+bool hasShaInstructions() { return false; }
+
+#endif
+
+BlockKernel getKernel() {
+    static const BlockKernel kernel = selectKernel();
+    return kernel;
+}
+
+// Compress the partial last block with the 0x80 terminator and the bit
+// length, in one or two blocks
+Sha256Digest finishBlocks(
+    BlockKernel kernel,
+    std::array<uint32_t, 8>& state,
+    const uint8_t* rest,
+    size_t restSize,
+    uint64_t length
+) {
+    uint8_t tail[BLOCK_SIZE * 2] = {};
+    if (restSize > 0) memcpy(tail, rest, restSize);
+    tail[restSize] = 0x80;
+    size_t tailSize =
+        restSize < BLOCK_SIZE - 8 ? BLOCK_SIZE : BLOCK_SIZE * 2;
+    uint64_t bits = length * 8;
+    for (int i = 0; i < 8; ++i) {
+        tail[tailSize - 1 - i] = static_cast<uint8_t>(bits >> (i * 8));
+    }
+    kernel(state.data(), tail, tailSize / BLOCK_SIZE);
+
+    Sha256Digest digest;
+    for (size_t i = 0; i < state.size(); ++i) {
+        digest[i * 4] = static_cast<uint8_t>(state[i] >> 24);
+        digest[i * 4 + 1] = static_cast<uint8_t>(state[i] >> 16);
+        digest[i * 4 + 2] = static_cast<uint8_t>(state[i] >> 8);
+        digest[i * 4 + 3] = static_cast<uint8_t>(state[i]);
+    }
+    return digest;
+}
+
+Sha256Digest hashWith(BlockKernel kernel, const void* data, size_t size) {
+    std::array<uint32_t, 8> state = INITIAL_STATE;
+    auto* bytes = static_cast<const uint8_t*>(data);
+    size_t blocks = size / BLOCK_SIZE;
+    kernel(state.data(), bytes, blocks);
+    return finishBlocks(
+        kernel, state, bytes + blocks * BLOCK_SIZE, size % BLOCK_SIZE, size
+    );
+}
+
+}  // namespace
+
+void Sha256::reset() {
+    state_ = INITIAL_STATE;
+    buffered_ = 0;
+    length_ = 0;
+}
+
+void Sha256::update(const void* data, size_t size) {
+    auto* bytes = static_cast<const uint8_t*>(data);
+    length_ += size;
+    if (buffered_ > 0) {
+        size_t chunk = std::min(size, BLOCK_SIZE - buffered_);
+        memcpy(buffer_.data() + buffered_, bytes, chunk);
+        buffered_ += chunk;
+        bytes += chunk;
+        size -= chunk;
+        if (buffered_ < BLOCK_SIZE) return;
+        getKernel()(state_.data(), buffer_.data(), 1);
+        buffered_ = 0;
+    }
+    // Whole blocks straight from the caller's memory, without a copy
+    size_t blocks = size / BLOCK_SIZE;
+    if (blocks > 0) getKernel()(state_.data(), bytes, blocks);
+    bytes += blocks * BLOCK_SIZE;
+    size -= blocks * BLOCK_SIZE;
+    memcpy(buffer_.data(), bytes, size);
+    buffered_ = size;
+}
+
+Sha256Digest Sha256::finish() {
+    Sha256Digest digest = finishBlocks(
+        getKernel(), state_, buffer_.data(), buffered_, length_
+    );
+    reset();
+    return digest;
+}
+
+Sha256Digest Sha256::hash(const void* data, size_t size) {
+    return hashWith(getKernel(), data, size);
+}
+
+Sha256Digest sha256Reference(const void* data, size_t size) {
+    return hashWith(compressScalar, data, size);
+}
+
+const char* getSha256KernelName() {
+    return hasShaInstructions() ? KERNEL_NAME : "scalar";
+}
+
+}  // namespace camera
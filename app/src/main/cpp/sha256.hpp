@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace camera {
+
+using Sha256Digest = std::array<uint8_t, 32>;
+
+/**
+ * Incremental SHA-256. Blocks are compressed with the SHA instructions of
+ * the running CPU when it has them (ARMv8 SHA2, x86 SHA-NI), with the
+ * portable code otherwise.
+ */
+class Sha256 {
+  public:
+    Sha256() { reset(); }
+
+    void reset();
+    void update(const void* data, size_t size);
+    /** The digest of everything since the last reset, then resets. */
+    Sha256Digest finish();
+
+    static Sha256Digest hash(const void* data, size_t size);
+
+  private:
+    std::array<uint32_t, 8> state_;
+    std::array<uint8_t, 64> buffer_;
+    size_t buffered_ = 0;
+    uint64_t length_ = 0;
+};
+
+// Portable implementation, the reference for the accelerated kernels
+Sha256Digest sha256Reference(const void* data, size_t size);
+
+// Name of the kernel Sha256 dispatches to, for logs and benchmarks
+const char* getSha256KernelName();
+
+}  // namespace camera
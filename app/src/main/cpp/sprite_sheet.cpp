@@ -0,0 +1,65 @@
+#include "sprite_sheet.hpp"
+
+#include <algorithm>
+
+#include "util.hpp"
+
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_ONLY_GIF
+#include <stb_image.h>
+
+using namespace camera::util;
+
+namespace camera {
+
+bool SpriteSheet::decode(const void* data, size_t size) {
+    int* delays = nullptr;
+    int width = 0;
+    int height = 0;
+    int frames = 0;
+    int channels = 0;
+    stbi_uc* pixels = stbi_load_gif_from_memory(
+        static_cast<const stbi_uc*>(data),
+        static_cast<int>(size),
+        &delays,
+        &width,
+        &height,
+        &frames,
+        &channels,
+        STBI_rgb_alpha
+    );
+    if (!pixels) {
+        logE("Can't decode the animation: %s", stbi_failure_reason());
+        return false;
+    }
+    if (width > static_cast<int>(MAX_SIZE) ||
+        height > static_cast<int>(MAX_SIZE)) {
+        logE("Animation of %dx%d is too large", width, height);
+        stbi_image_free(pixels);
+        stbi_image_free(delays);
+        return false;
+    }
+    if (frames > static_cast<int>(MAX_FRAMES)) {
+        logW("%d animation frames, only %u shown", frames, MAX_FRAMES);
+    }
+
+    width_ = static_cast<uint32_t>(width);
+    height_ = static_cast<uint32_t>(height);
+    frameCount_ = std::min(static_cast<uint32_t>(frames), MAX_FRAMES);
+    size_t frameSize = size_t{width_} * height_ * 4;
+    pixels_.assign(pixels, pixels + frameSize * frameCount_);
+
+    uint32_t endMs = 0;
+    for (uint32_t i = 0; i < frameCount_; ++i) {
+        int32_t delayMs = delays ? delays[i] : 0;
+        endMs += delayMs < MIN_DELAY_MS ? DEFAULT_DELAY_MS : delayMs;
+        frameEndsMs_[i] = endMs;
+    }
+    std::fill(frameEndsMs_.begin() + frameCount_, frameEndsMs_.end(), endMs);
+
+    stbi_image_free(pixels);
+    stbi_image_free(delays);
+    return true;
+}
+
+}  // namespace camera
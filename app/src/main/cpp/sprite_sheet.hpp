@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace camera {
+
+/**
+ * The frames of an animated GIF decoded once to RGBA, one after the other
+ * so they can be copied into the layers of an array texture. The frame
+ * shown at a time is looked up from the frame end times, the layer shader
+ * does that on the GPU for every frame drawn.
+ */
+class SpriteSheet {
+  public:
+    static constexpr uint32_t MAX_FRAMES = 64;
+    // What the device limits of every Vulkan implementation allow
+    static constexpr uint32_t MAX_SIZE = 4096;
+
+    /**
+     * Decode a GIF, false if it can't be. Frames beyond MAX_FRAMES are
+     * dropped.
+     */
+    bool decode(const void* data, size_t size);
+
+    [[nodiscard]] bool isEmpty() const { return frameCount_ == 0; }
+    [[nodiscard]] const std::vector<uint8_t>& getPixels() const {
+        return pixels_;
+    }
+    [[nodiscard]] uint32_t getWidth() const { return width_; }
+    [[nodiscard]] uint32_t getHeight() const { return height_; }
+    [[nodiscard]] uint32_t getFrameCount() const { return frameCount_; }
+    // Since the start of the animation, the last one is its duration
+    [[nodiscard]] const std::array<uint32_t, MAX_FRAMES>& getFrameEndsMs(
+    ) const {
+        return frameEndsMs_;
+    }
+    [[nodiscard]] uint32_t getDurationMs() const {
+        return isEmpty() ? 0 : frameEndsMs_[frameCount_ - 1];
+    }
+
+  private:
+    // What browsers show frames with shorter delays for
+    static constexpr int32_t DEFAULT_DELAY_MS = 100;
+    static constexpr int32_t MIN_DELAY_MS = 20;
+
+    std::vector<uint8_t> pixels_;
+    uint32_t width_ = 0;
+    uint32_t height_ = 0;
+    uint32_t frameCount_ = 0;
+    std::array<uint32_t, MAX_FRAMES> frameEndsMs_{};
+};
+
+}  // namespace camera
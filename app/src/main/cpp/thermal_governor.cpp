@@ -0,0 +1,136 @@
+#include "thermal_governor.hpp"
+
+#include <dlfcn.h>
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+
+#include "util.hpp"
+
+using namespace camera::util;
+
+namespace camera {
+
+// Entry points of android/thermal.h, AThermalManager* as void*
+struct AThermalSource::Api {
+    void* library = nullptr;
+    void* (*acquireManager)() = nullptr;
+    void (*releaseManager)(void*) = nullptr;
+    int32_t (*getCurrentStatus)(void*) = nullptr;
+    float (*getThermalHeadroom)(void*, int32_t) = nullptr;
+};
+
+AThermalSource::AThermalSource() : api_(std::make_unique<Api>()) {
+    api_->library = dlopen("libandroid.so", RTLD_NOW | RTLD_LOCAL);
+    if (!api_->library) return;
+    auto load = [this](auto& fn, const char* name) {
+        fn = reinterpret_cast<std::remove_reference_t<decltype(fn)>>(
+            dlsym(api_->library, name)
+        );
+    };
+    load(api_->acquireManager, "AThermal_acquireManager");
+    load(api_->releaseManager, "AThermal_releaseManager");
+    load(api_->getCurrentStatus, "AThermal_getCurrentStatus");
+    load(api_->getThermalHeadroom, "AThermal_getThermalHeadroom");
+    if (api_->acquireManager && api_->releaseManager &&
+        api_->getCurrentStatus) {
+        manager_ = api_->acquireManager();
+    }
+    if (!manager_) logW("Thermal status is not available");
+}
+
+AThermalSource::~AThermalSource() {
+    if (manager_) api_->releaseManager(manager_);
+    if (api_->library) dlclose(api_->library);
+}
+
+ThermalStatus AThermalSource::getStatus() {
+    if (!manager_) return ThermalStatus::NONE;
+    int32_t status = api_->getCurrentStatus(manager_);
+    // ATHERMAL_STATUS_ERROR is -1
+    if (status < 0) return ThermalStatus::NONE;
+    return static_cast<ThermalStatus>(
+        std::min(status, static_cast<int32_t>(ThermalStatus::SHUTDOWN))
+    );
+}
+
+float AThermalSource::getHeadroom(int32_t forecastSeconds) {
+    if (!manager_ || !api_->getThermalHeadroom) return NAN;
+    return api_->getThermalHeadroom(manager_, forecastSeconds);
+}
+
+ThermalGovernor::ThermalGovernor(
+    std::unique_ptr<ThermalSource> source, std::vector<QualityLevel> ladder
+)
+    : source_(std::move(source)), ladder_(std::move(ladder)) {
+    logAssert(!ladder_.empty(), "empty quality ladder");
+}
+
+void ThermalGovernor::onFrame(std::chrono::microseconds renderTime) {
+    renderTimeSumUs_ += renderTime.count();
+    renderCount_++;
+}
+
+bool ThermalGovernor::update(Clock::time_point now) {
+    if (now - lastSample_ < SAMPLE_INTERVAL) return false;
+    lastSample_ = now;
+
+    ThermalStatus status = source_->getStatus();
+    float headroom = source_->getHeadroom(HEADROOM_FORECAST_SECONDS);
+    float load = 0.0f;
+    if (renderCount_ > 0) {
+        float frameUs = 1e6f / static_cast<float>(getLevel().frameRate);
+        load = static_cast<float>(renderTimeSumUs_) /
+               static_cast<float>(renderCount_) / frameUs;
+    }
+    renderTimeSumUs_ = 0;
+    renderCount_ = 0;
+    overloadedSamples_ = load > LOAD_HIGH ? overloadedSamples_ + 1 : 0;
+
+    Clock::duration sinceChange = now - lastChange_;
+    if (status >= ThermalStatus::CRITICAL) {
+        calmSince_ = now;
+        return setLevel(ladder_.size() - 1, now, "critical");
+    }
+    if (status == ThermalStatus::SEVERE) {
+        calmSince_ = now;
+        if (sinceChange < SEVERE_STEP_DOWN_INTERVAL) return false;
+        return setLevel(level_ + 1, now, "severe");
+    }
+    // NaN headroom compares false, only the status counts then
+    bool isHot = status == ThermalStatus::MODERATE || headroom >= HEADROOM_HOT;
+    if (isHot || overloadedSamples_ >= OVERLOAD_SAMPLES) {
+        calmSince_ = now;
+        if (sinceChange < STEP_DOWN_INTERVAL) return false;
+        return setLevel(level_ + 1, now, isHot ? "hot" : "overloaded");
+    }
+
+    // Between the thresholds neither step is taken
+    bool isCalm = status <= ThermalStatus::LIGHT &&
+                  !(headroom >= HEADROOM_COOL) && load < LOAD_LOW;
+    if (!isCalm) {
+        calmSince_ = now;
+        return false;
+    }
+    if (level_ == 0 || now - calmSince_ < COOL_DOWN ||
+        sinceChange < COOL_DOWN) {
+        return false;
+    }
+    calmSince_ = now;
+    return setLevel(level_ - 1, now, "cool");
+}
+
+bool ThermalGovernor::setLevel(
+    size_t level, Clock::time_point now, const char* reason
+) {
+    level = std::min(level, ladder_.size() - 1);
+    if (level == level_) return false;
+    logI("Quality level %zu -> %zu, %s", level_, level, reason);
+    level_ = level;
+    lastChange_ = now;
+    overloadedSamples_ = 0;
+    return true;
+}
+
+}  // namespace camera
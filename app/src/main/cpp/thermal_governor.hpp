@@ -0,0 +1,125 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace camera {
+
+// AThermalStatus values
+enum class ThermalStatus : int32_t {
+    NONE = 0,
+    LIGHT,
+    MODERATE,
+    SEVERE,
+    CRITICAL,
+    EMERGENCY,
+    SHUTDOWN
+};
+
+/** Where the governor reads the device temperature from. */
+class ThermalSource {
+  public:
+    virtual ~ThermalSource() = default;
+
+    virtual ThermalStatus getStatus() = 0;
+    /**
+     * Forecast of the thermal headroom, 1.0 is where SEVERE throttling
+     * starts. NaN when unknown.
+     */
+    virtual float getHeadroom(int32_t forecastSeconds) = 0;
+};
+
+/**
+ * ThermalSource backed by the AThermal API. It's looked up at runtime
+ * since it needs API 30, headroom API 31, and reports NONE without it.
+ */
+class AThermalSource : public ThermalSource {
+  public:
+    AThermalSource();
+    ~AThermalSource() override;
+
+    AThermalSource(const AThermalSource&) = delete;
+    AThermalSource& operator=(const AThermalSource&) = delete;
+
+    ThermalStatus getStatus() override;
+    float getHeadroom(int32_t forecastSeconds) override;
+
+  private:
+    struct Api;
+
+    std::unique_ptr<Api> api_;
+    void* manager_ = nullptr;
+};
+
+/** One step of the quality ladder. */
+struct QualityLevel {
+    uint32_t framesInFlight;
+    // Display swapchain size relative to the window
+    float previewScale;
+    int32_t bitrate;
+    int32_t frameRate;
+    // Preview rate limit below the camera's, 0 for none. The preview is
+    // drawn the most, so it gives way before the recording does
+    int32_t previewFrameRate;
+};
+
+/**
+ * Trades quality for heat. Thermal status and render times are sampled
+ * every SAMPLE_INTERVAL, under pressure the governor steps down the
+ * ladder, and it only steps back up after COOL_DOWN without pressure, so
+ * it doesn't oscillate around a threshold.
+ */
+class ThermalGovernor {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    /** The first level is the full quality, each next one is cheaper. */
+    ThermalGovernor(
+        std::unique_ptr<ThermalSource> source, std::vector<QualityLevel> ladder
+    );
+
+    /** CPU time spent rendering a frame, without the waits on the GPU. */
+    void onFrame(std::chrono::microseconds renderTime);
+
+    /** Sample if it's time to, true when the level changed. */
+    bool update(Clock::time_point now = Clock::now());
+
+    [[nodiscard]] const QualityLevel& getLevel() const {
+        return ladder_[level_];
+    }
+    [[nodiscard]] size_t getLevelIndex() const { return level_; }
+
+  private:
+    static constexpr auto SAMPLE_INTERVAL = std::chrono::seconds(2);
+    static constexpr int32_t HEADROOM_FORECAST_SECONDS = 10;
+    // Headroom forecast to step down at, and to stay below to step up
+    static constexpr float HEADROOM_HOT = 0.9f;
+    static constexpr float HEADROOM_COOL = 0.7f;
+    // Render time relative to the frame interval
+    static constexpr float LOAD_HIGH = 0.9f;
+    static constexpr float LOAD_LOW = 0.6f;
+    // Samples in a row over LOAD_HIGH before stepping down
+    static constexpr uint32_t OVERLOAD_SAMPLES = 2;
+    // Let a step take effect before the next one
+    static constexpr auto STEP_DOWN_INTERVAL = std::chrono::seconds(10);
+    static constexpr auto SEVERE_STEP_DOWN_INTERVAL = std::chrono::seconds(2);
+    static constexpr auto COOL_DOWN = std::chrono::seconds(30);
+
+    std::unique_ptr<ThermalSource> source_;
+    std::vector<QualityLevel> ladder_;
+    size_t level_ = 0;
+
+    int64_t renderTimeSumUs_ = 0;
+    uint32_t renderCount_ = 0;
+    uint32_t overloadedSamples_ = 0;
+    Clock::time_point lastSample_{};
+    Clock::time_point lastChange_{};
+    // Start of the current stretch without pressure
+    Clock::time_point calmSince_{};
+
+    bool setLevel(size_t level, Clock::time_point now, const char* reason);
+};
+
+}  // namespace camera
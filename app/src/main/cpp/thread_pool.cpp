@@ -0,0 +1,101 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+namespace camera {
+
+ThreadPool::ThreadPool(uint32_t threadCount) {
+    workers_.reserve(threadCount);
+    for (uint32_t i = 0; i < threadCount; ++i) {
+        workers_.emplace_back(&ThreadPool::run, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+uint32_t ThreadPool::defaultThreadCount() {
+    // One core is left to the caller which works on the loop as well
+    uint32_t cores = std::thread::hardware_concurrency();
+    return cores > 1 ? cores - 1 : 0;
+}
+
+void ThreadPool::parallelFor(
+    int32_t begin,
+    int32_t end,
+    int32_t grain,
+    const std::function<void(int32_t, int32_t)>& fn
+) {
+    if (begin >= end) return;
+    grain = std::max(grain, 1);
+    int32_t chunks = (end - begin + grain - 1) / grain;
+    if (chunks == 1 || workers_.empty()) {
+        fn(begin, end);
+        return;
+    }
+
+    std::lock_guard loopLock(loopMutex_);
+    {
+        std::lock_guard lock(mutex_);
+        loop_.fn = &fn;
+        loop_.end = end;
+        loop_.grain = grain;
+        loop_.next = begin;
+        loop_.remaining = chunks;
+        ++generation_;
+    }
+    wake_.notify_all();
+
+    work(fn);
+
+    // Workers still inside work() hold on to fn, wait for them to leave
+    std::unique_lock lock(mutex_);
+    done_.wait(lock, [this] { return loop_.remaining == 0 && active_ == 0; });
+    loop_.fn = nullptr;
+}
+
+void ThreadPool::run() {
+    uint64_t seen = 0;
+    for (;;) {
+        const std::function<void(int32_t, int32_t)>* fn;
+        {
+            std::unique_lock lock(mutex_);
+            wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+            if (stop_) return;
+            seen = generation_;
+            // Woke up after the loop was already finished
+            if (loop_.fn == nullptr) continue;
+            fn = loop_.fn;
+            ++active_;
+        }
+        work(*fn);
+        {
+            std::lock_guard lock(mutex_);
+            --active_;
+        }
+        done_.notify_one();
+    }
+}
+
+void ThreadPool::work(const std::function<void(int32_t, int32_t)>& fn) {
+    for (;;) {
+        int32_t chunkBegin = loop_.next.fetch_add(loop_.grain);
+        if (chunkBegin >= loop_.end) return;
+        fn(chunkBegin, std::min(chunkBegin + loop_.grain, loop_.end));
+
+        if (loop_.remaining.fetch_sub(1) == 1) {
+            std::lock_guard lock(mutex_);
+            done_.notify_one();
+        }
+    }
+}
+
+}  // namespace camera
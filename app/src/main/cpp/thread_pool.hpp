@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace camera {
+
+/**
+ * Fixed set of worker threads for data parallel loops. The calling thread
+ * takes part in the work, so a pool of N threads runs N + 1 chunks at once.
+ */
+class ThreadPool {
+  public:
+    explicit ThreadPool(uint32_t threadCount = defaultThreadCount());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * Split [begin, end) into chunks of grain items and call fn(chunkBegin,
+     * chunkEnd) for each of them in parallel. Returns once every chunk is
+     * done.
+     */
+    void parallelFor(
+        int32_t begin,
+        int32_t end,
+        int32_t grain,
+        const std::function<void(int32_t, int32_t)>& fn
+    );
+
+    [[nodiscard]] uint32_t size() const {
+        return static_cast<uint32_t>(workers_.size());
+    }
+
+    static uint32_t defaultThreadCount();
+
+  private:
+    struct Loop {
+        const std::function<void(int32_t, int32_t)>* fn = nullptr;
+        int32_t end = 0;
+        int32_t grain = 1;
+        std::atomic<int32_t> next = 0;
+        std::atomic<int32_t> remaining = 0;
+    };
+
+    std::vector<std::thread> workers_;
+    // Serializes parallelFor calls from different threads
+    std::mutex loopMutex_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    Loop loop_;
+    uint64_t generation_ = 0;
+    // Workers currently running chunks of loop_
+    int32_t active_ = 0;
+    bool stop_ = false;
+
+    void run();
+    void work(const std::function<void(int32_t, int32_t)>& fn);
+};
+
+}  // namespace camera
@@ -0,0 +1,133 @@
+#include "tile_coverage.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace camera {
+
+namespace {
+
+bool hasVisiblePixel(
+    const uint8_t* data, uint32_t width, uint32_t height, size_t rowStride
+) {
+    // Little endian RGBA, the alpha is the top byte of each pixel
+    constexpr uint32_t ALPHA_MASK = 0xff000000u;
+    for (uint32_t y = 0; y < height; ++y) {
+        const uint8_t* row = data + y * rowStride;
+        uint32_t alpha = 0;
+        for (uint32_t x = 0; x < width; ++x) {
+            uint32_t pixel;
+            memcpy(&pixel, row + size_t{x} * 4, sizeof(pixel));
+            alpha |= pixel;
+        }
+        if (alpha & ALPHA_MASK) return true;
+    }
+    return false;
+}
+
+}  // namespace
+
+void TileCoverage::update(
+    const uint8_t* data,
+    uint32_t width,
+    uint32_t height,
+    size_t rowStride,
+    const std::vector<DamageRect>& damage
+) {
+    std::vector<DamageRect> all;
+    if (width != width_ || height != height_) {
+        resize(width, height);
+        all.push_back({0, 0, width, height});
+    }
+
+    // A pixel is sampled by the tiles next to it too when filtered, the
+    // tiles are scanned a pixel past their edges and so the ones around
+    // the damage with it
+    bool changed = false;
+    for (const DamageRect& rect : all.empty() ? damage : all) {
+        uint32_t firstRow = rect.y / TILE_SIZE;
+        uint32_t firstColumn = rect.x / TILE_SIZE;
+        uint32_t lastRow = std::min(
+            (rect.y + rect.height - 1) / TILE_SIZE + 1, rows_ - 1
+        );
+        uint32_t lastColumn = std::min(
+            (rect.x + rect.width - 1) / TILE_SIZE + 1, columns_ - 1
+        );
+        if (firstRow > 0) --firstRow;
+        if (firstColumn > 0) --firstColumn;
+        for (uint32_t row = firstRow; row <= lastRow; ++row) {
+            for (uint32_t column = firstColumn; column <= lastColumn;
+                 ++column) {
+                uint32_t x0 = column * TILE_SIZE;
+                uint32_t y0 = row * TILE_SIZE;
+                if (x0 > 0) --x0;
+                if (y0 > 0) --y0;
+                uint32_t x1 = std::min((column + 1) * TILE_SIZE + 1, width);
+                uint32_t y1 = std::min((row + 1) * TILE_SIZE + 1, height);
+                bool covered = hasVisiblePixel(
+                    data + y0 * rowStride + size_t{x0} * 4,
+                    x1 - x0,
+                    y1 - y0,
+                    rowStride
+                );
+                size_t tile = size_t{row} * columns_ + column;
+                changed |= covered_[tile] != covered;
+                covered_[tile] = covered;
+            }
+        }
+    }
+    if (changed) ++generation_;
+}
+
+void TileCoverage::setFull(uint32_t width, uint32_t height) {
+    if (width != width_ || height != height_) resize(width, height);
+    if (std::ranges::all_of(covered_, [](bool covered) { return covered; })) {
+        return;
+    }
+    covered_.assign(covered_.size(), true);
+    ++generation_;
+}
+
+void TileCoverage::getRects(std::vector<LayerRect>& rects) const {
+    rects.clear();
+    auto scaleX = [this](uint32_t column) {
+        return static_cast<float>(std::min(column * TILE_SIZE, width_)) /
+               static_cast<float>(width_);
+    };
+    auto scaleY = [this](uint32_t row) {
+        return static_cast<float>(std::min(row * TILE_SIZE, height_)) /
+               static_cast<float>(height_);
+    };
+    for (uint32_t row = 0; row < rows_; ++row) {
+        auto covered = [&](uint32_t column) {
+            return covered_[size_t{row} * columns_ + column];
+        };
+        uint32_t column = 0;
+        while (column < columns_) {
+            if (!covered(column)) {
+                ++column;
+                continue;
+            }
+            uint32_t start = column;
+            while (column < columns_ && covered(column)) ++column;
+            rects.push_back(
+                {scaleX(start), scaleY(row), scaleX(column), scaleY(row + 1)}
+            );
+        }
+    }
+}
+
+uint32_t TileCoverage::getCoveredTiles() const {
+    return static_cast<uint32_t>(std::ranges::count(covered_, true));
+}
+
+void TileCoverage::resize(uint32_t width, uint32_t height) {
+    width_ = width;
+    height_ = height;
+    columns_ = (width + TILE_SIZE - 1) / TILE_SIZE;
+    rows_ = (height + TILE_SIZE - 1) / TILE_SIZE;
+    covered_.assign(size_t{columns_} * rows_, false);
+    ++generation_;
+}
+
+}  // namespace camera
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "tile_diff.hpp"
+#include "watermark_layers.hpp"
+
+namespace camera {
+
+/**
+ * Which tiles of an RGBA image have a pixel with a non zero alpha on or
+ * next to them, on the TileDiff grid, so filtering never reads anything
+ * visible outside the covered tiles. Only the damaged areas are scanned
+ * again, keeping it current costs about as much as the changes do. The
+ * generation changes whenever the covered tiles do.
+ */
+class TileCoverage {
+  public:
+    static constexpr uint32_t TILE_SIZE = TileDiff::TILE_SIZE;
+
+    /** Rescan the tiles under damage, all of them on a size change. */
+    void update(
+        const uint8_t* data,
+        uint32_t width,
+        uint32_t height,
+        size_t rowStride,
+        const std::vector<DamageRect>& damage
+    );
+
+    /** Cover every tile, for images that can't be scanned. */
+    void setFull(uint32_t width, uint32_t height);
+
+    /**
+     * Replace rects with the covered areas normalized to the image, one
+     * per run of covered tiles in a row of tiles.
+     */
+    void getRects(std::vector<LayerRect>& rects) const;
+
+    [[nodiscard]] uint32_t getCoveredTiles() const;
+    [[nodiscard]] uint32_t getTileCount() const {
+        return static_cast<uint32_t>(covered_.size());
+    }
+    [[nodiscard]] uint32_t getGeneration() const { return generation_; }
+
+  private:
+    uint32_t width_ = 0;
+    uint32_t height_ = 0;
+    uint32_t columns_ = 0;
+    uint32_t rows_ = 0;
+    std::vector<bool> covered_;
+    uint32_t generation_ = 0;
+
+    void resize(uint32_t width, uint32_t height);
+};
+
+}  // namespace camera
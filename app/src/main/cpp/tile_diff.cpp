@@ -0,0 +1,88 @@
+#include "tile_diff.hpp"
+
+#include <algorithm>
+
+#include "content_hash.hpp"
+
+namespace camera {
+
+void TileDiff::diff(
+    const uint8_t* data,
+    uint32_t width,
+    uint32_t height,
+    size_t rowStride,
+    std::vector<DamageRect>& damage
+) {
+    damage.clear();
+    uint32_t columns = (width + TILE_SIZE - 1) / TILE_SIZE;
+    uint32_t rows = (height + TILE_SIZE - 1) / TILE_SIZE;
+    bool resized = width != width_ || height != height_;
+    if (resized || tileHashes_.empty()) {
+        width_ = width;
+        height_ = height;
+        tileHashes_.assign(size_t{columns} * rows, 0);
+        changed_.assign(tileHashes_.size(), true);
+    } else {
+        changed_.assign(tileHashes_.size(), false);
+    }
+
+    for (uint32_t row = 0; row < rows; ++row) {
+        uint32_t y = row * TILE_SIZE;
+        uint32_t tileHeight = std::min(TILE_SIZE, height - y);
+        for (uint32_t column = 0; column < columns; ++column) {
+            uint32_t x = column * TILE_SIZE;
+            uint32_t tileWidth = std::min(TILE_SIZE, width - x);
+            uint64_t hash = hashImage(
+                data + y * rowStride + size_t{x} * 4,
+                size_t{tileWidth} * 4,
+                tileHeight,
+                rowStride
+            );
+            size_t tile = size_t{row} * columns + column;
+            if (hash != tileHashes_[tile]) changed_[tile] = true;
+            tileHashes_[tile] = hash;
+        }
+    }
+
+    // Rects reaching down to the current row of tiles, which can grow
+    // further down
+    std::vector<size_t> open;
+    std::vector<size_t> nextOpen;
+    for (uint32_t row = 0; row < rows; ++row) {
+        uint32_t y = row * TILE_SIZE;
+        uint32_t tileHeight = std::min(TILE_SIZE, height - y);
+        nextOpen.clear();
+        auto changed = [&](uint32_t column) {
+            return changed_[size_t{row} * columns + column];
+        };
+        uint32_t column = 0;
+        while (column < columns) {
+            if (!changed(column)) {
+                ++column;
+                continue;
+            }
+            uint32_t start = column;
+            while (column < columns && changed(column)) ++column;
+            uint32_t x = start * TILE_SIZE;
+            uint32_t runWidth = std::min(column * TILE_SIZE, width) - x;
+
+            auto above = std::find_if(open.begin(), open.end(), [&](size_t i) {
+                return damage[i].x == x && damage[i].width == runWidth;
+            });
+            if (above != open.end()) {
+                damage[*above].height += tileHeight;
+                nextOpen.push_back(*above);
+            } else {
+                damage.push_back({x, y, runWidth, tileHeight});
+                nextOpen.push_back(damage.size() - 1);
+            }
+        }
+        open.swap(nextOpen);
+    }
+}
+
+void TileDiff::reset() {
+    tileHashes_.clear();
+}
+
+}  // namespace camera
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace camera {
+
+/** Area of an image in pixels. */
+struct DamageRect {
+    uint32_t x = 0;
+    uint32_t y = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+};
+
+/**
+ * Finds what changed in a 4 byte per pixel image since the previous one
+ * by checksumming it in tiles, see hashImage(). Only the checksums of the
+ * tiles are kept, not the image. Changed tiles next to each other in a
+ * row of tiles become one rect, which then grows down over the rows of
+ * tiles changed in the same columns.
+ */
+class TileDiff {
+  public:
+    static constexpr uint32_t TILE_SIZE = 64;
+
+    /**
+     * Replace damage with the areas changed since the last image diffed.
+     * All of it is damaged the first time, after reset() and when the
+     * size changes.
+     */
+    void diff(
+        const uint8_t* data,
+        uint32_t width,
+        uint32_t height,
+        size_t rowStride,
+        std::vector<DamageRect>& damage
+    );
+
+    /** Forget the last image. */
+    void reset();
+
+  private:
+    uint32_t width_ = 0;
+    uint32_t height_ = 0;
+    std::vector<uint64_t> tileHashes_;
+    // Changed tiles of the current image, by tile row
+    std::vector<bool> changed_;
+};
+
+}  // namespace camera
@@ -4,11 +4,12 @@
 #include <camera/NdkCameraManager.h>
 #include <media/NdkImage.h>
 
+#include <algorithm>
+#include <array>
 #include <cinttypes>
 #include <string>
 #include <typeinfo>
 #include <utility>
-#include <vector>
 
 #define UKNOWN_TAG "UNKNOW_TAG"
 #define MAKE_PAIR(val) std::make_pair(val, #val)
@@ -25,20 +26,42 @@ void callCamera(camera_status_t status, std::source_location location) {
 }
 
 template <typename T>
-const char* getPairStr(T key, std::vector<std::pair<T, const char*>>& store) {
-    typedef typename std::vector<std::pair<T, const char*>>::iterator iterator;
-    for (iterator it = store.begin(); it != store.end(); ++it) {
-        if (it->first == key) {
-            return it->second;
+using NamePair = std::pair<T, const char*>;
+
+// Tables are sorted by key at compile time, so they need no static
+// initializers and lookups are a binary search
+template <typename T, size_t N>
+constexpr std::array<NamePair<T>, N> sortByKey(
+    std::array<NamePair<T>, N> table
+) {
+    // Insertion sort, the tables are written almost in key order and
+    // constexpr std::sort is missing from older NDK libc++
+    for (size_t i = 1; i < N; ++i) {
+        for (size_t j = i; j > 0 && table[j].first < table[j - 1].first; --j) {
+            std::swap(table[j], table[j - 1]);
         }
     }
-    logW("(%#08x) : UNKNOWN_TAG for %s", key, typeid(store[0].first).name());
+    return table;
+}
+
+template <typename T, size_t N>
+const char* getPairStr(T key, const std::array<NamePair<T>, N>& store) {
+    auto it = std::lower_bound(
+        store.begin(),
+        store.end(),
+        key,
+        [](const NamePair<T>& pair, T value) { return pair.first < value; }
+    );
+    if (it != store.end() && it->first == key) {
+        return it->second;
+    }
+    logW("(%#08x) : UNKNOWN_TAG for %s", key, typeid(T).name());
     return UKNOWN_TAG;
 }
 
 // camera_status_t error translation
-using ERROR_PAIR = std::pair<camera_status_t, const char*>;
-static std::vector<ERROR_PAIR> errorInfo{
+using ERROR_PAIR = NamePair<camera_status_t>;
+constexpr auto errorInfo = sortByKey(std::to_array<ERROR_PAIR>({
     MAKE_PAIR(ACAMERA_OK),
     MAKE_PAIR(ACAMERA_ERROR_UNKNOWN),
     MAKE_PAIR(ACAMERA_ERROR_INVALID_PARAMETER),
@@ -54,16 +77,16 @@ static std::vector<ERROR_PAIR> errorInfo{
     MAKE_PAIR(ACAMERA_ERROR_MAX_CAMERA_IN_USE),
     MAKE_PAIR(ACAMERA_ERROR_CAMERA_DISABLED),
     MAKE_PAIR(ACAMERA_ERROR_PERMISSION_DENIED),
-};
+}));
 
 const char* getErrorStr(camera_status_t err) {
-    return getPairStr<camera_status_t>(err, errorInfo);
+    return getPairStr(err, errorInfo);
 }
 
 // camera_metadata_tag_t translation. Useful to look at available tags
 // on the underneath platform
-using TAG_PAIR = std::pair<acamera_metadata_tag_t, const char*>;
-static std::vector<TAG_PAIR> tagInfo{
+using TAG_PAIR = NamePair<acamera_metadata_tag_t>;
+constexpr auto tagInfo = sortByKey(std::to_array<TAG_PAIR>({
     MAKE_PAIR(ACAMERA_COLOR_CORRECTION_MODE),
     MAKE_PAIR(ACAMERA_COLOR_CORRECTION_TRANSFORM),
     MAKE_PAIR(ACAMERA_COLOR_CORRECTION_GAINS),
@@ -259,14 +282,14 @@ static std::vector<TAG_PAIR> tagInfo{
     MAKE_PAIR(ACAMERA_DEPTH_AVAILABLE_DEPTH_STALL_DURATIONS),
     MAKE_PAIR(ACAMERA_DEPTH_DEPTH_IS_EXCLUSIVE),
     MAKE_PAIR(ACAMERA_DEPTH_END),
-};
+}));
 
 const char* getTagStr(acamera_metadata_tag_t tag) {
-    return getPairStr<acamera_metadata_tag_t>(tag, tagInfo);
+    return getPairStr(tag, tagInfo);
 }
 
-using FORMAT_PAIR = std::pair<int, const char*>;
-static std::vector<FORMAT_PAIR> formatInfo{
+using FORMAT_PAIR = NamePair<int>;
+constexpr auto formatInfo = sortByKey(std::to_array<FORMAT_PAIR>({
     MAKE_PAIR(AIMAGE_FORMAT_YUV_420_888),
     MAKE_PAIR(AIMAGE_FORMAT_JPEG),
     MAKE_PAIR(AIMAGE_FORMAT_RAW16),
@@ -276,9 +299,9 @@ static std::vector<FORMAT_PAIR> formatInfo{
     MAKE_PAIR(AIMAGE_FORMAT_DEPTH16),
     MAKE_PAIR(AIMAGE_FORMAT_DEPTH_POINT_CLOUD),
     MAKE_PAIR(AIMAGE_FORMAT_PRIVATE),
-};
+}));
 
-const char* getFormatStr(int fmt) { return getPairStr<int>(fmt, formatInfo); }
+const char* getFormatStr(int fmt) { return getPairStr(fmt, formatInfo); }
 
 void printMetadataTags(int32_t entries, const uint32_t* pTags) {
     logI("MetadataTag (start):");
@@ -453,17 +476,17 @@ void printRequestMetadata(ACaptureRequest* req) {
 
 // CameraDevice error state translation, used in
 // ACameraDevice_ErrorStateCallback
-using DEV_ERROR_PAIR = std::pair<int, const char*>;
-static std::vector<DEV_ERROR_PAIR> devErrors{
+using DEV_ERROR_PAIR = NamePair<int>;
+constexpr auto devErrors = sortByKey(std::to_array<DEV_ERROR_PAIR>({
     MAKE_PAIR(ERROR_CAMERA_IN_USE),
     MAKE_PAIR(ERROR_MAX_CAMERAS_IN_USE),
     MAKE_PAIR(ERROR_CAMERA_DISABLED),
     MAKE_PAIR(ERROR_CAMERA_DEVICE),
     MAKE_PAIR(ERROR_CAMERA_SERVICE),
-};
+}));
 
 const char* getCameraDeviceErrorStr(int err) {
-    return getPairStr<int>(err, devErrors);
+    return getPairStr(err, devErrors);
 }
 
 void printCameraDeviceError(int err) {
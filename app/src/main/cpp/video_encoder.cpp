@@ -0,0 +1,306 @@
+#include "video_encoder.hpp"
+
+#include <dlfcn.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "util.hpp"
+
+using namespace camera::util;
+
+namespace camera {
+
+namespace {
+
+int64_t monotonicNowUs() {
+    // steady_clock is CLOCK_MONOTONIC, the clock surface frames are stamped
+    // with when the renderer presents them
+    return std::chrono::steady_clock::now().time_since_epoch() /
+           std::chrono::microseconds(1);
+}
+
+}  // namespace
+
+VideoEncoder::~VideoEncoder() { stop(); }
+
+bool VideoEncoder::start(
+    const VideoEncoderConfig& config,
+    PacketCallback onPacket,
+    FormatCallback onFormat
+) {
+    if (codec_) return false;
+    config_ = config;
+    onPacket_ = std::move(onPacket);
+    onFormat_ = std::move(onFormat);
+
+    codec_ = AMediaCodec_createEncoderByType(config.mime);
+    if (!codec_) {
+        logE("No encoder for %s", config.mime);
+        return false;
+    }
+
+    // String keys, the AMEDIAFORMAT_KEY_ constants for profile, level and
+    // bitrate mode need API 28
+    AMediaFormat* format = AMediaFormat_new();
+    AMediaFormat_setString(format, AMEDIAFORMAT_KEY_MIME, config.mime);
+    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_WIDTH, config.width);
+    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_HEIGHT, config.height);
+    AMediaFormat_setInt32(
+        format,
+        AMEDIAFORMAT_KEY_COLOR_FORMAT,
+        config.byteBufferInput ? COLOR_FORMAT_NV12 : COLOR_FORMAT_SURFACE
+    );
+    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_BIT_RATE, config.bitrate);
+    AMediaFormat_setInt32(format, "bitrate-mode", config.bitrateMode);
+    AMediaFormat_setInt32(
+        format, AMEDIAFORMAT_KEY_FRAME_RATE, config.frameRate
+    );
+    AMediaFormat_setInt32(
+        format, AMEDIAFORMAT_KEY_I_FRAME_INTERVAL, config.keyFrameInterval
+    );
+    AMediaFormat_setInt32(format, "profile", config.profile);
+    if (config.level > 0) {
+        AMediaFormat_setInt32(format, "level", config.level);
+    }
+    // No B-frames, so packets come out in presentation order
+    AMediaFormat_setInt32(format, "max-bframes", 0);
+
+    media_status_t status = AMediaCodec_configure(
+        codec_, format, nullptr, nullptr, AMEDIACODEC_CONFIGURE_FLAG_ENCODE
+    );
+    AMediaFormat_delete(format);
+    if (status != AMEDIA_OK) {
+        logE("Failed to configure the encoder: %d", status);
+        release();
+        return false;
+    }
+
+    if (config.byteBufferInput) {
+        readInputLayout();
+    } else {
+        status = AMediaCodec_createInputSurface(codec_, &window_);
+        if (status != AMEDIA_OK) {
+            logE("Failed to create the encoder input surface: %d", status);
+            release();
+            return false;
+        }
+    }
+
+    status = AMediaCodec_start(codec_);
+    if (status != AMEDIA_OK) {
+        logE("Failed to start the encoder: %d", status);
+        release();
+        return false;
+    }
+
+    framesQueued_ = 0;
+    framesEncoded_ = 0;
+    bytesEncoded_ = 0;
+    latencySumUs_ = 0;
+    latencyMaxUs_ = 0;
+    latencyCount_ = 0;
+    stopDeadlineUs_ = 0;
+    drainThread_ = std::thread(&VideoEncoder::drain, this);
+
+    logI(
+        "Encoder started %dx%d@%d, %d bps, gop %ds",
+        config.width,
+        config.height,
+        config.frameRate,
+        config.bitrate,
+        config.keyFrameInterval
+    );
+    return true;
+}
+
+void VideoEncoder::stop() {
+    if (!codec_) return;
+    media_status_t status = AMEDIA_ERROR_UNKNOWN;
+    if (config_.byteBufferInput) {
+        // An empty buffer carries the end of stream without a surface
+        ssize_t index =
+            AMediaCodec_dequeueInputBuffer(codec_, STOP_TIMEOUT_US);
+        if (index >= 0) {
+            status = AMediaCodec_queueInputBuffer(
+                codec_,
+                index,
+                0,
+                0,
+                monotonicNowUs(),
+                AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM
+            );
+        }
+    } else {
+        status = AMediaCodec_signalEndOfInputStream(codec_);
+    }
+    if (status != AMEDIA_OK) {
+        logW("Failed to signal the end of stream: %d", status);
+    }
+    // The drain thread exits on the end of stream packet or the deadline
+    stopDeadlineUs_ = monotonicNowUs() + STOP_TIMEOUT_US;
+    if (drainThread_.joinable()) drainThread_.join();
+    AMediaCodec_stop(codec_);
+    release();
+    logI("Encoder stopped, %llu frames", (unsigned long long)framesEncoded_);
+}
+
+void VideoEncoder::release() {
+    if (window_) {
+        ANativeWindow_release(window_);
+        window_ = nullptr;
+    }
+    if (codec_) {
+        AMediaCodec_delete(codec_);
+        codec_ = nullptr;
+    }
+}
+
+void VideoEncoder::readInputLayout() {
+    // Tightly packed unless the codec says otherwise. The input format
+    // needs API 28, looked up at runtime like the thermal API
+    inputStride_ = config_.width;
+    inputSliceHeight_ = config_.height;
+    using GetInputFormat = AMediaFormat* (*)(AMediaCodec*);
+    static auto getInputFormat = reinterpret_cast<GetInputFormat>(
+        dlsym(RTLD_DEFAULT, "AMediaCodec_getInputFormat")
+    );
+    if (!getInputFormat) return;
+    AMediaFormat* format = getInputFormat(codec_);
+    if (!format) return;
+    int32_t value = 0;
+    if (AMediaFormat_getInt32(format, "stride", &value)) {
+        inputStride_ = std::max(value, config_.width);
+    }
+    if (AMediaFormat_getInt32(format, "slice-height", &value)) {
+        inputSliceHeight_ = std::max(value, config_.height);
+    }
+    AMediaFormat_delete(format);
+}
+
+bool VideoEncoder::queueFrame(const FrameWriter& write) {
+    if (!codec_ || !config_.byteBufferInput) return false;
+    int64_t timeUs = monotonicNowUs();
+    ssize_t index = AMediaCodec_dequeueInputBuffer(codec_, 0);
+    if (index < 0) return false;
+
+    size_t lumaSize = size_t(inputStride_) * inputSliceHeight_;
+    size_t size = lumaSize + size_t(inputStride_) * ((config_.height + 1) / 2);
+    size_t capacity = 0;
+    uint8_t* data = AMediaCodec_getInputBuffer(codec_, index, &capacity);
+    if (!data || capacity < size) {
+        logAsyncE("Encoder input buffer of %zu bytes is too small", capacity);
+        // Handed back empty, so the codec can reuse it
+        AMediaCodec_queueInputBuffer(codec_, index, 0, 0, timeUs, 0);
+        return false;
+    }
+
+    write({
+        .y = data,
+        .u = data + lumaSize,
+        .v = data + lumaSize + 1,
+        .width = config_.width,
+        .height = config_.height,
+        .yRowStride = inputStride_,
+        .uvRowStride = inputStride_,
+        .uvPixelStride = 2
+    });
+    media_status_t status =
+        AMediaCodec_queueInputBuffer(codec_, index, 0, size, timeUs, 0);
+    if (status != AMEDIA_OK) {
+        logAsyncE("Failed to queue an encoder frame: %d", status);
+        return false;
+    }
+    framesQueued_.fetch_add(1);
+    return true;
+}
+
+uint32_t VideoEncoder::getQueueDepth() const {
+    uint64_t queued = framesQueued_.load(std::memory_order_relaxed);
+    uint64_t encoded = framesEncoded_.load(std::memory_order_relaxed);
+    // The codec may drop frames, never report a negative depth
+    return queued > encoded ? static_cast<uint32_t>(queued - encoded) : 0;
+}
+
+EncoderStats VideoEncoder::getStats() {
+    uint32_t count = latencyCount_.exchange(0);
+    int64_t sum = latencySumUs_.exchange(0);
+    int64_t max = latencyMaxUs_.exchange(0);
+    return {
+        .queueDepth = getQueueDepth(),
+        .framesEncoded = framesEncoded_,
+        .bytesEncoded = bytesEncoded_,
+        .averageLatencyMs = count ? sum / 1000.0f / count : 0.0f,
+        .maxLatencyMs = max / 1000.0f
+    };
+}
+
+void VideoEncoder::setBitrate(int32_t bitrate) {
+    if (!codec_) return;
+    AMediaFormat* params = AMediaFormat_new();
+    AMediaFormat_setInt32(params, "video-bitrate", bitrate);
+    AMediaCodec_setParameters(codec_, params);
+    AMediaFormat_delete(params);
+    config_.bitrate = bitrate;
+}
+
+void VideoEncoder::requestKeyFrame() {
+    if (!codec_) return;
+    AMediaFormat* params = AMediaFormat_new();
+    AMediaFormat_setInt32(params, "request-sync", 0);
+    AMediaCodec_setParameters(codec_, params);
+    AMediaFormat_delete(params);
+}
+
+void VideoEncoder::drain() {
+    for (;;) {
+        AMediaCodecBufferInfo info;
+        ssize_t index =
+            AMediaCodec_dequeueOutputBuffer(codec_, &info, DEQUEUE_TIMEOUT_US);
+        if (index == AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED) {
+            AMediaFormat* format = AMediaCodec_getOutputFormat(codec_);
+            logI("Encoder output format %s", AMediaFormat_toString(format));
+            if (onFormat_) onFormat_(format);
+            AMediaFormat_delete(format);
+            continue;
+        }
+        if (index < 0) {
+            int64_t deadline = stopDeadlineUs_.load();
+            if (deadline && monotonicNowUs() > deadline) {
+                logW("Encoder didn't reach the end of stream in time");
+                return;
+            }
+            continue;
+        }
+
+        size_t capacity;
+        uint8_t* data = AMediaCodec_getOutputBuffer(codec_, index, &capacity);
+        bool endOfStream = info.flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM;
+        if (data && info.size > 0) {
+            EncodedPacket packet{
+                .data = data + info.offset,
+                .size = static_cast<size_t>(info.size),
+                .presentationTimeUs = info.presentationTimeUs,
+                .flags = info.flags
+            };
+            if (!packet.isCodecConfig()) {
+                int64_t latency = monotonicNowUs() - info.presentationTimeUs;
+                if (latency >= 0) {
+                    latencySumUs_ += latency;
+                    latencyCount_++;
+                    int64_t max = latencyMaxUs_.load();
+                    while (latency > max &&
+                           !latencyMaxUs_.compare_exchange_weak(max, latency)) {
+                    }
+                }
+                framesEncoded_++;
+                bytesEncoded_ += packet.size;
+            }
+            if (onPacket_) onPacket_(packet);
+        }
+        AMediaCodec_releaseOutputBuffer(codec_, index, false);
+        if (endOfStream) return;
+    }
+}
+
+}  // namespace camera
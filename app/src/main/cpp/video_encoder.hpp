@@ -0,0 +1,167 @@
+#pragma once
+
+#include <android/native_window.h>
+#include <media/NdkMediaCodec.h>
+#include <media/NdkMediaFormat.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+#include "yuv_convert.hpp"
+
+namespace camera {
+
+struct VideoEncoderConfig {
+    // MediaCodecInfo.CodecProfileLevel values
+    static constexpr int32_t AVC_PROFILE_BASELINE = 0x01;
+    static constexpr int32_t AVC_PROFILE_MAIN = 0x02;
+    static constexpr int32_t AVC_PROFILE_HIGH = 0x08;
+    // MediaCodecInfo.EncoderCapabilities bitrate modes
+    static constexpr int32_t BITRATE_MODE_VBR = 1;
+    static constexpr int32_t BITRATE_MODE_CBR = 2;
+
+    const char* mime = "video/avc";
+    int32_t width = 1080;
+    int32_t height = 1920;
+    int32_t bitrate = 10'000'000;
+    int32_t bitrateMode = BITRATE_MODE_VBR;
+    int32_t frameRate = 30;
+    // Seconds between key frames, i.e. the GOP length
+    int32_t keyFrameInterval = 1;
+    int32_t profile = AVC_PROFILE_HIGH;
+    // 0 lets the codec pick the level
+    int32_t level = 0;
+    // Take NV12 frames through queueFrame() instead of an input surface,
+    // for frames composited on the CPU
+    bool byteBufferInput = false;
+};
+
+struct EncodedPacket {
+    // MediaCodec.BUFFER_FLAG_KEY_FRAME, missing from older NDK headers
+    static constexpr uint32_t FLAG_KEY_FRAME = 1;
+
+    const uint8_t* data;
+    size_t size;
+    int64_t presentationTimeUs;
+    uint32_t flags;
+
+    [[nodiscard]] bool isKeyFrame() const {
+        return flags & FLAG_KEY_FRAME;
+    }
+    [[nodiscard]] bool isCodecConfig() const {
+        return flags & AMEDIACODEC_BUFFER_FLAG_CODEC_CONFIG;
+    }
+};
+
+struct EncoderStats {
+    // Frames presented to the input surface and not encoded yet
+    uint32_t queueDepth;
+    uint64_t framesEncoded;
+    uint64_t bytesEncoded;
+    // From present to the encoded packet, over the frames since last call
+    float averageLatencyMs;
+    float maxLatencyMs;
+};
+
+/**
+ * H.264/HEVC encoder fed by its own input surface, which the renderer
+ * presents composited frames to, or with byteBufferInput by NV12 frames
+ * written into its input buffers. Encoded packets are delivered on a
+ * dedicated drain thread.
+ */
+class VideoEncoder {
+  public:
+    // Packet data is only valid during the call
+    using PacketCallback = std::function<void(const EncodedPacket&)>;
+    // Called once with the output format, before the first packet
+    using FormatCallback = std::function<void(AMediaFormat*)>;
+    // Writes a whole frame into an input buffer
+    using FrameWriter = std::function<void(const YuvImage& image)>;
+
+    // Frames the renderer may queue ahead of the encoder
+    static constexpr uint32_t MAX_QUEUE_DEPTH = 4;
+
+    VideoEncoder() = default;
+    ~VideoEncoder();
+
+    VideoEncoder(const VideoEncoder&) = delete;
+    VideoEncoder& operator=(const VideoEncoder&) = delete;
+
+    bool start(
+        const VideoEncoderConfig& config,
+        PacketCallback onPacket,
+        FormatCallback onFormat = {}
+    );
+    /**
+     * Signal the end of stream and wait until every queued frame is
+     * drained. The renderer must not present to the input window anymore.
+     */
+    void stop();
+
+    [[nodiscard]] bool isRunning() const { return codec_ != nullptr; }
+    [[nodiscard]] ANativeWindow* getInputWindow() const { return window_; }
+    [[nodiscard]] const VideoEncoderConfig& getConfig() const {
+        return config_;
+    }
+
+    /** Called by the renderer for every frame presented to the window. */
+    void onFrameQueued() { framesQueued_.fetch_add(1); }
+
+    /**
+     * With byteBufferInput, have write fill a free input buffer and queue
+     * it, stamped with the time of the call in CLOCK_MONOTONIC. False when
+     * the codec has no free buffer, the frame is skipped then.
+     */
+    bool queueFrame(const FrameWriter& write);
+
+    /**
+     * False while the encoder is MAX_QUEUE_DEPTH frames behind, the
+     * renderer skips the recording of a frame instead of blocking on it.
+     */
+    [[nodiscard]] bool canAcceptFrame() const {
+        return getQueueDepth() < MAX_QUEUE_DEPTH;
+    }
+
+    [[nodiscard]] uint32_t getQueueDepth() const;
+
+    EncoderStats getStats();
+
+    // Runtime controls, applied from the next frame on
+    void setBitrate(int32_t bitrate);
+    void requestKeyFrame();
+
+  private:
+    static constexpr int64_t DEQUEUE_TIMEOUT_US = 10'000;
+    static constexpr int64_t STOP_TIMEOUT_US = 1'000'000;
+    static constexpr int32_t COLOR_FORMAT_SURFACE = 0x7F000789;
+    // COLOR_FormatYUV420SemiPlanar, NV12
+    static constexpr int32_t COLOR_FORMAT_NV12 = 21;
+
+    VideoEncoderConfig config_;
+    AMediaCodec* codec_ = nullptr;
+    ANativeWindow* window_ = nullptr;
+    // Layout of the byte buffer input, the chroma rows follow sliceHeight
+    // rows of luma
+    int32_t inputStride_ = 0;
+    int32_t inputSliceHeight_ = 0;
+    PacketCallback onPacket_;
+    FormatCallback onFormat_;
+    std::thread drainThread_;
+
+    std::atomic<uint64_t> framesQueued_ = 0;
+    std::atomic<uint64_t> framesEncoded_ = 0;
+    std::atomic<uint64_t> bytesEncoded_ = 0;
+    std::atomic<int64_t> latencySumUs_ = 0;
+    std::atomic<int64_t> latencyMaxUs_ = 0;
+    std::atomic<uint32_t> latencyCount_ = 0;
+    // Set by stop(), 0 while running
+    std::atomic<int64_t> stopDeadlineUs_ = 0;
+
+    void drain();
+    void release();
+    void readInputLayout();
+};
+
+}  // namespace camera
@@ -2,6 +2,7 @@
 
 #include <vulkan/vulkan.hpp>
 
+#include "content_hash.hpp"
 #include "util.hpp"
 
 #define GLM_FORCE_RADIANS
@@ -30,6 +31,10 @@ void VkRenderer::init() {
     createCommandPool();
     createVertexBuffer();
     createIndexBuffer();
+    createGlyphAtlas();
+    createGlyphBuffers();
+    createLayerBuffers();
+    createSpriteTexture(SpriteSheet{});
     createUniformBuffers();
     createDescriptorPool();
     createDescriptorSets();
@@ -68,30 +73,22 @@ void VkRenderer::setMediaWindow(ANativeWindow* win) {
         .imageSharingMode = vk::SharingMode::eExclusive,
         .preTransform = swapChainSupport.capabilities.currentTransform,
         .compositeAlpha = vk::CompositeAlphaFlagBitsKHR::eInherit,
-        .presentMode = chooseSwapPresentMode(swapChainSupport.presentModes),
+        // Every paced frame must reach the encoder, mailbox would replace
+        // queued ones
+        .presentMode = vk::PresentModeKHR::eFifo,
         .clipped = true
     };
 
-    logI(
-        "media swapchain min image count = %i",
-        swapChainCreateInfo.minImageCount
-    );
-
     mediaSwapChain_ = device_.createSwapchainKHR(swapChainCreateInfo);
     mediaSwapChainImages_ = mediaSwapChain_.getImages();
 
     logI(
-        "media swapchain images count = %i", (int)mediaSwapChainImages_.size()
-    );
-    logI("swapchain images count = %i", (int)swapChainImages_.size());
-    logI("swapchain format = %i", (int)swapChainSurfaceFormat_.format);
-    logI(
-        "swapchain media format = %i", (int)mediaSwapChainSurfaceFormat_.format
-    );
-    logI(
-        "media swapchain w = %i, h = %i",
+        "media swapchain %ix%i, format = %i, images = %i (min %i)",
         mediaSwapChainExtent_.width,
-        mediaSwapChainExtent_.height
+        mediaSwapChainExtent_.height,
+        (int)mediaSwapChainSurfaceFormat_.format,
+        (int)mediaSwapChainImages_.size(),
+        swapChainCreateInfo.minImageCount
     );
 
     assert(mediaSwapChainImageViews_.empty());
@@ -143,7 +140,6 @@ void VkRenderer::setMediaWindow(ANativeWindow* win) {
 
     mediaImageAvailableSemaphores_.clear();
     mediaRenderFinishedSemaphores_.clear();
-    mediaInFlightFences_.clear();
 
     for (size_t i = 0; i < mediaSwapChainImages_.size(); ++i) {
         mediaImageAvailableSemaphores_.emplace_back(
@@ -153,24 +149,139 @@ void VkRenderer::setMediaWindow(ANativeWindow* win) {
             device_, vk::SemaphoreCreateInfo()
         );
     }
+}
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
-        mediaInFlightFences_.emplace_back(
-            device_,
-            vk::FenceCreateInfo{.flags = vk::FenceCreateFlagBits::eSignaled}
-        );
-    }
+void VkRenderer::startRecording(VideoEncoder* encoder) {
+    if (!initialized || isRecording_) return;
+    mediaEncoder_ = encoder;
+    setMediaWindow(encoder->getInputWindow());
+    mediaPacer_.setFrameRate(getMediaFrameRate());
+    mediaPacer_.reset();
+    isRecording_ = true;
 }
 
-void VkRenderer::camHwBufferToTexture(AHardwareBuffer* buf) {
-    if (watTextures_.empty()) return;
+void VkRenderer::stopRecording() {
+    if (!isRecording_) return;
+    isRecording_ = false;
+    device_.waitIdle();
+
+    mediaSwapChainFramebuffers_.clear();
+    mediaSwapChainImageViews_.clear();
+    mediaSwapChainImages_.clear();
+    mediaSwapChain_ = nullptr;
+    mediaSurface_ = nullptr;
+    mediaImageAvailableSemaphores_.clear();
+    mediaRenderFinishedSemaphores_.clear();
+    mediaSemaphoreIndex_ = 0;
+    mediaWindow_ = nullptr;
+    mediaEncoder_ = nullptr;
+}
+
+void VkRenderer::camHwBufferToTexture(
+    AHardwareBuffer* buf, const FrameMetadata& metadata
+) {
+    if (!watermarkBound_) return;
+
+    // The outputs keep their own rates, a frame neither of them takes
+    // isn't even imported
+    bool drawPreview = previewPacer_.advance(metadata.timestampNs).count > 0;
+    FramePacer::Slots mediaSlots{};
+    if (isRecording_) mediaSlots = mediaPacer_.advance(metadata.timestampNs);
+    if (!drawPreview && mediaSlots.count == 0) return;
 
+    auto waitStart = std::chrono::steady_clock::now();
     while (vk::Result::eTimeout ==
            device_.waitForFences(
                *inFlightFences_[currentFrame_], vk::True, FENCE_TIMEOUT
            ));
+    addGpuWait(waitStart);
+
+    readLayerStatistics();
+    pollWatermarkAnimation();
+    // Update uniform buffer with current transformation
+    updateUniformBuffer(currentFrame_, metadata);
+    updateGlyphBuffer(currentFrame_);
+    writeFrameOverlay(currentFrame_, metadata);
+    watermarkLayers_.update(metadata.timestampNs);
+    updateLayerBuffer(currentFrame_);
+
+    if (camTextures_.empty()) {
+        logI("Resize camTextures");
+        camTextures_.resize(MAX_FRAMES_IN_FLIGHT);
+    }
+
+    TextureData& camTexture = camTextures_[currentFrame_];
+    importCamHwBuffer(buf, camTexture);
+
+    transitionImageLayout(
+        camTexture.image,
+        vk::ImageLayout::eUndefined,
+        vk::ImageLayout::eShaderReadOnlyOptimal
+    );
+
+    // vk::DescriptorImageInfo watDescriptorImageInfo{
+    //     .sampler = *watTextureSampler,
+    //     .imageView = *watTextures[currentFrame].imageView,
+    //     .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
+    // };
+    vk::DescriptorImageInfo camDescriptorImageInfo{
+        .sampler = *camTextureSampler_,
+        .imageView = *camTexture.imageView,
+        .imageLayout = vk::ImageLayout::eGeneral
+    };
+
+    vk::WriteDescriptorSet descriptorWrites{
+        .dstSet = *descriptorSets_[currentFrame_],
+        .dstBinding = 2,
+        .dstArrayElement = 0,
+        .descriptorCount = 1,
+        .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+        .pImageInfo = &camDescriptorImageInfo
+    };
+
+    device_.updateDescriptorSets(descriptorWrites, nullptr);
+
+    // if (watTextures.size() > 0) {
+    //     vk::DescriptorImageInfo watDescriptorImageInfo{
+    //         .sampler = *watTextureSampler,
+    //         .imageView = *watTextures[currentFrame].imageView,
+    //         .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
+    //     };
+    //
+    //     vk::WriteDescriptorSet watDescriptorWrites{
+    //         .dstSet = *descriptorSets[currentFrame],
+    //         .dstBinding = 1,
+    //         .dstArrayElement = 0,
+    //         .descriptorCount = 1,
+    //         .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+    //         .pImageInfo = &watDescriptorImageInfo
+    //     };
+    //
+    //     device.updateDescriptorSets(watDescriptorWrites, nullptr);
+    // }
 
+    // First, so consumers in the later passes can read this frame's levels
+    bool submitted = drawPyramid(buf, metadata);
+    submitted |= drawPreview && drawPreviewFrame(metadata.timestampNs);
+    for (uint32_t i = 0; i < mediaSlots.count; ++i) {
+        int64_t presentTimeNs =
+            mediaSlots.firstTimeNs + i * mediaSlots.intervalNs;
+        submitted |= drawMediaFrame(i, presentTimeNs);
+    }
+
+    // Submitted after both passes on the same queue, so it signals once
+    // all of them are done with the frame's resources
+    if (submitted) {
+        device_.resetFences({*inFlightFences_[currentFrame_]});
+        queue_.submit(vk::SubmitInfo{}, *inFlightFences_[currentFrame_]);
+    }
+
+    currentFrame_ = (currentFrame_ + 1) % framesInFlight_;
+}
+
+bool VkRenderer::drawPreviewFrame(int64_t timestampNs) {
     uint32_t imageIndex;
+    auto waitStart = std::chrono::steady_clock::now();
     try {
         auto [_, idx] = swapChain_.acquireNextImage(
             FENCE_TIMEOUT, *imageAvailableSemaphores_[semaphoreIndex_], nullptr
@@ -178,40 +289,255 @@ void VkRenderer::camHwBufferToTexture(AHardwareBuffer* buf) {
         imageIndex = idx;
     } catch (vk::OutOfDateKHRError&) {
         recreateSwapChain();
-        return;
+        return false;
+    }
+    addGpuWait(waitStart);
+
+    vk::raii::CommandBuffer& commandBuffer = commandBuffers_[currentFrame_];
+    recordComposite(
+        commandBuffer,
+        swapChainFramebuffers_[imageIndex],
+        swapChainExtent_,
+        true
+    );
+    int32_t readbackSlot = -1;
+    if (readbackCallback_ && swapChainReadable_ &&
+        readbackCounter_++ % readbackInterval_ == 0) {
+        readbackSlot = frameReadback_.acquire();
+    }
+    vk::Fence readbackFence = nullptr;
+    if (readbackSlot >= 0) {
+        ReadbackTarget& target = readbackTargets_[readbackSlot];
+        recordReadback(commandBuffer, swapChainImages_[imageIndex], target);
+        device_.resetFences({*target.fence});
+        readbackFence = *target.fence;
     }
+    commandBuffer.end();
 
-    // Update uniform buffer with current transformation
-    updateUniformBuffer(currentFrame_);
+    vk::PipelineStageFlags waitDestinationStageMask(
+        vk::PipelineStageFlagBits::eColorAttachmentOutput
+    );
+    vk::SubmitInfo submitInfo{
+        .waitSemaphoreCount = 1,
+        .pWaitSemaphores = &*imageAvailableSemaphores_[semaphoreIndex_],
+        .pWaitDstStageMask = &waitDestinationStageMask,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &*commandBuffer,
+        .signalSemaphoreCount = 1,
+        .pSignalSemaphores = &*renderFinishedSemaphores_[imageIndex]
+    };
+    queue_.submit(submitInfo, readbackFence);
+    if (readbackSlot >= 0) submitReadback(readbackSlot, timestampNs);
+
+    vk::PresentInfoKHR presentInfoKHR{
+        .waitSemaphoreCount = 1,
+        .pWaitSemaphores = &*renderFinishedSemaphores_[imageIndex],
+        .swapchainCount = 1,
+        .pSwapchains = &*swapChain_,
+        .pImageIndices = &imageIndex
+    };
 
-    // device.resetFences({*inFlightFences[currentFrame]});
-    // commandBuffers[currentFrame].reset();
+    vk::Result result;
+    try {
+        result = queue_.presentKHR(presentInfoKHR);
+    } catch (vk::OutOfDateKHRError&) {
+        result = vk::Result::eErrorOutOfDateKHR;
+    }
 
-    vk::CommandBufferBeginInfo beginInfo{};
-    commandBuffers_[currentFrame_].begin(beginInfo);
+    if (result == vk::Result::eErrorOutOfDateKHR ||
+        result == vk::Result::eSuboptimalKHR || framebufferResized_) {
+        framebufferResized_ = false;
+        recreateSwapChain();
+    } else if (result != vk::Result::eSuccess) {
+        throw std::runtime_error("Failed to present swap chain image");
+    }
 
-    vk::RenderPassBeginInfo renderPassInfo{
-        .renderPass = *renderPass_,
-        .framebuffer = *swapChainFramebuffers_[imageIndex],
-        .renderArea = {.offset = {0, 0}, .extent = swapChainExtent_}
+    semaphoreIndex_ = (semaphoreIndex_ + 1) % imageAvailableSemaphores_.size();
+    return true;
+}
+
+bool VkRenderer::drawMediaFrame(uint32_t repeat, int64_t presentTimeNs) {
+    if (!mediaEncoder_->canAcceptFrame()) {
+        logAsyncW(
+            "Encoder is %u frames behind, frame skipped",
+            mediaEncoder_->getQueueDepth()
+        );
+        return false;
+    }
+
+    uint32_t imageIndex;
+    auto waitStart = std::chrono::steady_clock::now();
+    try {
+        auto [_, idx] = mediaSwapChain_.acquireNextImage(
+            FENCE_TIMEOUT,
+            *mediaImageAvailableSemaphores_[mediaSemaphoreIndex_],
+            nullptr
+        );
+        imageIndex = idx;
+    } catch (vk::OutOfDateKHRError&) {
+        logAsyncW("Media swapchain is out of date, frame skipped");
+        return false;
+    }
+    addGpuWait(waitStart);
+
+    vk::raii::CommandBuffer& commandBuffer =
+        mediaCommandBuffers_[currentFrame_ * MAX_MEDIA_REPEATS + repeat];
+    recordComposite(
+        commandBuffer,
+        mediaSwapChainFramebuffers_[imageIndex],
+        mediaSwapChainExtent_
+    );
+    commandBuffer.end();
+
+    vk::PipelineStageFlags waitDestinationStageMask(
+        vk::PipelineStageFlagBits::eColorAttachmentOutput
+    );
+    vk::SubmitInfo submitInfo{
+        .waitSemaphoreCount = 1,
+        .pWaitSemaphores =
+            &*mediaImageAvailableSemaphores_[mediaSemaphoreIndex_],
+        .pWaitDstStageMask = &waitDestinationStageMask,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &*commandBuffer,
+        .signalSemaphoreCount = 1,
+        .pSignalSemaphores = &*mediaRenderFinishedSemaphores_[imageIndex]
+    };
+    queue_.submit(submitInfo);
+    mediaSemaphoreIndex_ =
+        (mediaSemaphoreIndex_ + 1) % mediaImageAvailableSemaphores_.size();
+
+    // The encoder takes the buffer timestamp as the frame time
+    vk::PresentTimeGOOGLE presentTime{
+        .presentID = 0,
+        .desiredPresentTime = static_cast<uint64_t>(presentTimeNs)
     };
+    vk::PresentTimesInfoGOOGLE presentTimes{
+        .swapchainCount = 1, .pTimes = &presentTime
+    };
+    vk::PresentInfoKHR presentInfoKHR{
+        .pNext = hasDisplayTiming_ ? &presentTimes : nullptr,
+        .waitSemaphoreCount = 1,
+        .pWaitSemaphores = &*mediaRenderFinishedSemaphores_[imageIndex],
+        .swapchainCount = 1,
+        .pSwapchains = &*mediaSwapChain_,
+        .pImageIndices = &imageIndex
+    };
+
+    vk::Result result;
+    try {
+        result = queue_.presentKHR(presentInfoKHR);
+    } catch (vk::OutOfDateKHRError&) {
+        result = vk::Result::eErrorOutOfDateKHR;
+    }
+    if (result == vk::Result::eSuccess ||
+        result == vk::Result::eSuboptimalKHR) {
+        mediaEncoder_->onFrameQueued();
+    } else {
+        logAsyncW("Media frame present failed: %d", static_cast<int>(result));
+    }
+    return true;
+}
+
+void VkRenderer::recordComposite(
+    vk::raii::CommandBuffer& commandBuffer,
+    const vk::raii::Framebuffer& framebuffer,
+    vk::Extent2D extent,
+    bool queryLayers
+) {
+    commandBuffer.begin(vk::CommandBufferBeginInfo{});
+    queryLayers = queryLayers && hasPipelineStatistics_;
+    if (queryLayers) {
+        commandBuffer.resetQueryPool(*layerQueryPool_, currentFrame_, 1);
+    }
 
     vk::ClearValue clearColor;
     clearColor.color.float32 = std::array<float, 4>{0.0f, 0.0f, 0.0f, 1.0f};
-    renderPassInfo.clearValueCount = 1;
-    renderPassInfo.pClearValues = &clearColor;
+    vk::RenderPassBeginInfo renderPassInfo{
+        .renderPass = *renderPass_,
+        .framebuffer = *framebuffer,
+        .renderArea = {.offset = {0, 0}, .extent = extent},
+        .clearValueCount = 1,
+        .pClearValues = &clearColor
+    };
+    commandBuffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
 
-    commandBuffers_[currentFrame_].beginRenderPass(
-        renderPassInfo, vk::SubpassContents::eInline
+    commandBuffer.bindPipeline(
+        vk::PipelineBindPoint::eGraphics,
+        forensicSlots_[currentFrame_] ? *forensicPipeline_ : *graphicsPipeline_
     );
 
-    if (camTextures_.empty()) {
-        logI("Resize camTextures");
-        camTextures_.resize(MAX_FRAMES_IN_FLIGHT);
+    vk::Viewport viewport{
+        .x = 0.0f,
+        .y = 0.0f,
+        .width = static_cast<float>(extent.width),
+        .height = static_cast<float>(extent.height),
+        .minDepth = 0.0f,
+        .maxDepth = 1.0f
+    };
+    commandBuffer.setViewport(0, viewport);
+
+    vk::Rect2D scissor{.offset = {0, 0}, .extent = extent};
+    commandBuffer.setScissor(0, scissor);
+
+    commandBuffer.bindVertexBuffers(0, {*vertexBuffer_}, {0});
+    commandBuffer.bindIndexBuffer(
+        *indexBuffer_,
+        0,
+        vk::IndexTypeValue<decltype(indices_)::value_type>::value
+    );
+    commandBuffer.bindDescriptorSets(
+        vk::PipelineBindPoint::eGraphics,
+        *pipelineLayout_,
+        0,
+        {*descriptorSets_[currentFrame_]},
+        nullptr
+    );
+
+    auto indexCount = static_cast<uint32_t>(indices_.size());
+    commandBuffer.drawIndexed(indexCount, 1, 0, 0, 0);
+    if (queryLayers) {
+        commandBuffer.beginQuery(*layerQueryPool_, currentFrame_, {});
+    }
+    recordLayers(commandBuffer, currentFrame_);
+    if (queryLayers) {
+        commandBuffer.endQuery(*layerQueryPool_, currentFrame_);
+        layerQueryPending_[currentFrame_] = true;
     }
+    recordGlyphs(commandBuffer, currentFrame_);
 
-    TextureData& camTexture = camTextures_[currentFrame_];
+    commandBuffer.endRenderPass();
+}
+
+std::chrono::microseconds VkRenderer::takeGpuWaitTime() {
+    auto waitTime = std::chrono::duration_cast<std::chrono::microseconds>(
+        gpuWaitTime_
+    );
+    gpuWaitTime_ = {};
+    return waitTime;
+}
+
+void VkRenderer::addGpuWait(std::chrono::steady_clock::time_point start) {
+    gpuWaitTime_ += std::chrono::steady_clock::now() - start;
+}
+
+void VkRenderer::readLayerStatistics() {
+    // Called once the frame's fence signaled, the result is available
+    if (!layerQueryPending_[currentFrame_]) return;
+    layerQueryPending_[currentFrame_] = false;
+    auto [result, fragments] = layerQueryPool_.getResult<uint64_t>(
+        currentFrame_,
+        1,
+        sizeof(uint64_t),
+        vk::QueryResultFlagBits::e64
+    );
+    if (result == vk::Result::eSuccess) {
+        watermarkStats_.layerFragments = fragments;
+    }
+}
 
+void VkRenderer::importCamHwBuffer(
+    AHardwareBuffer* buf, TextureData& texture
+) {
     auto hwBufProps = device_.getAndroidHardwareBufferPropertiesANDROID<
         vk::AndroidHardwareBufferPropertiesANDROID,
         vk::AndroidHardwareBufferFormatPropertiesANDROID>(*buf);
@@ -249,11 +575,11 @@ void VkRenderer::camHwBufferToTexture(AHardwareBuffer* buf) {
         .initialLayout = vk::ImageLayout::eUndefined
     };
 
-    camTexture.image = device_.createImage(imageInfo);
+    texture.image = device_.createImage(imageInfo);
 
     vk::ImportAndroidHardwareBufferInfoANDROID importBufferInfo{.buffer = buf};
     vk::MemoryDedicatedAllocateInfo dedicatedAllocateInfo{
-        .pNext = &importBufferInfo, .image = *camTexture.image
+        .pNext = &importBufferInfo, .image = *texture.image
     };
     vk::MemoryAllocateInfo allocInfo{
         .pNext = &dedicatedAllocateInfo,
@@ -267,11 +593,11 @@ void VkRenderer::camHwBufferToTexture(AHardwareBuffer* buf) {
         )
     };
 
-    camTexture.memory = device_.allocateMemory(allocInfo);
+    texture.memory = device_.allocateMemory(allocInfo);
 
     vk::BindImageMemoryInfo bindInfo{
-        .image = *camTexture.image,
-        .memory = *camTexture.memory,
+        .image = *texture.image,
+        .memory = *texture.memory,
         .memoryOffset = 0
     };
 
@@ -283,7 +609,7 @@ void VkRenderer::camHwBufferToTexture(AHardwareBuffer* buf) {
 
     vk::ImageViewCreateInfo viewInfo{
         .pNext = &samplerYcbcrConversionInfo,
-        .image = *camTexture.image,
+        .image = *texture.image,
         .viewType = vk::ImageViewType::e2D,
         .format =
             hwBufProps.get<vk::AndroidHardwareBufferFormatPropertiesANDROID>()
@@ -305,294 +631,51 @@ void VkRenderer::camHwBufferToTexture(AHardwareBuffer* buf) {
         }
     };
 
-    camTexture.imageView = device_.createImageView(viewInfo);
+    texture.imageView = device_.createImageView(viewInfo);
+}
 
-    transitionImageLayout(
-        camTexture.image,
-        vk::ImageLayout::eUndefined,
-        vk::ImageLayout::eShaderReadOnlyOptimal
-    );
+void VkRenderer::watHwBufferToTexture(AHardwareBuffer* buf) {
+    // Only the changed areas are copied, without waiting for the device
+    if (updateWatermarkDamage(buf)) return;
 
-    // vk::DescriptorImageInfo watDescriptorImageInfo{
-    //     .sampler = *watTextureSampler,
-    //     .imageView = *watTextures[currentFrame].imageView,
-    //     .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
+    // The whole texture is swapped for the buffer instead. watImage_ falls
+    // behind, it's copied whole once used again
+    ++watermarkStats_.framesImported;
+    watImageBound_ = false;
+    watermarkDiff_.reset();
+
+    device_.waitIdle();
+
+    if (watTextures_.empty()) {
+        logI("Resize watTextures");
+        // watTextures.resize(MAX_FRAMES_IN_FLIGHT);
+        watTextures_.resize(1);
+    }
+
+    TextureData& watTexture = watTextures_[0];
+
+    auto hwBufProps = device_.getAndroidHardwareBufferPropertiesANDROID<
+        vk::AndroidHardwareBufferPropertiesANDROID,
+        vk::AndroidHardwareBufferFormatPropertiesANDROID>(*buf);
+    // vk::ExternalFormatANDROID extFormatAndroid{
+    //     .externalFormat =
+    //         hwBufProps.get<vk::AndroidHardwareBufferFormatPropertiesANDROID>()
+    //             .externalFormat
     // };
-    vk::DescriptorImageInfo camDescriptorImageInfo{
-        .sampler = *camTextureSampler_,
-        .imageView = *camTexture.imageView,
-        .imageLayout = vk::ImageLayout::eGeneral
-    };
 
-    vk::WriteDescriptorSet descriptorWrites{
-        .dstSet = *descriptorSets_[currentFrame_],
-        .dstBinding = 2,
-        .dstArrayElement = 0,
-        .descriptorCount = 1,
-        .descriptorType = vk::DescriptorType::eCombinedImageSampler,
-        .pImageInfo = &camDescriptorImageInfo
-    };
-
-    device_.updateDescriptorSets(descriptorWrites, nullptr);
-
-    // if (watTextures.size() > 0) {
-    //     vk::DescriptorImageInfo watDescriptorImageInfo{
-    //         .sampler = *watTextureSampler,
-    //         .imageView = *watTextures[currentFrame].imageView,
-    //         .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
-    //     };
-    //
-    //     vk::WriteDescriptorSet watDescriptorWrites{
-    //         .dstSet = *descriptorSets[currentFrame],
-    //         .dstBinding = 1,
-    //         .dstArrayElement = 0,
-    //         .descriptorCount = 1,
-    //         .descriptorType = vk::DescriptorType::eCombinedImageSampler,
-    //         .pImageInfo = &watDescriptorImageInfo
-    //     };
-    //
-    //     device.updateDescriptorSets(watDescriptorWrites, nullptr);
-    // }
-
-    commandBuffers_[currentFrame_].bindPipeline(
-        vk::PipelineBindPoint::eGraphics, *graphicsPipeline_
-    );
-
-    vk::Viewport viewport{
-        .x = 0.0f,
-        .y = 0.0f,
-        .width = static_cast<float>(swapChainExtent_.width),
-        .height = static_cast<float>(swapChainExtent_.height),
-        .minDepth = 0.0f,
-        .maxDepth = 1.0f
-    };
-    commandBuffers_[currentFrame_].setViewport(0, viewport);
-
-    vk::Rect2D scissor{.offset = {0, 0}, .extent = swapChainExtent_};
-    commandBuffers_[currentFrame_].setScissor(0, scissor);
-
-    commandBuffers_[currentFrame_].bindVertexBuffers(0, {*vertexBuffer_}, {0});
-    commandBuffers_[currentFrame_].bindIndexBuffer(
-        *indexBuffer_,
-        0,
-        vk::IndexTypeValue<decltype(indices_)::value_type>::value
-    );
-    commandBuffers_[currentFrame_].bindDescriptorSets(
-        vk::PipelineBindPoint::eGraphics,
-        *pipelineLayout_,
-        0,
-        {*descriptorSets_[currentFrame_]},
-        nullptr
-    );
-
-    auto indexCount = static_cast<uint32_t>(indices_.size() / 2);
-    if (watTextures_.empty()) {
-        indexCount = static_cast<uint32_t>(indices_.size());
-    }
-    commandBuffers_[currentFrame_].drawIndexed(indexCount, 1, 0, 0, 0);
-
-    commandBuffers_[currentFrame_].endRenderPass();
-    commandBuffers_[currentFrame_].end();
-
-    device_.resetFences({*inFlightFences_[currentFrame_]});
-
-    vk::PipelineStageFlags waitDestinationStageMask(
-        vk::PipelineStageFlagBits::eColorAttachmentOutput
-    );
-    vk::SubmitInfo submitInfo{
-        .waitSemaphoreCount = 1,
-        .pWaitSemaphores = &*imageAvailableSemaphores_[semaphoreIndex_],
-        .pWaitDstStageMask = &waitDestinationStageMask,
-        .commandBufferCount = 1,
-        .pCommandBuffers = &*commandBuffers_[currentFrame_],
-        .signalSemaphoreCount = 1,
-        .pSignalSemaphores = &*renderFinishedSemaphores_[imageIndex]
-    };
-    queue_.submit(submitInfo, *inFlightFences_[currentFrame_]);
-
-    vk::PresentInfoKHR presentInfoKHR{
-        .waitSemaphoreCount = 1,
-        .pWaitSemaphores = &*renderFinishedSemaphores_[imageIndex],
-        .swapchainCount = 1,
-        .pSwapchains = &*swapChain_,
-        .pImageIndices = &imageIndex
-    };
-
-    vk::Result result;
-    try {
-        result = queue_.presentKHR(presentInfoKHR);
-    } catch (vk::OutOfDateKHRError&) {
-        result = vk::Result::eErrorOutOfDateKHR;
-    }
-
-    if (result == vk::Result::eErrorOutOfDateKHR ||
-        result == vk::Result::eSuboptimalKHR || framebufferResized_) {
-        framebufferResized_ = false;
-        recreateSwapChain();
-    } else if (result != vk::Result::eSuccess) {
-        throw std::runtime_error("Failed to present swap chain image");
-    }
-
-    semaphoreIndex_ = (semaphoreIndex_ + 1) % imageAvailableSemaphores_.size();
-
-    if (isRecording_) {
-        while (vk::Result::eTimeout ==
-               device_.waitForFences(
-                   *mediaInFlightFences_[currentFrame_], vk::True, FENCE_TIMEOUT
-               ));
-
-        // uint32_t imageIndex;
-        try {
-            auto [_, idx] = mediaSwapChain_.acquireNextImage(
-                FENCE_TIMEOUT,
-                *mediaImageAvailableSemaphores_[mediaSemaphoreIndex_],
-                nullptr
-            );
-            imageIndex = idx;
-        } catch (vk::OutOfDateKHRError&) {
-            // recreateSwapChain();
-            return;
-        }
-
-        // Update uniform buffer with current transformation
-        // updateUniformBuffer(currentFrame);
-
-        // device.resetFences({*inFlightFences[currentFrame]});
-        // commandBuffers[currentFrame].reset();
-
-        // vk::CommandBufferBeginInfo beginInfo{};
-        commandBuffers_[currentFrame_].begin(beginInfo);
-
-        renderPassInfo = {
-            .renderPass = *renderPass_,
-            .framebuffer = *mediaSwapChainFramebuffers_[imageIndex],
-            .renderArea = {.offset = {0, 0}, .extent = mediaSwapChainExtent_}
-        };
-
-        // vk::ClearValue clearColor;
-        // clearColor.color.float32 = std::array<float, 4>{0.0f, 0.0f,
-        // 0.0f, 1.0f}; renderPassInfo.clearValueCount = 1;
-        // renderPassInfo.pClearValues = &clearColor;
-
-        commandBuffers_[currentFrame_].beginRenderPass(
-            renderPassInfo, vk::SubpassContents::eInline
-        );
-
-        commandBuffers_[currentFrame_].bindPipeline(
-            vk::PipelineBindPoint::eGraphics, *graphicsPipeline_
-        );
-
-        viewport = {
-            .x = 0.0f,
-            .y = 0.0f,
-            .width = static_cast<float>(mediaSwapChainExtent_.width),
-            .height = static_cast<float>(mediaSwapChainExtent_.height),
-            .minDepth = 0.0f,
-            .maxDepth = 1.0f
-        };
-        commandBuffers_[currentFrame_].setViewport(0, viewport);
-
-        scissor = {.offset = {0, 0}, .extent = mediaSwapChainExtent_};
-        commandBuffers_[currentFrame_].setScissor(0, scissor);
-
-        commandBuffers_[currentFrame_].bindVertexBuffers(
-            0, {*vertexBuffer_}, {0}
-        );
-        commandBuffers_[currentFrame_].bindIndexBuffer(
-            *indexBuffer_,
-            0,
-            vk::IndexTypeValue<decltype(indices_)::value_type>::value
-        );
-        commandBuffers_[currentFrame_].bindDescriptorSets(
-            vk::PipelineBindPoint::eGraphics,
-            *pipelineLayout_,
-            0,
-            {*descriptorSets_[currentFrame_]},
-            nullptr
-        );
-
-        indexCount = static_cast<uint32_t>(indices_.size() / 2);
-        if (watTextures_.empty()) {
-            indexCount = static_cast<uint32_t>(indices_.size());
-        }
-        commandBuffers_[currentFrame_].drawIndexed(indexCount, 1, 0, 0, 0);
-
-        commandBuffers_[currentFrame_].endRenderPass();
-        commandBuffers_[currentFrame_].end();
-
-        device_.resetFences({*mediaInFlightFences_[currentFrame_]});
-
-        // vk::PipelineStageFlags waitDestinationStageMask(
-        //     vk::PipelineStageFlagBits::eColorAttachmentOutput
-        // );
-        submitInfo = {
-            .waitSemaphoreCount = 1,
-            .pWaitSemaphores =
-                &*mediaImageAvailableSemaphores_[mediaSemaphoreIndex_],
-            .pWaitDstStageMask = &waitDestinationStageMask,
-            .commandBufferCount = 1,
-            .pCommandBuffers = &*commandBuffers_[currentFrame_],
-            .signalSemaphoreCount = 1,
-            .pSignalSemaphores = &*mediaRenderFinishedSemaphores_[imageIndex]
-        };
-        queue_.submit(submitInfo, *mediaInFlightFences_[currentFrame_]);
-
-        presentInfoKHR = {
-            .waitSemaphoreCount = 1,
-            .pWaitSemaphores = &*mediaRenderFinishedSemaphores_[imageIndex],
-            .swapchainCount = 1,
-            .pSwapchains = &*mediaSwapChain_,
-            .pImageIndices = &imageIndex
-        };
-
-        try {
-            result = queue_.presentKHR(presentInfoKHR);
-        } catch (vk::OutOfDateKHRError&) {
-            result = vk::Result::eErrorOutOfDateKHR;
-        }
-
-        if (result == vk::Result::eErrorOutOfDateKHR ||
-            result == vk::Result::eSuboptimalKHR || framebufferResized_) {
-            framebufferResized_ = false;
-            recreateSwapChain();
-        } else if (result != vk::Result::eSuccess) {
-            throw std::runtime_error("Failed to present swap chain image");
-        }
-        mediaSemaphoreIndex_ =
-            (semaphoreIndex_ + 1) % imageAvailableSemaphores_.size();
-    }
-
-    currentFrame_ = (currentFrame_ + 1) % MAX_FRAMES_IN_FLIGHT;
-}
-
-void VkRenderer::watHwBufferToTexture(AHardwareBuffer* buf) {
-    device_.waitIdle();
-
-    if (watTextures_.empty()) {
-        logI("Resize watTextures");
-        // watTextures.resize(MAX_FRAMES_IN_FLIGHT);
-        watTextures_.resize(1);
-    }
-
-    TextureData& watTexture = watTextures_[0];
-
-    auto hwBufProps = device_.getAndroidHardwareBufferPropertiesANDROID<
-        vk::AndroidHardwareBufferPropertiesANDROID,
-        vk::AndroidHardwareBufferFormatPropertiesANDROID>(*buf);
-    // vk::ExternalFormatANDROID extFormatAndroid{
-    //     .externalFormat =
-    //         hwBufProps.get<vk::AndroidHardwareBufferFormatPropertiesANDROID>()
-    //             .externalFormat
-    // };
-
-    vk::ExternalMemoryImageCreateInfo externalMemoryImageCreateInfo{
-        // .pNext = &extFormatAndroid,
-        .handleTypes =
-            vk::ExternalMemoryHandleTypeFlagBits::eAndroidHardwareBufferANDROID
+    vk::ExternalMemoryImageCreateInfo externalMemoryImageCreateInfo{
+        // .pNext = &extFormatAndroid,
+        .handleTypes =
+            vk::ExternalMemoryHandleTypeFlagBits::eAndroidHardwareBufferANDROID
     };
 
     AHardwareBuffer_Desc hardwareBufferDesc;
     AHardwareBuffer_describe(buf, &hardwareBufferDesc);
+    // Can't be read to find the transparent tiles, the layers are drawn
+    // whole
+    watermarkCoverage_.setFull(
+        hardwareBufferDesc.width, hardwareBufferDesc.height
+    );
 
     vk::ImageCreateInfo imageInfo{
         .pNext = &externalMemoryImageCreateInfo,
@@ -667,54 +750,1040 @@ void VkRenderer::watHwBufferToTexture(AHardwareBuffer* buf) {
             .layerCount = 1
         }
     };
-
-    watTexture.imageView = device_.createImageView(viewInfo);
-
-    transitionImageLayout(
-        watTexture.image,
-        vk::ImageLayout::eUndefined,
-        vk::ImageLayout::eShaderReadOnlyOptimal
+
+    watTexture.imageView = device_.createImageView(viewInfo);
+
+    transitionImageLayout(
+        watTexture.image,
+        vk::ImageLayout::eUndefined,
+        vk::ImageLayout::eShaderReadOnlyOptimal
+    );
+
+    bindWatermarkTexture(*watTexture.imageView);
+}
+
+bool VkRenderer::updateWatermarkDamage(AHardwareBuffer* buf) {
+    AHardwareBuffer_Desc desc;
+    AHardwareBuffer_describe(buf, &desc);
+    uint64_t readUsage = desc.usage & AHARDWAREBUFFER_USAGE_CPU_READ_MASK;
+    if (readUsage == 0 ||
+        desc.format != AHARDWAREBUFFER_FORMAT_R8G8B8A8_UNORM) {
+        return false;
+    }
+    void* data = nullptr;
+    if (AHardwareBuffer_lock(buf, readUsage, -1, nullptr, &data) != 0) {
+        return false;
+    }
+    auto* pixels = static_cast<const uint8_t*>(data);
+    size_t rowStride = size_t{desc.stride} * 4;
+
+    vk::Extent2D extent{desc.width, desc.height};
+    if (extent != watImageExtent_) {
+        createWatermarkImage(extent);
+        // Nothing in the new image yet, all of the frame is copied
+        watermarkDiff_.reset();
+    }
+    auto start = std::chrono::steady_clock::now();
+    watermarkDiff_.diff(
+        pixels, desc.width, desc.height, rowStride, watermarkDamage_
+    );
+    watermarkStats_.hashTimeUs +=
+        (std::chrono::steady_clock::now() - start) /
+        std::chrono::microseconds(1);
+
+    // The view often posts what it showed already
+    if (watermarkDamage_.empty()) {
+        ++watermarkStats_.framesSkipped;
+    } else {
+        uploadWatermarkDamage(pixels, rowStride);
+        watermarkCoverage_.update(
+            pixels, desc.width, desc.height, rowStride, watermarkDamage_
+        );
+        ++watermarkStats_.framesUpdated;
+    }
+    AHardwareBuffer_unlock(buf, nullptr);
+    watermarkStats_.tilesCovered = watermarkCoverage_.getCoveredTiles();
+    watermarkStats_.tileCount = watermarkCoverage_.getTileCount();
+
+    if (!watImageBound_) {
+        // Once, from the imported buffers or no watermark at all
+        device_.waitIdle();
+        bindWatermarkTexture(*watImage_.imageView);
+        watTextures_.clear();
+        watImageBound_ = true;
+    }
+    return true;
+}
+
+void VkRenderer::createWatermarkImage(vk::Extent2D extent) {
+    logI("Creating the watermark image %ux%u", extent.width, extent.height);
+    // Frames in flight may sample the old one
+    device_.waitIdle();
+    watImageBound_ = false;
+    watImageExtent_ = extent;
+
+    vk::ImageCreateInfo imageInfo{
+        .imageType = vk::ImageType::e2D,
+        .format = vk::Format::eR8G8B8A8Unorm,
+        .extent = {extent.width, extent.height, 1},
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = vk::SampleCountFlagBits::e1,
+        .tiling = vk::ImageTiling::eOptimal,
+        .usage = vk::ImageUsageFlagBits::eTransferDst |
+                 vk::ImageUsageFlagBits::eSampled,
+        .sharingMode = vk::SharingMode::eExclusive,
+        .initialLayout = vk::ImageLayout::eUndefined
+    };
+    watImage_.image = device_.createImage(imageInfo);
+
+    vk::MemoryRequirements memRequirements =
+        watImage_.image.getMemoryRequirements();
+    vk::MemoryAllocateInfo allocInfo{
+        .allocationSize = memRequirements.size,
+        .memoryTypeIndex = findMemoryType(
+            memRequirements.memoryTypeBits,
+            vk::MemoryPropertyFlagBits::eDeviceLocal
+        )
+    };
+    watImage_.memory = device_.allocateMemory(allocInfo);
+    watImage_.image.bindMemory(*watImage_.memory, 0);
+    watImage_.imageView =
+        createImageView(watImage_.image, vk::Format::eR8G8B8A8Unorm);
+
+    vk::DeviceSize bufferSize =
+        vk::DeviceSize{extent.width} * extent.height * 4;
+    std::vector<vk::raii::CommandBuffer> commandBuffers =
+        device_.allocateCommandBuffers(
+            {.commandPool = *commandPool_,
+             .level = vk::CommandBufferLevel::ePrimary,
+             .commandBufferCount = WATERMARK_STAGING_SLOTS}
+        );
+    watermarkStaging_.clear();
+    watermarkStaging_.resize(WATERMARK_STAGING_SLOTS);
+    for (uint32_t i = 0; i < WATERMARK_STAGING_SLOTS; ++i) {
+        WatermarkStaging& staging = watermarkStaging_[i];
+        createBuffer(
+            bufferSize,
+            vk::BufferUsageFlagBits::eTransferSrc,
+            vk::MemoryPropertyFlagBits::eHostVisible |
+                vk::MemoryPropertyFlagBits::eHostCoherent,
+            staging.buffer,
+            staging.memory
+        );
+        // Stays mapped for the lifetime of the buffer
+        staging.data =
+            static_cast<uint8_t*>(staging.memory.mapMemory(0, bufferSize));
+        staging.commandBuffer = std::move(commandBuffers[i]);
+        staging.fence = vk::raii::Fence(
+            device_,
+            vk::FenceCreateInfo{.flags = vk::FenceCreateFlagBits::eSignaled}
+        );
+    }
+    nextWatermarkStaging_ = 0;
+}
+
+void VkRenderer::uploadWatermarkDamage(
+    const uint8_t* pixels, size_t rowStride
+) {
+    WatermarkStaging& staging = watermarkStaging_[nextWatermarkStaging_];
+    nextWatermarkStaging_ =
+        (nextWatermarkStaging_ + 1) % WATERMARK_STAGING_SLOTS;
+    // Copied long ago unless the view posts faster than the GPU copies
+    while (vk::Result::eTimeout ==
+           device_.waitForFences(*staging.fence, vk::True, FENCE_TIMEOUT));
+    device_.resetFences({*staging.fence});
+
+    // The rects are packed one after the other
+    std::vector<vk::BufferImageCopy> regions;
+    regions.reserve(watermarkDamage_.size());
+    vk::DeviceSize offset = 0;
+    for (const DamageRect& rect : watermarkDamage_) {
+        size_t rowBytes = size_t{rect.width} * 4;
+        for (uint32_t row = 0; row < rect.height; ++row) {
+            memcpy(
+                staging.data + offset + row * rowBytes,
+                pixels + (rect.y + row) * rowStride + size_t{rect.x} * 4,
+                rowBytes
+            );
+        }
+        regions.push_back({
+            .bufferOffset = offset,
+            .bufferRowLength = rect.width,
+            .bufferImageHeight = rect.height,
+            .imageSubresource = {.aspectMask = vk::ImageAspectFlagBits::eColor,
+                                 .mipLevel = 0,
+                                 .baseArrayLayer = 0,
+                                 .layerCount = 1},
+            .imageOffset = {static_cast<int32_t>(rect.x),
+                            static_cast<int32_t>(rect.y),
+                            0},
+            .imageExtent = {rect.width, rect.height, 1}
+        });
+        offset += rowBytes * rect.height;
+    }
+    watermarkStats_.bytesUploaded += offset;
+
+    vk::raii::CommandBuffer& commandBuffer = staging.commandBuffer;
+    commandBuffer.begin(
+        {.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit}
+    );
+    // Only after the frames submitted before are done sampling it. A new
+    // image is copied whole, so its contents can be dropped
+    bool fresh = !watImageBound_;
+    commandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eFragmentShader,
+        vk::PipelineStageFlagBits::eTransfer,
+        {},
+        nullptr,
+        nullptr,
+        makeImageBarrier(
+            *watImage_.image,
+            vk::AccessFlagBits::eNone,
+            vk::AccessFlagBits::eTransferWrite,
+            fresh ? vk::ImageLayout::eUndefined
+                  : vk::ImageLayout::eShaderReadOnlyOptimal,
+            vk::ImageLayout::eTransferDstOptimal
+        )
+    );
+    commandBuffer.copyBufferToImage(
+        *staging.buffer,
+        *watImage_.image,
+        vk::ImageLayout::eTransferDstOptimal,
+        regions
+    );
+    commandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTransfer,
+        vk::PipelineStageFlagBits::eFragmentShader,
+        {},
+        nullptr,
+        nullptr,
+        makeImageBarrier(
+            *watImage_.image,
+            vk::AccessFlagBits::eTransferWrite,
+            vk::AccessFlagBits::eShaderRead,
+            vk::ImageLayout::eTransferDstOptimal,
+            vk::ImageLayout::eShaderReadOnlyOptimal
+        )
+    );
+    commandBuffer.end();
+
+    queue_.submit(
+        vk::SubmitInfo{
+            .commandBufferCount = 1, .pCommandBuffers = &*commandBuffer
+        },
+        *staging.fence
+    );
+}
+
+void VkRenderer::bindWatermarkTexture(vk::ImageView imageView) {
+    vk::DescriptorImageInfo descriptorImageInfo{
+        .sampler = *watTextureSampler_,
+        .imageView = imageView,
+        .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
+    };
+
+    std::array<vk::WriteDescriptorSet, DESCRIPTOR_SLOTS> descriptorWrites;
+    for (size_t i = 0; i < descriptorWrites.size(); ++i) {
+        descriptorWrites[i] = vk::WriteDescriptorSet{
+            .dstSet = *descriptorSets_[i],
+            .dstBinding = 1,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+            .pImageInfo = &descriptorImageInfo
+        };
+    }
+
+    device_.updateDescriptorSets(descriptorWrites, nullptr);
+    watermarkBound_ = true;
+}
+
+void VkRenderer::stillHwBufferToJpeg(
+    AHardwareBuffer* buf,
+    const FrameMetadata& metadata,
+    std::string path,
+    std::function<void()> releaseBuffer
+) {
+    if (!initialized) {
+        releaseBuffer();
+        return;
+    }
+    if (stillBusy_.exchange(true)) {
+        logAsyncW("Still capture is in progress, frame dropped");
+        releaseBuffer();
+        return;
+    }
+
+    AHardwareBuffer_Desc hardwareBufferDesc;
+    AHardwareBuffer_describe(buf, &hardwareBufferDesc);
+
+    // The camera quad is rotated by 90 degrees, so is the still target
+    vk::Extent2D extent{hardwareBufferDesc.height, hardwareBufferDesc.width};
+    auto limits = physicalDevice_.getProperties().limits;
+    float scale = std::min(
+        {1.0f,
+         static_cast<float>(limits.maxFramebufferWidth) /
+             static_cast<float>(extent.width),
+         static_cast<float>(limits.maxFramebufferHeight) /
+             static_cast<float>(extent.height)}
+    );
+    if (scale < 1.0f) {
+        logW(
+            "Still %ux%u exceeds framebuffer limits, downscaling",
+            extent.width,
+            extent.height
+        );
+        extent.width = static_cast<uint32_t>(extent.width * scale);
+        extent.height = static_cast<uint32_t>(extent.height * scale);
+    }
+    if (extent != still_.extent) {
+        createStillTarget(extent);
+    }
+
+    importCamHwBuffer(buf, still_.camTexture);
+    updateUniformBuffer(STILL_SLOT, metadata);
+    updateGlyphBuffer(STILL_SLOT);
+    writeFrameOverlay(STILL_SLOT, metadata);
+    updateLayerBuffer(STILL_SLOT);
+
+    vk::DescriptorImageInfo camDescriptorImageInfo{
+        .sampler = *camTextureSampler_,
+        .imageView = *still_.camTexture.imageView,
+        .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
+    };
+    vk::WriteDescriptorSet descriptorWrites{
+        .dstSet = *descriptorSets_[STILL_SLOT],
+        .dstBinding = 2,
+        .dstArrayElement = 0,
+        .descriptorCount = 1,
+        .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+        .pImageInfo = &camDescriptorImageInfo
+    };
+    device_.updateDescriptorSets(descriptorWrites, nullptr);
+
+    vk::raii::CommandBuffer& commandBuffer = still_.commandBuffer;
+    commandBuffer.reset();
+    commandBuffer.begin(
+        {.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit}
+    );
+
+    // Transition within the same submission, transitionImageLayout() idles
+    // the queue and would stall the preview
+    vk::ImageMemoryBarrier camBarrier{
+        .srcAccessMask = vk::AccessFlagBits::eNone,
+        .dstAccessMask = vk::AccessFlagBits::eShaderRead,
+        .oldLayout = vk::ImageLayout::eUndefined,
+        .newLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+        .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+        .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+        .image = *still_.camTexture.image,
+        .subresourceRange = {
+            .aspectMask = vk::ImageAspectFlagBits::eColor,
+            .baseMipLevel = 0,
+            .levelCount = 1,
+            .baseArrayLayer = 0,
+            .layerCount = 1
+        }
+    };
+    commandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTopOfPipe,
+        vk::PipelineStageFlagBits::eFragmentShader,
+        {},
+        nullptr,
+        nullptr,
+        camBarrier
+    );
+
+    vk::ClearValue clearColor;
+    clearColor.color.float32 = std::array<float, 4>{0.0f, 0.0f, 0.0f, 1.0f};
+    vk::RenderPassBeginInfo renderPassInfo{
+        .renderPass = *stillRenderPass_,
+        .framebuffer = *still_.framebuffer,
+        .renderArea = {.offset = {0, 0}, .extent = extent},
+        .clearValueCount = 1,
+        .pClearValues = &clearColor
+    };
+    commandBuffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
+
+    commandBuffer.bindPipeline(
+        vk::PipelineBindPoint::eGraphics,
+        forensicSlots_[STILL_SLOT] ? *forensicPipeline_ : *graphicsPipeline_
+    );
+
+    vk::Viewport viewport{
+        .x = 0.0f,
+        .y = 0.0f,
+        .width = static_cast<float>(extent.width),
+        .height = static_cast<float>(extent.height),
+        .minDepth = 0.0f,
+        .maxDepth = 1.0f
+    };
+    commandBuffer.setViewport(0, viewport);
+    commandBuffer.setScissor(0, vk::Rect2D{.offset = {0, 0}, .extent = extent});
+
+    commandBuffer.bindVertexBuffers(0, {*vertexBuffer_}, {0});
+    commandBuffer.bindIndexBuffer(
+        *indexBuffer_,
+        0,
+        vk::IndexTypeValue<decltype(indices_)::value_type>::value
+    );
+    commandBuffer.bindDescriptorSets(
+        vk::PipelineBindPoint::eGraphics,
+        *pipelineLayout_,
+        0,
+        {*descriptorSets_[STILL_SLOT]},
+        nullptr
+    );
+
+    auto indexCount = static_cast<uint32_t>(indices_.size());
+    commandBuffer.drawIndexed(indexCount, 1, 0, 0, 0);
+    recordLayers(commandBuffer, STILL_SLOT);
+    recordGlyphs(commandBuffer, STILL_SLOT);
+
+    commandBuffer.endRenderPass();
+
+    vk::ImageMemoryBarrier targetBarrier{
+        .srcAccessMask = vk::AccessFlagBits::eColorAttachmentWrite,
+        .dstAccessMask = vk::AccessFlagBits::eTransferRead,
+        .oldLayout = vk::ImageLayout::eTransferSrcOptimal,
+        .newLayout = vk::ImageLayout::eTransferSrcOptimal,
+        .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+        .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+        .image = *still_.target.image,
+        .subresourceRange = {
+            .aspectMask = vk::ImageAspectFlagBits::eColor,
+            .baseMipLevel = 0,
+            .levelCount = 1,
+            .baseArrayLayer = 0,
+            .layerCount = 1
+        }
+    };
+    commandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eColorAttachmentOutput,
+        vk::PipelineStageFlagBits::eTransfer,
+        {},
+        nullptr,
+        nullptr,
+        targetBarrier
+    );
+
+    vk::BufferImageCopy region{
+        .bufferOffset = 0,
+        .bufferRowLength = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource =
+            {.aspectMask = vk::ImageAspectFlagBits::eColor,
+             .mipLevel = 0,
+             .baseArrayLayer = 0,
+             .layerCount = 1},
+        .imageOffset = {0, 0, 0},
+        .imageExtent = {extent.width, extent.height, 1}
+    };
+    commandBuffer.copyImageToBuffer(
+        *still_.target.image,
+        vk::ImageLayout::eTransferSrcOptimal,
+        *still_.readbackBuffer,
+        region
+    );
+
+    vk::BufferMemoryBarrier readbackBarrier{
+        .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+        .dstAccessMask = vk::AccessFlagBits::eHostRead,
+        .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+        .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+        .buffer = *still_.readbackBuffer,
+        .offset = 0,
+        .size = vk::WholeSize
+    };
+    commandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTransfer,
+        vk::PipelineStageFlagBits::eHost,
+        {},
+        nullptr,
+        readbackBarrier,
+        nullptr
+    );
+
+    commandBuffer.end();
+
+    device_.resetFences({*still_.fence});
+    vk::SubmitInfo submitInfo{
+        .commandBufferCount = 1, .pCommandBuffers = &*commandBuffer
+    };
+    queue_.submit(submitInfo, *still_.fence);
+
+    // The fence is waited and the jpeg encoded on the writer thread, the
+    // render thread continues with the next preview frame right away
+    // The camera buffer is sampled until the fence signals
+    jpegWriter_.submit({
+        .waitForPixels =
+            [this, release = std::move(releaseBuffer)]() {
+                while (vk::Result::eTimeout ==
+                       device_.waitForFences(
+                           *still_.fence, vk::True, FENCE_TIMEOUT
+                       ));
+                release();
+                if (!still_.readbackCoherent) {
+                    device_.invalidateMappedMemoryRanges(vk::MappedMemoryRange{
+                        .memory = *still_.readbackMemory,
+                        .offset = 0,
+                        .size = vk::WholeSize
+                    });
+                }
+            },
+        .pixels = still_.readbackData,
+        .width = extent.width,
+        .height = extent.height,
+        .bgra = isSwapChainBgra(),
+        .quality = JPEG_QUALITY,
+        .path = std::move(path),
+        .onDone = [this](bool) { stillBusy_ = false; }
+    });
+}
+
+void VkRenderer::setFrameReadback(
+    FrameReadback::Callback callback,
+    uint32_t interval,
+    float scale
+) {
+    readbackCallback_ = std::move(callback);
+    readbackInterval_ = std::max(interval, 1u);
+    readbackScale_ = std::clamp(scale, 0.0625f, 1.0f);
+    readbackCounter_ = 0;
+    if (initialized && readbackCallback_ && !swapChainReadable_) {
+        recreateSwapChain();
+        if (!swapChainReadable_) logW("Preview frames can't be read back");
+    }
+}
+
+void VkRenderer::recordReadback(
+    vk::raii::CommandBuffer& commandBuffer,
+    vk::Image image,
+    ReadbackTarget& target
+) {
+    vk::Extent2D extent = swapChainExtent_;
+    if (swapChainBlittable_ && readbackScale_ < 1.0f) {
+        auto scaled = [this](uint32_t size) {
+            return std::max(
+                1u,
+                static_cast<uint32_t>(static_cast<float>(size) * readbackScale_)
+            );
+        };
+        extent = {scaled(extent.width), scaled(extent.height)};
+    }
+    bool scaled = extent != swapChainExtent_;
+    if (extent != target.extent ||
+        scaled != static_cast<bool>(*target.scaled.image)) {
+        createReadbackTarget(target, extent);
+    }
+
+    vk::ImageSubresourceLayers layers{
+        .aspectMask = vk::ImageAspectFlagBits::eColor,
+        .mipLevel = 0,
+        .baseArrayLayer = 0,
+        .layerCount = 1
+    };
+
+    // The render pass left the frame ready to present
+    commandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eColorAttachmentOutput,
+        vk::PipelineStageFlagBits::eTransfer,
+        {},
+        nullptr,
+        nullptr,
+        makeImageBarrier(
+            image,
+            vk::AccessFlagBits::eColorAttachmentWrite,
+            vk::AccessFlagBits::eTransferRead,
+            vk::ImageLayout::ePresentSrcKHR,
+            vk::ImageLayout::eTransferSrcOptimal
+        )
+    );
+
+    vk::Image source = image;
+    if (scaled) {
+        vk::Image scaledImage = *target.scaled.image;
+        commandBuffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eTopOfPipe,
+            vk::PipelineStageFlagBits::eTransfer,
+            {},
+            nullptr,
+            nullptr,
+            makeImageBarrier(
+                scaledImage,
+                vk::AccessFlagBits::eNone,
+                vk::AccessFlagBits::eTransferWrite,
+                vk::ImageLayout::eUndefined,
+                vk::ImageLayout::eTransferDstOptimal
+            )
+        );
+        vk::ImageBlit blit{
+            .srcSubresource = layers,
+            .srcOffsets = std::array<vk::Offset3D, 2>{
+                vk::Offset3D{0, 0, 0},
+                vk::Offset3D{
+                    static_cast<int32_t>(swapChainExtent_.width),
+                    static_cast<int32_t>(swapChainExtent_.height),
+                    1
+                }
+            },
+            .dstSubresource = layers,
+            .dstOffsets = std::array<vk::Offset3D, 2>{
+                vk::Offset3D{0, 0, 0},
+                vk::Offset3D{
+                    static_cast<int32_t>(extent.width),
+                    static_cast<int32_t>(extent.height),
+                    1
+                }
+            }
+        };
+        commandBuffer.blitImage(
+            image,
+            vk::ImageLayout::eTransferSrcOptimal,
+            scaledImage,
+            vk::ImageLayout::eTransferDstOptimal,
+            blit,
+            vk::Filter::eLinear
+        );
+        commandBuffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eTransfer,
+            vk::PipelineStageFlagBits::eTransfer,
+            {},
+            nullptr,
+            nullptr,
+            makeImageBarrier(
+                scaledImage,
+                vk::AccessFlagBits::eTransferWrite,
+                vk::AccessFlagBits::eTransferRead,
+                vk::ImageLayout::eTransferDstOptimal,
+                vk::ImageLayout::eTransferSrcOptimal
+            )
+        );
+        source = scaledImage;
+    }
+
+    vk::BufferImageCopy region{
+        .bufferOffset = 0,
+        .bufferRowLength = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource = layers,
+        .imageOffset = {0, 0, 0},
+        .imageExtent = {extent.width, extent.height, 1}
+    };
+    commandBuffer.copyImageToBuffer(
+        source, vk::ImageLayout::eTransferSrcOptimal, *target.buffer, region
+    );
+
+    // Back to presenting, and the copy made visible to the host
+    vk::BufferMemoryBarrier readbackBarrier{
+        .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+        .dstAccessMask = vk::AccessFlagBits::eHostRead,
+        .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+        .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+        .buffer = *target.buffer,
+        .offset = 0,
+        .size = vk::WholeSize
+    };
+    commandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTransfer,
+        vk::PipelineStageFlagBits::eBottomOfPipe |
+            vk::PipelineStageFlagBits::eHost,
+        {},
+        nullptr,
+        readbackBarrier,
+        makeImageBarrier(
+            image,
+            vk::AccessFlagBits::eTransferRead,
+            vk::AccessFlagBits::eNone,
+            vk::ImageLayout::eTransferSrcOptimal,
+            vk::ImageLayout::ePresentSrcKHR
+        )
+    );
+}
+
+void VkRenderer::submitReadback(uint32_t slot, int64_t timestampNs) {
+    ReadbackTarget& target = readbackTargets_[slot];
+    frameReadback_.submit(
+        slot,
+        [this, &target]() {
+            while (vk::Result::eTimeout ==
+                   device_.waitForFences(
+                       *target.fence, vk::True, FENCE_TIMEOUT
+                   ));
+            if (!target.coherent) {
+                device_.invalidateMappedMemoryRanges(vk::MappedMemoryRange{
+                    .memory = *target.memory, .offset = 0, .size = vk::WholeSize
+                });
+            }
+        },
+        {
+            .pixels = target.data,
+            .width = target.extent.width,
+            .height = target.extent.height,
+            .bgra = isSwapChainBgra(),
+            .timestampNs = timestampNs
+        },
+        readbackCallback_
+    );
+}
+
+void VkRenderer::setPyramidLevels(uint32_t levels) {
+    levels = std::min(levels, MAX_PYRAMID_LEVELS);
+    if (levels == pyramidLevels_) return;
+    pyramidLevels_ = levels;
+    if (levels > 0 || pyramidSlots_.empty()) return;
+    // Only released when turned off, the consumers may still be reading
+    device_.waitIdle();
+    for (PyramidSlot& slot : pyramidSlots_) slot = {};
+}
+
+uint32_t VkRenderer::addPyramidConsumer(PyramidConsumer consumer) {
+    pyramidConsumers_.emplace_back(nextPyramidConsumerId_, std::move(consumer));
+    return nextPyramidConsumerId_++;
+}
+
+void VkRenderer::removePyramidConsumer(uint32_t id) {
+    std::erase_if(pyramidConsumers_, [id](const auto& consumer) {
+        return consumer.first == id;
+    });
+}
+
+void VkRenderer::setLumaMeter(bool enabled) {
+    if (enabled == lumaMeterConsumer_.has_value()) return;
+    if (enabled) {
+        lumaMeterConsumer_ = addPyramidConsumer(
+            [this](
+                vk::raii::CommandBuffer& commandBuffer,
+                const PyramidFrame& frame
+            ) { recordLumaMeter(commandBuffer, frame); }
+        );
+        return;
+    }
+    removePyramidConsumer(*lumaMeterConsumer_);
+    lumaMeterConsumer_.reset();
+    // The buffers are kept, frames in flight may still copy into them
+    for (LumaMeterSlot& slot : lumaMeterSlots_) slot.pixelCount = 0;
+    sceneLuma_ = -1.0f;
+}
+
+void VkRenderer::recordLumaMeter(
+    vk::raii::CommandBuffer& commandBuffer, const PyramidFrame& frame
+) {
+    // The fence of the frame was waited, the copy of its last frame is done
+    LumaMeterSlot& slot = lumaMeterSlots_[currentFrame_];
+    if (slot.pixelCount > 0) {
+        if (!slot.coherent) {
+            device_.invalidateMappedMemoryRanges(vk::MappedMemoryRange{
+                .memory = *slot.memory, .offset = 0, .size = vk::WholeSize
+            });
+        }
+        uint64_t sum = 0;
+        for (uint32_t i = 0; i < slot.pixelCount; ++i) sum += slot.data[i];
+        sceneLuma_ = static_cast<float>(sum) /
+                     (255.0f * static_cast<float>(slot.pixelCount));
+    }
+
+    // A few pixels across, reading it back costs next to nothing
+    const PyramidLevel& level = frame.luma.back();
+    uint32_t pixelCount = level.extent.width * level.extent.height;
+    if (slot.size < pixelCount) createLumaMeterSlot(slot, pixelCount);
+    slot.pixelCount = pixelCount;
+
+    // Only this level leaves eShaderReadOnlyOptimal, and comes back to it
+    // for the consumers after
+    commandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTransfer,
+        vk::PipelineStageFlagBits::eTransfer,
+        {},
+        nullptr,
+        nullptr,
+        makeImageBarrier(
+            level.image,
+            vk::AccessFlagBits::eNone,
+            vk::AccessFlagBits::eTransferRead,
+            vk::ImageLayout::eShaderReadOnlyOptimal,
+            vk::ImageLayout::eTransferSrcOptimal,
+            level.mipLevel
+        )
+    );
+    commandBuffer.copyImageToBuffer(
+        level.image,
+        vk::ImageLayout::eTransferSrcOptimal,
+        *slot.buffer,
+        vk::BufferImageCopy{
+            .bufferOffset = 0,
+            .bufferRowLength = 0,
+            .bufferImageHeight = 0,
+            .imageSubresource = {
+                .aspectMask = vk::ImageAspectFlagBits::eColor,
+                .mipLevel = level.mipLevel,
+                .baseArrayLayer = 0,
+                .layerCount = 1
+            },
+            .imageOffset = {0, 0, 0},
+            .imageExtent = {level.extent.width, level.extent.height, 1}
+        }
+    );
+    vk::BufferMemoryBarrier meterBarrier{
+        .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+        .dstAccessMask = vk::AccessFlagBits::eHostRead,
+        .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+        .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+        .buffer = *slot.buffer,
+        .offset = 0,
+        .size = vk::WholeSize
+    };
+    commandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTransfer,
+        vk::PipelineStageFlagBits::eFragmentShader |
+            vk::PipelineStageFlagBits::eComputeShader |
+            vk::PipelineStageFlagBits::eTransfer |
+            vk::PipelineStageFlagBits::eHost,
+        {},
+        nullptr,
+        meterBarrier,
+        makeImageBarrier(
+            level.image,
+            vk::AccessFlagBits::eNone,
+            vk::AccessFlagBits::eShaderRead |
+                vk::AccessFlagBits::eTransferRead,
+            vk::ImageLayout::eTransferSrcOptimal,
+            vk::ImageLayout::eShaderReadOnlyOptimal,
+            level.mipLevel
+        )
+    );
+}
+
+bool VkRenderer::drawPyramid(
+    AHardwareBuffer* buf, const FrameMetadata& metadata
+) {
+    if (pyramidLevels_ == 0) return false;
+
+    // Upright like the still target, the camera quad is rotated
+    AHardwareBuffer_Desc hardwareBufferDesc;
+    AHardwareBuffer_describe(buf, &hardwareBufferDesc);
+    auto scaled = [](uint32_t size) {
+        return std::max(
+            1u, static_cast<uint32_t>(static_cast<float>(size) *
+                                      PYRAMID_BASE_SCALE)
+        );
+    };
+    vk::Extent2D extent{
+        scaled(hardwareBufferDesc.height), scaled(hardwareBufferDesc.width)
+    };
+    uint32_t levels = 1;
+    while (levels < pyramidLevels_ &&
+           std::min(extent.width, extent.height) >> levels > 0) {
+        ++levels;
+    }
+
+    // The fence of the frame was waited, its last pyramid is unused
+    if (pyramidSlots_.empty()) pyramidSlots_.resize(MAX_FRAMES_IN_FLIGHT);
+    PyramidSlot& slot = pyramidSlots_[currentFrame_];
+    if (slot.extent != extent || slot.levels != levels) {
+        createPyramidSlot(slot, extent, levels);
+    }
+
+    vk::raii::CommandBuffer& commandBuffer =
+        pyramidCommandBuffers_[currentFrame_];
+    commandBuffer.begin(vk::CommandBufferBeginInfo{});
+
+    vk::RenderPassBeginInfo renderPassInfo{
+        .renderPass = *pyramidRenderPass_,
+        .framebuffer = *slot.framebuffer,
+        .renderArea = {.offset = {0, 0}, .extent = extent}
+    };
+    commandBuffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
+    commandBuffer.bindPipeline(
+        vk::PipelineBindPoint::eGraphics, *pyramidPipeline_
+    );
+    commandBuffer.setViewport(
+        0,
+        vk::Viewport{
+            .x = 0.0f,
+            .y = 0.0f,
+            .width = static_cast<float>(extent.width),
+            .height = static_cast<float>(extent.height),
+            .minDepth = 0.0f,
+            .maxDepth = 1.0f
+        }
+    );
+    commandBuffer.setScissor(0, vk::Rect2D{.offset = {0, 0}, .extent = extent});
+    commandBuffer.bindVertexBuffers(0, {*vertexBuffer_}, {0});
+    commandBuffer.bindIndexBuffer(
+        *indexBuffer_,
+        0,
+        vk::IndexTypeValue<decltype(indices_)::value_type>::value
+    );
+    commandBuffer.bindDescriptorSets(
+        vk::PipelineBindPoint::eGraphics,
+        *pipelineLayout_,
+        0,
+        {*descriptorSets_[currentFrame_]},
+        nullptr
+    );
+    commandBuffer.drawIndexed(
+        static_cast<uint32_t>(indices_.size()), 1, 0, 0, 0
+    );
+    commandBuffer.endRenderPass();
+
+    // Each level is blitted from the one above it, in both pyramids
+    std::array<vk::Image, 2> images{*slot.rgba.image, *slot.luma.image};
+    auto barriers = [&images](
+                        uint32_t level,
+                        uint32_t levelCount,
+                        vk::AccessFlags srcAccessMask,
+                        vk::AccessFlags dstAccessMask,
+                        vk::ImageLayout oldLayout,
+                        vk::ImageLayout newLayout
+                    ) {
+        std::array<vk::ImageMemoryBarrier, 2> imageBarriers;
+        for (size_t i = 0; i < images.size(); ++i) {
+            imageBarriers[i] = makeImageBarrier(
+                images[i],
+                srcAccessMask,
+                dstAccessMask,
+                oldLayout,
+                newLayout,
+                level,
+                levelCount
+            );
+        }
+        return imageBarriers;
+    };
+    commandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eColorAttachmentOutput,
+        vk::PipelineStageFlagBits::eTransfer,
+        {},
+        nullptr,
+        nullptr,
+        barriers(
+            0,
+            1,
+            vk::AccessFlagBits::eColorAttachmentWrite,
+            vk::AccessFlagBits::eTransferRead,
+            vk::ImageLayout::eTransferSrcOptimal,
+            vk::ImageLayout::eTransferSrcOptimal
+        )
+    );
+    for (uint32_t level = 1; level < levels; ++level) {
+        commandBuffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eTopOfPipe,
+            vk::PipelineStageFlagBits::eTransfer,
+            {},
+            nullptr,
+            nullptr,
+            barriers(
+                level,
+                1,
+                vk::AccessFlagBits::eNone,
+                vk::AccessFlagBits::eTransferWrite,
+                vk::ImageLayout::eUndefined,
+                vk::ImageLayout::eTransferDstOptimal
+            )
+        );
+        auto corner = [&slot](uint32_t mipLevel) {
+            const vk::Extent2D& size = slot.frame.rgba[mipLevel].extent;
+            return vk::Offset3D{
+                static_cast<int32_t>(size.width),
+                static_cast<int32_t>(size.height),
+                1
+            };
+        };
+        for (vk::Image image : images) {
+            vk::ImageBlit blit{
+                .srcSubresource = {
+                    .aspectMask = vk::ImageAspectFlagBits::eColor,
+                    .mipLevel = level - 1,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1
+                },
+                .srcOffsets = std::array<vk::Offset3D, 2>{
+                    vk::Offset3D{0, 0, 0}, corner(level - 1)
+                },
+                .dstSubresource = {
+                    .aspectMask = vk::ImageAspectFlagBits::eColor,
+                    .mipLevel = level,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1
+                },
+                .dstOffsets = std::array<vk::Offset3D, 2>{
+                    vk::Offset3D{0, 0, 0}, corner(level)
+                }
+            };
+            commandBuffer.blitImage(
+                image,
+                vk::ImageLayout::eTransferSrcOptimal,
+                image,
+                vk::ImageLayout::eTransferDstOptimal,
+                blit,
+                vk::Filter::eLinear
+            );
+        }
+        commandBuffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eTransfer,
+            vk::PipelineStageFlagBits::eTransfer,
+            {},
+            nullptr,
+            nullptr,
+            barriers(
+                level,
+                1,
+                vk::AccessFlagBits::eTransferWrite,
+                vk::AccessFlagBits::eTransferRead,
+                vk::ImageLayout::eTransferDstOptimal,
+                vk::ImageLayout::eTransferSrcOptimal
+            )
+        );
+    }
+    commandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTransfer,
+        vk::PipelineStageFlagBits::eFragmentShader |
+            vk::PipelineStageFlagBits::eComputeShader |
+            vk::PipelineStageFlagBits::eTransfer,
+        {},
+        nullptr,
+        nullptr,
+        barriers(
+            0,
+            levels,
+            vk::AccessFlagBits::eTransferWrite,
+            vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eTransferRead,
+            vk::ImageLayout::eTransferSrcOptimal,
+            vk::ImageLayout::eShaderReadOnlyOptimal
+        )
     );
 
-    vk::DescriptorImageInfo descriptorImageInfo{
-        .sampler = *watTextureSampler_,
-        .imageView = *watTexture.imageView,
-        .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
-    };
+    slot.frame.frameNumber = metadata.frameNumber;
+    slot.frame.timestampNs = metadata.timestampNs;
+    for (auto& [id, consumer] : pyramidConsumers_) {
+        consumer(commandBuffer, slot.frame);
+    }
+    commandBuffer.end();
 
-    std::array descriptorWrites{
-        vk::WriteDescriptorSet{
-            .dstSet = *descriptorSets_[0],
-            .dstBinding = 1,
-            .dstArrayElement = 0,
-            .descriptorCount = 1,
-            .descriptorType = vk::DescriptorType::eCombinedImageSampler,
-            .pImageInfo = &descriptorImageInfo
-        },
-        vk::WriteDescriptorSet{
-            .dstSet = *descriptorSets_[1],
-            .dstBinding = 1,
-            .dstArrayElement = 0,
-            .descriptorCount = 1,
-            .descriptorType = vk::DescriptorType::eCombinedImageSampler,
-            .pImageInfo = &descriptorImageInfo
+    queue_.submit(
+        vk::SubmitInfo{
+            .commandBufferCount = 1, .pCommandBuffers = &*commandBuffer
         }
-    };
-    // vk::WriteDescriptorSet descriptorWrites{
-    //     .dstSet = *descriptorSets[currentFrame],
-    //     .dstBinding = 1,
-    //     .dstArrayElement = 0,
-    //     .descriptorCount = 1,
-    //     .descriptorType = vk::DescriptorType::eCombinedImageSampler,
-    //     .pImageInfo = &descriptorImageInfo
-    // };
+    );
+    return true;
+}
 
-    device_.updateDescriptorSets(descriptorWrites, nullptr);
+bool VkRenderer::isSwapChainBgra() const {
+    return swapChainSurfaceFormat_.format == vk::Format::eB8G8R8A8Srgb ||
+           swapChainSurfaceFormat_.format == vk::Format::eB8G8R8A8Unorm;
+}
+
+bool VkRenderer::isSwapChainSrgb() const {
+    return swapChainSurfaceFormat_.format == vk::Format::eB8G8R8A8Srgb ||
+           swapChainSurfaceFormat_.format == vk::Format::eR8G8B8A8Srgb;
 }
 
 void VkRenderer::reset(ANativeWindow* newWindow, AAssetManager* newManager) {
     displayWindow_ = newWindow;
     assetManager_ = newManager;
+    applyPreviewScale();
     if (initialized) {
         device_.waitIdle();
         cleanupSwapChain();
@@ -739,6 +1808,30 @@ void VkRenderer::cleanup() {
     }
 }
 
+bool VkRenderer::supportsYcbcrConversion() {
+    try {
+        vk::raii::Context context;
+        vk::ApplicationInfo appInfo{.apiVersion = vk::ApiVersion11};
+        vk::raii::Instance instance(
+            context, vk::InstanceCreateInfo{.pApplicationInfo = &appInfo}
+        );
+        for (const auto& device : instance.enumeratePhysicalDevices()) {
+            if (device.getProperties().apiVersion < vk::ApiVersion11) continue;
+            auto features = device.getFeatures2<
+                vk::PhysicalDeviceFeatures2,
+                vk::PhysicalDeviceSamplerYcbcrConversionFeatures>();
+            if (features
+                    .get<vk::PhysicalDeviceSamplerYcbcrConversionFeatures>()
+                    .samplerYcbcrConversion) {
+                return true;
+            }
+        }
+    } catch (const vk::SystemError& e) {
+        logW("Can't query Vulkan devices: %s", e.what());
+    }
+    return false;
+}
+
 void VkRenderer::createInstance() {
     vk::ApplicationInfo appInfo{
         .pApplicationName = "VkWatCam",
@@ -862,14 +1955,32 @@ void VkRenderer::createLogicalDevice() {
         .sampleRateShading = vk::True,
         .samplerAnisotropy = vk::True,
     };
+    // Optional, only measures what the watermark layers cost
+    hasPipelineStatistics_ =
+        physicalDevice_.getFeatures().pipelineStatisticsQuery;
+    deviceFeatures.pipelineStatisticsQuery = hasPipelineStatistics_;
+
+    // Optional, lets media frames carry their capture time
+    std::vector<const char*> extensions = deviceExtensions_;
+    hasDisplayTiming_ = std::ranges::any_of(
+        physicalDevice_.enumerateDeviceExtensionProperties(),
+        [](const vk::ExtensionProperties& properties) {
+            return strcmp(
+                       properties.extensionName,
+                       vk::GOOGLEDisplayTimingExtensionName
+                   ) == 0;
+        }
+    );
+    if (hasDisplayTiming_) {
+        extensions.push_back(vk::GOOGLEDisplayTimingExtensionName);
+    }
 
     vk::DeviceCreateInfo createInfo{
         .pNext = &vk11features,
         .queueCreateInfoCount = 1,
         .pQueueCreateInfos = &deviceQueueCreateInfo,
-        .enabledExtensionCount =
-            static_cast<uint32_t>(deviceExtensions_.size()),
-        .ppEnabledExtensionNames = deviceExtensions_.data(),
+        .enabledExtensionCount = static_cast<uint32_t>(extensions.size()),
+        .ppEnabledExtensionNames = extensions.data(),
         .pEnabledFeatures = &deviceFeatures
     };
 
@@ -883,6 +1994,23 @@ void VkRenderer::createSwapChain() {
         querySwapChainSupport(physicalDevice_, *displaySurface_);
     swapChainExtent_ = chooseSwapExtent(swapChainSupport.capabilities);
     swapChainSurfaceFormat_ = chooseSwapSurfaceFormat(swapChainSupport.formats);
+
+    // Copyable only once readbacks want it, the usage can cost the
+    // compositor its compressed formats
+    vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eColorAttachment;
+    swapChainReadable_ = readbackCallback_ &&
+                         (swapChainSupport.capabilities.supportedUsageFlags &
+                          vk::ImageUsageFlagBits::eTransferSrc);
+    if (swapChainReadable_) usage |= vk::ImageUsageFlagBits::eTransferSrc;
+    vk::FormatFeatureFlags blitFeatures =
+        vk::FormatFeatureFlagBits::eBlitSrc |
+        vk::FormatFeatureFlagBits::eBlitDst |
+        vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+    swapChainBlittable_ =
+        (physicalDevice_.getFormatProperties(swapChainSurfaceFormat_.format)
+             .optimalTilingFeatures &
+         blitFeatures) == blitFeatures;
+
     vk::SwapchainCreateInfoKHR swapChainCreateInfo{
         .surface = *displaySurface_,
         .minImageCount = chooseSwapMinImageCount(swapChainSupport.capabilities),
@@ -890,7 +2018,7 @@ void VkRenderer::createSwapChain() {
         .imageColorSpace = swapChainSurfaceFormat_.colorSpace,
         .imageExtent = swapChainExtent_,
         .imageArrayLayers = 1,
-        .imageUsage = vk::ImageUsageFlagBits::eColorAttachment,
+        .imageUsage = usage,
         .imageSharingMode = vk::SharingMode::eExclusive,
         .preTransform = swapChainSupport.capabilities.currentTransform,
         .compositeAlpha = vk::CompositeAlphaFlagBitsKHR::eInherit,
@@ -930,15 +2058,83 @@ void VkRenderer::createImageViews() {
 }
 
 void VkRenderer::createRenderPass() {
+    renderPass_ = createColorRenderPass(
+        swapChainSurfaceFormat_.format, vk::ImageLayout::ePresentSrcKHR
+    );
+    // Compatible with renderPass_, so the graphics pipeline is shared
+    stillRenderPass_ = createColorRenderPass(
+        swapChainSurfaceFormat_.format, vk::ImageLayout::eTransferSrcOptimal
+    );
+    createPyramidRenderPass();
+}
+
+void VkRenderer::createPyramidRenderPass() {
+    // The camera covers the whole level, nothing to load. Left ready for
+    // the blits of the next level
+    vk::AttachmentDescription attachment{
+        .samples = vk::SampleCountFlagBits::e1,
+        .loadOp = vk::AttachmentLoadOp::eDontCare,
+        .storeOp = vk::AttachmentStoreOp::eStore,
+        .stencilLoadOp = vk::AttachmentLoadOp::eDontCare,
+        .stencilStoreOp = vk::AttachmentStoreOp::eDontCare,
+        .initialLayout = vk::ImageLayout::eUndefined,
+        .finalLayout = vk::ImageLayout::eTransferSrcOptimal
+    };
+    std::array<vk::AttachmentDescription, 2> attachments{
+        attachment, attachment
+    };
+    attachments[0].format = PYRAMID_RGBA_FORMAT;
+    attachments[1].format = PYRAMID_LUMA_FORMAT;
+
+    std::array<vk::AttachmentReference, 2> colorAttachmentRefs{
+        vk::AttachmentReference{
+            .attachment = 0, .layout = vk::ImageLayout::eColorAttachmentOptimal
+        },
+        vk::AttachmentReference{
+            .attachment = 1, .layout = vk::ImageLayout::eColorAttachmentOptimal
+        }
+    };
+
+    vk::SubpassDescription subpass{
+        .pipelineBindPoint = vk::PipelineBindPoint::eGraphics,
+        .colorAttachmentCount =
+            static_cast<uint32_t>(colorAttachmentRefs.size()),
+        .pColorAttachments = colorAttachmentRefs.data()
+    };
+
+    vk::SubpassDependency dependency{
+        .srcSubpass = vk::SubpassExternal,
+        .dstSubpass = 0,
+        .srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput,
+        .dstStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput,
+        .srcAccessMask = vk::AccessFlagBits::eNone,
+        .dstAccessMask = vk::AccessFlagBits::eColorAttachmentWrite
+    };
+
+    vk::RenderPassCreateInfo renderPassInfo{
+        .attachmentCount = static_cast<uint32_t>(attachments.size()),
+        .pAttachments = attachments.data(),
+        .subpassCount = 1,
+        .pSubpasses = &subpass,
+        .dependencyCount = 1,
+        .pDependencies = &dependency
+    };
+
+    pyramidRenderPass_ = device_.createRenderPass(renderPassInfo);
+}
+
+vk::raii::RenderPass VkRenderer::createColorRenderPass(
+    vk::Format format, vk::ImageLayout finalLayout
+) const {
     vk::AttachmentDescription colorAttachment{
-        .format = swapChainSurfaceFormat_.format,
+        .format = format,
         .samples = vk::SampleCountFlagBits::e1,
         .loadOp = vk::AttachmentLoadOp::eClear,
         .storeOp = vk::AttachmentStoreOp::eStore,
         .stencilLoadOp = vk::AttachmentLoadOp::eDontCare,
         .stencilStoreOp = vk::AttachmentStoreOp::eDontCare,
         .initialLayout = vk::ImageLayout::eUndefined,
-        .finalLayout = vk::ImageLayout::ePresentSrcKHR
+        .finalLayout = finalLayout
     };
 
     vk::AttachmentReference colorAttachmentRef{
@@ -969,7 +2165,7 @@ void VkRenderer::createRenderPass() {
         .pDependencies = &dependency
     };
 
-    renderPass_ = device_.createRenderPass(renderPassInfo);
+    return device_.createRenderPass(renderPassInfo);
 }
 
 void VkRenderer::createDescriptorSetLayout() {
@@ -977,7 +2173,9 @@ void VkRenderer::createDescriptorSetLayout() {
         .binding = 0,
         .descriptorType = vk::DescriptorType::eUniformBuffer,
         .descriptorCount = 1,
-        .stageFlags = vk::ShaderStageFlagBits::eVertex
+        // The fragment stage reads the forensic watermark parameters
+        .stageFlags = vk::ShaderStageFlagBits::eVertex |
+                      vk::ShaderStageFlagBits::eFragment
     };
 
     vk::DescriptorSetLayoutBinding watSamplerLayoutBinding{
@@ -995,8 +2193,34 @@ void VkRenderer::createDescriptorSetLayout() {
         .pImmutableSamplers = &*camTextureSampler_
     };
 
+    vk::DescriptorSetLayoutBinding glyphSamplerLayoutBinding{
+        .binding = 3,
+        .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+        .descriptorCount = 1,
+        .stageFlags = vk::ShaderStageFlagBits::eFragment
+    };
+
+    vk::DescriptorSetLayoutBinding layerBufferLayoutBinding{
+        .binding = 4,
+        .descriptorType = vk::DescriptorType::eStorageBuffer,
+        .descriptorCount = 1,
+        .stageFlags = vk::ShaderStageFlagBits::eVertex
+    };
+
+    vk::DescriptorSetLayoutBinding spriteSamplerLayoutBinding{
+        .binding = 5,
+        .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+        .descriptorCount = 1,
+        .stageFlags = vk::ShaderStageFlagBits::eFragment
+    };
+
     std::array bindings = {
-        uboLayoutBinding, watSamplerLayoutBinding, camSamplerLayoutBinding
+        uboLayoutBinding,
+        watSamplerLayoutBinding,
+        camSamplerLayoutBinding,
+        glyphSamplerLayoutBinding,
+        layerBufferLayoutBinding,
+        spriteSamplerLayoutBinding
     };
 
     vk::DescriptorBindingFlags bindingFlags{
@@ -1108,9 +2332,10 @@ void VkRenderer::createGraphicsPipeline() {
         .sampleShadingEnable = vk::False
     };
 
-    // Color blending
+    // Color blending, off for the opaque camera quad and on for the
+    // layers and glyphs over it
     vk::PipelineColorBlendAttachmentState colorBlendAttachment{
-        .blendEnable = vk::True,
+        .blendEnable = vk::False,
         .srcColorBlendFactor = vk::BlendFactor::eSrcAlpha,
         .dstColorBlendFactor = vk::BlendFactor::eOneMinusSrcAlpha,
         .colorBlendOp = vk::BlendOp::eAdd,
@@ -1165,6 +2390,84 @@ void VkRenderer::createGraphicsPipeline() {
 
     // Create the pipeline
     graphicsPipeline_ = device_.createGraphicsPipeline(nullptr, pipelineInfo);
+
+    // The same with the forensic mark compiled in, forensicMark and
+    // srgbTarget. The mark goes into the encoding of the render pass
+    // format, which every composite target shares
+    std::array<vk::Bool32, 2> forensicConstants{
+        vk::True, isSwapChainSrgb() ? vk::True : vk::False
+    };
+    std::array<vk::SpecializationMapEntry, 2> forensicEntries;
+    for (uint32_t i = 0; i < forensicEntries.size(); ++i) {
+        forensicEntries[i] = {
+            .constantID = i,
+            .offset = i * static_cast<uint32_t>(sizeof(vk::Bool32)),
+            .size = sizeof(vk::Bool32)
+        };
+    }
+    vk::SpecializationInfo forensicSpecialization{
+        .mapEntryCount = static_cast<uint32_t>(forensicEntries.size()),
+        .pMapEntries = forensicEntries.data(),
+        .dataSize = sizeof(forensicConstants),
+        .pData = forensicConstants.data()
+    };
+    shaderStages[1].pSpecializationInfo = &forensicSpecialization;
+    forensicPipeline_ = device_.createGraphicsPipeline(nullptr, pipelineInfo);
+    shaderStages[1].pSpecializationInfo = nullptr;
+    colorBlendAttachment.blendEnable = vk::True;
+
+    // The glyph quads are expanded from their instance data, on the same
+    // layout so the descriptor set stays bound between the two
+    auto glyphBindingDescription = GlyphInstance::getBindingDescription();
+    auto glyphAttributeDescriptions = GlyphInstance::getAttributeDescriptions();
+    vertexInputInfo.pVertexBindingDescriptions = &glyphBindingDescription;
+    vertexInputInfo.vertexAttributeDescriptionCount =
+        static_cast<uint32_t>(glyphAttributeDescriptions.size());
+    vertexInputInfo.pVertexAttributeDescriptions =
+        glyphAttributeDescriptions.data();
+    inputAssembly.topology = vk::PrimitiveTopology::eTriangleStrip;
+    rasterizer.cullMode = vk::CullModeFlagBits::eNone;
+    shaderStages[0].pName = "glyphVertMain";
+    shaderStages[1].pName = "glyphFragMain";
+
+    glyphPipeline_ = device_.createGraphicsPipeline(nullptr, pipelineInfo);
+
+    // The layers come from the layer buffer, an instance per tile of them
+    // as strips over the parts of their bounding boxes
+    auto tileBindingDescription = LayerTile::getBindingDescription();
+    auto tileAttributeDescriptions = LayerTile::getAttributeDescriptions();
+    vertexInputInfo.pVertexBindingDescriptions = &tileBindingDescription;
+    vertexInputInfo.vertexAttributeDescriptionCount =
+        static_cast<uint32_t>(tileAttributeDescriptions.size());
+    vertexInputInfo.pVertexAttributeDescriptions =
+        tileAttributeDescriptions.data();
+    shaderStages[0].pName = "layerVertMain";
+    shaderStages[1].pName = "layerFragMain";
+
+    layerPipeline_ = device_.createGraphicsPipeline(nullptr, pipelineInfo);
+
+    // The camera quad again, into the RGBA and luma levels at once
+    vertexInputInfo.vertexBindingDescriptionCount = 1;
+    vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+    vertexInputInfo.vertexAttributeDescriptionCount =
+        static_cast<uint32_t>(attributeDescriptions.size());
+    vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+    inputAssembly.topology = vk::PrimitiveTopology::eTriangleList;
+    rasterizer.cullMode = vk::CullModeFlagBits::eBack;
+    shaderStages[0].pName = "vertMain";
+    shaderStages[1].pName = "pyramidFragMain";
+    std::array<vk::PipelineColorBlendAttachmentState, 2> pyramidAttachments{
+        colorBlendAttachment, colorBlendAttachment
+    };
+    pyramidAttachments[0].blendEnable = vk::False;
+    pyramidAttachments[1].blendEnable = vk::False;
+    pyramidAttachments[1].colorWriteMask = vk::ColorComponentFlagBits::eR;
+    colorBlending.attachmentCount =
+        static_cast<uint32_t>(pyramidAttachments.size());
+    colorBlending.pAttachments = pyramidAttachments.data();
+    pipelineInfo.renderPass = *pyramidRenderPass_;
+
+    pyramidPipeline_ = device_.createGraphicsPipeline(nullptr, pipelineInfo);
 }
 
 void VkRenderer::createFramebuffers() {
@@ -1289,11 +2592,237 @@ void VkRenderer::createVertexBuffer() {
         vertexBufferMemory_
     );
 
-    copyBuffer(stagingBuffer, vertexBuffer_, bufferSize);
+    copyBuffer(stagingBuffer, vertexBuffer_, bufferSize);
+}
+
+void VkRenderer::createIndexBuffer() {
+    vk::DeviceSize bufferSize = sizeof(indices_[0]) * indices_.size();
+
+    vk::raii::Buffer stagingBuffer = nullptr;
+    vk::raii::DeviceMemory stagingBufferMemory = nullptr;
+    createBuffer(
+        bufferSize,
+        vk::BufferUsageFlagBits::eTransferSrc,
+        vk::MemoryPropertyFlagBits::eHostVisible |
+            vk::MemoryPropertyFlagBits::eHostCoherent,
+        stagingBuffer,
+        stagingBufferMemory
+    );
+
+    void* data = stagingBufferMemory.mapMemory(0, bufferSize);
+    memcpy(data, indices_.data(), (size_t)bufferSize);
+    stagingBufferMemory.unmapMemory();
+
+    createBuffer(
+        bufferSize,
+        vk::BufferUsageFlagBits::eTransferDst |
+            vk::BufferUsageFlagBits::eIndexBuffer,
+        vk::MemoryPropertyFlagBits::eDeviceLocal,
+        indexBuffer_,
+        indexBufferMemory_
+    );
+
+    copyBuffer(stagingBuffer, indexBuffer_, bufferSize);
+}
+
+void VkRenderer::createGlyphAtlas() {
+    std::vector<uint8_t> font;
+    for (const char* path : FONT_PATHS) {
+        font = GlyphAtlas::readFont(path);
+        if (!font.empty()) break;
+    }
+    if (font.empty()) {
+        logW("No system font found, the watermark text is not drawn");
+        return;
+    }
+    if (!glyphAtlas_.build(font, TEXT_SIZE)) return;
+
+    const std::vector<uint8_t>& pixels = glyphAtlas_.getPixels();
+    vk::DeviceSize bufferSize = pixels.size();
+
+    vk::raii::Buffer stagingBuffer = nullptr;
+    vk::raii::DeviceMemory stagingBufferMemory = nullptr;
+    createBuffer(
+        bufferSize,
+        vk::BufferUsageFlagBits::eTransferSrc,
+        vk::MemoryPropertyFlagBits::eHostVisible |
+            vk::MemoryPropertyFlagBits::eHostCoherent,
+        stagingBuffer,
+        stagingBufferMemory
+    );
+
+    void* data = stagingBufferMemory.mapMemory(0, bufferSize);
+    memcpy(data, pixels.data(), (size_t)bufferSize);
+    stagingBufferMemory.unmapMemory();
+
+    // Coverage only, the color comes with the glyph quads
+    vk::ImageCreateInfo imageInfo{
+        .imageType = vk::ImageType::e2D,
+        .format = vk::Format::eR8Unorm,
+        .extent = {glyphAtlas_.getWidth(), glyphAtlas_.getHeight(), 1},
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = vk::SampleCountFlagBits::e1,
+        .tiling = vk::ImageTiling::eOptimal,
+        .usage = vk::ImageUsageFlagBits::eTransferDst |
+                 vk::ImageUsageFlagBits::eSampled,
+        .sharingMode = vk::SharingMode::eExclusive,
+        .initialLayout = vk::ImageLayout::eUndefined
+    };
+    glyphAtlasTexture_.image = device_.createImage(imageInfo);
+
+    vk::MemoryRequirements memRequirements =
+        glyphAtlasTexture_.image.getMemoryRequirements();
+    vk::MemoryAllocateInfo allocInfo{
+        .allocationSize = memRequirements.size,
+        .memoryTypeIndex = findMemoryType(
+            memRequirements.memoryTypeBits,
+            vk::MemoryPropertyFlagBits::eDeviceLocal
+        )
+    };
+    glyphAtlasTexture_.memory = device_.allocateMemory(allocInfo);
+    glyphAtlasTexture_.image.bindMemory(*glyphAtlasTexture_.memory, 0);
+
+    transitionImageLayout(
+        glyphAtlasTexture_.image,
+        vk::ImageLayout::eUndefined,
+        vk::ImageLayout::eTransferDstOptimal
+    );
+    copyBufferToImage(
+        stagingBuffer,
+        glyphAtlasTexture_.image,
+        glyphAtlas_.getWidth(),
+        glyphAtlas_.getHeight()
+    );
+    transitionImageLayout(
+        glyphAtlasTexture_.image,
+        vk::ImageLayout::eTransferDstOptimal,
+        vk::ImageLayout::eShaderReadOnlyOptimal
+    );
+    glyphAtlasTexture_.imageView =
+        createImageView(glyphAtlasTexture_.image, vk::Format::eR8Unorm);
+
+    // Text set before the atlas existed
+    layoutWatermarkText();
+}
+
+void VkRenderer::createGlyphBuffers() {
+    vk::DeviceSize bufferSize = sizeof(GlyphInstance) * MAX_GLYPHS;
+
+    glyphBuffers_.clear();
+    glyphBuffers_.resize(DESCRIPTOR_SLOTS);
+    for (GlyphBuffer& glyphs : glyphBuffers_) {
+        createBuffer(
+            bufferSize,
+            vk::BufferUsageFlagBits::eVertexBuffer,
+            vk::MemoryPropertyFlagBits::eHostVisible |
+                vk::MemoryPropertyFlagBits::eHostCoherent,
+            glyphs.buffer,
+            glyphs.memory
+        );
+        // Stays mapped for the lifetime of the buffer
+        glyphs.data =
+            static_cast<GlyphInstance*>(glyphs.memory.mapMemory(0, bufferSize));
+    }
+}
+
+void VkRenderer::createLayerBuffers() {
+    vk::DeviceSize bufferSize = sizeof(LayerData) * WatermarkLayers::MAX_LAYERS;
+
+    layerBuffers_.clear();
+    layerBuffers_.resize(DESCRIPTOR_SLOTS);
+    for (LayerBuffer& layers : layerBuffers_) {
+        createBuffer(
+            bufferSize,
+            vk::BufferUsageFlagBits::eStorageBuffer,
+            vk::MemoryPropertyFlagBits::eHostVisible |
+                vk::MemoryPropertyFlagBits::eHostCoherent,
+            layers.buffer,
+            layers.memory
+        );
+        // Stays mapped for the lifetime of the buffer
+        layers.data =
+            static_cast<LayerData*>(layers.memory.mapMemory(0, bufferSize));
+
+        vk::DeviceSize tileBufferSize = sizeof(LayerTile) * MAX_LAYER_TILES;
+        createBuffer(
+            tileBufferSize,
+            vk::BufferUsageFlagBits::eVertexBuffer,
+            vk::MemoryPropertyFlagBits::eHostVisible |
+                vk::MemoryPropertyFlagBits::eHostCoherent,
+            layers.tileBuffer,
+            layers.tileMemory
+        );
+        layers.tiles = static_cast<LayerTile*>(
+            layers.tileMemory.mapMemory(0, tileBufferSize)
+        );
+    }
+}
+
+void VkRenderer::setWatermarkLayers(std::vector<WatermarkLayer> layers) {
+    viewLayers_ = std::move(layers);
+    std::vector<WatermarkLayer> drawn = viewLayers_;
+    if (spriteFrameCount_ > 0) {
+        drawn.push_back({.rect = animationRect_, .animated = true});
+    }
+    watermarkLayers_.set(std::move(drawn));
+}
+
+void VkRenderer::loadWatermarkAnimation(std::string assetPath, LayerRect rect) {
+    animationRect_ = rect;
+    spriteSheetLoad_ = std::async(
+        std::launch::async,
+        [this, path = std::move(assetPath)] {
+            SpriteSheet sheet;
+            // Optional, without the asset there is no animation layer
+            AAsset* asset = AAssetManager_open(
+                assetManager_, path.c_str(), AASSET_MODE_BUFFER
+            );
+            if (!asset) return sheet;
+            if (const void* data = AAsset_getBuffer(asset)) {
+                sheet.decode(data, AAsset_getLength(asset));
+            }
+            AAsset_close(asset);
+            return sheet;
+        }
+    );
+}
+
+void VkRenderer::pollWatermarkAnimation() {
+    if (!spriteSheetLoad_.valid() ||
+        spriteSheetLoad_.wait_for(std::chrono::seconds(0)) !=
+            std::future_status::ready) {
+        return;
+    }
+    SpriteSheet sheet = spriteSheetLoad_.get();
+    if (sheet.isEmpty()) return;
+
+    logI(
+        "Watermark animation of %u frames, %ux%u, %u ms",
+        sheet.getFrameCount(),
+        sheet.getWidth(),
+        sheet.getHeight(),
+        sheet.getDurationMs()
+    );
+    // The only stall, frames in flight may still sample the placeholder.
+    // From here on the frame is picked by the shader
+    device_.waitIdle();
+    createSpriteTexture(sheet);
+    writeSpriteDescriptors();
+    spriteFrameEndsMs_ = sheet.getFrameEndsMs();
+    spriteFrameCount_ = sheet.getFrameCount();
+    setWatermarkLayers(viewLayers_);
 }
 
-void VkRenderer::createIndexBuffer() {
-    vk::DeviceSize bufferSize = sizeof(indices_[0]) * indices_.size();
+void VkRenderer::createSpriteTexture(const SpriteSheet& sheet) {
+    // A transparent stand-in, the layer shader always reads the binding
+    static constexpr std::array<uint8_t, 4> TRANSPARENT_PIXEL{};
+    const uint8_t* pixels = sheet.isEmpty() ? TRANSPARENT_PIXEL.data()
+                                            : sheet.getPixels().data();
+    uint32_t width = std::max(sheet.getWidth(), 1u);
+    uint32_t height = std::max(sheet.getHeight(), 1u);
+    uint32_t layers = std::max(sheet.getFrameCount(), 1u);
+    vk::DeviceSize bufferSize = vk::DeviceSize{width} * height * 4 * layers;
 
     vk::raii::Buffer stagingBuffer = nullptr;
     vk::raii::DeviceMemory stagingBufferMemory = nullptr;
@@ -1307,19 +2836,283 @@ void VkRenderer::createIndexBuffer() {
     );
 
     void* data = stagingBufferMemory.mapMemory(0, bufferSize);
-    memcpy(data, indices_.data(), (size_t)bufferSize);
+    memcpy(data, pixels, (size_t)bufferSize);
     stagingBufferMemory.unmapMemory();
 
-    createBuffer(
-        bufferSize,
-        vk::BufferUsageFlagBits::eTransferDst |
-            vk::BufferUsageFlagBits::eIndexBuffer,
-        vk::MemoryPropertyFlagBits::eDeviceLocal,
-        indexBuffer_,
-        indexBufferMemory_
+    vk::ImageCreateInfo imageInfo{
+        .imageType = vk::ImageType::e2D,
+        .format = vk::Format::eR8G8B8A8Unorm,
+        .extent = {width, height, 1},
+        .mipLevels = 1,
+        .arrayLayers = layers,
+        .samples = vk::SampleCountFlagBits::e1,
+        .tiling = vk::ImageTiling::eOptimal,
+        .usage = vk::ImageUsageFlagBits::eTransferDst |
+                 vk::ImageUsageFlagBits::eSampled,
+        .sharingMode = vk::SharingMode::eExclusive,
+        .initialLayout = vk::ImageLayout::eUndefined
+    };
+    spriteTexture_.image = device_.createImage(imageInfo);
+
+    vk::MemoryRequirements memRequirements =
+        spriteTexture_.image.getMemoryRequirements();
+    vk::MemoryAllocateInfo allocInfo{
+        .allocationSize = memRequirements.size,
+        .memoryTypeIndex = findMemoryType(
+            memRequirements.memoryTypeBits,
+            vk::MemoryPropertyFlagBits::eDeviceLocal
+        )
+    };
+    spriteTexture_.memory = device_.allocateMemory(allocInfo);
+    spriteTexture_.image.bindMemory(*spriteTexture_.memory, 0);
+
+    transitionImageLayout(
+        spriteTexture_.image,
+        vk::ImageLayout::eUndefined,
+        vk::ImageLayout::eTransferDstOptimal,
+        layers
+    );
+    copyBufferToImage(
+        stagingBuffer, spriteTexture_.image, width, height, layers
+    );
+    transitionImageLayout(
+        spriteTexture_.image,
+        vk::ImageLayout::eTransferDstOptimal,
+        vk::ImageLayout::eShaderReadOnlyOptimal,
+        layers
     );
 
-    copyBuffer(stagingBuffer, indexBuffer_, bufferSize);
+    vk::ImageViewCreateInfo viewInfo{
+        .image = *spriteTexture_.image,
+        .viewType = vk::ImageViewType::e2DArray,
+        .format = vk::Format::eR8G8B8A8Unorm,
+        .subresourceRange = {
+            .aspectMask = vk::ImageAspectFlagBits::eColor,
+            .baseMipLevel = 0,
+            .levelCount = 1,
+            .baseArrayLayer = 0,
+            .layerCount = layers
+        }
+    };
+    spriteTexture_.imageView = device_.createImageView(viewInfo);
+}
+
+void VkRenderer::writeSpriteDescriptors() {
+    vk::DescriptorImageInfo spriteImageInfo{
+        .sampler = *watTextureSampler_,
+        .imageView = *spriteTexture_.imageView,
+        .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
+    };
+    std::array<vk::WriteDescriptorSet, DESCRIPTOR_SLOTS> spriteWrites;
+    for (size_t i = 0; i < spriteWrites.size(); ++i) {
+        spriteWrites[i] = vk::WriteDescriptorSet{
+            .dstSet = *descriptorSets_[i],
+            .dstBinding = 5,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+            .pImageInfo = &spriteImageInfo
+        };
+    }
+    device_.updateDescriptorSets(spriteWrites, nullptr);
+}
+
+void VkRenderer::updateLayerBuffer(uint32_t slot) {
+    LayerBuffer& layers = layerBuffers_[slot];
+    if (layers.generation == watermarkLayers_.getGeneration() &&
+        layers.coverageGeneration == watermarkCoverage_.getGeneration()) {
+        return;
+    }
+    layers.count = static_cast<uint32_t>(watermarkLayers_.write(
+        WATERMARK_CANVAS_WIDTH, WATERMARK_CANVAS_HEIGHT, layers.data
+    ));
+    layers.generation = watermarkLayers_.getGeneration();
+    writeLayerTiles(layers);
+    layers.coverageGeneration = watermarkCoverage_.getGeneration();
+}
+
+void VkRenderer::writeLayerTiles(LayerBuffer& layers) {
+    LayerTile* tiles = layers.tiles;
+    watermarkCoverage_.getRects(coverageRects_);
+    bool scanned = watermarkCoverage_.getTileCount() > 0;
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < layers.count; ++i) {
+        const LayerData& layer = layers.data[i];
+        const float* t = layer.texRect;
+        // Only single copies of the watermark texture map to its tiles
+        if (!scanned || layer.animated != 0 || layer.tiles[0] != 1.0f ||
+            layer.tiles[1] != 1.0f || t[0] == t[2] || t[1] == t[3]) {
+            if (count == MAX_LAYER_TILES) break;
+            tiles[count++] = {{0.0f, 0.0f, 1.0f, 1.0f}, i};
+            continue;
+        }
+        for (const LayerRect& rect : coverageRects_) {
+            // The covered area in the layer, nothing of it may be outside
+            float x0 = (rect.x0 - t[0]) / (t[2] - t[0]);
+            float x1 = (rect.x1 - t[0]) / (t[2] - t[0]);
+            float y0 = (rect.y0 - t[1]) / (t[3] - t[1]);
+            float y1 = (rect.y1 - t[1]) / (t[3] - t[1]);
+            glm::vec4 part{
+                std::clamp(std::min(x0, x1), 0.0f, 1.0f),
+                std::clamp(std::min(y0, y1), 0.0f, 1.0f),
+                std::clamp(std::max(x0, x1), 0.0f, 1.0f),
+                std::clamp(std::max(y0, y1), 0.0f, 1.0f)
+            };
+            if (part.x >= part.z || part.y >= part.w) continue;
+            if (count == MAX_LAYER_TILES) {
+                // Too fragmented, the layers are drawn whole instead
+                for (uint32_t j = 0; j < layers.count; ++j) {
+                    tiles[j] = {{0.0f, 0.0f, 1.0f, 1.0f}, j};
+                }
+                layers.tileCount = layers.count;
+                return;
+            }
+            tiles[count++] = {part, i};
+        }
+    }
+    layers.tileCount = count;
+}
+
+void VkRenderer::recordLayers(
+    vk::raii::CommandBuffer& commandBuffer, uint32_t slot
+) {
+    // Drawn once the watermark texture is bound
+    const LayerBuffer& layers = layerBuffers_[slot];
+    if (layers.tileCount == 0 || !watermarkBound_) return;
+
+    commandBuffer.bindPipeline(
+        vk::PipelineBindPoint::eGraphics, *layerPipeline_
+    );
+    commandBuffer.bindVertexBuffers(0, {*layers.tileBuffer}, {0});
+    commandBuffer.draw(4, layers.tileCount, 0, 0);
+}
+
+void VkRenderer::setWatermarkText(std::string text) {
+    watermarkText_ = std::move(text);
+    layoutWatermarkText();
+}
+
+void VkRenderer::layoutWatermarkText() {
+    if (glyphAtlas_.isEmpty()) return;
+
+    // Top right, where the watermark layout had its text
+    std::vector<GlyphQuad> quads;
+    float x = WATERMARK_CANVAS_WIDTH - TEXT_MARGIN -
+        glyphAtlas_.measure(watermarkText_);
+    glyphAtlas_.layout(watermarkText_, x, TEXT_MARGIN, quads);
+    if (quads.size() > MAX_GLYPHS / 4) {
+        logW("Watermark text is too long, truncated");
+        quads.resize(MAX_GLYPHS / 4);
+    }
+
+    glyphInstances_.resize(quads.size() * 2);
+    writeGlyphInstances(quads, TEXT_SHADOW_OFFSET, glyphInstances_.data());
+    ++glyphGeneration_;
+}
+
+void VkRenderer::setOverlayLocation(std::string_view text) {
+    frameOverlay_.setLocation(text);
+}
+
+void VkRenderer::setForensicWatermark(
+    bool enabled, uint32_t key, uint32_t deviceId
+) {
+    forensicEnabled_ = enabled;
+    forensicKey_ = key;
+    forensicDeviceId_ = deviceId;
+}
+
+void VkRenderer::writeFrameOverlay(
+    uint32_t slot, const FrameMetadata& metadata
+) {
+    GlyphBuffer& glyphs = glyphBuffers_[slot];
+    glyphs.overlayCount = 0;
+    if (glyphAtlas_.isEmpty()) return;
+
+    FrameOverlay::Lines lines;
+    size_t lineCount = frameOverlay_.format(
+        metadata, FrameOverlay::getRealtimeOffsetNs(), lines
+    );
+
+    // Bottom left, the last line on the margin
+    float lineHeight = glyphAtlas_.getLineHeight() * OVERLAY_TEXT_SCALE;
+    float y = WATERMARK_CANVAS_HEIGHT - TEXT_MARGIN - lineHeight * lineCount;
+    overlayQuads_.clear();
+    for (size_t i = 0; i < lineCount; ++i) {
+        glyphAtlas_.layout(
+            lines[i].data(),
+            TEXT_MARGIN,
+            y + lineHeight * i,
+            overlayQuads_,
+            OVERLAY_TEXT_SCALE
+        );
+    }
+    size_t capacity = (MAX_GLYPHS - glyphs.count) / 2;
+    if (overlayQuads_.size() > capacity) overlayQuads_.resize(capacity);
+
+    // Written right after the watermark text, drawn with it
+    glyphs.overlayCount = writeGlyphInstances(
+        overlayQuads_,
+        TEXT_SHADOW_OFFSET * OVERLAY_TEXT_SCALE,
+        glyphs.data + glyphs.count
+    );
+}
+
+uint32_t VkRenderer::writeGlyphInstances(
+    const std::vector<GlyphQuad>& quads,
+    float shadowOffset,
+    GlyphInstance* instances
+) {
+    auto toNdc = [](float offset, const GlyphQuad& quad) {
+        return glm::vec4(
+            (quad.x0 + offset) / WATERMARK_CANVAS_WIDTH * 2.0f - 1.0f,
+            (quad.y0 + offset) / WATERMARK_CANVAS_HEIGHT * 2.0f - 1.0f,
+            (quad.x1 + offset) / WATERMARK_CANVAS_WIDTH * 2.0f - 1.0f,
+            (quad.y1 + offset) / WATERMARK_CANVAS_HEIGHT * 2.0f - 1.0f
+        );
+    };
+    // The shadow goes first, the text is blended over it
+    const std::array<std::pair<float, glm::vec4>, 2> passes{{
+        {shadowOffset, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)},
+        {0.0f, glm::vec4(1.0f)}
+    }};
+    uint32_t count = 0;
+    for (const auto& [offset, color] : passes) {
+        for (const GlyphQuad& quad : quads) {
+            instances[count++] = {
+                .rect = toNdc(offset, quad),
+                .texRect = glm::vec4(quad.u0, quad.v0, quad.u1, quad.v1),
+                .color = color
+            };
+        }
+    }
+    return count;
+}
+
+void VkRenderer::updateGlyphBuffer(uint32_t slot) {
+    GlyphBuffer& glyphs = glyphBuffers_[slot];
+    if (glyphs.generation == glyphGeneration_) return;
+    glyphs.count = static_cast<uint32_t>(glyphInstances_.size());
+    memcpy(
+        glyphs.data,
+        glyphInstances_.data(),
+        glyphs.count * sizeof(GlyphInstance)
+    );
+    glyphs.generation = glyphGeneration_;
+}
+
+void VkRenderer::recordGlyphs(
+    vk::raii::CommandBuffer& commandBuffer, uint32_t slot
+) {
+    const GlyphBuffer& glyphs = glyphBuffers_[slot];
+    uint32_t instanceCount = glyphs.count + glyphs.overlayCount;
+    if (instanceCount == 0) return;
+
+    commandBuffer.bindPipeline(
+        vk::PipelineBindPoint::eGraphics, *glyphPipeline_
+    );
+    commandBuffer.bindVertexBuffers(0, {*glyphs.buffer}, {0});
+    commandBuffer.draw(4, instanceCount, 0, 0);
 }
 
 void VkRenderer::createUniformBuffers() {
@@ -1329,12 +3122,12 @@ void VkRenderer::createUniformBuffers() {
     uniformBuffersMemory_.clear();
 
     // todo: see desktop tutor
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    for (size_t i = 0; i < DESCRIPTOR_SLOTS; i++) {
         uniformBuffers_.push_back(nullptr);
         uniformBuffersMemory_.push_back(nullptr);
     }
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    for (size_t i = 0; i < DESCRIPTOR_SLOTS; i++) {
         createBuffer(
             bufferSize,
             vk::BufferUsageFlagBits::eUniformBuffer,
@@ -1350,20 +3143,32 @@ void VkRenderer::createDescriptorPool() {
     std::array poolSizes = {
         vk::DescriptorPoolSize{
             .type = vk::DescriptorType::eUniformBuffer,
-            .descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT)
+            .descriptorCount = static_cast<uint32_t>(DESCRIPTOR_SLOTS)
+        },
+        vk::DescriptorPoolSize{
+            .type = vk::DescriptorType::eCombinedImageSampler,
+            .descriptorCount = static_cast<uint32_t>(DESCRIPTOR_SLOTS)
+        },
+        vk::DescriptorPoolSize{
+            .type = vk::DescriptorType::eCombinedImageSampler,
+            .descriptorCount = static_cast<uint32_t>(DESCRIPTOR_SLOTS)
         },
         vk::DescriptorPoolSize{
             .type = vk::DescriptorType::eCombinedImageSampler,
-            .descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT)
+            .descriptorCount = static_cast<uint32_t>(DESCRIPTOR_SLOTS)
+        },
+        vk::DescriptorPoolSize{
+            .type = vk::DescriptorType::eStorageBuffer,
+            .descriptorCount = static_cast<uint32_t>(DESCRIPTOR_SLOTS)
         },
         vk::DescriptorPoolSize{
             .type = vk::DescriptorType::eCombinedImageSampler,
-            .descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT)
+            .descriptorCount = static_cast<uint32_t>(DESCRIPTOR_SLOTS)
         }
     };
 
     vk::DescriptorPoolCreateInfo poolInfo{
-        .maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT),
+        .maxSets = static_cast<uint32_t>(DESCRIPTOR_SLOTS),
         .poolSizeCount = static_cast<uint32_t>(poolSizes.size()),
         .pPoolSizes = poolSizes.data()
     };
@@ -1373,22 +3178,27 @@ void VkRenderer::createDescriptorPool() {
 
 void VkRenderer::createDescriptorSets() {
     std::vector<vk::DescriptorSetLayout> layouts(
-        MAX_FRAMES_IN_FLIGHT, *descriptorSetLayout_
+        DESCRIPTOR_SLOTS, *descriptorSetLayout_
     );
     vk::DescriptorSetAllocateInfo allocInfo{
         .descriptorPool = *descriptorPool_,
-        .descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT),
+        .descriptorSetCount = static_cast<uint32_t>(DESCRIPTOR_SLOTS),
         .pSetLayouts = layouts.data()
     };
 
     descriptorSets_ = device_.allocateDescriptorSets(allocInfo);
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    for (size_t i = 0; i < DESCRIPTOR_SLOTS; i++) {
         vk::DescriptorBufferInfo bufferInfo{
             .buffer = *uniformBuffers_[i],
             .offset = 0,
             .range = sizeof(UniformBufferObject)
         };
+        vk::DescriptorBufferInfo layerBufferInfo{
+            .buffer = *layerBuffers_[i].buffer,
+            .offset = 0,
+            .range = vk::WholeSize
+        };
 
         // vk::DescriptorImageInfo imageInfo{
         //     .sampler = *watTextureSampler,
@@ -1405,6 +3215,14 @@ void VkRenderer::createDescriptorSets() {
                 .descriptorType = vk::DescriptorType::eUniformBuffer,
                 .pBufferInfo = &bufferInfo
             },
+            vk::WriteDescriptorSet{
+                .dstSet = *descriptorSets_[i],
+                .dstBinding = 4,
+                .dstArrayElement = 0,
+                .descriptorCount = 1,
+                .descriptorType = vk::DescriptorType::eStorageBuffer,
+                .pBufferInfo = &layerBufferInfo
+            },
             // vk::WriteDescriptorSet{
             //     .dstSet = *descriptorSets[i],
             //     .dstBinding = 1,
@@ -1418,6 +3236,27 @@ void VkRenderer::createDescriptorSets() {
 
         device_.updateDescriptorSets(descriptorWrites, nullptr);
     }
+    writeSpriteDescriptors();
+
+    // Written once, the atlas doesn't change
+    if (glyphAtlas_.isEmpty()) return;
+    vk::DescriptorImageInfo glyphImageInfo{
+        .sampler = *watTextureSampler_,
+        .imageView = *glyphAtlasTexture_.imageView,
+        .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
+    };
+    std::array<vk::WriteDescriptorSet, DESCRIPTOR_SLOTS> glyphWrites;
+    for (size_t i = 0; i < glyphWrites.size(); ++i) {
+        glyphWrites[i] = vk::WriteDescriptorSet{
+            .dstSet = *descriptorSets_[i],
+            .dstBinding = 3,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+            .pImageInfo = &glyphImageInfo
+        };
+    }
+    device_.updateDescriptorSets(glyphWrites, nullptr);
 }
 
 void VkRenderer::createCommandBuffers() {
@@ -1430,6 +3269,20 @@ void VkRenderer::createCommandBuffers() {
     };
 
     commandBuffers_ = device_.allocateCommandBuffers(allocInfo);
+
+    // Separate from the preview ones, a frame can be recorded repeatedly
+    allocInfo.commandBufferCount = MAX_FRAMES_IN_FLIGHT * MAX_MEDIA_REPEATS;
+    mediaCommandBuffers_ = device_.allocateCommandBuffers(allocInfo);
+
+    pyramidCommandBuffers_ = device_.allocateCommandBuffers(
+        {.commandPool = *commandPool_,
+         .level = vk::CommandBufferLevel::ePrimary,
+         .commandBufferCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT)}
+    );
+
+    allocInfo.commandBufferCount = 1;
+    still_.commandBuffer =
+        std::move(device_.allocateCommandBuffers(allocInfo)[0]);
 }
 
 void VkRenderer::createSyncObjects() {
@@ -1452,6 +3305,296 @@ void VkRenderer::createSyncObjects() {
             vk::FenceCreateInfo{.flags = vk::FenceCreateFlagBits::eSignaled}
         );
     }
+
+    still_.fence = vk::raii::Fence(device_, vk::FenceCreateInfo{});
+
+    if (hasPipelineStatistics_) {
+        layerQueryPool_ = vk::raii::QueryPool(
+            device_,
+            vk::QueryPoolCreateInfo{
+                .queryType = vk::QueryType::ePipelineStatistics,
+                .queryCount = MAX_FRAMES_IN_FLIGHT,
+                .pipelineStatistics = vk::QueryPipelineStatisticFlagBits::
+                    eFragmentShaderInvocations
+            }
+        );
+        layerQueryPending_.fill(false);
+    }
+
+    readbackTargets_.resize(FrameReadback::SLOT_COUNT);
+    for (ReadbackTarget& target : readbackTargets_) {
+        target.fence = vk::raii::Fence(device_, vk::FenceCreateInfo{});
+    }
+}
+
+void VkRenderer::createStillTarget(vk::Extent2D extent) {
+    logI("Creating still target %ux%u", extent.width, extent.height);
+
+    still_.framebuffer = nullptr;
+    still_.target.imageView = nullptr;
+    still_.target.image = nullptr;
+    still_.target.memory = nullptr;
+    still_.readbackData = nullptr;
+    still_.readbackBuffer = nullptr;
+    still_.readbackMemory = nullptr;
+    still_.extent = extent;
+
+    vk::Format format = swapChainSurfaceFormat_.format;
+    vk::ImageCreateInfo imageInfo{
+        .imageType = vk::ImageType::e2D,
+        .format = format,
+        .extent = {extent.width, extent.height, 1},
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = vk::SampleCountFlagBits::e1,
+        .tiling = vk::ImageTiling::eOptimal,
+        .usage = vk::ImageUsageFlagBits::eColorAttachment |
+                 vk::ImageUsageFlagBits::eTransferSrc,
+        .sharingMode = vk::SharingMode::eExclusive,
+        .initialLayout = vk::ImageLayout::eUndefined
+    };
+    still_.target.image = device_.createImage(imageInfo);
+
+    vk::MemoryRequirements memRequirements =
+        still_.target.image.getMemoryRequirements();
+    vk::MemoryAllocateInfo allocInfo{
+        .allocationSize = memRequirements.size,
+        .memoryTypeIndex = findMemoryType(
+            memRequirements.memoryTypeBits,
+            vk::MemoryPropertyFlagBits::eDeviceLocal
+        )
+    };
+    still_.target.memory = device_.allocateMemory(allocInfo);
+    still_.target.image.bindMemory(*still_.target.memory, 0);
+    still_.target.imageView = createImageView(still_.target.image, format);
+
+    vk::ImageView attachments[] = {*still_.target.imageView};
+    vk::FramebufferCreateInfo framebufferInfo{
+        .renderPass = *stillRenderPass_,
+        .attachmentCount = 1,
+        .pAttachments = attachments,
+        .width = extent.width,
+        .height = extent.height,
+        .layers = 1
+    };
+    still_.framebuffer = device_.createFramebuffer(framebufferInfo);
+
+    vk::DeviceSize size =
+        static_cast<vk::DeviceSize>(extent.width) * extent.height * 4;
+    still_.readbackBuffer = device_.createBuffer({
+        .size = size,
+        .usage = vk::BufferUsageFlagBits::eTransferDst,
+        .sharingMode = vk::SharingMode::eExclusive
+    });
+    memRequirements = still_.readbackBuffer.getMemoryRequirements();
+    still_.readbackMemory = device_.allocateMemory({
+        .allocationSize = memRequirements.size,
+        .memoryTypeIndex = findReadbackMemoryType(
+            memRequirements.memoryTypeBits, still_.readbackCoherent
+        )
+    });
+    still_.readbackBuffer.bindMemory(*still_.readbackMemory, 0);
+    // Stays mapped for the lifetime of the buffer
+    still_.readbackData =
+        static_cast<uint8_t*>(still_.readbackMemory.mapMemory(0, size));
+}
+
+void VkRenderer::createReadbackTarget(
+    ReadbackTarget& target,
+    vk::Extent2D extent
+) {
+    logI("Creating readback target %ux%u", extent.width, extent.height);
+
+    target.data = nullptr;
+    target.buffer = nullptr;
+    target.memory = nullptr;
+    target.scaled.image = nullptr;
+    target.scaled.memory = nullptr;
+    target.extent = extent;
+
+    vk::Format format = swapChainSurfaceFormat_.format;
+    if (extent != swapChainExtent_) {
+        vk::ImageCreateInfo imageInfo{
+            .imageType = vk::ImageType::e2D,
+            .format = format,
+            .extent = {extent.width, extent.height, 1},
+            .mipLevels = 1,
+            .arrayLayers = 1,
+            .samples = vk::SampleCountFlagBits::e1,
+            .tiling = vk::ImageTiling::eOptimal,
+            .usage = vk::ImageUsageFlagBits::eTransferDst |
+                     vk::ImageUsageFlagBits::eTransferSrc,
+            .sharingMode = vk::SharingMode::eExclusive,
+            .initialLayout = vk::ImageLayout::eUndefined
+        };
+        target.scaled.image = device_.createImage(imageInfo);
+        vk::MemoryRequirements memRequirements =
+            target.scaled.image.getMemoryRequirements();
+        target.scaled.memory = device_.allocateMemory({
+            .allocationSize = memRequirements.size,
+            .memoryTypeIndex = findMemoryType(
+                memRequirements.memoryTypeBits,
+                vk::MemoryPropertyFlagBits::eDeviceLocal
+            )
+        });
+        target.scaled.image.bindMemory(*target.scaled.memory, 0);
+    }
+
+    vk::DeviceSize size =
+        static_cast<vk::DeviceSize>(extent.width) * extent.height * 4;
+    target.buffer = device_.createBuffer({
+        .size = size,
+        .usage = vk::BufferUsageFlagBits::eTransferDst,
+        .sharingMode = vk::SharingMode::eExclusive
+    });
+    vk::MemoryRequirements memRequirements =
+        target.buffer.getMemoryRequirements();
+
+    target.memory = device_.allocateMemory({
+        .allocationSize = memRequirements.size,
+        .memoryTypeIndex = findReadbackMemoryType(
+            memRequirements.memoryTypeBits, target.coherent
+        )
+    });
+    target.buffer.bindMemory(*target.memory, 0);
+    // Stays mapped for the lifetime of the buffer
+    target.data = static_cast<uint8_t*>(target.memory.mapMemory(0, size));
+}
+
+void VkRenderer::createLumaMeterSlot(
+    LumaMeterSlot& slot,
+    vk::DeviceSize size
+) {
+    slot.data = nullptr;
+    slot.buffer = nullptr;
+    slot.memory = nullptr;
+    slot.size = size;
+    slot.buffer = device_.createBuffer({
+        .size = size,
+        .usage = vk::BufferUsageFlagBits::eTransferDst,
+        .sharingMode = vk::SharingMode::eExclusive
+    });
+    vk::MemoryRequirements memRequirements =
+        slot.buffer.getMemoryRequirements();
+    slot.memory = device_.allocateMemory({
+        .allocationSize = memRequirements.size,
+        .memoryTypeIndex = findReadbackMemoryType(
+            memRequirements.memoryTypeBits, slot.coherent
+        )
+    });
+    slot.buffer.bindMemory(*slot.memory, 0);
+    slot.data = static_cast<uint8_t*>(slot.memory.mapMemory(0, size));
+}
+
+uint32_t VkRenderer::findReadbackMemoryType(
+    uint32_t typeFilter, bool& coherent
+) {
+    // The CPU reads the pixels, which is slow from uncached memory. Cached
+    // memory may need invalidating
+    vk::PhysicalDeviceMemoryProperties memProperties =
+        physicalDevice_.getMemoryProperties();
+    vk::MemoryPropertyFlags cached = vk::MemoryPropertyFlagBits::eHostVisible |
+                                     vk::MemoryPropertyFlagBits::eHostCached;
+    uint32_t memoryType = memProperties.memoryTypeCount;
+    for (uint32_t i = 0; i < memProperties.memoryTypeCount; ++i) {
+        if ((typeFilter & (1 << i)) &&
+            (memProperties.memoryTypes[i].propertyFlags & cached) == cached) {
+            memoryType = i;
+            break;
+        }
+    }
+    if (memoryType == memProperties.memoryTypeCount) {
+        memoryType = findMemoryType(
+            typeFilter,
+            vk::MemoryPropertyFlagBits::eHostVisible |
+                vk::MemoryPropertyFlagBits::eHostCoherent
+        );
+    }
+    coherent = static_cast<bool>(
+        memProperties.memoryTypes[memoryType].propertyFlags &
+        vk::MemoryPropertyFlagBits::eHostCoherent
+    );
+    return memoryType;
+}
+
+void VkRenderer::createPyramidSlot(
+    PyramidSlot& slot,
+    vk::Extent2D extent,
+    uint32_t levels
+) {
+    logI(
+        "Creating image pyramid %ux%u, %u levels",
+        extent.width,
+        extent.height,
+        levels
+    );
+    slot = {};
+    slot.extent = extent;
+    slot.levels = levels;
+
+    auto createLevels = [&](TextureData& texture,
+                            std::vector<vk::raii::ImageView>& views,
+                            std::vector<PyramidLevel>& published,
+                            vk::Format format) {
+        vk::ImageCreateInfo imageInfo{
+            .imageType = vk::ImageType::e2D,
+            .format = format,
+            .extent = {extent.width, extent.height, 1},
+            .mipLevels = levels,
+            .arrayLayers = 1,
+            .samples = vk::SampleCountFlagBits::e1,
+            .tiling = vk::ImageTiling::eOptimal,
+            .usage = vk::ImageUsageFlagBits::eColorAttachment |
+                     vk::ImageUsageFlagBits::eTransferSrc |
+                     vk::ImageUsageFlagBits::eTransferDst |
+                     vk::ImageUsageFlagBits::eSampled,
+            .sharingMode = vk::SharingMode::eExclusive,
+            .initialLayout = vk::ImageLayout::eUndefined
+        };
+        texture.image = device_.createImage(imageInfo);
+        vk::MemoryRequirements memRequirements =
+            texture.image.getMemoryRequirements();
+        texture.memory = device_.allocateMemory({
+            .allocationSize = memRequirements.size,
+            .memoryTypeIndex = findMemoryType(
+                memRequirements.memoryTypeBits,
+                vk::MemoryPropertyFlagBits::eDeviceLocal
+            )
+        });
+        texture.image.bindMemory(*texture.memory, 0);
+
+        for (uint32_t level = 0; level < levels; ++level) {
+            views.push_back(createImageView(texture.image, format, level));
+            published.push_back({
+                .image = *texture.image,
+                .view = *views.back(),
+                .mipLevel = level,
+                .extent = {
+                    std::max(extent.width >> level, 1u),
+                    std::max(extent.height >> level, 1u)
+                }
+            });
+        }
+    };
+    createLevels(
+        slot.rgba, slot.rgbaViews, slot.frame.rgba, PYRAMID_RGBA_FORMAT
+    );
+    createLevels(
+        slot.luma, slot.lumaViews, slot.frame.luma, PYRAMID_LUMA_FORMAT
+    );
+
+    std::array<vk::ImageView, 2> attachments{
+        *slot.rgbaViews[0], *slot.lumaViews[0]
+    };
+    vk::FramebufferCreateInfo framebufferInfo{
+        .renderPass = *pyramidRenderPass_,
+        .attachmentCount = static_cast<uint32_t>(attachments.size()),
+        .pAttachments = attachments.data(),
+        .width = extent.width,
+        .height = extent.height,
+        .layers = 1
+    };
+    slot.framebuffer = device_.createFramebuffer(framebufferInfo);
 }
 
 void VkRenderer::cleanupSwapChain() {
@@ -1470,7 +3613,9 @@ void VkRenderer::cleanupSwapChain() {
 
 void VkRenderer::recreateSwapChain() {
     // Wait for device to finish operations
+    auto waitStart = std::chrono::steady_clock::now();
     device_.waitIdle();
+    addGpuWait(waitStart);
 
     // Clean up old swap chain
     cleanupSwapChain();
@@ -1520,6 +3665,52 @@ vk::PresentModeKHR VkRenderer::chooseSwapPresentMode(
                : vk::PresentModeKHR::eFifo;
 }
 
+void VkRenderer::setPreviewFrameRate(int32_t frameRate) {
+    previewPacer_.setFrameRate(frameRate);
+}
+
+void VkRenderer::setMediaFrameRate(int32_t frameRate) {
+    mediaFrameRate_ = frameRate;
+    if (isRecording_) mediaPacer_.setFrameRate(getMediaFrameRate());
+}
+
+int32_t VkRenderer::getMediaFrameRate() const {
+    int32_t frameRate = mediaEncoder_->getConfig().frameRate;
+    if (mediaFrameRate_ > 0) frameRate = std::min(frameRate, mediaFrameRate_);
+    return frameRate;
+}
+
+void VkRenderer::setFramesInFlight(uint32_t count) {
+    framesInFlight_ =
+        std::clamp(count, 1u, static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT));
+    currentFrame_ %= framesInFlight_;
+}
+
+void VkRenderer::setPreviewScale(float scale) {
+    scale = std::clamp(scale, 0.25f, 1.0f);
+    if (scale == previewScale_) return;
+    previewScale_ = scale;
+    if (!displayWindow_) return;
+    applyPreviewScale();
+    if (initialized) recreateSwapChain();
+}
+
+void VkRenderer::applyPreviewScale() {
+    if (!displayWindow_) return;
+    // Back to the window size first, which the scale is relative to
+    ANativeWindow_setBuffersGeometry(displayWindow_, 0, 0, 0);
+    if (previewScale_ == 1.0f) return;
+    auto scaled = [this](int32_t size) {
+        return static_cast<int32_t>(static_cast<float>(size) * previewScale_);
+    };
+    ANativeWindow_setBuffersGeometry(
+        displayWindow_,
+        scaled(ANativeWindow_getWidth(displayWindow_)),
+        scaled(ANativeWindow_getHeight(displayWindow_)),
+        0
+    );
+}
+
 vk::Extent2D VkRenderer::chooseSwapExtent(
     const vk::SurfaceCapabilitiesKHR& capabilities
 ) {
@@ -1632,8 +3823,35 @@ uint32_t VkRenderer::findMemoryType(
     throw std::runtime_error("Failed to find suitable memory type");
 }
 
+vk::ImageMemoryBarrier VkRenderer::makeImageBarrier(
+    vk::Image image,
+    vk::AccessFlags srcAccessMask,
+    vk::AccessFlags dstAccessMask,
+    vk::ImageLayout oldLayout,
+    vk::ImageLayout newLayout,
+    uint32_t baseMipLevel,
+    uint32_t levelCount
+) {
+    return {
+        .srcAccessMask = srcAccessMask,
+        .dstAccessMask = dstAccessMask,
+        .oldLayout = oldLayout,
+        .newLayout = newLayout,
+        .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+        .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+        .image = image,
+        .subresourceRange = {
+            .aspectMask = vk::ImageAspectFlagBits::eColor,
+            .baseMipLevel = baseMipLevel,
+            .levelCount = levelCount,
+            .baseArrayLayer = 0,
+            .layerCount = 1
+        }
+    };
+}
+
 vk::raii::ImageView VkRenderer::createImageView(
-    vk::raii::Image& image, vk::Format format
+    vk::raii::Image& image, vk::Format format, uint32_t mipLevel
 ) {
     vk::ImageViewCreateInfo viewInfo{
         .image = *image,
@@ -1641,7 +3859,7 @@ vk::raii::ImageView VkRenderer::createImageView(
         .format = format,
         .subresourceRange = {
             .aspectMask = vk::ImageAspectFlagBits::eColor,
-            .baseMipLevel = 0,
+            .baseMipLevel = mipLevel,
             .levelCount = 1,
             .baseArrayLayer = 0,
             .layerCount = 1
@@ -1652,7 +3870,10 @@ vk::raii::ImageView VkRenderer::createImageView(
 }
 
 void VkRenderer::transitionImageLayout(
-    vk::raii::Image& image, vk::ImageLayout oldLayout, vk::ImageLayout newLayout
+    vk::raii::Image& image,
+    vk::ImageLayout oldLayout,
+    vk::ImageLayout newLayout,
+    uint32_t layerCount
 ) {
     vk::CommandBufferAllocateInfo allocInfo{
         .commandPool = *commandPool_,
@@ -1679,7 +3900,7 @@ void VkRenderer::transitionImageLayout(
             .baseMipLevel = 0,
             .levelCount = 1,
             .baseArrayLayer = 0,
-            .layerCount = 1
+            .layerCount = layerCount
         }
     };
 
@@ -1738,7 +3959,8 @@ void VkRenderer::copyBufferToImage(
     vk::raii::Buffer& buffer,
     vk::raii::Image& image,
     uint32_t width,
-    uint32_t height
+    uint32_t height,
+    uint32_t layerCount
 ) {
     vk::CommandBufferAllocateInfo allocInfo{
         .commandPool = *commandPool_,
@@ -1762,7 +3984,7 @@ void VkRenderer::copyBufferToImage(
             {.aspectMask = vk::ImageAspectFlagBits::eColor,
              .mipLevel = 0,
              .baseArrayLayer = 0,
-             .layerCount = 1},
+             .layerCount = layerCount},
         .imageOffset = {0, 0, 0},
         .imageExtent = {width, height, 1}
     };
@@ -1781,7 +4003,9 @@ void VkRenderer::copyBufferToImage(
     queue_.waitIdle();
 }
 
-void VkRenderer::updateUniformBuffer(uint32_t currentImage) {
+void VkRenderer::updateUniformBuffer(
+    uint32_t currentImage, const FrameMetadata& metadata
+) {
     // static auto startTime = std::chrono::high_resolution_clock::now();
     //
     // auto currentTime = std::chrono::high_resolution_clock::now();
@@ -1823,6 +4047,28 @@ void VkRenderer::updateUniformBuffer(uint32_t currentImage) {
     );
     //         ubo.proj[1][1] *= -1;
 
+    // The pipeline for the slot is picked with it
+    forensicSlots_[currentImage] = forensicEnabled_;
+    if (forensicSlots_[currentImage]) {
+        int64_t realtimeNs =
+            metadata.timestampNs + FrameOverlay::getRealtimeOffsetNs();
+        ubo.forensicPayload = packForensicPayload({
+            .deviceId = forensicDeviceId_,
+            .frameNumber = static_cast<uint32_t>(metadata.frameNumber),
+            .timestampS = static_cast<uint32_t>(realtimeNs / 1'000'000'000)
+        });
+        ubo.forensicStrength = FORENSIC_STRENGTH / 255.0f;
+        ubo.forensicKey = forensicKey_;
+    }
+
+    if (spriteFrameCount_ > 0) {
+        uint32_t durationMs = spriteFrameEndsMs_[spriteFrameCount_ - 1];
+        ubo.spriteFrameEndsMs = spriteFrameEndsMs_;
+        ubo.spriteFrameCount = spriteFrameCount_;
+        int64_t timeMs = metadata.timestampNs / 1'000'000;
+        ubo.spriteTimeMs = static_cast<uint32_t>(timeMs % durationMs);
+    }
+
     void* data = uniformBuffersMemory_[currentImage].mapMemory(0, sizeof(ubo));
     memcpy(data, &ubo, sizeof(ubo));
     uniformBuffersMemory_[currentImage].unmapMemory();
@@ -2,8 +2,15 @@
 
 #include <android/asset_manager.h>
 
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <functional>
+#include <future>
 #include <glm/glm.hpp>
+#include <optional>
+#include <string>
 
 // clang-format off
 #include <vulkan/vulkan.hpp>
@@ -16,6 +23,18 @@
 #include <vulkan/vulkan_core.h>
 // clang-format on
 
+#include "forensic_watermark.hpp"
+#include "frame_overlay.hpp"
+#include "frame_pacer.hpp"
+#include "frame_readback.hpp"
+#include "glyph_atlas.hpp"
+#include "jpeg_writer.hpp"
+#include "sprite_sheet.hpp"
+#include "tile_coverage.hpp"
+#include "tile_diff.hpp"
+#include "video_encoder.hpp"
+#include "watermark_layers.hpp"
+
 namespace camera {
 
 struct Vertex {
@@ -48,27 +67,282 @@ struct Vertex {
     }
 };
 
+// A glyph quad of the watermark text, drawn as an instance of a 4 vertex
+// triangle strip
+struct GlyphInstance {
+    // Corners in NDC and in the atlas
+    glm::vec4 rect;
+    glm::vec4 texRect;
+    glm::vec4 color;
+
+    static vk::VertexInputBindingDescription getBindingDescription() {
+        return {0, sizeof(GlyphInstance), vk::VertexInputRate::eInstance};
+    }
+
+    static std::array<vk::VertexInputAttributeDescription, 3>
+    getAttributeDescriptions() {
+        return {
+            vk::VertexInputAttributeDescription(
+                0,
+                0,
+                vk::Format::eR32G32B32A32Sfloat,
+                offsetof(GlyphInstance, rect)
+            ),
+            vk::VertexInputAttributeDescription(
+                1,
+                0,
+                vk::Format::eR32G32B32A32Sfloat,
+                offsetof(GlyphInstance, texRect)
+            ),
+            vk::VertexInputAttributeDescription(
+                2,
+                0,
+                vk::Format::eR32G32B32A32Sfloat,
+                offsetof(GlyphInstance, color)
+            )
+        };
+    }
+};
+
+// A part of a watermark layer, drawn as an instance of a 4 vertex
+// triangle strip like the glyphs
+struct LayerTile {
+    // Corners in the layer, 0 to 1 over its rect
+    glm::vec4 rect;
+    uint32_t layer;
+
+    static vk::VertexInputBindingDescription getBindingDescription() {
+        return {0, sizeof(LayerTile), vk::VertexInputRate::eInstance};
+    }
+
+    static std::array<vk::VertexInputAttributeDescription, 2>
+    getAttributeDescriptions() {
+        return {
+            vk::VertexInputAttributeDescription(
+                0,
+                0,
+                vk::Format::eR32G32B32A32Sfloat,
+                offsetof(LayerTile, rect)
+            ),
+            vk::VertexInputAttributeDescription(
+                1, 0, vk::Format::eR32Uint, offsetof(LayerTile, layer)
+            )
+        };
+    }
+};
+
 struct UniformBufferObject {
     alignas(16) glm::mat4 camModel;
     alignas(16) glm::mat4 watModel;
     alignas(16) glm::mat4 view;
     alignas(16) glm::mat4 proj;
+    // Invisible watermark, off at 0 strength
+    alignas(16) ForensicWords forensicPayload;
+    float forensicStrength;
+    uint32_t forensicKey;
+    // Watermark animation, the layer shader picks the frame from the time
+    alignas(16) std::array<uint32_t, SpriteSheet::MAX_FRAMES> spriteFrameEndsMs;
+    uint32_t spriteFrameCount;
+    uint32_t spriteTimeMs;
+};
+
+// A level of the camera frame pyramid, sampled or copied by consumers
+struct PyramidLevel {
+    vk::Image image;
+    vk::ImageView view;
+    uint32_t mipLevel = 0;
+    vk::Extent2D extent;
+};
+
+/**
+ * The camera frame at decreasing sizes, RGBA and luma. The levels are in
+ * eShaderReadOnlyOptimal and stay valid for the commands submitted with
+ * the frame, the images are reused frames in flight later.
+ */
+struct PyramidFrame {
+    uint64_t frameNumber = 0;
+    int64_t timestampNs = 0;
+    std::vector<PyramidLevel> rgba;
+    std::vector<PyramidLevel> luma;
+};
+
+struct WatermarkStats {
+    // Swapped in whole, the buffers weren't CPU readable
+    uint64_t framesImported = 0;
+    // Only their changed areas copied
+    uint64_t framesUpdated = 0;
+    // Repeats of the frame before, nothing was copied or waited for
+    uint64_t framesSkipped = 0;
+    uint64_t bytesUploaded = 0;
+    // Spent checksumming the tiles of the frames to find the changes
+    uint64_t hashTimeUs = 0;
+    // Tiles of the current frame with something visible, the layers are
+    // only drawn over those
+    uint32_t tilesCovered = 0;
+    uint32_t tileCount = 0;
+    // Fragments shaded for the layers of the last preview frame measured,
+    // 0 without pipeline statistics
+    uint64_t layerFragments = 0;
 };
 
+// Records a consumer's reads of the pyramid, layouts are restored after
+using PyramidConsumer = std::function<
+    void(vk::raii::CommandBuffer& commandBuffer, const PyramidFrame& frame)>;
+
 class VkRenderer {
   public:
     bool initialized = false;
 
+    /**
+     * Whether a device can sample camera buffers through a YCbCr
+     * conversion, which the renderer needs.
+     */
+    static bool supportsYcbcrConversion();
+
     void init();
     void setMediaWindow(ANativeWindow* win);
-    void camHwBufferToTexture(AHardwareBuffer* buf);
+    /**
+     * Start presenting composited frames to the encoder's input surface as
+     * well, paced to the encoder frame rate by the camera timestamps.
+     * Frames are skipped while the encoder is behind.
+     */
+    void startRecording(VideoEncoder* encoder);
+    /** Stop presenting to the encoder and release the media swapchain. */
+    void stopRecording();
+    /**
+     * The metadata timestamp is the sensor timestamp in CLOCK_MONOTONIC,
+     * the metadata is burned into the frame.
+     */
+    void camHwBufferToTexture(
+        AHardwareBuffer* buf, const FrameMetadata& metadata
+    );
     void watHwBufferToTexture(AHardwareBuffer* buf);
+    /**
+     * Text drawn over the watermark layer from the glyph atlas. A change
+     * only uploads the glyph quads.
+     */
+    void setWatermarkText(std::string text);
+    /**
+     * Layers of the watermark texture, drawn in order. Until set, one
+     * layer covers the whole frame.
+     */
+    void setWatermarkLayers(std::vector<WatermarkLayer> layers);
+    /**
+     * Decode an animated GIF asset on a worker thread into an array
+     * texture, then draw it as a layer over rect on top of the others.
+     */
+    void loadWatermarkAnimation(std::string assetPath, LayerRect rect);
+    /** Location line of the frame overlay, empty hides it. */
+    void setOverlayLocation(std::string_view text);
+    /**
+     * Embed the device ID with the frame number and time invisibly into
+     * every frame, keyed so only key holders can read it back.
+     */
+    void setForensicWatermark(bool enabled, uint32_t key, uint32_t deviceId);
+    /**
+     * Composite the watermark over a full resolution camera frame in an
+     * offscreen pass and save the result as jpeg on a worker thread. The frame
+     * is dropped if the previous still is still being processed.
+     * releaseBuffer is called once buf is no longer read, possibly on the
+     * worker thread.
+     */
+    void stillHwBufferToJpeg(
+        AHardwareBuffer* buf,
+        const FrameMetadata& metadata,
+        std::string path,
+        std::function<void()> releaseBuffer
+    );
+    /**
+     * Copy every interval-th preview frame back to the CPU at scale times
+     * its size and pass it to callback on a worker thread, a null callback
+     * stops it. The copy is part of the frame's command buffer, frames are
+     * skipped instead of waited for. Recreates the display swapchain the
+     * first time, its images have to be copyable.
+     */
+    void setFrameReadback(
+        FrameReadback::Callback callback,
+        uint32_t interval = 1,
+        float scale = 1.0f
+    );
+    [[nodiscard]] ReadbackStats getReadbackStats() {
+        return frameReadback_.getStats();
+    }
+    [[nodiscard]] WatermarkStats getWatermarkStats() const {
+        return watermarkStats_;
+    }
+    /**
+     * Convert each camera frame once into RGBA and luma pyramids with that
+     * many levels, from PYRAMID_BASE_SCALE of the frame down by halves,
+     * for the consumers to sample or copy. 0 levels turns it off.
+     */
+    void setPyramidLevels(uint32_t levels);
+    /** Returns an ID for removePyramidConsumer(). */
+    uint32_t addPyramidConsumer(PyramidConsumer consumer);
+    void removePyramidConsumer(uint32_t id);
+    /**
+     * Meter the average luma of the camera frames on the smallest level of
+     * the luma pyramid, which has to be on.
+     */
+    void setLumaMeter(bool enabled);
+    /**
+     * 0 to 1, of a frame one or two frames in flight back. Negative until
+     * the meter measured a frame, callable from any thread.
+     */
+    [[nodiscard]] float getSceneLuma() const { return sceneLuma_; }
+    /**
+     * Time the render thread spent waiting for frame fences, swapchain
+     * images and an idle device since the last call, so the caller can
+     * leave it out of the CPU work a frame took.
+     */
+    std::chrono::microseconds takeGpuWaitTime();
     void reset(ANativeWindow* newWindow, AAssetManager* newManager);
     void cleanup();
 
+    /** Preview rate limit, 0 draws every camera frame. */
+    void setPreviewFrameRate(int32_t frameRate);
+    /** Media rate limit below the encoder's, 0 for none. */
+    void setMediaFrameRate(int32_t frameRate);
+    /** Frames the CPU may record ahead of the GPU, 1 to 2. */
+    void setFramesInFlight(uint32_t count);
+    /**
+     * Render the preview at a fraction of the window size, the compositor
+     * scales it up. Recreates the display swapchain.
+     */
+    void setPreviewScale(float scale);
+
   private:
     static constexpr uint64_t FENCE_TIMEOUT = 100000000;
     static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
+    // Uniform buffer and descriptor set slot of the offscreen still pass
+    static constexpr int STILL_SLOT = MAX_FRAMES_IN_FLIGHT;
+    static constexpr int DESCRIPTOR_SLOTS = MAX_FRAMES_IN_FLIGHT + 1;
+    // Media frames a camera frame may fill when the camera is slower
+    static constexpr uint32_t MAX_MEDIA_REPEATS = 3;
+    static constexpr int JPEG_QUALITY = 95;
+    // Glyph quads per slot with their shadows, half of them for the
+    // watermark text and the rest for the frame overlay
+    static constexpr uint32_t MAX_GLYPHS = 512;
+    // Size of the watermark texture, its layers and text are placed in
+    // its pixels
+    static constexpr float WATERMARK_CANVAS_WIDTH = 1080.0f;
+    static constexpr float WATERMARK_CANVAS_HEIGHT = 1920.0f;
+    static constexpr float TEXT_SIZE = 60.0f;
+    static constexpr float TEXT_MARGIN = 48.0f;
+    static constexpr float TEXT_SHADOW_OFFSET = 4.0f;
+    // Frame overlay glyphs relative to the watermark text
+    static constexpr float OVERLAY_TEXT_SCALE = 0.5f;
+    static constexpr uint32_t WATERMARK_STAGING_SLOTS = 2;
+    // Covered areas of the layers per slot, whole layers beyond it
+    static constexpr uint32_t MAX_LAYER_TILES = 1024;
+    static constexpr uint32_t MAX_PYRAMID_LEVELS = 8;
+    static constexpr float PYRAMID_BASE_SCALE = 0.5f;
+    static constexpr vk::Format PYRAMID_RGBA_FORMAT =
+        vk::Format::eR8G8B8A8Unorm;
+    static constexpr vk::Format PYRAMID_LUMA_FORMAT = vk::Format::eR8Unorm;
+    // Tried in order, every device has one of them
+    static constexpr std::array<const char*, 2> FONT_PATHS{
+        "/system/fonts/Roboto-Regular.ttf", "/system/fonts/DroidSans.ttf"
+    };
 
     // Required device extensions
     const std::vector<const char*> deviceExtensions_{
@@ -78,29 +352,30 @@ class VkRenderer {
         /*vk::EXTDescriptorIndexingExtensionName*/
     };
 
-    // Model data
+    // Model data, the camera quad. The watermark is drawn as layers
     const std::vector<Vertex> vertices_{
-        // cam vertices
-        {{-1.0f, -1.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f}},
-        {{1.0f, -1.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f}},
-        {{1.0f, 1.0f}, {0.0f, 0.0f, 1.0f}, {1.0f, 1.0f}},
-        {{-1.0f, 1.0f}, {1.0f, 1.0f, 1.0f}, {0.0f, 1.0f}},
-
-        // tex vertices
         {{-1.0f, -1.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f}},
         {{1.0f, -1.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f}},
         {{1.0f, 1.0f}, {0.0f, 0.0f, 1.0f}, {1.0f, 1.0f}},
         {{-1.0f, 1.0f}, {1.0f, 1.0f, 1.0f}, {0.0f, 1.0f}}
     };
-    const std::vector<uint16_t> indices_{0, 1, 2, 2, 3, 0, 4, 5, 6, 6, 7, 4};
+    const std::vector<uint16_t> indices_{0, 1, 2, 2, 3, 0};
 
     ANativeWindow* displayWindow_ = nullptr;
     ANativeWindow* mediaWindow_ = nullptr;
     AAssetManager* assetManager_ = nullptr;
 
     bool framebufferResized_ = false;
+    uint32_t framesInFlight_ = MAX_FRAMES_IN_FLIGHT;
+    float previewScale_ = 1.0f;
 
     std::atomic_bool isRecording_ = false;
+    VideoEncoder* mediaEncoder_ = nullptr;
+    FramePacer previewPacer_;
+    FramePacer mediaPacer_{0, MAX_MEDIA_REPEATS};
+    int32_t mediaFrameRate_ = 0;
+    bool hasDisplayTiming_ = false;
+    bool hasPipelineStatistics_ = false;
 
     // Vulkan objects
     vk::raii::Context context_;
@@ -117,6 +392,9 @@ class VkRenderer {
     vk::SurfaceFormatKHR swapChainSurfaceFormat_;
     vk::Extent2D swapChainExtent_;
     std::vector<vk::raii::ImageView> swapChainImageViews_;
+    // Whether the images can be copied, and scaled, for readbacks
+    bool swapChainReadable_ = false;
+    bool swapChainBlittable_ = false;
 
     vk::raii::SwapchainKHR mediaSwapChain_ = nullptr;
     std::vector<vk::Image> mediaSwapChainImages_;
@@ -125,13 +403,22 @@ class VkRenderer {
     std::vector<vk::raii::ImageView> mediaSwapChainImageViews_;
 
     vk::raii::RenderPass renderPass_ = nullptr;
+    vk::raii::RenderPass stillRenderPass_ = nullptr;
     vk::raii::DescriptorSetLayout descriptorSetLayout_ = nullptr;
     vk::raii::PipelineLayout pipelineLayout_ = nullptr;
     vk::raii::Pipeline graphicsPipeline_ = nullptr;
+    // The camera quad with the forensic mark, for the slots it's on in
+    vk::raii::Pipeline forensicPipeline_ = nullptr;
+    std::array<bool, DESCRIPTOR_SLOTS> forensicSlots_{};
+    vk::raii::Pipeline glyphPipeline_ = nullptr;
+    vk::raii::Pipeline layerPipeline_ = nullptr;
+    vk::raii::RenderPass pyramidRenderPass_ = nullptr;
+    vk::raii::Pipeline pyramidPipeline_ = nullptr;
     std::vector<vk::raii::Framebuffer> swapChainFramebuffers_;
     std::vector<vk::raii::Framebuffer> mediaSwapChainFramebuffers_;
     vk::raii::CommandPool commandPool_ = nullptr;
     std::vector<vk::raii::CommandBuffer> commandBuffers_;
+    std::vector<vk::raii::CommandBuffer> mediaCommandBuffers_;
     vk::raii::Buffer vertexBuffer_ = nullptr;
     vk::raii::DeviceMemory vertexBufferMemory_ = nullptr;
     vk::raii::Buffer indexBuffer_ = nullptr;
@@ -143,13 +430,157 @@ class VkRenderer {
         vk::raii::ImageView imageView = nullptr;
     };
     std::vector<TextureData> watTextures_;
+    // Device local copy the changed areas of the watermark are copied to,
+    // through a ring of staging buffers each holding a whole frame
+    TextureData watImage_;
+    vk::Extent2D watImageExtent_{};
+    struct WatermarkStaging {
+        vk::raii::Buffer buffer = nullptr;
+        vk::raii::DeviceMemory memory = nullptr;
+        uint8_t* data = nullptr;
+        vk::raii::CommandBuffer commandBuffer = nullptr;
+        vk::raii::Fence fence = nullptr;
+    };
+    std::vector<WatermarkStaging> watermarkStaging_;
+    uint32_t nextWatermarkStaging_ = 0;
+    TileDiff watermarkDiff_;
+    std::vector<DamageRect> watermarkDamage_;
+    // Where the watermark isn't transparent, kept up to date from the
+    // damage
+    TileCoverage watermarkCoverage_;
+    std::vector<LayerRect> coverageRects_;
+    // Whether the descriptors point at watImage_ or the imported buffer
+    bool watImageBound_ = false;
+    bool watermarkBound_ = false;
 
     vk::raii::Sampler watTextureSampler_ = nullptr;
 
+    GlyphAtlas glyphAtlas_;
+    TextureData glyphAtlasTexture_;
+    // Per descriptor slot, so a ring over the frames in flight. The
+    // watermark text is refilled when the slot is free and the text
+    // changed since, the frame overlay after it on every frame
+    struct GlyphBuffer {
+        vk::raii::Buffer buffer = nullptr;
+        vk::raii::DeviceMemory memory = nullptr;
+        GlyphInstance* data = nullptr;
+        uint32_t count = 0;
+        uint32_t overlayCount = 0;
+        uint32_t generation = 0;
+    };
+    std::vector<GlyphBuffer> glyphBuffers_;
+    std::string watermarkText_;
+    std::vector<GlyphInstance> glyphInstances_;
+    uint32_t glyphGeneration_ = 0;
+    FrameOverlay frameOverlay_;
+    // Reused by every frame
+    std::vector<GlyphQuad> overlayQuads_;
+
+    // Those set, with the animation layer once it's loaded
+    std::vector<WatermarkLayer> viewLayers_{WatermarkLayer{}};
+    WatermarkLayers watermarkLayers_{viewLayers_};
+    // Per descriptor slot like the glyphs, read by the layer vertex shader
+    // The tiles are the parts of the layers drawn, rewritten when the
+    // layers or the watermark coverage change
+    struct LayerBuffer {
+        vk::raii::Buffer buffer = nullptr;
+        vk::raii::DeviceMemory memory = nullptr;
+        LayerData* data = nullptr;
+        uint32_t count = 0;
+        uint32_t generation = 0;
+        vk::raii::Buffer tileBuffer = nullptr;
+        vk::raii::DeviceMemory tileMemory = nullptr;
+        LayerTile* tiles = nullptr;
+        uint32_t tileCount = 0;
+        uint32_t coverageGeneration = 0;
+    };
+    std::vector<LayerBuffer> layerBuffers_;
+    // Fragment shader invocations of the layers, per frame in flight
+    vk::raii::QueryPool layerQueryPool_ = nullptr;
+    std::array<bool, MAX_FRAMES_IN_FLIGHT> layerQueryPending_{};
+    // A layer per frame, transparent until the animation is loaded. Only
+    // the timing is kept from the decoded sheet
+    TextureData spriteTexture_;
+    std::future<SpriteSheet> spriteSheetLoad_;
+    LayerRect animationRect_;
+    std::array<uint32_t, SpriteSheet::MAX_FRAMES> spriteFrameEndsMs_{};
+    uint32_t spriteFrameCount_ = 0;
+
+    WatermarkStats watermarkStats_;
+
+    bool forensicEnabled_ = false;
+    uint32_t forensicKey_ = 0;
+    uint32_t forensicDeviceId_ = 0;
+
     std::vector<TextureData> camTextures_;
     vk::raii::SamplerYcbcrConversion camTexConversion_ = nullptr;
     vk::raii::Sampler camTextureSampler_ = nullptr;
 
+    struct StillCaptureData {
+        TextureData camTexture;
+        TextureData target;
+        vk::Extent2D extent;
+        vk::raii::Framebuffer framebuffer = nullptr;
+        vk::raii::Buffer readbackBuffer = nullptr;
+        vk::raii::DeviceMemory readbackMemory = nullptr;
+        uint8_t* readbackData = nullptr;
+        bool readbackCoherent = false;
+        vk::raii::CommandBuffer commandBuffer = nullptr;
+        vk::raii::Fence fence = nullptr;
+    };
+    StillCaptureData still_;
+    // Set while the still pass or its jpeg encoding is in progress
+    std::atomic_bool stillBusy_ = false;
+
+    // Host visible copies of preview frames, one per FrameReadback slot
+    struct ReadbackTarget {
+        // Downscaled copy of the frame, when a scale is set
+        TextureData scaled;
+        vk::Extent2D extent;
+        vk::raii::Buffer buffer = nullptr;
+        vk::raii::DeviceMemory memory = nullptr;
+        uint8_t* data = nullptr;
+        bool coherent = false;
+        vk::raii::Fence fence = nullptr;
+    };
+    std::vector<ReadbackTarget> readbackTargets_;
+
+    // Per frame in flight, the frame's pyramid is rebuilt once the fence
+    // of its slot says the consumers of the last one are done
+    struct PyramidSlot {
+        TextureData rgba;
+        TextureData luma;
+        std::vector<vk::raii::ImageView> rgbaViews;
+        std::vector<vk::raii::ImageView> lumaViews;
+        vk::raii::Framebuffer framebuffer = nullptr;
+        vk::Extent2D extent;
+        uint32_t levels = 0;
+        PyramidFrame frame;
+    };
+    std::vector<PyramidSlot> pyramidSlots_;
+    std::vector<vk::raii::CommandBuffer> pyramidCommandBuffers_;
+    uint32_t pyramidLevels_ = 0;
+    std::vector<std::pair<uint32_t, PyramidConsumer>> pyramidConsumers_;
+    uint32_t nextPyramidConsumerId_ = 0;
+    // Host visible copies of the smallest luma level, per frame in flight,
+    // averaged once the fence of the slot was waited
+    struct LumaMeterSlot {
+        vk::raii::Buffer buffer = nullptr;
+        vk::raii::DeviceMemory memory = nullptr;
+        uint8_t* data = nullptr;
+        bool coherent = false;
+        vk::DeviceSize size = 0;
+        // Copied by the last frame of the slot, 0 for none
+        uint32_t pixelCount = 0;
+    };
+    std::array<LumaMeterSlot, MAX_FRAMES_IN_FLIGHT> lumaMeterSlots_;
+    std::optional<uint32_t> lumaMeterConsumer_;
+    std::atomic<float> sceneLuma_ = -1.0f;
+    FrameReadback::Callback readbackCallback_;
+    uint32_t readbackInterval_ = 1;
+    float readbackScale_ = 1.0f;
+    uint32_t readbackCounter_ = 0;
+
     std::vector<vk::raii::Buffer> uniformBuffers_;
     std::vector<vk::raii::DeviceMemory> uniformBuffersMemory_;
     vk::raii::DescriptorPool descriptorPool_ = nullptr;
@@ -161,11 +592,16 @@ class VkRenderer {
 
     std::vector<vk::raii::Semaphore> mediaImageAvailableSemaphores_;
     std::vector<vk::raii::Semaphore> mediaRenderFinishedSemaphores_;
-    std::vector<vk::raii::Fence> mediaInFlightFences_;
 
     uint32_t semaphoreIndex_ = 0;
     uint32_t mediaSemaphoreIndex_ = 0;
     uint32_t currentFrame_ = 0;
+    std::chrono::steady_clock::duration gpuWaitTime_{};
+
+    // Declared after the vulkan objects so pending jobs finish before the
+    // objects they wait on are destroyed
+    JpegWriter jpegWriter_;
+    FrameReadback frameReadback_;
 
     // Swap chain support details
     struct SwapChainSupportDetails {
@@ -181,6 +617,9 @@ class VkRenderer {
     void createSwapChain();
     void createImageViews();
     void createRenderPass();
+    [[nodiscard]] vk::raii::RenderPass createColorRenderPass(
+        vk::Format format, vk::ImageLayout finalLayout
+    ) const;
     void createDescriptorSetLayout();
     std::vector<char> readFile(const std::string& filename);
     [[nodiscard]] vk::raii::ShaderModule createShaderModule(
@@ -192,13 +631,80 @@ class VkRenderer {
     void createTextureSamplers();
     void createVertexBuffer();
     void createIndexBuffer();
+    void createGlyphAtlas();
+    void createGlyphBuffers();
+    void createLayerBuffers();
+    void updateLayerBuffer(uint32_t slot);
+    void writeLayerTiles(LayerBuffer& layers);
+    void recordLayers(vk::raii::CommandBuffer& commandBuffer, uint32_t slot);
+    void createSpriteTexture(const SpriteSheet& sheet);
+    void writeSpriteDescriptors();
+    void pollWatermarkAnimation();
+    void layoutWatermarkText();
+    void updateGlyphBuffer(uint32_t slot);
+    void writeFrameOverlay(uint32_t slot, const FrameMetadata& metadata);
+    static uint32_t writeGlyphInstances(
+        const std::vector<GlyphQuad>& quads,
+        float shadowOffset,
+        GlyphInstance* instances
+    );
+    void recordGlyphs(vk::raii::CommandBuffer& commandBuffer, uint32_t slot);
     void createUniformBuffers();
     void createDescriptorPool();
     void createDescriptorSets();
     void createCommandBuffers();
     void createSyncObjects();
+    void importCamHwBuffer(AHardwareBuffer* buf, TextureData& texture);
+    bool drawPreviewFrame(int64_t timestampNs);
+    bool drawMediaFrame(uint32_t repeat, int64_t presentTimeNs);
+    // Begins the command buffer and leaves it open for more commands
+    void recordComposite(
+        vk::raii::CommandBuffer& commandBuffer,
+        const vk::raii::Framebuffer& framebuffer,
+        vk::Extent2D extent,
+        bool queryLayers = false
+    );
+    void readLayerStatistics();
+    void addGpuWait(std::chrono::steady_clock::time_point start);
+    [[nodiscard]] int32_t getMediaFrameRate() const;
+    [[nodiscard]] bool isSwapChainBgra() const;
+    [[nodiscard]] bool isSwapChainSrgb() const;
+    void createStillTarget(vk::Extent2D extent);
+    void createReadbackTarget(ReadbackTarget& target, vk::Extent2D extent);
+    void recordReadback(
+        vk::raii::CommandBuffer& commandBuffer,
+        vk::Image image,
+        ReadbackTarget& target
+    );
+    void submitReadback(uint32_t slot, int64_t timestampNs);
+    void createPyramidRenderPass();
+    void createPyramidSlot(
+        PyramidSlot& slot,
+        vk::Extent2D extent,
+        uint32_t levels
+    );
+    bool drawPyramid(AHardwareBuffer* buf, const FrameMetadata& metadata);
+    void recordLumaMeter(
+        vk::raii::CommandBuffer& commandBuffer, const PyramidFrame& frame
+    );
+    void createLumaMeterSlot(LumaMeterSlot& slot, vk::DeviceSize size);
+    // False when the buffer isn't CPU readable RGBA, to be imported whole
+    bool updateWatermarkDamage(AHardwareBuffer* buf);
+    void createWatermarkImage(vk::Extent2D extent);
+    void uploadWatermarkDamage(const uint8_t* pixels, size_t rowStride);
+    void bindWatermarkTexture(vk::ImageView imageView);
+    static vk::ImageMemoryBarrier makeImageBarrier(
+        vk::Image image,
+        vk::AccessFlags srcAccessMask,
+        vk::AccessFlags dstAccessMask,
+        vk::ImageLayout oldLayout,
+        vk::ImageLayout newLayout,
+        uint32_t baseMipLevel = 0,
+        uint32_t levelCount = 1
+    );
     void cleanupSwapChain();
     void recreateSwapChain();
+    void applyPreviewScale();
     static uint32_t chooseSwapMinImageCount(
         vk::SurfaceCapabilitiesKHR const& surfaceCapabilities
     );
@@ -229,21 +735,28 @@ class VkRenderer {
     uint32_t findMemoryType(
         uint32_t typeFilter, vk::MemoryPropertyFlags properties
     );
+    // Host visible, cached when there is such memory
+    uint32_t findReadbackMemoryType(uint32_t typeFilter, bool& coherent);
     vk::raii::ImageView createImageView(
-        vk::raii::Image& image, vk::Format format
+        vk::raii::Image& image, vk::Format format, uint32_t mipLevel = 0
     );
     void transitionImageLayout(
         vk::raii::Image& image,
         vk::ImageLayout oldLayout,
-        vk::ImageLayout newLayout
+        vk::ImageLayout newLayout,
+        uint32_t layerCount = 1
     );
+    // Layers packed one after the other in the buffer
     void copyBufferToImage(
         vk::raii::Buffer& buffer,
         vk::raii::Image& image,
         uint32_t width,
-        uint32_t height
+        uint32_t height,
+        uint32_t layerCount = 1
+    );
+    void updateUniformBuffer(
+        uint32_t currentImage, const FrameMetadata& metadata
     );
-    void updateUniformBuffer(uint32_t currentImage);
 };
 
 }  // namespace camera
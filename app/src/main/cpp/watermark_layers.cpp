@@ -0,0 +1,77 @@
+#include "watermark_layers.hpp"
+
+#include <cmath>
+#include <numbers>
+
+#include "util.hpp"
+
+using namespace camera::util;
+
+namespace camera {
+
+WatermarkLayers::WatermarkLayers(std::vector<WatermarkLayer> layers) {
+    set(std::move(layers));
+}
+
+void WatermarkLayers::set(std::vector<WatermarkLayer> layers) {
+    if (layers.size() > MAX_LAYERS) {
+        logW("%zu watermark layers, only %zu drawn", layers.size(), MAX_LAYERS);
+        layers.resize(MAX_LAYERS);
+    }
+    layers_.clear();
+    for (WatermarkLayer& layer : layers) {
+        layers_.push_back({.layer = std::move(layer)});
+    }
+    ++generation_;
+}
+
+void WatermarkLayers::update(int64_t timestampNs) {
+    for (Entry& entry : layers_) {
+        WatermarkLayer& layer = entry.layer;
+        if (layer.updateIntervalNs <= 0 || !layer.update) continue;
+        if (timestampNs < entry.nextUpdateNs) continue;
+        layer.update(layer, timestampNs);
+        entry.nextUpdateNs = timestampNs + layer.updateIntervalNs;
+        ++generation_;
+    }
+}
+
+size_t WatermarkLayers::write(
+    float width, float height, LayerData* data
+) const {
+    for (size_t i = 0; i < layers_.size(); ++i) {
+        const WatermarkLayer& layer = layers_[i].layer;
+        LayerData& out = data[i];
+
+        // Transformed in pixels, the canvas isn't square
+        float centerX = (layer.rect.x0 + layer.rect.x1) / 2 * width;
+        float centerY = (layer.rect.y0 + layer.rect.y1) / 2 * height;
+        float halfWidth = (layer.rect.x1 - layer.rect.x0) / 2 * width;
+        float halfHeight = (layer.rect.y1 - layer.rect.y0) / 2 * height;
+        float angle = layer.rotationDegrees * std::numbers::pi_v<float> / 180;
+        float cosine = std::cos(angle) * layer.scale;
+        float sine = std::sin(angle) * layer.scale;
+        centerX += layer.offsetX * width;
+        centerY += layer.offsetY * height;
+        for (int corner = 0; corner < 4; ++corner) {
+            float x = (corner & 1) ? halfWidth : -halfWidth;
+            float y = (corner & 2) ? halfHeight : -halfHeight;
+            float px = centerX + x * cosine - y * sine;
+            float py = centerY + x * sine + y * cosine;
+            out.corners[corner][0] = px / width * 2 - 1;
+            out.corners[corner][1] = py / height * 2 - 1;
+        }
+
+        out.texRect[0] = layer.texRect.x0;
+        out.texRect[1] = layer.texRect.y0;
+        out.texRect[2] = layer.texRect.x1;
+        out.texRect[3] = layer.texRect.y1;
+        out.tiles[0] = layer.tilesX;
+        out.tiles[1] = layer.tilesY;
+        out.opacity = layer.opacity;
+        out.animated = layer.animated ? 1 : 0;
+    }
+    return layers_.size();
+}
+
+}  // namespace camera
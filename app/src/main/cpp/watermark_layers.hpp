@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace camera {
+
+/** Normalized area, y down. */
+struct LayerRect {
+    float x0 = 0.0f;
+    float y0 = 0.0f;
+    float x1 = 1.0f;
+    float y1 = 1.0f;
+};
+
+/** A watermark layer, placed on the watermark canvas. */
+struct WatermarkLayer {
+    // Area of the watermark texture shown
+    LayerRect texRect;
+    // Bounding box on the canvas, the only area rasterized
+    LayerRect rect;
+    // Around the center of the rect, then moved by the normalized offset
+    float rotationDegrees = 0.0f;
+    float scale = 1.0f;
+    float offsetX = 0.0f;
+    float offsetY = 0.0f;
+    float opacity = 1.0f;
+    // Repeats of the texture area across the rect, for tiled marks
+    float tilesX = 1.0f;
+    float tilesY = 1.0f;
+    // Shows the frame of the watermark animation due instead, with texRect
+    // the area of the frame
+    bool animated = false;
+    // Called with the frame timestamp every interval to animate the layer,
+    // never when 0
+    int64_t updateIntervalNs = 0;
+    std::function<void(WatermarkLayer& layer, int64_t timestampNs)> update;
+};
+
+/** A layer as the layer shaders read it, std430. */
+struct LayerData {
+    // NDC corners in triangle strip order, top left first
+    float corners[4][2];
+    float texRect[4];
+    float tiles[2];
+    float opacity;
+    uint32_t animated;
+};
+
+/**
+ * The layers of the watermark in drawing order. Layers are animated at
+ * their own cadence, and the generation changes whenever one of them does
+ * so the GPU copies are only rewritten then.
+ */
+class WatermarkLayers {
+  public:
+    static constexpr size_t MAX_LAYERS = 16;
+
+    explicit WatermarkLayers(std::vector<WatermarkLayer> layers = {});
+
+    /** Layers beyond MAX_LAYERS are dropped. */
+    void set(std::vector<WatermarkLayer> layers);
+
+    /** Run the updates due at timestampNs. */
+    void update(int64_t timestampNs);
+
+    /**
+     * Write the layers for a canvas of width x height pixels, returns how
+     * many. data holds MAX_LAYERS.
+     */
+    size_t write(float width, float height, LayerData* data) const;
+
+    [[nodiscard]] uint32_t getGeneration() const { return generation_; }
+
+  private:
+    struct Entry {
+        WatermarkLayer layer;
+        int64_t nextUpdateNs = 0;
+    };
+
+    std::vector<Entry> layers_;
+    uint32_t generation_ = 0;
+};
+
+}  // namespace camera
@@ -0,0 +1,491 @@
+#include "yuv_convert.hpp"
+
+#include <algorithm>
+#include <cstddef>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define YUV_HAS_X86 1
+#endif
+
+namespace camera {
+
+namespace {
+
+constexpr int16_t toQ6(double value) {
+    return static_cast<int16_t>(value * 64.0 + (value < 0 ? -0.5 : 0.5));
+}
+
+constexpr YuvCoefficients makeCoefficients(double kr, double kb, bool full) {
+    double kg = 1.0 - kr - kb;
+    double yScale = full ? 1.0 : 255.0 / 219.0;
+    double cScale = full ? 1.0 : 255.0 / 224.0;
+    return {
+        .yOffset = static_cast<int16_t>(full ? 0 : 16),
+        .yScale = toQ6(yScale),
+        .vToR = toQ6(2.0 * (1.0 - kr) * cScale),
+        .uToG = toQ6(2.0 * kb * (1.0 - kb) / kg * cScale),
+        .vToG = toQ6(2.0 * kr * (1.0 - kr) / kg * cScale),
+        .uToB = toQ6(2.0 * (1.0 - kb) * cScale),
+    };
+}
+
+constexpr YuvCoefficients BT601_FULL = makeCoefficients(0.299, 0.114, true);
+constexpr YuvCoefficients BT601_LIMITED =
+    makeCoefficients(0.299, 0.114, false);
+constexpr YuvCoefficients BT709_FULL = makeCoefficients(0.2126, 0.0722, true);
+constexpr YuvCoefficients BT709_LIMITED =
+    makeCoefficients(0.2126, 0.0722, false);
+
+// Every intermediate fits int16 so the vector kernels can use saturating
+// 16 bit arithmetic and still match the scalar code bit for bit
+inline int32_t sat16(int32_t value) {
+    return std::clamp<int32_t>(value, INT16_MIN, INT16_MAX);
+}
+
+inline uint8_t toPixel(int32_t value) {
+    return static_cast<uint8_t>(std::clamp(sat16(value + 32) >> 6, 0, 255));
+}
+
+inline void convertPixel(
+    int32_t y, int32_t u, int32_t v, const YuvCoefficients& c, uint8_t* out
+) {
+    int32_t yy = (y - c.yOffset) * c.yScale;
+    u -= 128;
+    v -= 128;
+    out[0] = toPixel(sat16(yy + c.vToR * v));
+    out[1] = toPixel(sat16(sat16(yy - c.uToG * u) - c.vToG * v));
+    out[2] = toPixel(sat16(yy + c.uToB * u));
+    out[3] = 0xFF;
+}
+
+struct Row {
+    const uint8_t* y;
+    const uint8_t* u;
+    const uint8_t* v;
+    // Semi-planar rows are read through the interleaved pointer
+    const uint8_t* uv;
+    bool uFirst;
+    bool interleaved;
+    uint8_t* dst;
+};
+
+// Converts the vectorizable head of a row, returns the number of pixels done
+using RowKernel = int32_t (*)(const Row&, int32_t, const YuvCoefficients&);
+
+void convertRowScalar(
+    const Row& row,
+    int32_t begin,
+    int32_t end,
+    int32_t uvPixelStride,
+    const YuvCoefficients& c
+) {
+    for (int32_t x = begin; x < end; ++x) {
+        ptrdiff_t uvOffset = static_cast<ptrdiff_t>(x / 2) * uvPixelStride;
+        convertPixel(
+            row.y[x], row.u[uvOffset], row.v[uvOffset], c, row.dst + x * 4
+        );
+    }
+}
+
+#if defined(__ARM_NEON)
+
+constexpr const char* KERNEL_NAME = "neon";
+
+// Converts 16 pixels from 8 bit lanes of luma and duplicated chroma
+inline void convert16Neon(
+    uint8x16_t y,
+    int16x8_t uLo,
+    int16x8_t uHi,
+    int16x8_t vLo,
+    int16x8_t vHi,
+    const YuvCoefficients& c,
+    uint8_t* dst
+) {
+    const int16x8_t yOffset = vdupq_n_s16(c.yOffset);
+    const int16x8_t round = vdupq_n_s16(32);
+
+    int16x8_t y0 = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(y)));
+    int16x8_t y1 = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(y)));
+    y0 = vmulq_n_s16(vsubq_s16(y0, yOffset), c.yScale);
+    y1 = vmulq_n_s16(vsubq_s16(y1, yOffset), c.yScale);
+
+    auto narrow = [&](int16x8_t lo, int16x8_t hi) {
+        lo = vshrq_n_s16(vqaddq_s16(lo, round), 6);
+        hi = vshrq_n_s16(vqaddq_s16(hi, round), 6);
+        return vcombine_u8(vqmovun_s16(lo), vqmovun_s16(hi));
+    };
+
+    uint8x16x4_t rgba;
+    rgba.val[0] = narrow(
+        vqaddq_s16(y0, vmulq_n_s16(vLo, c.vToR)),
+        vqaddq_s16(y1, vmulq_n_s16(vHi, c.vToR))
+    );
+    rgba.val[1] = narrow(
+        vqsubq_s16(
+            vqsubq_s16(y0, vmulq_n_s16(uLo, c.uToG)), vmulq_n_s16(vLo, c.vToG)
+        ),
+        vqsubq_s16(
+            vqsubq_s16(y1, vmulq_n_s16(uHi, c.uToG)), vmulq_n_s16(vHi, c.vToG)
+        )
+    );
+    rgba.val[2] = narrow(
+        vqaddq_s16(y0, vmulq_n_s16(uLo, c.uToB)),
+        vqaddq_s16(y1, vmulq_n_s16(uHi, c.uToB))
+    );
+    rgba.val[3] = vdupq_n_u8(0xFF);
+    vst4q_u8(dst, rgba);
+}
+
+int32_t convertRowSimd(
+    const Row& row, int32_t width, const YuvCoefficients& c
+) {
+    const int16x8_t bias = vdupq_n_s16(128);
+    int32_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x8_t u8;
+        uint8x8_t v8;
+        if (row.interleaved) {
+            uint8x8x2_t uv = vld2_u8(row.uv + x);
+            u8 = row.uFirst ? uv.val[0] : uv.val[1];
+            v8 = row.uFirst ? uv.val[1] : uv.val[0];
+        } else {
+            u8 = vld1_u8(row.u + x / 2);
+            v8 = vld1_u8(row.v + x / 2);
+        }
+        int16x8_t u = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(u8)), bias);
+        int16x8_t v = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v8)), bias);
+        int16x8x2_t uDup = vzipq_s16(u, u);
+        int16x8x2_t vDup = vzipq_s16(v, v);
+
+        convert16Neon(
+            vld1q_u8(row.y + x),
+            uDup.val[0],
+            uDup.val[1],
+            vDup.val[0],
+            vDup.val[1],
+            c,
+            row.dst + x * 4
+        );
+    }
+    return x;
+}
+
+RowKernel selectRowKernel() { return convertRowSimd; }
+
+#elif defined(YUV_HAS_X86)
+
+// 16 bit lanes of r, g and b for 8 pixels
+struct Rgb16 {
+    __m128i r;
+    __m128i g;
+    __m128i b;
+};
+
+inline __m128i finishSse2(__m128i value) {
+    return _mm_srai_epi16(_mm_adds_epi16(value, _mm_set1_epi16(32)), 6);
+}
+
+inline Rgb16 convert8Sse2(
+    __m128i y, __m128i u, __m128i v, const YuvCoefficients& c
+) {
+    __m128i yy = _mm_mullo_epi16(
+        _mm_sub_epi16(y, _mm_set1_epi16(c.yOffset)), _mm_set1_epi16(c.yScale)
+    );
+    __m128i r = _mm_adds_epi16(yy, _mm_mullo_epi16(v, _mm_set1_epi16(c.vToR)));
+    __m128i g = _mm_subs_epi16(
+        _mm_subs_epi16(yy, _mm_mullo_epi16(u, _mm_set1_epi16(c.uToG))),
+        _mm_mullo_epi16(v, _mm_set1_epi16(c.vToG))
+    );
+    __m128i b = _mm_adds_epi16(yy, _mm_mullo_epi16(u, _mm_set1_epi16(c.uToB)));
+    return {finishSse2(r), finishSse2(g), finishSse2(b)};
+}
+
+int32_t convertRowSse2(
+    const Row& row, int32_t width, const YuvCoefficients& c
+) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi16(128);
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    const __m128i alpha = _mm_set1_epi8(static_cast<char>(0xFF));
+
+    int32_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i u;
+        __m128i v;
+        if (row.interleaved) {
+            __m128i uv = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(row.uv + x)
+            );
+            __m128i first = _mm_and_si128(uv, lowBytes);
+            __m128i second = _mm_srli_epi16(uv, 8);
+            u = row.uFirst ? first : second;
+            v = row.uFirst ? second : first;
+        } else {
+            u = _mm_unpacklo_epi8(
+                _mm_loadl_epi64(
+                    reinterpret_cast<const __m128i*>(row.u + x / 2)
+                ),
+                zero
+            );
+            v = _mm_unpacklo_epi8(
+                _mm_loadl_epi64(
+                    reinterpret_cast<const __m128i*>(row.v + x / 2)
+                ),
+                zero
+            );
+        }
+        u = _mm_sub_epi16(u, bias);
+        v = _mm_sub_epi16(v, bias);
+
+        __m128i y =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(row.y + x));
+        Rgb16 lo = convert8Sse2(
+            _mm_unpacklo_epi8(y, zero),
+            _mm_unpacklo_epi16(u, u),
+            _mm_unpacklo_epi16(v, v),
+            c
+        );
+        Rgb16 hi = convert8Sse2(
+            _mm_unpackhi_epi8(y, zero),
+            _mm_unpackhi_epi16(u, u),
+            _mm_unpackhi_epi16(v, v),
+            c
+        );
+
+        __m128i r = _mm_packus_epi16(lo.r, hi.r);
+        __m128i g = _mm_packus_epi16(lo.g, hi.g);
+        __m128i b = _mm_packus_epi16(lo.b, hi.b);
+        __m128i rgLo = _mm_unpacklo_epi8(r, g);
+        __m128i rgHi = _mm_unpackhi_epi8(r, g);
+        __m128i baLo = _mm_unpacklo_epi8(b, alpha);
+        __m128i baHi = _mm_unpackhi_epi8(b, alpha);
+
+        auto* out = reinterpret_cast<__m128i*>(row.dst + x * 4);
+        _mm_storeu_si128(out, _mm_unpacklo_epi16(rgLo, baLo));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(rgLo, baLo));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(rgHi, baHi));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(rgHi, baHi));
+    }
+    return x;
+}
+
+// 16 bit lanes of r, g and b for 16 pixels
+struct Rgb16x2 {
+    __m256i r;
+    __m256i g;
+    __m256i b;
+};
+
+__attribute__((target("avx2"))) inline __m256i finishAvx2(__m256i value) {
+    return _mm256_srai_epi16(
+        _mm256_adds_epi16(value, _mm256_set1_epi16(32)), 6
+    );
+}
+
+__attribute__((target("avx2"))) inline Rgb16x2 convert16Avx2(
+    __m256i y, __m256i u, __m256i v, const YuvCoefficients& c
+) {
+    __m256i yy = _mm256_mullo_epi16(
+        _mm256_sub_epi16(y, _mm256_set1_epi16(c.yOffset)),
+        _mm256_set1_epi16(c.yScale)
+    );
+    __m256i r = _mm256_adds_epi16(
+        yy, _mm256_mullo_epi16(v, _mm256_set1_epi16(c.vToR))
+    );
+    __m256i g = _mm256_subs_epi16(
+        _mm256_subs_epi16(
+            yy, _mm256_mullo_epi16(u, _mm256_set1_epi16(c.uToG))
+        ),
+        _mm256_mullo_epi16(v, _mm256_set1_epi16(c.vToG))
+    );
+    __m256i b = _mm256_adds_epi16(
+        yy, _mm256_mullo_epi16(u, _mm256_set1_epi16(c.uToB))
+    );
+    return {finishAvx2(r), finishAvx2(g), finishAvx2(b)};
+}
+
+__attribute__((target("avx2"))) int32_t convertRowAvx2(
+    const Row& row, int32_t width, const YuvCoefficients& c
+) {
+    const __m256i bias = _mm256_set1_epi16(128);
+    const __m256i lowBytes = _mm256_set1_epi16(0x00FF);
+    const __m256i alpha = _mm256_set1_epi8(static_cast<char>(0xFF));
+
+    int32_t x = 0;
+    for (; x + 32 <= width; x += 32) {
+        // 16 chroma samples in order, one per 16 bit lane
+        __m256i u;
+        __m256i v;
+        if (row.interleaved) {
+            __m256i uv = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(row.uv + x)
+            );
+            __m256i first = _mm256_and_si256(uv, lowBytes);
+            __m256i second = _mm256_srli_epi16(uv, 8);
+            u = row.uFirst ? first : second;
+            v = row.uFirst ? second : first;
+        } else {
+            u = _mm256_cvtepu8_epi16(_mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(row.u + x / 2)
+            ));
+            v = _mm256_cvtepu8_epi16(_mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(row.v + x / 2)
+            ));
+        }
+        u = _mm256_sub_epi16(u, bias);
+        v = _mm256_sub_epi16(v, bias);
+
+        // Duplicate every sample for two horizontal pixels, unpack works
+        // within 128 bit lanes so the halves are reordered afterwards
+        __m256i uLo = _mm256_unpacklo_epi16(u, u);
+        __m256i uHi = _mm256_unpackhi_epi16(u, u);
+        __m256i vLo = _mm256_unpacklo_epi16(v, v);
+        __m256i vHi = _mm256_unpackhi_epi16(v, v);
+
+        Rgb16x2 first = convert16Avx2(
+            _mm256_cvtepu8_epi16(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(row.y + x))
+            ),
+            _mm256_permute2x128_si256(uLo, uHi, 0x20),
+            _mm256_permute2x128_si256(vLo, vHi, 0x20),
+            c
+        );
+        Rgb16x2 second = convert16Avx2(
+            _mm256_cvtepu8_epi16(_mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(row.y + x + 16)
+            )),
+            _mm256_permute2x128_si256(uLo, uHi, 0x31),
+            _mm256_permute2x128_si256(vLo, vHi, 0x31),
+            c
+        );
+
+        // packus interleaves the lanes of both operands, restore the order
+        __m256i r = _mm256_permute4x64_epi64(
+            _mm256_packus_epi16(first.r, second.r), 0xD8
+        );
+        __m256i g = _mm256_permute4x64_epi64(
+            _mm256_packus_epi16(first.g, second.g), 0xD8
+        );
+        __m256i b = _mm256_permute4x64_epi64(
+            _mm256_packus_epi16(first.b, second.b), 0xD8
+        );
+
+        __m256i rgLo = _mm256_unpacklo_epi8(r, g);
+        __m256i rgHi = _mm256_unpackhi_epi8(r, g);
+        __m256i baLo = _mm256_unpacklo_epi8(b, alpha);
+        __m256i baHi = _mm256_unpackhi_epi8(b, alpha);
+        __m256i p0 = _mm256_unpacklo_epi16(rgLo, baLo);
+        __m256i p1 = _mm256_unpackhi_epi16(rgLo, baLo);
+        __m256i p2 = _mm256_unpacklo_epi16(rgHi, baHi);
+        __m256i p3 = _mm256_unpackhi_epi16(rgHi, baHi);
+
+        auto* out = reinterpret_cast<__m256i*>(row.dst + x * 4);
+        _mm256_storeu_si256(out, _mm256_permute2x128_si256(p0, p1, 0x20));
+        _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(p2, p3, 0x20));
+        _mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(p0, p1, 0x31));
+        _mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(p2, p3, 0x31));
+    }
+    return x;
+}
+
+bool hasAvx2() {
+    static const bool hasAvx2 = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+    }();
+    return hasAvx2;
+}
+
+constexpr const char* KERNEL_NAME = "sse2";
+
+RowKernel selectRowKernel() {
+    return hasAvx2() ? convertRowAvx2 : convertRowSse2;
+}
+
+#else
+
+constexpr const char* KERNEL_NAME = "scalar";
+
+RowKernel selectRowKernel() { return nullptr; }
+
+#endif
+
+void convert(
+    const YuvPlanes& src,
+    uint8_t* dst,
+    int32_t dstRowStride,
+    const YuvCoefficients& c,
+    RowKernel rowKernel
+) {
+    bool semiPlanar =
+        src.uvPixelStride == 2 && (src.v - src.u == 1 || src.u - src.v == 1);
+    bool planar = src.uvPixelStride == 1;
+    // Arbitrary pixel strides can't be vectorized, fall back to scalar
+    if (!semiPlanar && !planar) rowKernel = nullptr;
+
+    for (int32_t y = 0; y < src.height; ++y) {
+        ptrdiff_t uvRow = static_cast<ptrdiff_t>(y / 2) * src.uvRowStride;
+        Row row{
+            .y = src.y + static_cast<ptrdiff_t>(y) * src.yRowStride,
+            .u = src.u + uvRow,
+            .v = src.v + uvRow,
+            .uv = std::min(src.u, src.v) + uvRow,
+            .uFirst = src.u < src.v,
+            .interleaved = semiPlanar,
+            .dst = dst + static_cast<ptrdiff_t>(y) * dstRowStride
+        };
+        int32_t x = rowKernel ? rowKernel(row, src.width, c) : 0;
+        convertRowScalar(row, x, src.width, src.uvPixelStride, c);
+    }
+}
+
+}  // namespace
+
+YuvCoefficients getYuvCoefficients(YuvMatrix matrix, YuvRange range) {
+    if (matrix == YuvMatrix::BT601) {
+        return range == YuvRange::FULL ? BT601_FULL : BT601_LIMITED;
+    }
+    return range == YuvRange::FULL ? BT709_FULL : BT709_LIMITED;
+}
+
+void yuv420ToRgba(
+    const YuvPlanes& src,
+    uint8_t* dst,
+    int32_t dstRowStride,
+    YuvMatrix matrix,
+    YuvRange range
+) {
+    static const RowKernel rowKernel = selectRowKernel();
+    convert(
+        src, dst, dstRowStride, getYuvCoefficients(matrix, range), rowKernel
+    );
+}
+
+void yuv420ToRgbaReference(
+    const YuvPlanes& src,
+    uint8_t* dst,
+    int32_t dstRowStride,
+    YuvMatrix matrix,
+    YuvRange range
+) {
+    convert(
+        src,
+        dst,
+        dstRowStride,
+        getYuvCoefficients(matrix, range),
+        nullptr
+    );
+}
+
+const char* getYuvKernelName() {
+#if defined(YUV_HAS_X86)
+    return hasAvx2() ? "avx2" : KERNEL_NAME;
+#else
+    return KERNEL_NAME;
+#endif
+}
+
+}  // namespace camera
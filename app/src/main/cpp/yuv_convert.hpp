@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+
+namespace camera {
+
+enum class YuvMatrix { BT601, BT709 };
+
+enum class YuvRange { FULL, LIMITED };
+
+/**
+ * View of a YUV 4:2:0 image as delivered by AImage for
+ * AIMAGE_FORMAT_YUV_420_888. Chroma planes are either planar
+ * (uvPixelStride == 1), semi-planar NV12/NV21 (uvPixelStride == 2 and the
+ * U and V pointers one byte apart) or use an arbitrary pixel stride.
+ */
+struct YuvPlanes {
+    const uint8_t* y = nullptr;
+    const uint8_t* u = nullptr;
+    const uint8_t* v = nullptr;
+    int32_t width = 0;
+    int32_t height = 0;
+    int32_t yRowStride = 0;
+    int32_t uvRowStride = 0;
+    int32_t uvPixelStride = 0;
+};
+
+/**
+ * Writable YUV 4:2:0 image, e.g. an encoder input buffer. Same layout rules
+ * as YuvPlanes.
+ */
+struct YuvImage {
+    uint8_t* y = nullptr;
+    uint8_t* u = nullptr;
+    uint8_t* v = nullptr;
+    int32_t width = 0;
+    int32_t height = 0;
+    int32_t yRowStride = 0;
+    int32_t uvRowStride = 0;
+    int32_t uvPixelStride = 0;
+};
+
+// Q6 fixed point conversion coefficients
+struct YuvCoefficients {
+    int16_t yOffset;
+    int16_t yScale;
+    int16_t vToR;
+    int16_t uToG;
+    int16_t vToG;
+    int16_t uToB;
+};
+
+YuvCoefficients getYuvCoefficients(YuvMatrix matrix, YuvRange range);
+
+/**
+ * Convert to RGBA8888 with the fastest kernel available on the running CPU
+ * (NEON on arm, AVX2 or SSE2 on x86). Output is bit exact with
+ * yuv420ToRgbaReference().
+ */
+void yuv420ToRgba(
+    const YuvPlanes& src,
+    uint8_t* dst,
+    int32_t dstRowStride,
+    YuvMatrix matrix,
+    YuvRange range
+);
+
+// Portable scalar implementation, the reference for the vectorized kernels
+void yuv420ToRgbaReference(
+    const YuvPlanes& src,
+    uint8_t* dst,
+    int32_t dstRowStride,
+    YuvMatrix matrix,
+    YuvRange range
+);
+
+// Name of the kernel yuv420ToRgba() dispatches to, for logs and benchmarks
+const char* getYuvKernelName();
+
+}  // namespace camera
@@ -38,6 +38,14 @@ class MainActivity : AppCompatActivity(), AdapterView.OnItemSelectedListener {
 
         binding.btnGl.setOnClickListener(::onOpenCameraClick)
         binding.btnVk.setOnClickListener(::onOpenCameraClick)
+
+        val prefs = getPreferences(MODE_PRIVATE)
+        binding.swForensic.apply {
+            isChecked = prefs.getBoolean(PREF_FORENSIC_WATERMARK, false)
+            setOnCheckedChangeListener { _, checked ->
+                prefs.edit().putBoolean(PREF_FORENSIC_WATERMARK, checked).apply()
+            }
+        }
     }
 
     @SuppressLint("SetTextI18n")
@@ -63,6 +71,7 @@ class MainActivity : AppCompatActivity(), AdapterView.OnItemSelectedListener {
             startActivity(
                 Intent(this, cls).apply {
                     putExtra(EXTRA_RESOLUTION, binding.spinQuality.selectedItemPosition)
+                    putExtra(EXTRA_FORENSIC_WATERMARK, binding.swForensic.isChecked)
                 }
             )
         }
@@ -72,8 +81,9 @@ class MainActivity : AppCompatActivity(), AdapterView.OnItemSelectedListener {
 
     private fun checkAndRequestPermissions(): Boolean =
         if (!hasPermissions) {
+            // Location is optional, the frames just go without it
             requestPermissions(
-                PERMISSIONS,
+                PERMISSIONS + LOCATION_PERMISSIONS,
                 REQUEST_CODE_PERMISSIONS
             )
             false
@@ -103,8 +113,15 @@ class MainActivity : AppCompatActivity(), AdapterView.OnItemSelectedListener {
 
     companion object {
         const val EXTRA_RESOLUTION = "EXTRA_RESOLUTION"
+        const val EXTRA_FORENSIC_WATERMARK = "EXTRA_FORENSIC_WATERMARK"
+        private const val PREF_FORENSIC_WATERMARK = "forensic_watermark"
         private val PERMISSIONS =
             arrayOf(Manifest.permission.CAMERA, Manifest.permission.RECORD_AUDIO)
+        // Optional, the overlay shows the location when either is granted
+        val LOCATION_PERMISSIONS = arrayOf(
+            Manifest.permission.ACCESS_FINE_LOCATION,
+            Manifest.permission.ACCESS_COARSE_LOCATION
+        )
         private const val REQUEST_CODE_PERMISSIONS = 0xCA
     }
 }
\ No newline at end of file
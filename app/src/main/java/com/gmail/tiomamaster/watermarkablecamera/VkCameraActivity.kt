@@ -1,11 +1,14 @@
 package com.gmail.tiomamaster.watermarkablecamera
 
-import android.media.MediaCodec
-import android.media.MediaRecorder
-import android.media.MediaRecorder.OutputFormat
+import android.annotation.SuppressLint
+import android.content.pm.PackageManager
+import android.location.Location
+import android.location.LocationListener
+import android.location.LocationManager
 import android.os.Build
 import android.os.Bundle
 import android.os.Handler
+import android.provider.Settings
 import android.util.Log
 import android.view.KeyEvent
 import android.view.Surface
@@ -18,8 +21,9 @@ import androidx.core.view.WindowInsetsControllerCompat
 import com.gmail.tiomamaster.watermarkablecamera.databinding.ActivityCameraVkBinding
 import com.gmail.tiomamaster.watermarkablecamera.databinding.WatermarkBinding
 import com.google.androidgamesdk.GameActivity
-import java.io.File
+import java.util.Locale
 import kotlin.math.roundToInt
+import kotlin.random.Random
 import kotlin.system.exitProcess
 
 class VkCameraActivity : GameActivity() {
@@ -27,12 +31,24 @@ class VkCameraActivity : GameActivity() {
     private lateinit var binding: ActivityCameraVkBinding
     private lateinit var watBinding: WatermarkBinding
 
-    private val mediaSurface = MediaCodec.createPersistentInputSurface()
-    private lateinit var mediaRecorder: MediaRecorder
     private var recording = false
 
     private var resolution = Resolution.FHD
 
+    private val locationManager by lazy { getSystemService(LocationManager::class.java) }
+
+    // All methods implemented, before API 30 only onLocationChanged has a default
+    private val locationListener = object : LocationListener {
+        override fun onLocationChanged(location: Location) =
+            setLocation(location.latitude, location.longitude)
+
+        override fun onProviderEnabled(provider: String) = Unit
+        override fun onProviderDisabled(provider: String) = Unit
+
+        @Deprecated("Deprecated in Java")
+        override fun onStatusChanged(provider: String?, status: Int, extras: Bundle?) = Unit
+    }
+
     override fun onCreate(savedInstanceState: Bundle?) {
         super.onCreate(savedInstanceState)
         Log.i(TAG, "Called onCreate")
@@ -53,13 +69,12 @@ class VkCameraActivity : GameActivity() {
         }
 
         resolution = Resolution.entries[intent.getIntExtra(MainActivity.EXTRA_RESOLUTION, 1)]
+        if (intent.getBooleanExtra(MainActivity.EXTRA_FORENSIC_WATERMARK, false)) {
+            setForensicWatermark(true, forensicKey)
+        }
 
         Handler(mainLooper).postDelayed({
             setupWatermark()
-//            val filename = "${System.currentTimeMillis()}.mp4"
-//            val dir = /*getExternalFilesDir(null)*/"/sdcard/DCIM/Camera"
-//            initRecorder(File("$dir/$filename"), 720, 1280, 0)
-            setMediaSurface(mediaSurface)
         }, 1000)
 
 //        var i = 0
@@ -74,6 +89,12 @@ class VkCameraActivity : GameActivity() {
     override fun onStart() {
         super.onStart()
         Log.i(TAG, "Called onStart")
+        startLocationUpdates()
+    }
+
+    override fun onStop() {
+        locationManager.removeUpdates(locationListener)
+        super.onStop()
     }
 
     override fun onResume() {
@@ -83,6 +104,12 @@ class VkCameraActivity : GameActivity() {
 
     private fun setupWatermark() {
         watBinding = WatermarkBinding.inflate(layoutInflater)
+        // The text is drawn natively from a glyph atlas, the layer only
+        // carries the image
+        with(watBinding.txt) {
+            nativeSetWatermarkText(text.toString())
+            visibility = View.GONE
+        }
         with(watBinding.root) {
             surface = getWatermarkSurface()
             val widthMeasureSpec =
@@ -92,60 +119,69 @@ class VkCameraActivity : GameActivity() {
             this.widthMeasureSpec = widthMeasureSpec
             this.heightMeasureSpec = heightMeasureSpec
             update()
+            nativeSetWatermarkLayers(getLayerBounds())
         }
     }
 
-    private fun initRecorder(
-        saveTo: File,
-        desiredWidth: Int,
-        desiredHeight: Int,
-        orientationHint: Int
-    ) {
-        mediaRecorder = MediaRecorder(this).apply {
-            setVideoSource(MediaRecorder.VideoSource.SURFACE)
-            setInputSurface(mediaSurface)
-            setAudioSource(MediaRecorder.AudioSource.CAMCORDER)
-            setOutputFormat(OutputFormat.MPEG_4)
-
-            setAudioEncoder(MediaRecorder.AudioEncoder.AAC)
-            setAudioEncodingBitRate(10_000_000)
-            setAudioSamplingRate(96000)
-            setAudioChannels(2)
-
-            setVideoEncoder(MediaRecorder.VideoEncoder.H264)
-            setVideoEncodingBitRate(10_000_000)
-            setVideoFrameRate(30)
-            setVideoSize(desiredWidth, desiredHeight)
-
-            setOrientationHint(orientationHint)
-
-            setOutputFile(saveTo.absolutePath)
-            prepare()
+    // The location line stays empty without a location permission
+    @SuppressLint("MissingPermission")
+    private fun startLocationUpdates() {
+        val granted = MainActivity.LOCATION_PERMISSIONS.any {
+            checkSelfPermission(it) == PackageManager.PERMISSION_GRANTED
         }
+        if (!granted) return
+        val provider = listOf(LocationManager.GPS_PROVIDER, LocationManager.NETWORK_PROVIDER)
+            .firstOrNull(locationManager::isProviderEnabled) ?: return
+        locationManager.getLastKnownLocation(provider)?.let(locationListener::onLocationChanged)
+        locationManager.requestLocationUpdates(
+            provider,
+            LOCATION_INTERVAL_MS,
+            LOCATION_DISTANCE_M,
+            locationListener,
+            mainLooper
+        )
+    }
+
+    // Burned into every frame below the timecode and the exposure
+    fun setLocation(latitude: Double, longitude: Double) {
+        nativeSetLocationText(String.format(Locale.US, "%.5f, %.5f", latitude, longitude))
     }
 
-    fun startRecording(): Boolean = kotlin.runCatching {
+    // Made once per install, wmdetect --key reads the footage with it
+    private val forensicKey: Int
+        get() {
+            val prefs = getPreferences(MODE_PRIVATE)
+            if (!prefs.contains(PREF_FORENSIC_KEY)) {
+                prefs.edit().putInt(PREF_FORENSIC_KEY, Random.nextInt()).apply()
+            }
+            return prefs.getInt(PREF_FORENSIC_KEY, 0).also {
+                Log.i(TAG, "Forensic watermark key 0x%08x".format(it))
+            }
+        }
+
+    // Invisible mark of the device, frame number and time, only readable
+    // with the key
+    fun setForensicWatermark(enabled: Boolean, key: Int) {
+        val androidId = Settings.Secure.getString(contentResolver, Settings.Secure.ANDROID_ID)
+        nativeSetForensicWatermark(enabled, key, androidId.orEmpty().hashCode())
+    }
+
+    // The native side records on its render thread, encoding the composited
+    // frames with AMediaCodec
+    fun startRecording() {
         nativeStartStopRecording()
-        mediaRecorder.start()
         recording = true
-        true
-    }.onFailure {
+    }
+
+    fun stopRecording() {
+        check(recording) { "Cannot stop. Is not recording." }
+        nativeStartStopRecording()
         recording = false
-        mediaRecorder.reset()
-        mediaSurface.release()
-    }.getOrNull() ?: false
-
-    fun stopRecording(): Boolean = if (recording) {
-        kotlin.runCatching {
-            nativeStartStopRecording()
-            mediaRecorder.stop()
-            recording = false
-            true
-        }.onFailure {
-            mediaRecorder.release()
-        }.getOrNull() ?: false
-    } else {
-        throw IllegalStateException("Cannot stop. Is not recording.")
+        // The native logs are compiled out of release builds
+        val latencyUs = nativeGetStartLatencyUs()
+        if (latencyUs >= 0) {
+            Log.i(TAG, String.format(Locale.US, "Recording started after %.1f ms", latencyUs / 1000.0))
+        }
     }
 
     override fun onCreateSurfaceView() {
@@ -161,6 +197,9 @@ class VkCameraActivity : GameActivity() {
             if (recording) stopRecording() else startRecording()
         }
 
+        // Taken on the render thread, which logs when it can't
+        binding.btnTakePicture.setOnClickListener { nativeTakePicture() }
+
         // adjust video's preview size to make it aspect ratio equal to recorded video
         val height = resources.displayMetrics.heightPixels
         val width = resources.displayMetrics.widthPixels
@@ -204,8 +243,13 @@ class VkCameraActivity : GameActivity() {
     }
 
     private external fun getWatermarkSurface(): Surface
-    private external fun setMediaSurface(surface: Surface)
+    private external fun nativeSetWatermarkText(text: String)
+    private external fun nativeSetLocationText(text: String)
+    private external fun nativeSetWatermarkLayers(bounds: FloatArray)
+    private external fun nativeSetForensicWatermark(enabled: Boolean, key: Int, deviceId: Int)
     private external fun nativeStartStopRecording()
+    private external fun nativeTakePicture()
+    private external fun nativeGetStartLatencyUs(): Long
 
     private companion object {
         init {
@@ -213,5 +257,9 @@ class VkCameraActivity : GameActivity() {
         }
 
         val TAG: String = VkCameraActivity::class.java.simpleName
+
+        const val PREF_FORENSIC_KEY = "forensic_key"
+        const val LOCATION_INTERVAL_MS = 1000L
+        const val LOCATION_DISTANCE_M = 5f
     }
 }
\ No newline at end of file
@@ -32,4 +32,20 @@ class WatermarkView @JvmOverloads constructor(
             e.printStackTrace()
         }
     }
+
+    // Normalized left, top, right, bottom of each visible child, the only
+    // areas composited over the frames
+    fun getLayerBounds(): FloatArray {
+        if (width == 0 || height == 0) return FloatArray(0)
+        val bounds = ArrayList<Float>()
+        for (i in 0 until childCount) {
+            val child = getChildAt(i)
+            if (child.visibility != VISIBLE || child.width == 0 || child.height == 0) continue
+            bounds += child.left.toFloat() / width
+            bounds += child.top.toFloat() / height
+            bounds += child.right.toFloat() / width
+            bounds += child.bottom.toFloat() / height
+        }
+        return bounds.toFloatArray()
+    }
 }
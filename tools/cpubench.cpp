@@ -0,0 +1,223 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "cpu_compositor.hpp"
+#include "thread_pool.hpp"
+#include "yuv_convert.hpp"
+
+using namespace camera;
+
+namespace {
+
+constexpr auto USAGE =
+    "usage: cpubench [--frames N] [--threads N]\n"
+    "\n"
+    "Times the CPU fallback renderer on 1080p camera frames: the watermark\n"
+    "composite and the conversion to RGBA, with a sparse watermark like the\n"
+    "app's and with one covering the whole frame.\n"
+    "\n"
+    "Exits with 0 when the p95 frame time fits 30 frames/s, 1 otherwise.\n";
+
+constexpr int32_t FRAME_WIDTH = 1920;
+constexpr int32_t FRAME_HEIGHT = 1080;
+constexpr double BUDGET_MS = 1000.0 / 30.0;
+// Frames run before timing, so the caches and the pool are warm
+constexpr int32_t WARMUP_FRAMES = 10;
+
+struct Options {
+    int32_t frames = 300;
+    uint32_t threads = ThreadPool::defaultThreadCount() + 1;
+};
+
+bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--frames" && hasValue) {
+            options.frames = atoi(argv[++i]);
+            if (options.frames <= 0) return false;
+        } else if (arg == "--threads" && hasValue) {
+            options.threads = static_cast<uint32_t>(atoi(argv[++i]));
+            if (options.threads == 0) return false;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Camera frame as NV21, the layout most camera HALs deliver
+struct Frame {
+    std::vector<uint8_t> data;
+    YuvPlanes planes;
+};
+
+void makeFrame(Frame& frame) {
+    int32_t chromaWidth = FRAME_WIDTH / 2;
+    size_t lumaSize = size_t(FRAME_WIDTH) * FRAME_HEIGHT;
+    frame.data.resize(lumaSize * 3 / 2);
+    for (size_t i = 0; i < frame.data.size(); ++i) {
+        frame.data[i] = static_cast<uint8_t>(i * 7 + (i >> 11));
+    }
+    frame.planes = {
+        .y = frame.data.data(),
+        .u = frame.data.data() + lumaSize + 1,
+        .v = frame.data.data() + lumaSize,
+        .width = FRAME_WIDTH,
+        .height = FRAME_HEIGHT,
+        .yRowStride = FRAME_WIDTH,
+        .uvRowStride = chromaWidth * 2,
+        .uvPixelStride = 2
+    };
+}
+
+// Portrait RGBA view, coverage is the part of the rows at the top with
+// visible pixels
+std::vector<uint8_t> makeWatermark(float coverage) {
+    int32_t width = FRAME_HEIGHT;
+    int32_t height = FRAME_WIDTH;
+    std::vector<uint8_t> rgba(size_t(width) * height * 4, 0);
+    auto rows = static_cast<int32_t>(static_cast<float>(height) * coverage);
+    for (int32_t y = 0; y < rows; ++y) {
+        for (int32_t x = 0; x < width; ++x) {
+            uint8_t* pixel = rgba.data() + (size_t(y) * width + x) * 4;
+            pixel[0] = static_cast<uint8_t>(x);
+            pixel[1] = static_cast<uint8_t>(y);
+            pixel[2] = static_cast<uint8_t>(x + y);
+            pixel[3] = static_cast<uint8_t>(128 + (x ^ y) % 128);
+        }
+    }
+    return rgba;
+}
+
+double percentile(std::vector<double> values, double p) {
+    std::ranges::sort(values);
+    auto index = static_cast<size_t>(p * static_cast<double>(values.size()));
+    return values[std::min(index, values.size() - 1)];
+}
+
+// Returns the p95 frame time in ms
+double run(
+    const char* name,
+    float coverage,
+    const Frame& frame,
+    ThreadPool& pool,
+    int32_t frames
+) {
+    CpuCompositor compositor(pool);
+    std::vector<uint8_t> watermark = makeWatermark(coverage);
+    compositor.setWatermark(
+        watermark.data(),
+        FRAME_HEIGHT,
+        FRAME_WIDTH,
+        FRAME_HEIGHT * 4,
+        false,
+        FRAME_WIDTH,
+        FRAME_HEIGHT,
+        270,
+        YuvMatrix::BT709,
+        YuvRange::FULL
+    );
+
+    // Same layout as the renderer's composited frame
+    size_t lumaSize = size_t(FRAME_WIDTH) * FRAME_HEIGHT;
+    std::vector<uint8_t> composited(lumaSize * 3 / 2);
+    YuvImage dst{
+        .y = composited.data(),
+        .u = composited.data() + lumaSize,
+        .v = composited.data() + lumaSize + 1,
+        .width = FRAME_WIDTH,
+        .height = FRAME_HEIGHT,
+        .yRowStride = FRAME_WIDTH,
+        .uvRowStride = FRAME_WIDTH,
+        .uvPixelStride = 2
+    };
+    std::vector<uint8_t> rgba(lumaSize * 4);
+    constexpr int32_t CONVERT_GRAIN = 64;
+
+    std::vector<double> compositeMs;
+    std::vector<double> totalMs;
+    for (int32_t i = -WARMUP_FRAMES; i < frames; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        compositor.composite(frame.planes, dst);
+        auto composed = std::chrono::steady_clock::now();
+        pool.parallelFor(
+            0,
+            FRAME_HEIGHT,
+            CONVERT_GRAIN,
+            [&](int32_t begin, int32_t end) {
+                YuvPlanes band{
+                    .y = dst.y + size_t(begin) * dst.yRowStride,
+                    .u = dst.u + size_t(begin / 2) * dst.uvRowStride,
+                    .v = dst.v + size_t(begin / 2) * dst.uvRowStride,
+                    .width = FRAME_WIDTH,
+                    .height = end - begin,
+                    .yRowStride = dst.yRowStride,
+                    .uvRowStride = dst.uvRowStride,
+                    .uvPixelStride = dst.uvPixelStride
+                };
+                yuv420ToRgba(
+                    band,
+                    rgba.data() + size_t(begin) * FRAME_WIDTH * 4,
+                    FRAME_WIDTH * 4,
+                    YuvMatrix::BT709,
+                    YuvRange::FULL
+                );
+            }
+        );
+        auto done = std::chrono::steady_clock::now();
+        if (i < 0) continue;
+        compositeMs.push_back(
+            std::chrono::duration<double, std::milli>(composed - start).count()
+        );
+        totalMs.push_back(
+            std::chrono::duration<double, std::milli>(done - start).count()
+        );
+    }
+
+    double p95 = percentile(totalMs, 0.95);
+    printf(
+        "%-7s composite p50 %6.2f ms  total p50 %6.2f ms, p95 %6.2f ms  "
+        "%s\n",
+        name,
+        percentile(compositeMs, 0.5),
+        percentile(totalMs, 0.5),
+        p95,
+        p95 <= BUDGET_MS ? "ok" : "over budget"
+    );
+    return p95;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        fputs(USAGE, stderr);
+        return 2;
+    }
+
+    // The calling thread works on the frames too
+    ThreadPool pool(options.threads - 1);
+    Frame frame;
+    makeFrame(frame);
+    printf(
+        "%dx%d, %d frames, %s blend, %s conversion, threads %u, budget "
+        "%.1f ms\n",
+        FRAME_WIDTH,
+        FRAME_HEIGHT,
+        options.frames,
+        CpuCompositor::getKernelName(),
+        getYuvKernelName(),
+        pool.size() + 1,
+        BUDGET_MS
+    );
+
+    double sparse = run("sparse", 0.15f, frame, pool, options.frames);
+    double full = run("full", 1.0f, frame, pool, options.frames);
+    return std::max(sparse, full) <= BUDGET_MS ? 0 : 1;
+}
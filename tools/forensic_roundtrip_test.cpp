@@ -0,0 +1,201 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <vector>
+
+#include "forensic_watermark.hpp"
+
+using namespace camera;
+
+// Embeds the forensic mark into synthetic frames and extracts it again,
+// at 1080p and at sizes that leave partial blocks on the right and the
+// bottom. The payload must come back with the key it was marked with,
+// and neither another key nor an unmarked frame may yield one
+
+namespace {
+
+constexpr uint32_t KEY = 0x5eed1234u;
+constexpr uint32_t WRONG_KEY = 0x5eed1235u;
+// Row padding past the width, the mark must leave it alone
+constexpr int32_t ROW_PADDING = 13;
+constexpr uint8_t CANARY = 0xA5;
+
+// Extractions the dispatched kernel and the reference disagreed on
+int kernelMismatches = 0;
+
+struct Frame {
+    std::vector<uint8_t> luma;
+    int32_t width = 0;
+    int32_t height = 0;
+    int32_t rowStride = 0;
+};
+
+// Smooth gradients, edges and sensor like noise, the content the marked
+// blocks have to stand out from
+Frame makeFrame(int32_t width, int32_t height) {
+    Frame frame;
+    frame.width = width;
+    frame.height = height;
+    frame.rowStride = width + ROW_PADDING;
+    frame.luma.assign(size_t(frame.rowStride) * height, CANARY);
+    uint32_t state = static_cast<uint32_t>(width * 7919 + height);
+    for (int32_t y = 0; y < height; ++y) {
+        uint8_t* row = frame.luma.data() + size_t(y) * frame.rowStride;
+        for (int32_t x = 0; x < width; ++x) {
+            state = state * 1664525u + 1013904223u;
+            float noise = static_cast<float>(state >> 28) - 7.5f;
+            float value = 128.0f +
+                          60.0f * std::sin(static_cast<float>(x) * 0.013f) *
+                              std::cos(static_cast<float>(y) * 0.021f) +
+                          ((x / 97 + y / 61) % 2 ? 30.0f : -30.0f) + noise;
+            row[x] = static_cast<uint8_t>(std::lround(
+                std::fmin(std::fmax(value, 0.0f), 255.0f)
+            ));
+        }
+    }
+    return frame;
+}
+
+bool checkPadding(const Frame& frame) {
+    for (int32_t y = 0; y < frame.height; ++y) {
+        const uint8_t* padding =
+            frame.luma.data() + size_t(y) * frame.rowStride + frame.width;
+        for (int32_t i = 0; i < ROW_PADDING; ++i) {
+            if (padding[i] != CANARY) {
+                fprintf(stderr, "row padding overwritten in row %d\n", y);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Extracts with the dispatched kernel and checks the reference agrees
+bool extract(
+    const Frame& frame,
+    uint32_t key,
+    ForensicPayload& payload,
+    float& confidence
+) {
+    ForensicPayload referencePayload;
+    float referenceConfidence = 0.0f;
+    bool marked = extractForensicWatermark(
+        frame.luma.data(),
+        frame.width,
+        frame.height,
+        frame.rowStride,
+        key,
+        payload,
+        confidence
+    );
+    bool referenceMarked = extractForensicWatermarkReference(
+        frame.luma.data(),
+        frame.width,
+        frame.height,
+        frame.rowStride,
+        key,
+        referencePayload,
+        referenceConfidence
+    );
+    if (marked != referenceMarked || payload != referencePayload ||
+        confidence != referenceConfidence) {
+        fprintf(
+            stderr,
+            "%s disagrees with the reference: %.3f, expected %.3f\n",
+            getForensicKernelName(),
+            confidence,
+            referenceConfidence
+        );
+        ++kernelMismatches;
+    }
+    return marked;
+}
+
+bool checkSize(int32_t width, int32_t height) {
+    Frame frame = makeFrame(width, height);
+    ForensicPayload payload;
+    float confidence = 0.0f;
+    bool ok = true;
+
+    if (extract(frame, KEY, payload, confidence)) {
+        fprintf(stderr, "unmarked frame read as marked\n");
+        ok = false;
+    }
+    float unmarkedConfidence = confidence;
+
+    const ForensicPayload expected{
+        .deviceId = 0xC0FFEE01u ^ static_cast<uint32_t>(width),
+        .frameNumber = static_cast<uint32_t>(height) * 31u,
+        .timestampS = 1760000000u
+    };
+    embedForensicWatermark(
+        frame.luma.data(),
+        frame.width,
+        frame.height,
+        frame.rowStride,
+        KEY,
+        expected
+    );
+    ok &= checkPadding(frame);
+
+    if (!extract(frame, KEY, payload, confidence)) {
+        fprintf(stderr, "mark not found, confidence %.2f\n", confidence);
+        ok = false;
+    } else if (payload != expected) {
+        fprintf(
+            stderr,
+            "payload %08x %u %u, expected %08x %u %u\n",
+            payload.deviceId,
+            payload.frameNumber,
+            payload.timestampS,
+            expected.deviceId,
+            expected.frameNumber,
+            expected.timestampS
+        );
+        ok = false;
+    }
+    float markedConfidence = confidence;
+
+    if (extract(frame, WRONG_KEY, payload, confidence)) {
+        fprintf(stderr, "read with the wrong key\n");
+        ok = false;
+    }
+
+    printf(
+        "%dx%d: marked %.1f, unmarked %.1f, wrong key %.1f\n",
+        width,
+        height,
+        markedConfidence,
+        unmarkedConfidence,
+        confidence
+    );
+    if (!ok) fprintf(stderr, "  failed at %dx%d\n", width, height);
+    return ok;
+}
+
+}  // namespace
+
+int main() {
+    // The recording sizes and odd ones with partial blocks on both edges
+    const int32_t sizes[][2] = {
+        {1920, 1080},
+        {1280, 720},
+        {1919, 1079},
+        {1283, 725},
+        {641, 363}
+    };
+    int failures = 0;
+    for (const auto& size : sizes) {
+        if (!checkSize(size[0], size[1])) ++failures;
+    }
+    int cases = static_cast<int>(std::size(sizes));
+    printf(
+        "%s: %d of %d sizes passed\n",
+        getForensicKernelName(),
+        cases - failures,
+        cases
+    );
+    bool passed = failures == 0 && kernelMismatches == 0;
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,150 @@
+#include "frame_reader.hpp"
+
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+namespace camera {
+
+namespace {
+
+// Enough for every header field seen in practice
+constexpr size_t MAX_HEADER_LENGTH = 256;
+
+// Half resolution chroma planes rounded up, as 4:2:0 stores them
+size_t getI420ChromaSize(int32_t width, int32_t height) {
+    return static_cast<size_t>((width + 1) / 2) * ((height + 1) / 2) * 2;
+}
+
+bool readLine(FILE* file, std::string& line) {
+    line.clear();
+    for (int c; (c = fgetc(file)) != EOF;) {
+        if (c == '\n') return true;
+        if (line.size() == MAX_HEADER_LENGTH) return false;
+        line.push_back(static_cast<char>(c));
+    }
+    return false;
+}
+
+}  // namespace
+
+FrameReader::~FrameReader() {
+    if (file_ && file_ != stdin) fclose(file_);
+}
+
+bool FrameReader::open(const std::string& path) {
+    file_ = path == "-" ? stdin : fopen(path.c_str(), "rb");
+    if (!file_) {
+        fprintf(stderr, "Can't open %s: %s\n", path.c_str(), strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool FrameReader::openY4m(const std::string& path) {
+    if (!open(path)) return false;
+    y4m_ = true;
+    return readY4mHeader();
+}
+
+bool FrameReader::openRaw(
+    const std::string& path, int32_t width, int32_t height
+) {
+    if (width <= 0 || height <= 0) {
+        fprintf(stderr, "Invalid frame size %dx%d\n", width, height);
+        return false;
+    }
+    if (!open(path)) return false;
+    width_ = width;
+    height_ = height;
+    chromaSize_ = getI420ChromaSize(width, height);
+    return true;
+}
+
+bool FrameReader::readY4mHeader() {
+    std::string header;
+    if (!readLine(file_, header) || header.rfind("YUV4MPEG2 ", 0) != 0) {
+        fprintf(stderr, "Not a Y4M stream\n");
+        return false;
+    }
+
+    std::string colorSpace = "420";
+    size_t start = 0;
+    while (start < header.size()) {
+        size_t end = header.find(' ', start);
+        if (end == std::string::npos) end = header.size();
+        std::string field = header.substr(start, end - start);
+        start = end + 1;
+        if (field.empty()) continue;
+        if (field[0] == 'W') width_ = atoi(field.c_str() + 1);
+        if (field[0] == 'H') height_ = atoi(field.c_str() + 1);
+        if (field[0] == 'C') colorSpace = field.substr(1);
+    }
+    if (width_ <= 0 || height_ <= 0) {
+        fprintf(stderr, "Y4M header without a frame size\n");
+        return false;
+    }
+
+    // Only 8 bit samples, high bit depths are suffixed like 420p10
+    size_t depth = colorSpace.find('p');
+    bool highBitDepth = depth != std::string::npos &&
+        depth + 1 < colorSpace.size() && isdigit(colorSpace[depth + 1]);
+    if (!highBitDepth && colorSpace.rfind("420", 0) == 0) {
+        chromaSize_ = getI420ChromaSize(width_, height_);
+    } else if (colorSpace == "422") {
+        chromaSize_ = static_cast<size_t>((width_ + 1) / 2) * height_ * 2;
+    } else if (colorSpace == "444") {
+        chromaSize_ = static_cast<size_t>(width_) * height_ * 2;
+    } else if (colorSpace == "mono") {
+        chromaSize_ = 0;
+    } else {
+        fprintf(
+            stderr, "Unsupported Y4M color space C%s\n", colorSpace.c_str()
+        );
+        return false;
+    }
+    return true;
+}
+
+bool FrameReader::skipFrameHeader() {
+    std::string header;
+    if (!readLine(file_, header)) {
+        // The end of the stream, unless a header was cut
+        failed_ = !header.empty();
+        return false;
+    }
+    if (header.rfind("FRAME", 0) != 0) {
+        fprintf(stderr, "Malformed Y4M frame header\n");
+        failed_ = true;
+        return false;
+    }
+    return true;
+}
+
+bool FrameReader::read(std::vector<uint8_t>& luma) {
+    if (!file_ || failed_) return false;
+    if (y4m_ && !skipFrameHeader()) return false;
+
+    luma.resize(static_cast<size_t>(width_) * height_);
+    size_t count = fread(luma.data(), 1, luma.size(), file_);
+    if (count != luma.size()) {
+        // A raw stream ends on a frame boundary
+        if (count != 0 || y4m_) {
+            fprintf(stderr, "Truncated frame\n");
+            failed_ = true;
+        }
+        return false;
+    }
+
+    // Chroma is skipped by reading it, stdin can't seek
+    chroma_.resize(chromaSize_);
+    if (fread(chroma_.data(), 1, chroma_.size(), file_) != chroma_.size()) {
+        fprintf(stderr, "Truncated frame\n");
+        failed_ = true;
+        return false;
+    }
+    return true;
+}
+
+}  // namespace camera
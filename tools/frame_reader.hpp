@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace camera {
+
+/**
+ * Reads the luma planes of 8 bit YUV frames from a Y4M stream, or from
+ * raw I420 frames of a known size. Chroma is skipped. Recordings are
+ * read by piping them through a decoder, e.g.
+ * ffmpeg -i clip.mp4 -f yuv4mpegpipe -.
+ */
+class FrameReader {
+  public:
+    FrameReader() = default;
+    ~FrameReader();
+
+    FrameReader(const FrameReader&) = delete;
+    FrameReader& operator=(const FrameReader&) = delete;
+
+    /** Open a Y4M file, "-" for stdin. Prints the error when it fails. */
+    bool openY4m(const std::string& path);
+    /** Open raw I420 frames of width x height. */
+    bool openRaw(const std::string& path, int32_t width, int32_t height);
+
+    /** Read the next luma plane, false at the end or on errors. */
+    bool read(std::vector<uint8_t>& luma);
+
+    [[nodiscard]] int32_t getWidth() const { return width_; }
+    [[nodiscard]] int32_t getHeight() const { return height_; }
+    /** Whether read() stopped on a malformed or truncated frame. */
+    [[nodiscard]] bool hasFailed() const { return failed_; }
+
+  private:
+    FILE* file_ = nullptr;
+    bool y4m_ = false;
+    bool failed_ = false;
+    int32_t width_ = 0;
+    int32_t height_ = 0;
+    size_t chromaSize_ = 0;
+    std::vector<uint8_t> chroma_;
+
+    bool open(const std::string& path);
+    bool readY4mHeader();
+    bool skipFrameHeader();
+};
+
+}  // namespace camera
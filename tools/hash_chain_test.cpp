@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "hash_chain.hpp"
+
+using namespace camera;
+
+// Writes the segments of a recording with their chains the way the app
+// does, every link handed out before the previous segment is saved, and
+// checks each chain continues from the head of the one before. Segments
+// out of order, tampered with or after a lost one must not pass as linked
+
+namespace {
+
+constexpr uint32_t SEGMENTS = 3;
+constexpr size_t SEGMENT_BYTES = 3000;
+constexpr size_t LINK_BYTES = 700;
+constexpr uint64_t PATCH_OFFSET = 4;
+
+const RecordingId RECORDING_ID = {
+    0x10, 0x32, 0x54, 0x76, 0x98, 0xba, 0xdc, 0xfe,
+    0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef
+};
+
+struct Segment {
+    std::string path;
+    Sha256Digest head{};
+};
+
+bool writeFile(const std::string& path, const std::vector<uint8_t>& data) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr) return false;
+    bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+    return fclose(file) == 0 && written;
+}
+
+// Hashes the bytes in links and fills in a size field at the end, like a
+// recording's mdat, then writes the file and its chain
+bool writeSegment(HashChainLink link, uint32_t segment, Segment& out) {
+    std::vector<uint8_t> data(SEGMENT_BYTES);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<uint8_t>(i * 31 + segment * 7);
+    }
+    HashChain chain(std::move(link));
+    for (size_t offset = 0; offset < data.size(); offset += LINK_BYTES) {
+        size_t size = std::min(LINK_BYTES, data.size() - offset);
+        chain.append(data.data() + offset, size);
+        chain.endLink();
+    }
+    const uint8_t sizeField[4] = {0, 0, 0x0b, 0xb8};
+    chain.addPatch(PATCH_OFFSET, data.data() + PATCH_OFFSET, sizeField, 4);
+    std::copy_n(sizeField, 4, data.data() + PATCH_OFFSET);
+
+    out.path = (std::filesystem::temp_directory_path() /
+                ("hash_chain_test_" + std::to_string(segment) + ".mp4"))
+                   .string();
+    if (!writeFile(out.path, data) ||
+        !chain.save(out.path + HASH_CHAIN_SUFFIX)) {
+        fprintf(stderr, "can't write %s\n", out.path.c_str());
+        return false;
+    }
+    out.head = chain.getHead();
+    return true;
+}
+
+bool verify(const Segment& segment, HashChainResult& result) {
+    if (!verifyHashChain(
+            segment.path,
+            segment.path + HASH_CHAIN_SUFFIX,
+            result
+        )) {
+        fprintf(
+            stderr,
+            "%s: %s\n",
+            segment.path.c_str(),
+            result.error.c_str()
+        );
+        return false;
+    }
+    return true;
+}
+
+bool checkLinked(const std::vector<Segment>& segments) {
+    bool ok = true;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        HashChainResult result;
+        if (!verify(segments[i], result)) {
+            ok = false;
+            continue;
+        }
+        if (result.head != segments[i].head) {
+            fprintf(stderr, "segment %zu: head doesn't match\n", i);
+            ok = false;
+        }
+        const Sha256Digest& expected = i == 0
+                                           ? getHashChainSeed(RECORDING_ID)
+                                           : segments[i - 1].head;
+        if (result.header.previousHead != expected) {
+            fprintf(stderr, "segment %zu: not linked to the one before\n", i);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+bool checkOutOfOrder(const std::vector<Segment>& segments) {
+    // Segment 2 verifies on its own but doesn't continue segment 0
+    HashChainResult result;
+    if (!verify(segments[2], result)) return false;
+    if (result.header.previousHead == segments[0].head) {
+        fprintf(stderr, "segment 2 passes as the next of segment 0\n");
+        return false;
+    }
+    return true;
+}
+
+bool checkTampered(const std::vector<Segment>& segments) {
+    // A changed byte breaks its link
+    FILE* file = fopen(segments[1].path.c_str(), "r+b");
+    if (file == nullptr) return false;
+    fseek(file, LINK_BYTES + 1, SEEK_SET);
+    int byte = fgetc(file);
+    fseek(file, LINK_BYTES + 1, SEEK_SET);
+    fputc(byte ^ 1, file);
+    fclose(file);
+    HashChainResult result;
+    if (verifyHashChain(
+            segments[1].path,
+            segments[1].path + HASH_CHAIN_SUFFIX,
+            result
+        )) {
+        fprintf(stderr, "tampered segment verified\n");
+        return false;
+    }
+    return true;
+}
+
+bool checkLostSegment() {
+    // A segment dropped before it saved its chain leaves the next one on
+    // its own, it can't pass as continuing anything
+    HashChainLinker linker(RECORDING_ID);
+    Segment first;
+    if (!writeSegment(linker.next(0), 0, first)) return false;
+    linker.next(1);
+    Segment third;
+    if (!writeSegment(linker.next(2), 2, third)) return false;
+    HashChainResult result;
+    if (!verify(third, result)) return false;
+    if (result.header.previousHead == first.head) {
+        fprintf(stderr, "segment after a lost one passes as linked\n");
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+int main() {
+    // Links are handed out ahead, as the muxer opens the next segment
+    // before the previous one is finished
+    HashChainLinker linker(RECORDING_ID);
+    std::vector<HashChainLink> links;
+    for (uint32_t i = 0; i < SEGMENTS; ++i) links.push_back(linker.next(i));
+    std::vector<Segment> segments(SEGMENTS);
+    bool written = true;
+    for (uint32_t i = 0; i < SEGMENTS; ++i) {
+        written &= writeSegment(std::move(links[i]), i, segments[i]);
+    }
+
+    bool passed = written && checkLinked(segments);
+    passed = written && checkOutOfOrder(segments) && passed;
+    passed = written && checkTampered(segments) && passed;
+    passed = checkLostSegment() && passed;
+
+    for (const Segment& segment : segments) {
+        std::filesystem::remove(segment.path);
+        std::filesystem::remove(segment.path + HASH_CHAIN_SUFFIX);
+    }
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
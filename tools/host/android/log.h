@@ -0,0 +1,47 @@
+#pragma once
+
+// Stand-in for the NDK logging API, prints to stderr so the app code the
+// tools share builds and logs on a host
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+
+enum android_LogPriority {
+    ANDROID_LOG_UNKNOWN = 0,
+    ANDROID_LOG_DEFAULT,
+    ANDROID_LOG_VERBOSE,
+    ANDROID_LOG_DEBUG,
+    ANDROID_LOG_INFO,
+    ANDROID_LOG_WARN,
+    ANDROID_LOG_ERROR,
+    ANDROID_LOG_FATAL,
+    ANDROID_LOG_SILENT
+};
+
+inline int __android_log_write(int, const char* tag, const char* text) {
+    return fprintf(stderr, "%s: %s\n", tag, text);
+}
+
+__attribute__((format(printf, 3, 4))) inline int __android_log_print(
+    int, const char* tag, const char* format, ...
+) {
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "%s: ", tag);
+    int length = vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+    va_end(args);
+    return length;
+}
+
+__attribute__((format(printf, 3, 4))) [[noreturn]] inline void
+__android_log_assert(const char*, const char* tag, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "%s: ", tag);
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+    va_end(args);
+    abort();
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+// Host build of the app's util.hpp, only the logging, the camera helpers
+// need the NDK
+
+#include "logger.hpp"
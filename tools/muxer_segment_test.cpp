@@ -0,0 +1,279 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "muxer.hpp"
+
+using namespace camera;
+
+// Runs a Muxer over a fake backend and checks that split recordings lose
+// nothing: every packet lands in exactly one segment or is counted as
+// dropped, each segment starts with a video key frame at 0 and its
+// timestamps only go forward
+
+namespace {
+
+constexpr uint32_t VIDEO_TRACK = 0;
+constexpr uint32_t AUDIO_TRACK = 1;
+constexpr int64_t VIDEO_FRAME_US = 33'333;
+// AAC frames of 1024 samples at 48 kHz
+constexpr int64_t AUDIO_FRAME_US = 21'333;
+constexpr int64_t KEY_FRAME_INTERVAL = 30;
+// Below the key frame interval, each key frame starts a segment
+constexpr int64_t SEGMENT_DURATION_US = 900'000;
+constexpr size_t PACKET_SIZE = 256;
+
+struct Sample {
+    uint32_t track;
+    int64_t timeUs;
+    uint32_t flags;
+    uint64_t id;
+};
+
+// What the backends wrote, by segment, published when a segment stops
+struct Output {
+    std::mutex mutex;
+    std::map<uint32_t, std::vector<Sample>> segments;
+    uint32_t created = 0;
+};
+
+class FakeBackend : public MuxerBackend {
+  public:
+    FakeBackend(Output& output, uint32_t segment)
+        : output_(output), segment_(segment) {}
+
+    int32_t addTrack(const TrackFormat& format) override {
+        if (started_) return -1;
+        types_.push_back(format.type);
+        return static_cast<int32_t>(types_.size() - 1);
+    }
+
+    bool start() override {
+        started_ = true;
+        return true;
+    }
+
+    bool writeSample(
+        int32_t track,
+        const uint8_t* data,
+        size_t size,
+        int64_t presentationTimeUs,
+        uint32_t flags
+    ) override {
+        if (!started_ || size < sizeof(uint64_t)) return false;
+        Sample sample{
+            .track = types_[track] == TrackType::VIDEO ? VIDEO_TRACK
+                                                       : AUDIO_TRACK,
+            .timeUs = presentationTimeUs,
+            .flags = flags,
+            .id = 0
+        };
+        memcpy(&sample.id, data, sizeof(sample.id));
+        samples_.push_back(sample);
+        return true;
+    }
+
+    bool stop() override {
+        if (!started_) return false;
+        started_ = false;
+        std::lock_guard lock(output_.mutex);
+        output_.segments[segment_] = std::move(samples_);
+        return true;
+    }
+
+  private:
+    Output& output_;
+    uint32_t segment_;
+    std::vector<TrackType> types_;
+    std::vector<Sample> samples_;
+    bool started_ = false;
+};
+
+struct Feed {
+    Output output;
+    std::unique_ptr<Muxer> muxer;
+    // Timestamp of every pushed packet by id
+    std::map<uint64_t, int64_t> pushed;
+    uint64_t nextId = 0;
+
+    explicit Feed(SegmentConfig segments) {
+        muxer = std::make_unique<Muxer>(
+            [this](uint32_t segment) -> std::unique_ptr<MuxerBackend> {
+                std::lock_guard lock(output.mutex);
+                output.created++;
+                return std::make_unique<FakeBackend>(output, segment);
+            },
+            std::vector<TrackType>{TrackType::VIDEO, TrackType::AUDIO},
+            segments
+        );
+        TrackFormat video;
+        video.mime = "video/avc";
+        muxer->setTrackFormat(VIDEO_TRACK, video);
+        TrackFormat audio;
+        audio.type = TrackType::AUDIO;
+        audio.mime = "audio/mp4a-latm";
+        muxer->setTrackFormat(AUDIO_TRACK, audio);
+    }
+
+    void push(uint32_t track, int64_t timeUs, uint32_t flags = 0) {
+        uint64_t id = nextId++;
+        std::vector<uint8_t> data(PACKET_SIZE);
+        memcpy(data.data(), &id, sizeof(id));
+        if (muxer->push(track, data.data(), data.size(), timeUs, flags)) {
+            pushed[id] = timeUs;
+        }
+    }
+
+    void pushVideo(int64_t fromUs, int64_t toUs) {
+        for (int64_t t = fromUs; t < toUs; t += VIDEO_FRAME_US) {
+            bool key = t / VIDEO_FRAME_US % KEY_FRAME_INTERVAL == 0;
+            push(VIDEO_TRACK, t, key ? MediaPacket::FLAG_KEY_FRAME : 0);
+        }
+    }
+
+    void pushAudio(int64_t fromUs, int64_t toUs) {
+        for (int64_t t = fromUs; t < toUs; t += AUDIO_FRAME_US) {
+            push(AUDIO_TRACK, t);
+        }
+    }
+};
+
+bool fail(const char* message) {
+    fprintf(stderr, "%s\n", message);
+    return false;
+}
+
+// Checks the segments against the pushed packets, returns the number of
+// packets written
+bool checkOutput(Feed& feed, uint64_t& written) {
+    if (!feed.muxer->finish()) return fail("muxer failed");
+    Muxer::Stats stats = feed.muxer->getStats();
+    std::lock_guard lock(feed.output.mutex);
+
+    std::set<uint64_t> seen;
+    uint32_t expectedSegment = 0;
+    for (const auto& [index, samples] : feed.output.segments) {
+        if (index != expectedSegment++) return fail("segment missing");
+        if (samples.empty()) return fail("empty segment");
+        const Sample& first = samples.front();
+        if (first.track != VIDEO_TRACK ||
+            !(first.flags & MediaPacket::FLAG_KEY_FRAME) || first.timeUs != 0) {
+            fprintf(stderr, "segment %u doesn't start at a key frame\n", index);
+            return false;
+        }
+        // Absolute time of the segment start
+        int64_t baseUs = feed.pushed.at(first.id);
+        int64_t lastUs[2] = {-1, -1};
+        for (const Sample& sample : samples) {
+            if (!seen.insert(sample.id).second) {
+                return fail("packet written twice");
+            }
+            auto pushed = feed.pushed.find(sample.id);
+            if (pushed == feed.pushed.end()) return fail("unknown packet");
+            if (sample.timeUs != pushed->second - baseUs) {
+                return fail("timestamp not relative to the segment start");
+            }
+            if (sample.timeUs < 0 || sample.timeUs <= lastUs[sample.track]) {
+                fprintf(
+                    stderr,
+                    "segment %u track %u goes back to %lld\n",
+                    index,
+                    sample.track,
+                    (long long)sample.timeUs
+                );
+                return false;
+            }
+            lastUs[sample.track] = sample.timeUs;
+        }
+    }
+
+    written = seen.size();
+    if (stats.segments != feed.output.segments.size()) {
+        return fail("segment count differs from the backends written");
+    }
+    if (stats.packetsWritten != written) {
+        return fail("written count differs from the packets written");
+    }
+    if (written + stats.packetsDropped != feed.pushed.size()) {
+        fprintf(
+            stderr,
+            "%llu pushed, %llu written, %llu dropped\n",
+            (unsigned long long)feed.pushed.size(),
+            (unsigned long long)written,
+            (unsigned long long)stats.packetsDropped
+        );
+        return fail("packets lost without being counted");
+    }
+    return true;
+}
+
+// A two minute recording in one second segments, pushed in bursts as the
+// encoders deliver
+bool testContinuity() {
+    constexpr int64_t DURATION_US = 120'000'000;
+    constexpr int64_t BURST_US = 100'000;
+    Feed feed({.maxDurationUs = SEGMENT_DURATION_US});
+    int64_t videoUs = 0;
+    int64_t audioUs = 0;
+    for (int64_t burstUs = BURST_US; burstUs <= DURATION_US;
+         burstUs += BURST_US) {
+        for (; videoUs < burstUs; videoUs += VIDEO_FRAME_US) {
+            feed.pushVideo(videoUs, videoUs + 1);
+        }
+        for (; audioUs < burstUs; audioUs += AUDIO_FRAME_US) {
+            feed.pushAudio(audioUs, audioUs + 1);
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+
+    uint64_t written = 0;
+    if (!checkOutput(feed, written)) return false;
+    Muxer::Stats stats = feed.muxer->getStats();
+    printf(
+        "continuity: %u segments, %llu packets, %llu dropped\n",
+        stats.segments,
+        (unsigned long long)written,
+        (unsigned long long)stats.packetsDropped
+    );
+    if (stats.segments < 100) return fail("expected 100+ segments");
+    if (stats.packetsDropped != 0) return fail("packets dropped");
+    return true;
+}
+
+// Audio arriving after the segment it belongs to was closed by SPLIT_WAIT
+// can't be written, it has to show up as dropped
+bool testLateAudio() {
+    Feed feed({.maxDurationUs = SEGMENT_DURATION_US});
+    feed.pushAudio(0, 500'000);
+    feed.pushVideo(0, 2'500'000);
+    // Past the wait at the first split, before the one at the second
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    feed.pushAudio(500'000, 2'500'000);
+
+    uint64_t written = 0;
+    if (!checkOutput(feed, written)) return false;
+    Muxer::Stats stats = feed.muxer->getStats();
+    printf(
+        "late audio: %u segments, %llu packets, %llu dropped\n",
+        stats.segments,
+        (unsigned long long)written,
+        (unsigned long long)stats.packetsDropped
+    );
+    if (stats.packetsDropped == 0) return fail("late audio not dropped");
+    return true;
+}
+
+}  // namespace
+
+int main() {
+    bool passed = testContinuity();
+    passed = testLateAudio() && passed;
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,176 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include "thermal_governor.hpp"
+
+using namespace camera;
+using namespace std::chrono_literals;
+
+// Drives the ThermalGovernor with a stub ThermalSource and render times on
+// a simulated clock. It has to step down when hot, overloaded or critical,
+// hold its level while readings sit between the thresholds, and only step
+// back up after a cool down
+
+namespace {
+
+constexpr int32_t FRAME_RATE = 30;
+constexpr float FRAME_US = 1e6f / FRAME_RATE;
+// The governor's own interval, sampling faster only repeats samples
+constexpr auto SAMPLE_INTERVAL = 2s;
+
+class StubThermalSource : public ThermalSource {
+  public:
+    ThermalStatus status = ThermalStatus::NONE;
+    float headroom = NAN;
+
+    ThermalStatus getStatus() override { return status; }
+    float getHeadroom(int32_t) override { return headroom; }
+};
+
+std::vector<QualityLevel> makeLadder() {
+    return {
+        {2, 1.0f, 20'000'000, FRAME_RATE, 0},
+        {1, 1.0f, 20'000'000, FRAME_RATE, 0},
+        {1, 0.75f, 12'000'000, FRAME_RATE, 24},
+        {1, 0.5f, 8'000'000, FRAME_RATE, 20}
+    };
+}
+
+struct Rig {
+    StubThermalSource* source;
+    std::unique_ptr<ThermalGovernor> governor;
+    ThermalGovernor::Clock::time_point now;
+    bool ok = true;
+
+    Rig() {
+        auto stub = std::make_unique<StubThermalSource>();
+        source = stub.get();
+        governor = std::make_unique<ThermalGovernor>(
+            std::move(stub),
+            makeLadder()
+        );
+        now = ThermalGovernor::Clock::time_point{} + 1h;
+    }
+
+    // One frame at load, relative to the frame interval, per sample
+    void run(std::chrono::seconds duration, float load) {
+        auto renderTime = std::chrono::microseconds(
+            static_cast<int64_t>(load * FRAME_US)
+        );
+        for (auto end = now + duration; now < end;) {
+            now += SAMPLE_INTERVAL;
+            governor->onFrame(renderTime);
+            governor->update(now);
+        }
+    }
+
+    void expect(size_t level, const char* what) {
+        if (governor->getLevelIndex() == level) return;
+        fprintf(
+            stderr,
+            "%s: level %zu, expected %zu\n",
+            what,
+            governor->getLevelIndex(),
+            level
+        );
+        ok = false;
+    }
+};
+
+bool testStepDown() {
+    Rig rig;
+    rig.source->status = ThermalStatus::MODERATE;
+    rig.run(2s, 0.3f);
+    rig.expect(1, "hot");
+    // Steps are spaced so each one can take effect
+    rig.run(8s, 0.3f);
+    rig.expect(1, "hot again right away");
+    rig.run(2s, 0.3f);
+    rig.expect(2, "hot after the step interval");
+
+    // Only CPU work counts as load, over LOAD_HIGH twice in a row
+    rig.source->status = ThermalStatus::NONE;
+    rig.run(8s, 0.95f);
+    rig.expect(2, "overloaded within the step interval");
+    rig.run(2s, 0.95f);
+    rig.expect(3, "overloaded");
+
+    Rig critical;
+    critical.source->status = ThermalStatus::CRITICAL;
+    critical.run(2s, 0.3f);
+    critical.expect(3, "critical");
+
+    Rig severe;
+    severe.source->status = ThermalStatus::SEVERE;
+    severe.run(4s, 0.3f);
+    severe.expect(2, "severe, a step per sample");
+    return rig.ok && critical.ok && severe.ok;
+}
+
+bool testHysteresis() {
+    Rig rig;
+    rig.source->status = ThermalStatus::MODERATE;
+    rig.run(2s, 0.3f);
+    rig.expect(1, "hot");
+
+    // Headroom between HEADROOM_COOL and HEADROOM_HOT
+    rig.source->status = ThermalStatus::NONE;
+    rig.source->headroom = 0.8f;
+    rig.run(120s, 0.3f);
+    rig.expect(1, "warm");
+    // Load between LOAD_LOW and LOAD_HIGH
+    rig.source->headroom = 0.5f;
+    rig.run(120s, 0.75f);
+    rig.expect(1, "busy");
+    // LIGHT still counts as calm
+    rig.source->status = ThermalStatus::LIGHT;
+    rig.run(20s, 0.3f);
+    rig.expect(1, "calm for less than the cool down");
+    rig.run(2s, 0.75f);
+    rig.run(20s, 0.3f);
+    rig.expect(1, "calm stretch restarted by load");
+    return rig.ok;
+}
+
+bool testStepUp() {
+    Rig rig;
+    rig.source->status = ThermalStatus::CRITICAL;
+    rig.run(2s, 0.3f);
+    rig.expect(3, "critical");
+
+    rig.source->status = ThermalStatus::NONE;
+    rig.source->headroom = 0.5f;
+    rig.run(28s, 0.3f);
+    rig.expect(3, "cooling down");
+    rig.run(2s, 0.3f);
+    rig.expect(2, "cool");
+    // One step per cool down
+    rig.run(28s, 0.3f);
+    rig.expect(2, "cooling down again");
+    rig.run(2s, 0.3f);
+    rig.expect(1, "cool again");
+    rig.run(60s, 0.3f);
+    rig.expect(0, "full quality");
+    rig.run(60s, 0.3f);
+    rig.expect(0, "stays at the top");
+
+    // Without a headroom forecast only the status counts
+    rig.source->headroom = NAN;
+    rig.source->status = ThermalStatus::MODERATE;
+    rig.run(2s, 0.3f);
+    rig.expect(1, "hot without headroom");
+    return rig.ok;
+}
+
+}  // namespace
+
+int main() {
+    bool passed = testStepDown();
+    passed = testHysteresis() && passed;
+    passed = testStepUp() && passed;
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,195 @@
+#include <array>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "forensic_watermark.hpp"
+#include "frame_reader.hpp"
+#include "thread_pool.hpp"
+
+using namespace camera;
+
+namespace {
+
+constexpr auto USAGE =
+    "usage: wmdetect --key KEY [--raw WIDTHxHEIGHT] [--threads N] FILE\n"
+    "\n"
+    "Reads the invisible watermark of every frame of a Y4M file, or of raw\n"
+    "I420 frames with --raw. FILE - reads stdin, so recordings can be\n"
+    "piped in: ffmpeg -i clip.mp4 -f yuv4mpegpipe - | wmdetect --key K -\n"
+    "Frames must have the size they were recorded at.\n"
+    "\n"
+    "Exits with 0 when a frame is marked, 1 when none is, 2 on errors.\n";
+
+// Frames in flight per thread, so the fast threads have more to take
+// while a slow one finishes its frame
+constexpr size_t FRAMES_PER_THREAD = 4;
+
+struct Options {
+    uint32_t key = 0;
+    bool hasKey = false;
+    int32_t rawWidth = 0;
+    int32_t rawHeight = 0;
+    uint32_t threads = ThreadPool::defaultThreadCount() + 1;
+    std::string path;
+};
+
+bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--key" && hasValue) {
+            options.key = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+            options.hasKey = true;
+        } else if (arg == "--raw" && hasValue) {
+            if (sscanf(
+                    argv[++i], "%dx%d", &options.rawWidth, &options.rawHeight
+                ) != 2) {
+                return false;
+            }
+        } else if (arg == "--threads" && hasValue) {
+            options.threads = static_cast<uint32_t>(atoi(argv[++i]));
+            if (options.threads == 0) return false;
+        } else if (options.path.empty() && (arg == "-" || arg[0] != '-')) {
+            options.path = arg;
+        } else {
+            return false;
+        }
+    }
+    return options.hasKey && !options.path.empty();
+}
+
+struct Result {
+    ForensicPayload payload;
+    float confidence = 0.0f;
+    bool marked = false;
+};
+
+struct Batch {
+    std::vector<std::vector<uint8_t>> frames;
+    std::vector<Result> results;
+    size_t count = 0;
+};
+
+size_t readBatch(FrameReader& reader, Batch& batch) {
+    batch.count = 0;
+    while (batch.count < batch.frames.size() &&
+           reader.read(batch.frames[batch.count])) {
+        ++batch.count;
+    }
+    return batch.count;
+}
+
+void printResult(int64_t index, const Result& result) {
+    if (!result.marked) {
+        printf(
+            "%8" PRId64 "  no watermark  confidence %.2f\n",
+            index,
+            result.confidence
+        );
+        return;
+    }
+
+    auto seconds = static_cast<time_t>(result.payload.timestampS);
+    tm utc{};
+    gmtime_r(&seconds, &utc);
+    char time[32];
+    strftime(time, sizeof(time), "%Y-%m-%dT%H:%M:%SZ", &utc);
+    printf(
+        "%8" PRId64 "  device %08x  frame %10u  %s  confidence %.2f\n",
+        index,
+        result.payload.deviceId,
+        result.payload.frameNumber,
+        time,
+        result.confidence
+    );
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        fputs(USAGE, stderr);
+        return 2;
+    }
+
+    FrameReader reader;
+    bool opened = options.rawWidth > 0
+        ? reader.openRaw(options.path, options.rawWidth, options.rawHeight)
+        : reader.openY4m(options.path);
+    if (!opened) return 2;
+
+    // The calling thread works on the frames too
+    ThreadPool pool(options.threads - 1);
+    size_t batchSize = (pool.size() + 1) * FRAMES_PER_THREAD;
+    std::array<Batch, 2> batches;
+    for (Batch& batch : batches) {
+        batch.frames.resize(batchSize);
+        batch.results.resize(batchSize);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    int64_t frameCount = 0;
+    int64_t markedCount = 0;
+    size_t current = 0;
+    readBatch(reader, batches[current]);
+    while (batches[current].count > 0) {
+        // The next frames are read while these are searched
+        Batch& next = batches[current ^ 1];
+        auto reading = std::async(std::launch::async, [&reader, &next] {
+            return readBatch(reader, next);
+        });
+
+        Batch& batch = batches[current];
+        pool.parallelFor(
+            0,
+            static_cast<int32_t>(batch.count),
+            1,
+            [&](int32_t begin, int32_t end) {
+                for (int32_t i = begin; i < end; ++i) {
+                    Result& result = batch.results[i];
+                    result.marked = extractForensicWatermark(
+                        batch.frames[i].data(),
+                        reader.getWidth(),
+                        reader.getHeight(),
+                        reader.getWidth(),
+                        options.key,
+                        result.payload,
+                        result.confidence
+                    );
+                }
+            }
+        );
+        for (size_t i = 0; i < batch.count; ++i) {
+            printResult(frameCount++, batch.results[i]);
+            if (batch.results[i].marked) ++markedCount;
+        }
+
+        reading.wait();
+        current ^= 1;
+    }
+
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    fprintf(
+        stderr,
+        "%" PRId64 " of %" PRId64 " frames marked, %dx%d, %.0f frames/s "
+        "(%s, threads %u)\n",
+        markedCount,
+        frameCount,
+        reader.getWidth(),
+        reader.getHeight(),
+        elapsed.count() > 0 ? frameCount / elapsed.count() : 0.0,
+        getForensicKernelName(),
+        pool.size() + 1
+    );
+    if (reader.hasFailed()) return 2;
+    return markedCount > 0 ? 0 : 1;
+}
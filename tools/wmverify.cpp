@@ -0,0 +1,90 @@
+#include <cstdio>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "hash_chain.hpp"
+
+using namespace camera;
+
+namespace {
+
+constexpr auto USAGE =
+    "usage: wmverify [--head DIGEST] FILE...\n"
+    "\n"
+    "Checks recordings against the hash chains written next to them, the\n"
+    "segments of a recording in order, each has to continue from the head\n"
+    "of the one before. Prints the head of each chain, which has to match\n"
+    "the one the app logged for the file to prove more than that file and\n"
+    "chain agree. --head compares it for one FILE.\n"
+    "\n"
+    "Exits with 0 when every file matches, 1 when one doesn't, 2 on usage\n"
+    "errors.\n";
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::string head;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--head" && i + 1 < argc) {
+            head = argv[++i];
+        } else if (arg[0] != '-') {
+            paths.push_back(arg);
+        } else {
+            paths.clear();
+            break;
+        }
+    }
+    if (paths.empty() || (!head.empty() && paths.size() != 1)) {
+        fputs(USAGE, stderr);
+        return 2;
+    }
+
+    bool valid = true;
+    HashChainHeader first;
+    std::optional<Sha256Digest> previousHead;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        const std::string& path = paths[i];
+        HashChainResult result;
+        if (!verifyHashChain(path, path + HASH_CHAIN_SUFFIX, result)) {
+            printf("%s: FAILED, %s\n", path.c_str(), result.error.c_str());
+            valid = false;
+            previousHead.reset();
+            continue;
+        }
+
+        // A segment continues from the last head of the one before, files
+        // from another recording or out of order would otherwise pass one
+        // by one. The ID and number tell what went wrong
+        std::string order;
+        if (i == 0) {
+            first = result.header;
+        } else if (result.header.recordingId != first.recordingId) {
+            order = ", from another recording";
+        } else if (result.header.segment != first.segment + i) {
+            order = ", segment out of order";
+        } else if (previousHead &&
+                   result.header.previousHead != *previousHead) {
+            order = ", doesn't continue the previous segment";
+        }
+        previousHead = result.head;
+        std::string digest = toHex(result.head);
+        if (!head.empty() && head != digest) {
+            order += ", head doesn't match";
+        }
+        printf(
+            "%s: %s segment %u, %u links, %u patches, head %s%s\n",
+            path.c_str(),
+            order.empty() ? "OK" : "FAILED",
+            result.header.segment,
+            result.links,
+            result.patches,
+            digest.c_str(),
+            order.c_str()
+        );
+        valid &= order.empty();
+    }
+    return valid ? 0 : 1;
+}
@@ -0,0 +1,268 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "yuv_convert.hpp"
+
+using namespace camera;
+
+// Checks yuv420ToRgba is bit exact with yuv420ToRgbaReference on every
+// chroma layout, odd sizes and padded strides, and that the reference is
+// within rounding of the floating point BT.601 and BT.709 equations
+
+namespace {
+
+// In 8 bit steps. The Q6 limited range luma scale is 75 / 64 instead of
+// 255 / 219, near white that alone is 2 steps, rounding the chroma terms
+// adds one
+constexpr int32_t FLOAT_TOLERANCE = 3;
+
+enum class Layout { I420, NV12, NV21, STRIDED };
+
+const char* getLayoutName(Layout layout) {
+    switch (layout) {
+        case Layout::I420:
+            return "I420";
+        case Layout::NV12:
+            return "NV12";
+        case Layout::NV21:
+            return "NV21";
+        case Layout::STRIDED:
+            return "strided";
+    }
+    return "";
+}
+
+struct Image {
+    std::vector<uint8_t> data;
+    YuvPlanes planes;
+};
+
+// Planes with rows padded past the width, filled with noise and the
+// extreme values the fixed point math saturates on
+void makeImage(int32_t width, int32_t height, Layout layout, Image& image) {
+    int32_t chromaWidth = (width + 1) / 2;
+    int32_t chromaHeight = (height + 1) / 2;
+    int32_t pixelStride = layout == Layout::I420      ? 1
+                          : layout == Layout::STRIDED ? 3
+                                                      : 2;
+    int32_t yRowStride = width + 13;
+    int32_t uvRowStride = chromaWidth * pixelStride + 7;
+    size_t lumaSize = size_t(yRowStride) * height;
+    size_t chromaSize = size_t(uvRowStride) * chromaHeight;
+    image.data.resize(lumaSize + chromaSize * 2);
+
+    uint32_t state = static_cast<uint32_t>(width * 7919 + height);
+    for (uint8_t& value : image.data) {
+        state = state * 1664525u + 1013904223u;
+        uint32_t r = state >> 24;
+        value = r < 16 ? 0 : r > 240 ? 255 : static_cast<uint8_t>(r);
+    }
+
+    uint8_t* chroma = image.data.data() + lumaSize;
+    image.planes = {
+        .y = image.data.data(),
+        .width = width,
+        .height = height,
+        .yRowStride = yRowStride,
+        .uvRowStride = uvRowStride,
+        .uvPixelStride = pixelStride
+    };
+    switch (layout) {
+        case Layout::I420:
+        case Layout::STRIDED:
+            image.planes.u = chroma;
+            image.planes.v = chroma + chromaSize;
+            break;
+        case Layout::NV12:
+            image.planes.u = chroma;
+            image.planes.v = chroma + 1;
+            break;
+        case Layout::NV21:
+            image.planes.v = chroma;
+            image.planes.u = chroma + 1;
+            break;
+    }
+}
+
+void toFloat(
+    int32_t y,
+    int32_t u,
+    int32_t v,
+    YuvMatrix matrix,
+    YuvRange range,
+    int32_t* rgb
+) {
+    double kr = matrix == YuvMatrix::BT601 ? 0.299 : 0.2126;
+    double kb = matrix == YuvMatrix::BT601 ? 0.114 : 0.0722;
+    double kg = 1.0 - kr - kb;
+    bool full = range == YuvRange::FULL;
+    double yy = full ? y : (y - 16) * 255.0 / 219.0;
+    double cScale = full ? 1.0 : 255.0 / 224.0;
+    double cb = (u - 128) * cScale;
+    double cr = (v - 128) * cScale;
+    double values[3] = {
+        yy + 2.0 * (1.0 - kr) * cr,
+        yy - 2.0 * kb * (1.0 - kb) / kg * cb - 2.0 * kr * (1.0 - kr) / kg * cr,
+        yy + 2.0 * (1.0 - kb) * cb
+    };
+    for (int i = 0; i < 3; ++i) {
+        rgb[i] = static_cast<int32_t>(
+            std::clamp(std::lround(values[i]), 0L, 255L)
+        );
+    }
+}
+
+bool checkAgainstFloat(
+    const Image& image,
+    const std::vector<uint8_t>& rgba,
+    int32_t rowStride,
+    YuvMatrix matrix,
+    YuvRange range
+) {
+    const YuvPlanes& p = image.planes;
+    for (int32_t y = 0; y < p.height; ++y) {
+        for (int32_t x = 0; x < p.width; ++x) {
+            size_t uv = size_t(y / 2) * p.uvRowStride +
+                        size_t(x / 2) * p.uvPixelStride;
+            int32_t expected[3];
+            toFloat(
+                p.y[size_t(y) * p.yRowStride + x],
+                p.u[uv],
+                p.v[uv],
+                matrix,
+                range,
+                expected
+            );
+            const uint8_t* pixel = rgba.data() + size_t(y) * rowStride + x * 4;
+            for (int i = 0; i < 3; ++i) {
+                if (std::abs(pixel[i] - expected[i]) > FLOAT_TOLERANCE) {
+                    fprintf(
+                        stderr,
+                        "reference off at %d,%d channel %d: %d, expected "
+                        "%d\n",
+                        x,
+                        y,
+                        i,
+                        pixel[i],
+                        expected[i]
+                    );
+                    return false;
+                }
+            }
+            if (pixel[3] != 0xFF) {
+                fprintf(stderr, "alpha not opaque at %d,%d\n", x, y);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool checkCase(
+    int32_t width,
+    int32_t height,
+    Layout layout,
+    YuvMatrix matrix,
+    YuvRange range
+) {
+    Image image;
+    makeImage(width, height, layout, image);
+    // Padded too, the padding must be left alone
+    int32_t rowStride = width * 4 + 12;
+    constexpr uint8_t CANARY = 0xA5;
+    std::vector<uint8_t> fast(size_t(rowStride) * height, CANARY);
+    std::vector<uint8_t> reference(fast.size(), CANARY);
+    yuv420ToRgba(image.planes, fast.data(), rowStride, matrix, range);
+    yuv420ToRgbaReference(
+        image.planes, reference.data(), rowStride, matrix, range
+    );
+
+    auto describe = [&] {
+        fprintf(
+            stderr,
+            "  %dx%d %s %s %s\n",
+            width,
+            height,
+            getLayoutName(layout),
+            matrix == YuvMatrix::BT601 ? "BT.601" : "BT.709",
+            range == YuvRange::FULL ? "full" : "limited"
+        );
+    };
+    auto mismatch = std::ranges::mismatch(fast, reference);
+    if (mismatch.in1 != fast.end()) {
+        auto offset = mismatch.in1 - fast.begin();
+        fprintf(
+            stderr,
+            "%s differs from the reference at %d,%d byte %d\n",
+            getYuvKernelName(),
+            static_cast<int>(offset % rowStride / 4),
+            static_cast<int>(offset / rowStride),
+            static_cast<int>(offset % 4)
+        );
+        describe();
+        return false;
+    }
+    for (int32_t y = 0; y < height; ++y) {
+        const uint8_t* padding =
+            reference.data() + size_t(y) * rowStride + width * 4;
+        if (std::any_of(padding, padding + 12, [](uint8_t value) {
+                return value != CANARY;
+            })) {
+            fprintf(stderr, "row padding overwritten in row %d\n", y);
+            describe();
+            return false;
+        }
+    }
+    if (!checkAgainstFloat(image, reference, rowStride, matrix, range)) {
+        describe();
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+int main() {
+    // Below, at and past the vector widths, odd ones leave a scalar tail
+    // and a last luma row without its own chroma row
+    const int32_t sizes[][2] = {
+        {1, 1},
+        {2, 2},
+        {3, 5},
+        {15, 3},
+        {16, 2},
+        {17, 9},
+        {31, 7},
+        {33, 31},
+        {64, 4},
+        {127, 33},
+        {1920, 1080},
+        {1921, 1081}
+    };
+    int failures = 0;
+    int cases = 0;
+    for (const auto& size : sizes) {
+        for (Layout layout :
+             {Layout::I420, Layout::NV12, Layout::NV21, Layout::STRIDED}) {
+            for (YuvMatrix matrix : {YuvMatrix::BT601, YuvMatrix::BT709}) {
+                for (YuvRange range : {YuvRange::FULL, YuvRange::LIMITED}) {
+                    ++cases;
+                    if (!checkCase(size[0], size[1], layout, matrix, range)) {
+                        ++failures;
+                    }
+                }
+            }
+        }
+    }
+    printf(
+        "%s: %d of %d cases passed\n",
+        getYuvKernelName(),
+        cases - failures,
+        cases
+    );
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,136 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "yuv_convert.hpp"
+
+using namespace camera;
+
+namespace {
+
+constexpr auto USAGE =
+    "usage: yuvbench [--frames N] [--size WIDTHxHEIGHT]\n"
+    "\n"
+    "Times the YUV 4:2:0 to RGBA conversion on one thread, the kernel the\n"
+    "CPU dispatches to against the scalar reference, for planar and\n"
+    "semi-planar chroma.\n";
+
+struct Options {
+    int32_t frames = 200;
+    int32_t width = 1920;
+    int32_t height = 1080;
+};
+
+bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--frames" && hasValue) {
+            options.frames = atoi(argv[++i]);
+            if (options.frames <= 0) return false;
+        } else if (arg == "--size" && hasValue) {
+            if (sscanf(argv[++i], "%dx%d", &options.width, &options.height) !=
+                    2 ||
+                options.width <= 0 || options.height <= 0) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+using Convert = void (*)(
+    const YuvPlanes&, uint8_t*, int32_t, YuvMatrix, YuvRange
+);
+
+// Returns the average ms per frame
+double time(
+    Convert convert,
+    const YuvPlanes& planes,
+    std::vector<uint8_t>& rgba,
+    int32_t frames
+) {
+    // Once untimed so the output is paged in
+    convert(
+        planes, rgba.data(), planes.width * 4, YuvMatrix::BT709, YuvRange::FULL
+    );
+    auto start = std::chrono::steady_clock::now();
+    for (int32_t i = 0; i < frames; ++i) {
+        convert(
+            planes,
+            rgba.data(),
+            planes.width * 4,
+            YuvMatrix::BT709,
+            YuvRange::FULL
+        );
+    }
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count() / frames;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        fputs(USAGE, stderr);
+        return 2;
+    }
+
+    int32_t width = options.width;
+    int32_t height = options.height;
+    int32_t chromaWidth = (width + 1) / 2;
+    size_t lumaSize = size_t(width) * height;
+    size_t chromaSize = size_t(chromaWidth) * ((height + 1) / 2);
+    std::vector<uint8_t> data(lumaSize + chromaSize * 2);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<uint8_t>(i * 13 + (i >> 9));
+    }
+    std::vector<uint8_t> rgba(lumaSize * 4);
+
+    YuvPlanes planar{
+        .y = data.data(),
+        .u = data.data() + lumaSize,
+        .v = data.data() + lumaSize + chromaSize,
+        .width = width,
+        .height = height,
+        .yRowStride = width,
+        .uvRowStride = chromaWidth,
+        .uvPixelStride = 1
+    };
+    YuvPlanes semiPlanar = planar;
+    semiPlanar.v = data.data() + lumaSize;
+    semiPlanar.u = semiPlanar.v + 1;
+    semiPlanar.uvRowStride = chromaWidth * 2;
+    semiPlanar.uvPixelStride = 2;
+
+    double megapixels = static_cast<double>(lumaSize) / 1e6;
+    printf("%dx%d, %d frames\n", width, height, options.frames);
+    struct {
+        const char* name;
+        const YuvPlanes& planes;
+    } layouts[] = {{"I420", planar}, {"NV21", semiPlanar}};
+    for (const auto& layout : layouts) {
+        double fastMs = time(yuv420ToRgba, layout.planes, rgba, options.frames);
+        double referenceMs = time(
+            yuv420ToRgbaReference, layout.planes, rgba, options.frames
+        );
+        printf(
+            "%-5s %-6s %6.2f ms %7.0f Mpx/s   reference %6.2f ms %7.0f "
+            "Mpx/s   %.1fx\n",
+            layout.name,
+            getYuvKernelName(),
+            fastMs,
+            megapixels / fastMs * 1000.0,
+            referenceMs,
+            megapixels / referenceMs * 1000.0,
+            referenceMs / fastMs
+        );
+    }
+    return 0;
+}